@@ -1,19 +1,27 @@
+import gzip
 import hashlib
+from functools import lru_cache
 
 from gridfs import GridFS
 from gridfs.errors import NoFile
 from gridfs.grid_file import GridOut
 from database.mongo import get_fs
 from models.firmware import MetaData
+from utils.config import FIRMWARE_BASE_URL
+from utils.delta import make_patch
+from utils.signing import sign_image
 from datetime import datetime
 import pytz
 
-def add_new_firmware(contents, version, file_name) -> tuple[str, str]:
+def add_new_firmware(contents, version, file_name, signature=None) -> tuple[str, str]:
     # 2. Calculate hash (SHA-256 as an example)
     hash_val = hashlib.sha256(contents).hexdigest()
     current_time = datetime.now(pytz.utc)
+    # Signed offline, or here with FIRMWARE_SIGNING_KEY (None without a key)
+    if signature is None:
+        signature = sign_image(contents)
     # 3. Store metadata in the DB
-    new_firmware = MetaData(version=version, hash_value=hash_val, upload_time=current_time)
+    new_firmware = MetaData(version=version, hash_value=hash_val, upload_time=current_time, signature=signature)
     fs = get_fs()
     file_id = fs.put(contents, filename=file_name, metadata=new_firmware.model_dump())
     return file_id, hash_val
@@ -66,4 +74,60 @@ def delete_firmware_by_version(version: str) -> bool:
         file_id = result._id
         fs.delete(file_id)
         return True
-    return False
\ No newline at end of file
+    return False
+
+def image_digest(contents: bytes) -> str:
+    """
+    SHA-256 appended by esp-idf at the end of the image, i.e. the value the
+    device reports with esp_partition_get_sha256() for its running app.
+    """
+    return hashlib.sha256(contents[:-32]).hexdigest()
+
+def get_firmware_by_image_digest(digest: str) -> GridOut:
+    fs = get_fs()
+    for file in fs.find():
+        if image_digest(file.read()) == digest.lower():
+            return file
+    return None
+
+@lru_cache(maxsize=8)
+def _cached_patch(old_id, new_id) -> bytes:
+    fs = get_fs()
+    return make_patch(fs.get(old_id).read(), fs.get(new_id).read())
+
+def get_delta(old: GridOut, new: GridOut) -> bytes:
+    """
+    Patch turning the old image into the new one (see utils/delta.py).
+    Computing it takes a few seconds for a 1 MB image, so it is cached.
+    """
+    return _cached_patch(old._id, new._id)
+
+@lru_cache(maxsize=4)
+def _cached_gzip(file_id) -> bytes:
+    return gzip.compress(get_fs().get(file_id).read(), compresslevel=9, mtime=0)
+
+def get_gzip(file: GridOut) -> bytes:
+    """
+    Image compressed for the device, which inflates it while flashing.
+    mtime=0 keeps the output identical between calls, so a Range request
+    resuming a download gets the same bytes.
+    """
+    return _cached_gzip(file._id)
+
+def get_manifest(file: GridOut, rollout: int = 100, window: int = 0) -> dict:
+    """
+    OTA manifest published to the devices. Each device takes a fixed slot
+    from its MAC: only slots below rollout (%) update, and their downloads
+    start spread over window seconds, so the file server never sees the
+    whole fleet at once. sha256 and size describe the image once inflated.
+    """
+    version = file.metadata["version"]
+    return {
+        "version": version,
+        "sha256": file.metadata["hash_value"],
+        "signature": file.metadata.get("signature") or "",
+        "size": file.length,
+        "url": f"{FIRMWARE_BASE_URL}/file/firmware.bin.gz?version={version}",
+        "rollout": rollout,
+        "window": window,
+    }
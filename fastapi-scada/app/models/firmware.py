@@ -1,8 +1,10 @@
 
 from datetime import datetime
+from typing import Optional
 from pydantic import BaseModel
 
 class MetaData(BaseModel):
     version: str
     hash_value: str
-    upload_time: datetime
\ No newline at end of file
+    upload_time: datetime
+    signature: Optional[str] = None
\ No newline at end of file
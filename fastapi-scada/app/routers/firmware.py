@@ -1,11 +1,11 @@
 from typing import Annotated, Optional
-from fastapi import APIRouter, Depends, File, HTTPException, Response, UploadFile, status
+from fastapi import APIRouter, Depends, File, Header, HTTPException, Query, Response, UploadFile, status
 from models.auth import User
 
 from models.device import Device
 from models.firmware import MetaData
 from utils.auth import Role, RoleChecker
-from crud.firmware import add_new_firmware, check_firmware_exists, get_firmware_by_version, get_latest_firmware, get_all_metadata as crud_get_all_metadata, delete_firmware_by_version
+from crud.firmware import add_new_firmware, check_firmware_exists, get_firmware_by_version, get_latest_firmware, get_all_metadata as crud_get_all_metadata, delete_firmware_by_version, get_firmware_by_image_digest, get_delta, get_gzip, get_manifest
 from crud.device import read_device
 from utils.logging import logger
 from services.mqtt import client
@@ -21,9 +21,39 @@ deprecated_router = APIRouter(
     deprecated=True
 )
 
-# Serve the firmware file
+def _send_image(content: bytes, headers: dict, range_header: Optional[str]) -> Response:
+    """
+    Full image, or the tail asked with "Range: bytes=first-[last]" so a
+    device can resume an interrupted download.
+    """
+    headers["Accept-Ranges"] = "bytes"
+    if not range_header:
+        return Response(content=content, media_type="application/octet-stream", headers=headers)
+    try:
+        unit, _, spec = range_header.partition("=")
+        first, _, last = spec.strip().partition("-")
+        first = int(first)
+        last = int(last) if last else len(content) - 1
+        if unit.strip() != "bytes" or first > last:
+            raise ValueError
+    except ValueError:
+        # not a single byte range we understand, send everything
+        return Response(content=content, media_type="application/octet-stream", headers=headers)
+    if first >= len(content):
+        raise HTTPException(
+            status_code=status.HTTP_416_REQUESTED_RANGE_NOT_SATISFIABLE,
+            detail="Range not satisfiable.",
+            headers={"Content-Range": f"bytes */{len(content)}"}
+        )
+    last = min(last, len(content) - 1)
+    headers["Content-Range"] = f"bytes {first}-{last}/{len(content)}"
+    return Response(content=content[first:last + 1], status_code=status.HTTP_206_PARTIAL_CONTENT,
+                    media_type="application/octet-stream", headers=headers)
+
+# Serve the firmware file, gzip-compressed when the name ends with .gz
 @deprecated_router.get("/{filename}")
-async def deprecated_download_firmware(filename: Optional[str], version: Optional[str] = None):
+async def deprecated_download_firmware(filename: Optional[str], version: Optional[str] = None,
+                                       range_header: Optional[str] = Header(None, alias="Range")):
     if not version or version == "latest":
         file = get_latest_firmware()
     else:
@@ -48,7 +78,12 @@ async def deprecated_download_firmware(filename: Optional[str], version: Optiona
             status_code=status.HTTP_500_INTERNAL_SERVER_ERROR,
             detail="Firmware metadata is missing version."
         )
-    return Response(content=file.read(), media_type="application/octet-stream", headers=headers)
+    if file.metadata.get("signature"):
+        headers["X-Signature"] = file.metadata["signature"]
+    if filename.endswith(".gz"):
+        headers["Content-Disposition"] += ".gz"
+        return _send_image(get_gzip(file), headers, range_header)
+    return _send_image(file.read(), headers, range_header)
 
 # Upload firmware
 @router.post("/upload/")
@@ -56,6 +91,7 @@ async def upload_firmware(
     current_user: Annotated[User, Depends(RoleChecker(allowed_roles=[Role.SUPERADMIN]))],
     file: UploadFile = File(...), 
     version: str = "0.1.0",
+    signature: Optional[str] = Query(None, pattern="^[0-9a-fA-F]{16,160}$"),
 ):
     try:
         # Check file extension
@@ -78,7 +114,7 @@ async def upload_firmware(
                 status_code=status.HTTP_409_CONFLICT,
                 detail="Exists firmware with the same hash."
             )
-        add_new_firmware(contents, version, file.filename)
+        add_new_firmware(contents, version, file.filename, signature.lower() if signature else None)
         # 5. Return info to the user
         return status.HTTP_201_CREATED
     except HTTPException as e:
@@ -87,9 +123,10 @@ async def upload_firmware(
         logger.error(f"Failed to upload firmware: {e}")
         raise HTTPException(status_code=500, detail="Failed to upload firmware")
 
-# Get latest firmware
+# Get latest firmware, gzip-compressed with ?compress=gzip
 @router.get("/")
-async def download_firmware(version: Optional[str] = None):
+async def download_firmware(version: Optional[str] = None, compress: Optional[str] = None,
+                            range_header: Optional[str] = Header(None, alias="Range")):
     if not version or version == "latest":
         file = get_latest_firmware()
     else:
@@ -114,7 +151,41 @@ async def download_firmware(version: Optional[str] = None):
             status_code=status.HTTP_500_INTERNAL_SERVER_ERROR,
             detail="Firmware metadata is missing version."
         )
-    return Response(content=file.read(), media_type="application/octet-stream", headers=headers)
+    if file.metadata.get("signature"):
+        headers["X-Signature"] = file.metadata["signature"]
+    if compress == "gzip":
+        headers["Content-Disposition"] += ".gz"
+        return _send_image(get_gzip(file), headers, range_header)
+    return _send_image(file.read(), headers, range_header)
+
+# Get a delta patch from the image running on the device
+# Sync on purpose: computing a patch is CPU bound and runs in the threadpool
+@router.get("/delta/")
+def download_firmware_delta(from_digest: str = Query(alias="from"), version: Optional[str] = None):
+    if not version or version == "latest":
+        new = get_latest_firmware()
+    else:
+        new = get_firmware_by_version(version)
+    if not new:
+        raise HTTPException(
+            status_code=status.HTTP_404_NOT_FOUND,
+            detail="No firmware found."
+        )
+    old = get_firmware_by_image_digest(from_digest)
+    if not old or old._id == new._id:
+        # unknown base or nothing to do, the device falls back to the full image
+        raise HTTPException(
+            status_code=status.HTTP_404_NOT_FOUND,
+            detail="No delta available."
+        )
+    patch = get_delta(old, new)
+    headers = {
+        "Content-Disposition": "attachment; filename=firmware.sdp",
+        "X-Checksum": new.metadata.get("hash_value", ""),
+        "X-Version": new.metadata.get("version", ""),
+        "X-Signature": new.metadata.get("signature") or "",
+    }
+    return Response(content=patch, media_type="application/octet-stream", headers=headers)
 
 # Get all firmware metadata
 @router.get("/metadata/")
@@ -163,21 +234,40 @@ async def update_device(
                 status_code=status.HTTP_404_NOT_FOUND,
                 detail="Device not found."
             )
-        client.update_device(device.mac, version)
+        file = get_latest_firmware() if not version or version == "latest" else get_firmware_by_version(version)
+        if not file:
+            raise HTTPException(
+                status_code=status.HTTP_404_NOT_FOUND,
+                detail="No firmware found."
+            )
+        client.update_device(device.mac, get_manifest(file))
         return status.HTTP_200_OK
+    except HTTPException as e:
+        raise e
     except Exception as e:
         logger.error(f"Failed to update device: {e}")
         raise HTTPException(status_code=500, detail="Failed to update device")
     
-# Mass update devices
+# Mass update devices, in waves: rollout is the % of the fleet taking part
+# (raise it to start the next wave), window spreads their start over seconds
 @router.put("/update/")
 async def mass_update_devices(
     current_user: Annotated[User, Depends(RoleChecker(allowed_roles=[Role.SUPERADMIN]))],
-    version: Optional[str] = None
+    version: Optional[str] = None,
+    rollout: int = Query(100, ge=0, le=100),
+    window: int = Query(0, ge=0, le=7 * 24 * 3600)
 ):
     try:
-        client.update_all(version)
+        file = get_latest_firmware() if not version or version == "latest" else get_firmware_by_version(version)
+        if not file:
+            raise HTTPException(
+                status_code=status.HTTP_404_NOT_FOUND,
+                detail="No firmware found."
+            )
+        client.update_all(get_manifest(file, rollout, window))
         return status.HTTP_200_OK
+    except HTTPException as e:
+        raise e
     except Exception as e:
         logger.error(f"Failed to update devices: {e}")
         raise HTTPException(status_code=500, detail="Failed to update devices")
@@ -5,6 +5,7 @@ from utils.config import MQTT_BROKER, MQTT_PORT, DEBUG
 import re
 import json
 import random
+import struct
 from datetime import datetime
 import json
 from paho.mqtt import client as mqtt_client
@@ -161,31 +162,73 @@ class Client(mqtt_client.Client):
         else:
             self.publish(topic, json.dumps(body))
 
-    # Update all device
-    def update_all(self, version: str):
+    # Update all device, in waves (see crud.firmware.get_manifest)
+    def update_all(self, manifest: dict):
         topic = "firmware/update"
-        body = "update_firmware"
+        body = manifest
         if DEBUG:
             print("Topic", topic)
             print("Body", body)
         else:
-            self.publish(topic, body)
+            self.publish(topic, json.dumps(body))
 
     # Update a device
-    def update_device(self, mac: str, version: str):
+    def update_device(self, mac: str, manifest: dict):
         topic = f"unit/{mac}firmware/update"
-        body = "update_firmware"
+        body = manifest
         if DEBUG:
             print("Topic", topic)
             print("Body", body)
         else:
-            self.publish(topic, body)
+            self.publish(topic, json.dumps(body))
+
+    def handle_ota(self, mac: str, payload: dict):
+        # scheduled, skipped, downloading, done, failed
+        if payload.get("state") in ("skipped", "failed"):
+            logger.warning(f"OTA {payload.get('state')} on {mac}: {payload.get('error')} "
+                           f"(running {payload.get('current')}, target {payload.get('version')})")
+        else:
+            logger.info(f"OTA {payload.get('state')} on {mac}: {payload.get('written')}/{payload.get('total')} "
+                        f"(running {payload.get('current')}, target {payload.get('version')})")
+
+    # Ask a device for its recent log lines, answered on unit/<mac>/log
+    def request_log(self, mac: str, since: int = 0):
+        topic = f"unit/{mac}/command"
+        body = {
+            "command": "LOG",
+            "payload": since
+        }
+        if DEBUG:
+            print("Topic", topic)
+            print("Body", body)
+        else:
+            self.publish(topic, json.dumps(body))
+
+    def handle_log(self, mac: str, payload: bytes):
+        # Records of lib/Wifi_BaoTran97/log.h: seq u32, millis u32, level u8, module u8, len u8, text
+        levels = {1: logger.error, 2: logger.warning, 3: logger.info, 4: logger.debug}
+        modules = ["MAIN", "MQTT", "WEB", "FILE", "WIFI", "DATA", "METER", "OTA"]
+        offset = 0
+        while offset + 11 <= len(payload):
+            seq, millis, level, module, length = struct.unpack_from("<IIBBB", payload, offset)
+            text = payload[offset + 11:offset + 11 + length].decode("utf-8", "replace")
+            offset += 11 + length
+            name = modules[module] if module < len(modules) else str(module)
+            levels.get(level, logger.info)(f"{mac} #{seq} +{millis}ms {name}: {text}")
+
+    def handle_alarm(self, mac: str, payload: dict):
+        # Timing budget exceeded on the device (see src/timing.h in the firmware)
+        logger.warning(f"Timing alarm {payload.get('alarm')} on {mac}: {payload.get('count')} times, "
+                       f"worst {payload.get('worst_us')} us, budget {payload.get('budget_us')} us")
 
     ## Override
     def on_connect(self, client, userdata, flags, reason_code, properties=None):
         logger.info(f"Connected with result code {reason_code}")
         self.subscribe("unit/+/status")
         self.subscribe("unit/+/alive")
+        self.subscribe("unit/+/ota")
+        self.subscribe("unit/+/log")
+        self.subscribe("unit/+/alarm")
 
     def on_disconnect(self, client, userdata, flags, reason_code, properties=None):
         logger.info(f"Disconnected with result code {reason_code}")
@@ -193,9 +236,12 @@ class Client(mqtt_client.Client):
     def on_message(self, client, userdata, message):
         try:
             topic = message.topic
-            match = re.match(r"unit/(\w+)/(status|alive)", topic)
+            match = re.match(r"unit/(\w+)/(status|alive|ota|log|alarm)", topic)
             if match:
                 mac_address, _type = match.groups()
+                if _type == "log":
+                    self.handle_log(mac_address, message.payload)
+                    return
                 body = message.payload.decode("utf-8")
                 if _type == "status":
                     payload = json.loads(body)
@@ -203,6 +249,12 @@ class Client(mqtt_client.Client):
                 elif _type == "alive":
                     payload = json.loads(body)
                     self.handle_connection(mac_address, payload)
+                elif _type == "ota":
+                    payload = json.loads(body)
+                    self.handle_ota(mac_address, payload)
+                elif _type == "alarm":
+                    payload = json.loads(body)
+                    self.handle_alarm(mac_address, payload)
             else:
                 logger.error(f"Unknown topic: {topic}")
         except json.JSONDecodeError as e:
@@ -0,0 +1,84 @@
+"""
+Sample firmware image pairs for the delta patch tests.
+
+The pairs mimic what happens between two builds: a changed version string,
+code inserted or removed in the middle (everything after it moves and the
+pointers into it change), an image rebuilt from scratch, and the edge cases
+of an identical and an empty image.
+
+    python -m tests.delta_samples OUTDIR
+
+writes NAME.old, NAME.new and NAME.sdp (made by utils.delta) for every pair,
+for the firmware's DeltaPatcher host test.
+"""
+import random
+import struct
+import sys
+from pathlib import Path
+
+from utils.delta import make_patch
+
+IMAGE_SIZE = 48 * 1024
+
+
+def _image(rng: random.Random, size: int) -> bytes:
+    # instruction-like words with repeats, a pointer table and a string table
+    opcodes = [rng.getrandbits(32) for _ in range(256)]
+    out = bytearray()
+    while len(out) < size * 3 // 4:
+        out += struct.pack("<I", rng.choice(opcodes) ^ (rng.getrandbits(8) << 8))
+    while len(out) < size * 7 // 8:
+        out += struct.pack("<I", 0x400D0000 + rng.randrange(0, size, 4))
+    while len(out) < size:
+        out += f"msg {rng.randrange(1000)}: value out of range\0".encode()
+    return bytes(out[:size])
+
+
+def _relocate(image: bytes, start: int, shift: int) -> bytes:
+    # pointers (0x400Dxxxx) past start move by shift, like a relinked image
+    out = bytearray(image)
+    for i in range(0, len(out) - 3, 4):
+        (word,) = struct.unpack_from("<I", out, i)
+        if word >> 16 == 0x400D and (word & 0xFFFF) >= start:
+            struct.pack_into("<I", out, i, word + shift)
+    return bytes(out)
+
+
+def sample_pairs(seed: int = 32) -> dict[str, tuple[bytes, bytes]]:
+    rng = random.Random(seed)
+    old = _image(rng, IMAGE_SIZE)
+    middle = IMAGE_SIZE // 3
+
+    version = bytearray(old)
+    version[100:116] = b"0.2.1 2024-06-01"
+
+    inserted = _image(rng, 1536)
+    grown = _relocate(old[:middle] + inserted + old[middle:], middle, len(inserted))
+
+    shrunk = _relocate(old[:middle] + old[middle + 4096:], middle, -4096)
+
+    return {
+        "version": (old, bytes(version)),
+        "insert": (old, grown),
+        "remove": (old, shrunk),
+        "rebuild": (old, _image(rng, IMAGE_SIZE + 1000)),
+        "same": (old, old),
+        "empty": (old, b""),
+    }
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) != 1:
+        print("usage: python -m tests.delta_samples OUTDIR", file=sys.stderr)
+        return 2
+    out = Path(argv[0])
+    out.mkdir(parents=True, exist_ok=True)
+    for name, (old, new) in sample_pairs().items():
+        (out / f"{name}.old").write_bytes(old)
+        (out / f"{name}.new").write_bytes(new)
+        (out / f"{name}.sdp").write_bytes(make_patch(old, new))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,62 @@
+"""
+Round trip of utils.delta on the sample images: every patch rebuilds the new
+image exactly, stays small when the images are close, and is rejected when
+applied to the wrong image or damaged.
+
+    cd app && python -m unittest tests.test_delta
+"""
+import unittest
+
+from utils.delta import HEADER, PatchError, apply_patch, make_patch
+
+from tests.delta_samples import sample_pairs
+
+
+class DeltaRoundTrip(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.pairs = sample_pairs()
+        cls.patches = {name: make_patch(old, new) for name, (old, new) in cls.pairs.items()}
+
+    def test_apply_rebuilds_new_image(self):
+        for name, (old, new) in self.pairs.items():
+            with self.subTest(name):
+                self.assertEqual(apply_patch(old, self.patches[name]), new)
+
+    def test_close_images_give_small_patches(self):
+        # bounds with room to spare over what make_patch produces today
+        limits = {"version": 512, "insert": 8 * 1024, "remove": 6 * 1024, "same": 256, "empty": 128}
+        for name, limit in limits.items():
+            with self.subTest(name):
+                self.assertLessEqual(len(self.patches[name]), limit)
+
+    def test_wrong_old_image_is_rejected(self):
+        old, _ = self.pairs["insert"]
+        other = bytearray(old)
+        other[0] ^= 1
+        with self.assertRaisesRegex(PatchError, "another image"):
+            apply_patch(bytes(other), self.patches["insert"])
+
+    def test_bad_magic_is_rejected(self):
+        old, _ = self.pairs["version"]
+        with self.assertRaisesRegex(PatchError, "bad magic"):
+            apply_patch(old, b"XXXX" + self.patches["version"][4:])
+
+    def test_truncated_patch_is_rejected(self):
+        old, _ = self.pairs["insert"]
+        patch = self.patches["insert"]
+        for size in (10, HEADER.size + 3, len(patch) // 2, len(patch) - 1):
+            with self.subTest(size=size):
+                with self.assertRaises(PatchError):
+                    apply_patch(old, patch[:size])
+
+    def test_damaged_patch_is_rejected(self):
+        old, _ = self.pairs["insert"]
+        patch = bytearray(self.patches["insert"])
+        patch[-20] ^= 0x55  # inside the last record, past the header
+        with self.assertRaises(PatchError):
+            apply_patch(old, bytes(patch))
+
+
+if __name__ == "__main__":
+    unittest.main()
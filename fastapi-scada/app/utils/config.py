@@ -19,6 +19,11 @@ MQTT_BROKER = config("MQTT_BROKER")
 MQTT_PORT = int(config("MQTT_PORT"))
 MQTT_CLIENT_ID = config("MQTT_CLIENT_ID")
 
+# Public address of this API, put in the OTA manifests sent to the devices
+FIRMWARE_BASE_URL = config("FIRMWARE_BASE_URL", default="http://api.chaugiaphat.com/api")
+# PEM file of the ECDSA key signing the uploaded images (python -m utils.signing genkey)
+FIRMWARE_SIGNING_KEY = config("FIRMWARE_SIGNING_KEY", default=None)
+
 # Mongo
 MONGO_URI = config("MONGO_URI")
 
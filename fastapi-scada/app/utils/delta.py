@@ -0,0 +1,207 @@
+"""
+Binary delta between two firmware images, applied by the device as a stream.
+
+Patch layout (little endian), close to bsdiff with the control data inlined
+so the device never needs to seek in the patch:
+
+    "SDP1" | old_size u32 | new_size u32 | old_sha256 [32] | new_sha256 [32]
+    then records until new_size bytes are produced:
+        diff_len u32 | diff runs         new[i] = old[pos + i] + diff[i] (mod 256)
+        extra_len u32 | extra_len bytes  copied as is
+        seek i32                         pos += diff_len + seek
+
+The diff is mostly zeros, so it is stored as runs until diff_len bytes are
+covered: zeros varint | count varint | count bytes (varints are LEB128).
+
+Usage:
+    python -m utils.delta diff old.bin new.bin patch.sdp
+    python -m utils.delta apply old.bin patch.sdp new.bin
+"""
+import hashlib
+import struct
+import sys
+
+MAGIC = b"SDP1"
+HEADER = struct.Struct("<4sII32s32s")
+U32 = struct.Struct("<I")
+I32 = struct.Struct("<i")
+
+BLOCK = 16   # length of the seeds looked up in the old image
+STRIDE = 4   # only every STRIDE-th old position is indexed
+
+
+class PatchError(ValueError):
+    pass
+
+
+def _varint(value: int) -> bytes:
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def _read_varint(data: bytes, offset: int) -> tuple[int, int]:
+    value = shift = 0
+    while True:
+        if offset >= len(data):
+            raise PatchError("truncated patch")
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+
+
+def _encode_diff(diff: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(diff):
+        start = i
+        while i < len(diff) and diff[i] == 0:
+            i += 1
+        zeros = i - start
+        start = i
+        # a literal run ends at the first pair of zeros
+        while i < len(diff) and not (diff[i] == 0 and (i + 1 == len(diff) or diff[i + 1] == 0)):
+            i += 1
+        out += _varint(zeros) + _varint(i - start) + diff[start:i]
+    return bytes(out)
+
+
+def _index(old: bytes) -> dict[bytes, int]:
+    index = {}
+    for pos in range(0, len(old) - BLOCK + 1, STRIDE):
+        index.setdefault(old[pos:pos + BLOCK], pos)
+    return index
+
+
+def _extend(old: bytes, new: bytes, o: int, n: int) -> int:
+    """Length of the approximate match starting at old[o] / new[n].
+
+    Keeps the length that maximises 2 * equal_bytes - length, like bsdiff,
+    so small changes (relocated addresses) stay inside the diff region.
+    """
+    best_len = best_score = score = 0
+    length = 0
+    limit = min(len(old) - o, len(new) - n)
+    while length < limit:
+        score += 1 if old[o + length] == new[n + length] else -1
+        length += 1
+        if score > best_score:
+            best_score, best_len = score, length
+        elif score < best_score - 64:
+            break
+    return best_len
+
+
+def _extend_back(old: bytes, new: bytes, o: int, n: int, floor: int) -> int:
+    """Number of bytes the match can grow backwards, without passing floor."""
+    length = 0
+    while (length < n - floor and length < o
+           and old[o - length - 1] == new[n - length - 1]):
+        length += 1
+    return length
+
+
+def make_patch(old: bytes, new: bytes) -> bytes:
+    index = _index(old)
+    records = []        # (old_pos, new_pos, diff_len)
+    last_end = 0        # end of the last diff region in new
+    n = 0
+    while n + BLOCK <= len(new):
+        o = index.get(new[n:n + BLOCK])
+        if o is None or o + BLOCK > len(old):
+            n += 1
+            continue
+        back = _extend_back(old, new, o, n, last_end)
+        o, start = o - back, n - back
+        length = _extend(old, new, o, start)
+        if length < BLOCK:
+            n += 1
+            continue
+        records.append((o, start, length))
+        last_end = n = start + length
+
+    out = bytearray(HEADER.pack(MAGIC, len(old), len(new),
+                                hashlib.sha256(old).digest(),
+                                hashlib.sha256(new).digest()))
+    # an empty first record carries the literal head and the first seek
+    records.insert(0, (0, 0, 0))
+    for i, (o, start, length) in enumerate(records):
+        last = i + 1 == len(records)
+        end = len(new) if last else records[i + 1][1]
+        seek = 0 if last else records[i + 1][0] - (o + length)
+        diff = bytes((new[start + k] - old[o + k]) & 0xFF for k in range(length))
+        extra = new[start + length:end]
+        out += U32.pack(length) + _encode_diff(diff)
+        out += U32.pack(len(extra)) + extra + I32.pack(seek)
+    return bytes(out)
+
+
+def apply_patch(old: bytes, patch: bytes) -> bytes:
+    if len(patch) < HEADER.size:
+        raise PatchError("truncated header")
+    magic, old_size, new_size, old_hash, new_hash = HEADER.unpack_from(patch)
+    if magic != MAGIC:
+        raise PatchError("bad magic")
+    if old_size > len(old) or hashlib.sha256(old[:old_size]).digest() != old_hash:
+        raise PatchError("patch was made for another image")
+
+    new = bytearray()
+    pos = 0
+    offset = HEADER.size
+    try:
+        while len(new) < new_size:
+            (length,) = U32.unpack_from(patch, offset)
+            offset += 4
+            if pos < 0 or pos + length > old_size:
+                raise PatchError("diff outside the old image")
+            done = 0
+            while done < length:
+                zeros, offset = _read_varint(patch, offset)
+                count, offset = _read_varint(patch, offset)
+                if done + zeros + count > length:
+                    raise PatchError("diff run too long")
+                new += old[pos + done:pos + done + zeros]
+                done += zeros
+                for k in range(count):
+                    new.append((patch[offset + k] + old[pos + done + k]) & 0xFF)
+                offset += count
+                done += count
+            (extra,) = U32.unpack_from(patch, offset)
+            offset += 4
+            new += patch[offset:offset + extra]
+            offset += extra
+            (seek,) = I32.unpack_from(patch, offset)
+            offset += 4
+            pos += length + seek
+    except struct.error:
+        raise PatchError("truncated patch") from None
+
+    if len(new) != new_size or hashlib.sha256(new).digest() != new_hash:
+        raise PatchError("hash mismatch")
+    return bytes(new)
+
+
+def main(argv: list[str]) -> int:
+    if len(argv) != 4 or argv[0] not in ("diff", "apply"):
+        print("\n".join(__doc__.strip().splitlines()[-3:]), file=sys.stderr)
+        return 2
+    with open(argv[1], "rb") as f:
+        a = f.read()
+    with open(argv[2], "rb") as f:
+        b = f.read()
+    result = make_patch(a, b) if argv[0] == "diff" else apply_patch(a, b)
+    with open(argv[3], "wb") as f:
+        f.write(result)
+    if argv[0] == "diff":
+        print(f"{len(b)} -> {len(result)} bytes ({100 * len(result) / max(len(b), 1):.1f}%)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
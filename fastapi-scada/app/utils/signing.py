@@ -0,0 +1,58 @@
+"""
+ECDSA P-256 signatures of the firmware images, checked by the device with
+the public key built into it (lib/OTAHandler/OTAPublicKey.h).
+
+The signature covers the SHA-256 of the whole image (the "sha256" of the
+manifest) and is DER encoded, as mbedtls_pk_verify() expects.
+
+Usage:
+    python -m utils.signing genkey firmware_key.pem
+    python -m utils.signing sign firmware_key.pem firmware.bin
+"""
+import hashlib
+import sys
+
+from ecdsa import NIST256p, SigningKey  # installed with python-jose
+from ecdsa.util import sigencode_der
+
+from utils.config import FIRMWARE_SIGNING_KEY
+
+
+def _load_key(path: str) -> SigningKey:
+    with open(path, "rb") as f:
+        return SigningKey.from_pem(f.read())
+
+
+def sign_image(contents: bytes, key: SigningKey | None = None) -> str | None:
+    """Hex signature of the image, None when no signing key is configured."""
+    if key is None:
+        if not FIRMWARE_SIGNING_KEY:
+            return None
+        key = _load_key(FIRMWARE_SIGNING_KEY)
+    digest = hashlib.sha256(contents).digest()
+    return key.sign_digest_deterministic(digest, hashfunc=hashlib.sha256, sigencode=sigencode_der).hex()
+
+
+def _c_string(pem: str) -> str:
+    lines = pem.strip().splitlines()
+    return " \\\n".join(f'  "{line}\\n"' for line in lines)
+
+
+def main(argv: list[str]) -> int:
+    if argv[:1] == ["genkey"] and len(argv) == 2:
+        key = SigningKey.generate(curve=NIST256p)
+        with open(argv[1], "wb") as f:
+            f.write(key.to_pem())
+        print("#define OTA_PUBLIC_KEY \\")
+        print(_c_string(key.get_verifying_key().to_pem().decode()))
+        return 0
+    if argv[:1] == ["sign"] and len(argv) == 3:
+        with open(argv[2], "rb") as f:
+            print(sign_image(f.read(), _load_key(argv[1])))
+        return 0
+    print("\n".join(__doc__.strip().splitlines()[-2:]), file=sys.stderr)
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,738 @@
+// Fleet simulator: N copies of the firmware (scada_host processes, each with
+// its own MAC and clock) whose MQTT connections all go through one epoll
+// relay to the broker, where faults are injected. See README.md.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define MQTT_PORT 1883                      // mqtt_port in src/main.cpp
+#define MQTT_BROKER "iot.vuhongquang.com"   // mqtt_broker in src/main.cpp
+#define FLEET_READ_SIZE 16384
+#define FLEET_QUEUE_LIMIT (256 * 1024)      // per direction, then the sender waits
+#define FLEET_BOOT_DELAY 1.0                // seconds between a restart and the next boot
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) { stop_requested = 1; }
+
+static double now_s()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration<double>(steady_clock::now() - start).count();
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "devices:\n"
+            "  --devices N           firmware instances (default 10)\n"
+            "  --host PATH           scada_host binary (default: next to this one)\n"
+            "  --dir DIR             per-device SPIFFS roots and logs (default ./fleet)\n"
+            "  --mac-base MAC        first device MAC, the others count up (default 24:0A:C4:10:00:00)\n"
+            "  --speed X             firmware seconds per second: status every 10/X s per device (default 1)\n"
+            "  --loop-period US      firmware microseconds between loop() passes (default 10000)\n"
+            "  --ramp S              spread the first boots over S seconds (default 0)\n"
+            "  --serial              keep each device's Serial output in its log\n"
+            "broker:\n"
+            "  --broker HOST[:PORT]  the real broker (default 127.0.0.1:1883)\n"
+            "  --listen ADDR         where the relay accepts devices on port 1883 (default 127.0.0.2)\n"
+            "faults:\n"
+            "  --drop-every S        cut every link every S seconds, like a broker restart\n"
+            "  --drop-for S          and refuse connections for S seconds after (default 0)\n"
+            "  --drop-rate P         chance per second that a link is cut (default 0)\n"
+            "  --latency MS          extra delay per direction on slow links\n"
+            "  --bandwidth B         bytes per second per direction on slow links\n"
+            "  --slow-fraction F     share of links that are slow (default 1)\n"
+            "run:\n"
+            "  --duration S          stop after S seconds (default: until Ctrl-C)\n"
+            "  --stats S             print counters every S seconds (default 5)\n",
+            argv0);
+}
+
+// ---------------------------------------------------------------- options
+
+struct Options
+{
+    int devices = 10;
+    std::string host;
+    std::string dir = "fleet";
+    uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0x10, 0x00, 0x00};
+    double speed = 1;
+    unsigned loop_period = 10000;
+    double ramp = 0;
+    bool serial = false;
+    std::string broker = "127.0.0.1";
+    int broker_port = MQTT_PORT;
+    std::string listen = "127.0.0.2";
+    double drop_every = 0, drop_for = 0, drop_rate = 0;
+    double latency = 0, bandwidth = 0, slow_fraction = 1;
+    double duration = 0, stats = 5;
+};
+
+static Options opt;
+
+// ---------------------------------------------------------------- counters
+
+struct Counters
+{
+    uint64_t connects = 0, refused = 0, broker_fail = 0, drops = 0, closed = 0;
+    uint64_t up_bytes = 0, down_bytes = 0;
+    uint64_t up_packets[16] = {}, down_packets[16] = {}; // by MQTT packet type
+    uint64_t boots = 0, reboots = 0, watchdogs = 0, exits = 0;
+};
+
+static Counters total, last;
+
+// Counts MQTT packets in one direction of a link: fixed header byte, then
+// the remaining length as a base-128 varint, then that many bytes.
+struct MqttStream
+{
+    uint64_t *packets;
+    int state = 0; // 0 header, 1 length, 2 body
+    uint32_t remaining = 0, shift = 0;
+
+    void feed(const uint8_t *p, size_t n)
+    {
+        while (n)
+        {
+            if (state == 0)
+            {
+                packets[*p >> 4]++;
+                state = 1, remaining = 0, shift = 0;
+                p++, n--;
+            }
+            else if (state == 1)
+            {
+                remaining |= (uint32_t)(*p & 0x7f) << shift;
+                shift += 7;
+                state = *p & 0x80 && shift < 28 ? 1 : remaining ? 2 : 0;
+                p++, n--;
+            }
+            else
+            {
+                size_t skip = n < remaining ? n : remaining;
+                remaining -= skip;
+                p += skip, n -= skip;
+                if (!remaining)
+                    state = 0;
+            }
+        }
+    }
+};
+
+// ---------------------------------------------------------------- relay
+
+struct Link;
+
+struct Endpoint // what epoll_event.data.ptr points at; NULL is the listener
+{
+    Link *link;
+    int fd;
+    uint32_t events; // as registered
+};
+
+struct Chunk
+{
+    double due;
+    std::string data;
+};
+
+struct Direction
+{
+    Endpoint *to;
+    std::deque<Chunk> queue;
+    size_t queued = 0, offset = 0; // bytes in queue, bytes of queue.front() already sent
+    double last_due = 0;
+    MqttStream mqtt;
+};
+
+struct Link
+{
+    Endpoint device, broker;
+    Direction up, down; // device -> broker, broker -> device
+    bool connecting = true, slow = false, closed = false;
+};
+
+static int epfd = -1;
+static std::list<std::unique_ptr<Link>> links;
+static std::vector<std::unique_ptr<Link>> graveyard; // freed after the epoll batch that closed them
+static struct sockaddr_storage broker_addr;
+static socklen_t broker_addr_len;
+static double refuse_until = 0;
+
+static void watch(Link *link)
+{
+    // reading stops while the other direction's queue is full; writing is
+    // watched while a connect is pending or the kernel buffer was full
+    auto events = [&](Endpoint &self, Direction &in, Direction &out) {
+        struct epoll_event ev = {};
+        ev.data.ptr = &self;
+        if (in.queued < FLEET_QUEUE_LIMIT)
+            ev.events |= EPOLLIN;
+        if ((&self == &link->broker && link->connecting) || out.offset || (!out.queue.empty() && out.queue.front().due <= now_s()))
+            ev.events |= EPOLLOUT;
+        if (ev.events != self.events)
+            epoll_ctl(epfd, EPOLL_CTL_MOD, self.fd, &ev);
+        self.events = ev.events;
+    };
+    events(link->device, link->up, link->down);
+    events(link->broker, link->down, link->up);
+}
+
+static void close_link(Link *link, bool dropped)
+{
+    if (link->closed)
+        return;
+    link->closed = true;
+    close(link->device.fd);
+    close(link->broker.fd);
+    (dropped ? total.drops : total.closed)++;
+    for (auto it = links.begin(); it != links.end(); ++it)
+        if (it->get() == link)
+        {
+            graveyard.push_back(std::move(*it));
+            links.erase(it);
+            break;
+        }
+}
+
+// Sends what is due; false when the link had to be closed.
+static bool flush(Link *link, Direction &dir)
+{
+    if (dir.to == &link->broker && link->connecting)
+        return true;
+    double now = now_s();
+    while (!dir.queue.empty() && dir.queue.front().due <= now)
+    {
+        Chunk &chunk = dir.queue.front();
+        ssize_t n = send(dir.to->fd, chunk.data.data() + dir.offset, chunk.data.size() - dir.offset, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            close_link(link, false);
+            return false;
+        }
+        dir.offset += n;
+        if (dir.offset == chunk.data.size())
+        {
+            dir.queued -= chunk.data.size();
+            dir.queue.pop_front();
+            dir.offset = 0;
+        }
+    }
+    return true;
+}
+
+static void receive(Link *link, Endpoint &from)
+{
+    Direction &dir = &from == &link->device ? link->up : link->down;
+    uint8_t buffer[FLEET_READ_SIZE];
+    ssize_t n = recv(from.fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0)
+    {
+        close_link(link, false);
+        return;
+    }
+    dir.mqtt.feed(buffer, n);
+    (&dir == &link->up ? total.up_bytes : total.down_bytes) += n;
+
+    double now = now_s();
+    double due = now;
+    if (link->slow)
+    {
+        due += opt.latency / 1000;
+        if (opt.bandwidth > 0) // the link is busy until the previous chunk is through
+            due = std::max(due, dir.last_due) + n / opt.bandwidth;
+    }
+    dir.last_due = due;
+    dir.queue.push_back({due, std::string((const char *)buffer, n)});
+    dir.queued += n;
+}
+
+static void accept_devices(int listener)
+{
+    for (;;)
+    {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        if (now_s() < refuse_until)
+        {
+            close(fd);
+            total.refused++;
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        int up = socket(broker_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (up < 0 || (connect(up, (struct sockaddr *)&broker_addr, broker_addr_len) < 0 && errno != EINPROGRESS))
+        {
+            if (up >= 0)
+                close(up);
+            close(fd);
+            total.broker_fail++;
+            continue;
+        }
+        setsockopt(up, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        links.emplace_back(new Link);
+        Link *link = links.back().get();
+        link->device = {link, fd, 0};
+        link->broker = {link, up, 0};
+        link->up.to = &link->broker;
+        link->down.to = &link->device;
+        link->up.mqtt.packets = total.up_packets;
+        link->down.mqtt.packets = total.down_packets;
+        link->slow = (opt.latency > 0 || opt.bandwidth > 0) && drand48() < opt.slow_fraction;
+        for (Endpoint *end : {&link->device, &link->broker})
+        {
+            struct epoll_event ev = {};
+            ev.data.ptr = end;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, end->fd, &ev);
+        }
+        watch(link);
+        total.connects++;
+    }
+}
+
+static void handle(Endpoint *end, uint32_t events)
+{
+    Link *link = end->link;
+    if (link->closed)
+        return;
+    if (end == &link->broker && link->connecting && events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+    {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(end->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error)
+        {
+            total.broker_fail++;
+            close_link(link, false);
+            return;
+        }
+        link->connecting = false;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        receive(link, *end);
+}
+
+// ---------------------------------------------------------------- devices
+
+struct Device
+{
+    std::string id; // lower-case MAC without colons, like getDeviceID()
+    std::string mac;
+    pid_t pid = 0;
+    double boot_at = 0; // next boot, 0: running or stopped for good
+};
+
+static std::vector<Device> devices;
+
+static void boot(Device &device)
+{
+    std::string root = opt.dir + "/" + device.id;
+    std::string fs = root + "/fs";
+    mkdir(root.c_str(), 0755);
+    mkdir(fs.c_str(), 0755);
+
+    std::string map = std::string(MQTT_BROKER "=") + opt.listen;
+    std::string speed = std::to_string(opt.speed);
+    std::string period = std::to_string(opt.loop_period);
+    std::vector<const char *> args = {opt.host.c_str(), "--fs", fs.c_str(), "--mac", device.mac.c_str(),
+                                      "--host-map", map.c_str(), "--speed", speed.c_str(),
+                                      "--loop-period", period.c_str()};
+    if (!opt.serial)
+        args.push_back("--quiet");
+    args.push_back(NULL);
+    std::string log = root + "/host.log";
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execv(args[0], (char **)args.data());
+        fprintf(stderr, "%s: %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+    device.pid = pid > 0 ? pid : 0;
+    device.boot_at = 0;
+    total.boots++;
+}
+
+// ESP.restart() (status 3) and the task watchdog (status 4) reset the chip,
+// so those devices boot again; anything else is left down and reported.
+static void reap()
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        for (Device &device : devices)
+        {
+            if (device.pid != pid)
+                continue;
+            device.pid = 0;
+            int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            if (stop_requested)
+                break;
+            if (code == 3 || code == 4)
+            {
+                (code == 3 ? total.reboots : total.watchdogs)++;
+                device.boot_at = now_s() + FLEET_BOOT_DELAY;
+            }
+            else
+            {
+                total.exits++;
+                fprintf(stderr, "fleet: %s exited (%s %d), see %s/%s/host.log\n", device.id.c_str(),
+                        WIFEXITED(status) ? "status" : "signal", WIFEXITED(status) ? code : WTERMSIG(status),
+                        opt.dir.c_str(), device.id.c_str());
+            }
+            break;
+        }
+}
+
+// ---------------------------------------------------------------- report
+
+static void report(double elapsed, double interval)
+{
+    size_t running = 0;
+    for (Device &device : devices)
+        running += device.pid != 0;
+    auto rate = [&](uint64_t now, uint64_t before) { return interval > 0 ? (now - before) / interval : 0; };
+    fprintf(stderr,
+            "fleet %7.1fs: devices %zu/%zu links %zu | connect %llu refused %llu drop %llu | "
+            "up %llu pub (%.1f/s) %.1f kB/s | down %llu pub (%.1f/s) %.1f kB/s | reboot %llu wdt %llu\n",
+            elapsed, running, devices.size(), links.size(), (unsigned long long)total.connects,
+            (unsigned long long)total.refused, (unsigned long long)total.drops, (unsigned long long)total.up_packets[3],
+            rate(total.up_packets[3], last.up_packets[3]), rate(total.up_bytes, last.up_bytes) / 1000,
+            (unsigned long long)total.down_packets[3], rate(total.down_packets[3], last.down_packets[3]),
+            rate(total.down_bytes, last.down_bytes) / 1000, (unsigned long long)total.reboots,
+            (unsigned long long)total.watchdogs);
+    last = total;
+}
+
+// ---------------------------------------------------------------- main
+
+static bool parse_mac(const char *text, uint8_t mac[6])
+{
+    unsigned v[6];
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)
+        return false;
+    for (int i = 0; i < 6; i++)
+        mac[i] = v[i];
+    return true;
+}
+
+static bool resolve_broker()
+{
+    struct addrinfo hints = {}, *result;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt.broker.c_str(), std::to_string(opt.broker_port).c_str(), &hints, &result) != 0)
+        return false;
+    memcpy(&broker_addr, result->ai_addr, result->ai_addrlen);
+    broker_addr_len = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static int listen_devices()
+{
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(MQTT_PORT);
+    if (inet_pton(AF_INET, opt.listen.c_str(), &addr.sin_addr) != 1)
+        return -1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_DEVICES = 1,
+        OPT_HOST,
+        OPT_DIR,
+        OPT_MAC_BASE,
+        OPT_SPEED,
+        OPT_LOOP_PERIOD,
+        OPT_RAMP,
+        OPT_SERIAL,
+        OPT_BROKER,
+        OPT_LISTEN,
+        OPT_DROP_EVERY,
+        OPT_DROP_FOR,
+        OPT_DROP_RATE,
+        OPT_LATENCY,
+        OPT_BANDWIDTH,
+        OPT_SLOW_FRACTION,
+        OPT_DURATION,
+        OPT_STATS,
+        OPT_HELP
+    };
+    static const struct option options[] = {
+        {"devices", required_argument, NULL, OPT_DEVICES},
+        {"host", required_argument, NULL, OPT_HOST},
+        {"dir", required_argument, NULL, OPT_DIR},
+        {"mac-base", required_argument, NULL, OPT_MAC_BASE},
+        {"speed", required_argument, NULL, OPT_SPEED},
+        {"loop-period", required_argument, NULL, OPT_LOOP_PERIOD},
+        {"ramp", required_argument, NULL, OPT_RAMP},
+        {"serial", no_argument, NULL, OPT_SERIAL},
+        {"broker", required_argument, NULL, OPT_BROKER},
+        {"listen", required_argument, NULL, OPT_LISTEN},
+        {"drop-every", required_argument, NULL, OPT_DROP_EVERY},
+        {"drop-for", required_argument, NULL, OPT_DROP_FOR},
+        {"drop-rate", required_argument, NULL, OPT_DROP_RATE},
+        {"latency", required_argument, NULL, OPT_LATENCY},
+        {"bandwidth", required_argument, NULL, OPT_BANDWIDTH},
+        {"slow-fraction", required_argument, NULL, OPT_SLOW_FRACTION},
+        {"duration", required_argument, NULL, OPT_DURATION},
+        {"stats", required_argument, NULL, OPT_STATS},
+        {"help", no_argument, NULL, OPT_HELP},
+        {NULL, 0, NULL, 0}};
+
+    for (int o; (o = getopt_long(argc, argv, "", options, NULL)) != -1;)
+    {
+        switch (o)
+        {
+        case OPT_DEVICES:
+            opt.devices = atoi(optarg);
+            break;
+        case OPT_HOST:
+            opt.host = optarg;
+            break;
+        case OPT_DIR:
+            opt.dir = optarg;
+            break;
+        case OPT_MAC_BASE:
+            if (!parse_mac(optarg, opt.mac))
+            {
+                fprintf(stderr, "--mac-base: expected AA:BB:CC:DD:EE:FF\n");
+                return 2;
+            }
+            break;
+        case OPT_SPEED:
+            opt.speed = atof(optarg);
+            break;
+        case OPT_LOOP_PERIOD:
+            opt.loop_period = strtoul(optarg, NULL, 10);
+            break;
+        case OPT_RAMP:
+            opt.ramp = atof(optarg);
+            break;
+        case OPT_SERIAL:
+            opt.serial = true;
+            break;
+        case OPT_BROKER:
+        {
+            opt.broker = optarg;
+            size_t colon = opt.broker.rfind(':');
+            if (colon != std::string::npos)
+            {
+                opt.broker_port = atoi(opt.broker.c_str() + colon + 1);
+                opt.broker.resize(colon);
+            }
+            break;
+        }
+        case OPT_LISTEN:
+            opt.listen = optarg;
+            break;
+        case OPT_DROP_EVERY:
+            opt.drop_every = atof(optarg);
+            break;
+        case OPT_DROP_FOR:
+            opt.drop_for = atof(optarg);
+            break;
+        case OPT_DROP_RATE:
+            opt.drop_rate = atof(optarg);
+            break;
+        case OPT_LATENCY:
+            opt.latency = atof(optarg);
+            break;
+        case OPT_BANDWIDTH:
+            opt.bandwidth = atof(optarg);
+            break;
+        case OPT_SLOW_FRACTION:
+            opt.slow_fraction = atof(optarg);
+            break;
+        case OPT_DURATION:
+            opt.duration = atof(optarg);
+            break;
+        case OPT_STATS:
+            opt.stats = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return o == OPT_HELP ? 0 : 2;
+        }
+    }
+    if (opt.devices <= 0 || opt.speed <= 0)
+    {
+        fprintf(stderr, "--devices and --speed must be positive\n");
+        return 2;
+    }
+    if (opt.host.empty())
+    {
+        char self[PATH_MAX];
+        ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        std::string dir = n > 0 ? std::string(self, n) : std::string(argv[0]);
+        opt.host = dir.substr(0, dir.rfind('/') + 1) + "scada_host";
+    }
+    if (access(opt.host.c_str(), X_OK) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", opt.host.c_str(), strerror(errno));
+        return 1;
+    }
+    if (!resolve_broker())
+    {
+        fprintf(stderr, "--broker: cannot resolve %s\n", opt.broker.c_str());
+        return 1;
+    }
+    int listener = listen_devices();
+    if (listener < 0)
+    {
+        fprintf(stderr, "--listen: cannot listen on %s:%d: %s\n", opt.listen.c_str(), MQTT_PORT, strerror(errno));
+        return 1;
+    }
+    mkdir(opt.dir.c_str(), 0755);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    srand48(time(NULL));
+
+    uint32_t base = opt.mac[3] << 16 | opt.mac[4] << 8 | opt.mac[5];
+    devices.resize(opt.devices);
+    for (int i = 0; i < opt.devices; i++)
+    {
+        uint32_t low = (base + i) & 0xffffff;
+        char mac[18], id[13];
+        snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", opt.mac[0], opt.mac[1], opt.mac[2], low >> 16,
+                 (low >> 8) & 0xff, low & 0xff);
+        snprintf(id, sizeof(id), "%02x%02x%02x%06x", opt.mac[0], opt.mac[1], opt.mac[2], low);
+        devices[i].mac = mac;
+        devices[i].id = id;
+        devices[i].boot_at = opt.ramp * i / opt.devices + 1e-9; // 0 means "do not boot"
+    }
+    fprintf(stderr, "fleet: %d devices %s .. %s, relay %s:%d -> %s:%d, firmware speed %gx\n", opt.devices,
+            devices.front().id.c_str(), devices.back().id.c_str(), opt.listen.c_str(), MQTT_PORT, opt.broker.c_str(),
+            opt.broker_port, opt.speed);
+
+    double next_stats = opt.stats, next_drop = opt.drop_every, next_second = 1, last_stats = 0;
+    struct epoll_event events[256];
+    while (!stop_requested && (opt.duration <= 0 || now_s() < opt.duration))
+    {
+        bool pending = false;
+        for (auto &link : links)
+            pending |= !link->up.queue.empty() || !link->down.queue.empty();
+        int n = epoll_wait(epfd, events, 256, pending ? 1 : 50);
+        for (int i = 0; i < n; i++)
+        {
+            if (!events[i].data.ptr)
+                accept_devices(listener);
+            else
+                handle((Endpoint *)events[i].data.ptr, events[i].events);
+        }
+        for (auto it = links.begin(); it != links.end();)
+        {
+            Link *link = (it++)->get(); // flush() may move the link to the graveyard
+            if (flush(link, link->up) && flush(link, link->down))
+                watch(link);
+        }
+        graveyard.clear();
+
+        double now = now_s();
+        reap();
+        for (Device &device : devices)
+            if (device.boot_at && device.boot_at <= now)
+                boot(device);
+        if (opt.drop_every > 0 && now >= next_drop)
+        {
+            next_drop += opt.drop_every;
+            refuse_until = now + opt.drop_for;
+            while (!links.empty())
+                close_link(links.front().get(), true);
+            fprintf(stderr, "fleet %7.1fs: broker drop, refusing for %gs\n", now, opt.drop_for);
+        }
+        if (now >= next_second)
+        {
+            next_second += 1;
+            if (opt.drop_rate > 0)
+                for (auto it = links.begin(); it != links.end();)
+                {
+                    Link *link = (it++)->get();
+                    if (drand48() < opt.drop_rate)
+                        close_link(link, true);
+                }
+        }
+        if (opt.stats > 0 && now >= next_stats)
+        {
+            report(now, now - last_stats);
+            last_stats = now;
+            next_stats += opt.stats;
+        }
+        graveyard.clear();
+    }
+
+    for (Device &device : devices)
+        if (device.pid)
+            kill(device.pid, SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+    double now = now_s();
+    if (now - last_stats >= 0.5)
+        report(now, now - last_stats);
+    fprintf(stderr, "fleet: %llu boots, %llu connects, %llu drops, %llu broker failures, %llu status/health/alarm publishes\n",
+            (unsigned long long)total.boots, (unsigned long long)total.connects, (unsigned long long)total.drops,
+            (unsigned long long)total.broker_fail, (unsigned long long)total.up_packets[3]);
+    return 0;
+}
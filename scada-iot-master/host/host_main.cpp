@@ -0,0 +1,283 @@
+// Runs the firmware (src/main.cpp) on Linux: setup() once, then loop()
+// until the pass or virtual-time budget is spent. See README.md.
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <chrono>
+#include <vector>
+
+#include "host.h"
+#include "LiquidCrystal.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) { stop_requested = 1; }
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --fs DIR              SPIFFS root directory (default ./host_fs)\n"
+            "  --loops N             stop after N loop() passes\n"
+            "  --duration S          stop after S seconds of firmware time\n"
+            "  --realtime            use the host clock instead of the virtual one\n"
+            "  --speed X             host clock at X firmware seconds per second (implies --realtime)\n"
+            "  --loop-period US      start loop() passes at least US firmware microseconds apart\n"
+            "  --serial1 PATH        attach Serial1 (GPS) to a pty, FIFO or file; also SCADA_SERIAL1\n"
+            "  --serial2 PATH        attach Serial2 (Modbus) likewise; also SCADA_SERIAL2\n"
+            "  --mac AA:BB:CC:DD:EE:FF\n"
+            "  --port-offset N       add N to the ports the firmware listens on (Modbus TCP 502)\n"
+            "  --host-map NAME=ADDR  resolve NAME to ADDR, e.g. the MQTT broker; also SCADA_HOST_MAP=a=b,c=d\n"
+            "  --wifi-down           start with the station link down\n"
+            "  --reset-reason R      poweron, sw, panic, task_wdt, int_wdt, brownout\n"
+            "  --rolled-back         boot as after an OTA rollback (the other slot is invalid)\n"
+            "  --events              attach one /events (SSE) client\n"
+            "  --http PATH           GET PATH after the run and print the answer (repeatable)\n"
+            "  --quiet               drop Serial output\n",
+            argv0);
+}
+
+static bool parse_mac(const char *text, uint8_t mac[6])
+{
+    unsigned v[6];
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)
+        return false;
+    for (int i = 0; i < 6; i++)
+        mac[i] = v[i];
+    return true;
+}
+
+static bool add_host_map(const char *entry) // NAME=ADDR
+{
+    const char *eq = strchr(entry, '=');
+    IPAddress ip;
+    if (!eq || !ip.fromString(eq + 1))
+        return false;
+    host_map_add(String(entry, eq - entry).c_str(), ip);
+    return true;
+}
+
+static bool parse_reset_reason(const char *name, esp_reset_reason_t &reason)
+{
+    static const struct
+    {
+        const char *name;
+        esp_reset_reason_t reason;
+    } reasons[] = {{"poweron", ESP_RST_POWERON}, {"sw", ESP_RST_SW},           {"panic", ESP_RST_PANIC},
+                   {"task_wdt", ESP_RST_TASK_WDT}, {"int_wdt", ESP_RST_INT_WDT}, {"brownout", ESP_RST_BROWNOUT}};
+    for (auto &r : reasons)
+        if (!strcmp(name, r.name))
+        {
+            reason = r.reason;
+            return true;
+        }
+    return false;
+}
+
+extern AsyncEventSource state_events; // src/index.h
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_FS = 1,
+        OPT_LOOPS,
+        OPT_DURATION,
+        OPT_REALTIME,
+        OPT_SPEED,
+        OPT_LOOP_PERIOD,
+        OPT_SERIAL1,
+        OPT_SERIAL2,
+        OPT_MAC,
+        OPT_HOST_MAP,
+        OPT_PORT_OFFSET,
+        OPT_WIFI_DOWN,
+        OPT_RESET_REASON,
+        OPT_ROLLED_BACK,
+        OPT_EVENTS,
+        OPT_HTTP,
+        OPT_QUIET,
+        OPT_HELP
+    };
+    static const struct option options[] = {
+        {"fs", required_argument, NULL, OPT_FS},
+        {"loops", required_argument, NULL, OPT_LOOPS},
+        {"duration", required_argument, NULL, OPT_DURATION},
+        {"realtime", no_argument, NULL, OPT_REALTIME},
+        {"speed", required_argument, NULL, OPT_SPEED},
+        {"loop-period", required_argument, NULL, OPT_LOOP_PERIOD},
+        {"serial1", required_argument, NULL, OPT_SERIAL1},
+        {"serial2", required_argument, NULL, OPT_SERIAL2},
+        {"mac", required_argument, NULL, OPT_MAC},
+        {"host-map", required_argument, NULL, OPT_HOST_MAP},
+        {"port-offset", required_argument, NULL, OPT_PORT_OFFSET},
+        {"wifi-down", no_argument, NULL, OPT_WIFI_DOWN},
+        {"reset-reason", required_argument, NULL, OPT_RESET_REASON},
+        {"rolled-back", no_argument, NULL, OPT_ROLLED_BACK},
+        {"events", no_argument, NULL, OPT_EVENTS},
+        {"http", required_argument, NULL, OPT_HTTP},
+        {"quiet", no_argument, NULL, OPT_QUIET},
+        {"help", no_argument, NULL, OPT_HELP},
+        {NULL, 0, NULL, 0}};
+
+    const char *fs_dir = "host_fs";
+    uint64_t max_loops = 0;
+    double duration = 0;
+    const char *serial1 = getenv("SCADA_SERIAL1");
+    const char *serial2 = getenv("SCADA_SERIAL2");
+    bool events = false, quiet = false;
+    std::vector<const char *> http;
+
+    if (const char *map = getenv("SCADA_HOST_MAP"))
+    {
+        String entries(map);
+        while (entries.length())
+        {
+            int comma = entries.indexOf(',');
+            String entry = comma < 0 ? entries : entries.substring(0, comma);
+            entries = comma < 0 ? String() : entries.substring(comma + 1);
+            if (entry.length() && !add_host_map(entry.c_str()))
+                fprintf(stderr, "SCADA_HOST_MAP: bad entry '%s'\n", entry.c_str());
+        }
+    }
+
+    for (int opt; (opt = getopt_long(argc, argv, "", options, NULL)) != -1;)
+    {
+        switch (opt)
+        {
+        case OPT_FS:
+            fs_dir = optarg;
+            break;
+        case OPT_LOOPS:
+            max_loops = strtoull(optarg, NULL, 10);
+            break;
+        case OPT_DURATION:
+            duration = atof(optarg);
+            break;
+        case OPT_REALTIME:
+            host_clock_realtime(true);
+            break;
+        case OPT_SPEED:
+            if (atof(optarg) <= 0)
+            {
+                fprintf(stderr, "--speed: expected a positive number\n");
+                return 2;
+            }
+            host_clock_speed(atof(optarg));
+            break;
+        case OPT_LOOP_PERIOD:
+            host_loop_period(strtoul(optarg, NULL, 10));
+            break;
+        case OPT_SERIAL1:
+            serial1 = optarg;
+            break;
+        case OPT_SERIAL2:
+            serial2 = optarg;
+            break;
+        case OPT_MAC:
+        {
+            uint8_t mac[6];
+            if (!parse_mac(optarg, mac))
+            {
+                fprintf(stderr, "--mac: expected AA:BB:CC:DD:EE:FF\n");
+                return 2;
+            }
+            host_set_mac(mac);
+            break;
+        }
+        case OPT_HOST_MAP:
+            if (!add_host_map(optarg))
+            {
+                fprintf(stderr, "--host-map: expected NAME=ADDR\n");
+                return 2;
+            }
+            break;
+        case OPT_PORT_OFFSET:
+            host_port_offset(atoi(optarg));
+            break;
+        case OPT_WIFI_DOWN:
+            host_wifi_set_status(WL_DISCONNECTED);
+            break;
+        case OPT_RESET_REASON:
+        {
+            esp_reset_reason_t reason;
+            if (!parse_reset_reason(optarg, reason))
+            {
+                fprintf(stderr, "--reset-reason: unknown reason '%s'\n", optarg);
+                return 2;
+            }
+            host_set_reset_reason(reason);
+            break;
+        }
+        case OPT_ROLLED_BACK:
+            host_set_rolled_back(true);
+            break;
+        case OPT_EVENTS:
+            events = true;
+            break;
+        case OPT_HTTP:
+            http.push_back(optarg);
+            break;
+        case OPT_QUIET:
+            quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == OPT_HELP ? 0 : 2;
+        }
+    }
+
+    host_fs_root(fs_dir);
+    if (serial1 && !Serial1.attach(serial1))
+        return 1;
+    if (serial2 && !Serial2.attach(serial2))
+        return 1;
+    if (quiet)
+        Serial.attach(-1, -1);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    randomSeed(ESP.getEfuseMac()); // random() is the hardware RNG on the chip: no two boards agree
+
+    auto wall_start = std::chrono::steady_clock::now();
+    struct rusage usage_start;
+    getrusage(RUSAGE_SELF, &usage_start);
+
+    setup();
+    if (events)
+        host_events_connect(state_events);
+
+    uint64_t end_us = duration > 0 ? host_now_us() + (uint64_t)(duration * 1e6) : 0;
+    while (!stop_requested && (!max_loops || host_loops < max_loops) && (!end_us || host_now_us() < end_us))
+    {
+        host_loop_begin();
+        loop();
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    struct rusage usage_end;
+    getrusage(RUSAGE_SELF, &usage_end);
+    double cpu = (usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) +
+                 (usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) / 1e6 +
+                 (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) +
+                 (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) / 1e6;
+    double firmware = host_now_us() / 1e6;
+
+    for (const char *path : http)
+    {
+        HostHttpResponse response = host_http(HTTP_GET, path);
+        printf("GET %s -> %d %s (%zu bytes)\n%s\n", path, response.code, response.type.c_str(),
+               response.body.length(), response.body.c_str());
+    }
+
+    fprintf(stderr, "host: %llu loops, %.3f s firmware time, %.3f s wall, %.3f s cpu (%.1fx real time)\n",
+            (unsigned long long)host_loops, firmware, wall, cpu, wall > 0 ? firmware / wall : 0);
+    if (host_lcd)
+        for (uint8_t row = 0; row < 4; row++)
+            if (host_lcd->line(row).length())
+                fprintf(stderr, "lcd %u |%s|\n", row, host_lcd->line(row).c_str());
+    fflush(NULL);
+    _exit(0); // background tasks are still running, skip static destructors
+}
@@ -0,0 +1,639 @@
+// Modbus RTU slave emulator on a pseudo-terminal: answers the firmware's
+// Modbus master (Serial2, --serial2 of scada_host) from register maps in
+// meters/, with configurable latency and line faults. See README.md.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MODBUS_FRAME_MAX 256
+#define METER_SILENCE_MS 50 // a partial frame older than this is line noise
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) { stop_requested = 1; }
+
+static double now_s()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return duration<double>(steady_clock::now() - start).count();
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s --map [ID:]FILE [options]\n"
+            "  --map [ID:]FILE       register map of slave ID (default 1), repeatable\n"
+            "  --link PATH           symlink PATH to the pty, for --serial2 PATH\n"
+            "  --baud N              line speed for the reply transmission time (default 9600)\n"
+            "  --latency MS          slave turnaround before the reply (default 20)\n"
+            "  --jitter MS           random extra turnaround, 0..MS (default 0)\n"
+            "  --crc-errors P        chance that a reply goes out with a bad CRC\n"
+            "  --drop-bytes P        chance that each reply byte is lost on the line\n"
+            "  --no-reply P          chance that a request is not answered at all\n"
+            "  --seed N              random seed for the faults and jitter (default 1)\n"
+            "  --stats S             print counters every S seconds (default 10)\n"
+            "  --verbose             print every frame\n",
+            argv0);
+}
+
+// ---------------------------------------------------------------- register maps
+
+enum Table
+{
+    COILS,
+    DISCRETE,
+    HOLDING,
+    INPUT,
+    TABLES
+};
+
+static const char *const table_names[TABLES] = {"coil", "discrete", "holding", "input"};
+
+// One mapped value: a bit, or a 16/32-bit number spread over registers
+// (high word first unless "swap"). jitter and step make it move per read.
+struct Point
+{
+    Table table;
+    uint16_t address;
+    std::string type; // bit u16 s16 u32 s32 f32
+    double value;
+    double jitter = 0; // percent, uniform +-
+    double step = 0;   // added after every read, e.g. energy counters
+    bool swap = false;
+
+    int registers() const { return type == "u32" || type == "s32" || type == "f32" ? 2 : 1; }
+};
+
+struct Slave
+{
+    uint8_t id;
+    std::string file;
+    std::map<uint16_t, uint16_t> tables[TABLES]; // present address = readable
+    std::vector<Point> points;
+};
+
+static std::vector<Slave> slaves;
+
+static double uniform(double lo, double hi) { return lo + (hi - lo) * drand48(); }
+
+static void store(Slave &slave, const Point &p, double value)
+{
+    auto &table = slave.tables[p.table];
+    if (p.type == "bit")
+    {
+        table[p.address] = value != 0;
+        return;
+    }
+    uint32_t raw;
+    if (p.type == "f32")
+    {
+        float f = value;
+        memcpy(&raw, &f, 4);
+    }
+    else if (p.type == "s16" || p.type == "s32")
+        raw = (uint32_t)(int32_t)lround(value);
+    else
+        raw = (uint32_t)llround(value);
+    if (p.registers() == 1)
+        table[p.address] = raw;
+    else
+    {
+        table[p.address + (p.swap ? 1 : 0)] = raw >> 16;
+        table[p.address + (p.swap ? 0 : 1)] = raw;
+    }
+}
+
+// Points in the read range take their next value.
+static void refresh(Slave &slave, Table table, uint16_t first, uint16_t count)
+{
+    for (Point &p : slave.points)
+    {
+        if (p.table != table || p.address + p.registers() <= first || p.address >= first + count)
+            continue;
+        if (!p.jitter && !p.step)
+            continue;
+        store(slave, p, p.value * (1 + uniform(-p.jitter, p.jitter) / 100));
+        p.value += p.step;
+    }
+}
+
+// Map file, one entry per line, '#' starts a comment:
+//   range TABLE FIRST LAST             registers that read as 0 unless mapped
+//   TABLE ADDRESS TYPE VALUE [jitter=PERCENT] [step=N] [swap]
+static bool load_map(Slave &slave)
+{
+    FILE *f = fopen(slave.file.c_str(), "r");
+    if (!f)
+    {
+        fprintf(stderr, "%s: %s\n", slave.file.c_str(), strerror(errno));
+        return false;
+    }
+    char line[256];
+    for (int number = 1; fgets(line, sizeof(line), f); number++)
+    {
+        if (char *hash = strchr(line, '#'))
+            *hash = 0;
+        char *words[8];
+        int n = 0;
+        for (char *w = strtok(line, " \t\r\n"); w && n < 8; w = strtok(NULL, " \t\r\n"))
+            words[n++] = w;
+        if (!n)
+            continue;
+
+        bool ok = false;
+        if (!strcmp(words[0], "range") && n == 4)
+        {
+            for (int t = 0; t < TABLES; t++)
+                if (!strcmp(words[1], table_names[t]))
+                {
+                    for (long a = strtol(words[2], NULL, 0); a <= strtol(words[3], NULL, 0) && a < 65536; a++)
+                        slave.tables[t].emplace(a, 0);
+                    ok = true;
+                }
+        }
+        else if (n >= 4)
+        {
+            Point p;
+            p.table = TABLES;
+            for (int t = 0; t < TABLES; t++)
+                if (!strcmp(words[0], table_names[t]))
+                    p.table = (Table)t;
+            p.address = strtol(words[1], NULL, 0);
+            p.type = words[2];
+            p.value = atof(words[3]);
+            ok = p.table != TABLES && (p.type == "bit") == (p.table == COILS || p.table == DISCRETE) &&
+                 (p.type == "bit" || p.type == "u16" || p.type == "s16" || p.type == "u32" || p.type == "s32" ||
+                  p.type == "f32");
+            for (int i = 4; i < n; i++)
+            {
+                if (!strncmp(words[i], "jitter=", 7))
+                    p.jitter = atof(words[i] + 7);
+                else if (!strncmp(words[i], "step=", 5))
+                    p.step = atof(words[i] + 5);
+                else if (!strcmp(words[i], "swap"))
+                    p.swap = true;
+                else
+                    ok = false;
+            }
+            if (ok)
+            {
+                store(slave, p, p.value);
+                slave.points.push_back(p);
+            }
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "%s:%d: cannot parse this line\n", slave.file.c_str(), number);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// ---------------------------------------------------------------- protocol
+
+static uint16_t crc16(const uint8_t *buf, size_t len) // Modbus: poly 0xA001, init 0xFFFF, low byte first
+{
+    uint16_t crc = 0xFFFF;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = crc & 1 ? crc >> 1 ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+struct Counters
+{
+    uint64_t requests = 0, replies = 0, exceptions = 0, foreign = 0, bad_crc = 0, noise = 0;
+    uint64_t crc_errors = 0, dropped_bytes = 0, no_replies = 0;
+    uint64_t functions[128] = {};
+};
+
+static Counters total;
+
+// Length of the request at buf: 0 while more bytes are needed, -1 when the
+// function code is unknown (the frame then ends at the silence).
+static int request_length(const uint8_t *buf, size_t len)
+{
+    if (len < 2)
+        return 0;
+    switch (buf[1])
+    {
+    case 1: case 2: case 3: case 4: case 5: case 6:
+        return 8;
+    case 15: case 16:
+        return len < 7 ? 0 : 9 + buf[6];
+    default:
+        return -1;
+    }
+}
+
+static size_t exception(uint8_t *reply, uint8_t code)
+{
+    reply[1] |= 0x80;
+    reply[2] = code;
+    total.exceptions++;
+    return 3;
+}
+
+// Builds the reply to one CRC-checked request, returns its length without
+// the CRC, 0 for no reply (broadcast).
+static size_t serve(Slave &slave, const uint8_t *req, size_t len, uint8_t *reply)
+{
+    uint8_t fc = req[1];
+    uint16_t address = req[2] << 8 | req[3];
+    uint16_t count = req[4] << 8 | req[5];
+    reply[0] = req[0];
+    reply[1] = fc;
+    total.functions[fc & 0x7f]++;
+
+    auto readable = [&](Table t, uint16_t first, uint16_t n) {
+        for (uint32_t a = first; a < (uint32_t)first + n; a++)
+            if (!slave.tables[t].count(a))
+                return false;
+        return true;
+    };
+
+    switch (fc)
+    {
+    case 1: // read coils
+    case 2: // read discrete inputs
+    {
+        Table t = fc == 1 ? COILS : DISCRETE;
+        if (count < 1 || count > 2000)
+            return exception(reply, 3);
+        if (!readable(t, address, count))
+            return exception(reply, 2);
+        refresh(slave, t, address, count);
+        reply[2] = (count + 7) / 8;
+        memset(reply + 3, 0, reply[2]);
+        for (uint16_t i = 0; i < count; i++)
+            if (slave.tables[t][address + i])
+                reply[3 + i / 8] |= 1 << (i % 8);
+        return 3 + reply[2];
+    }
+    case 3: // read holding registers
+    case 4: // read input registers
+    {
+        Table t = fc == 3 ? HOLDING : INPUT;
+        if (count < 1 || count > 125)
+            return exception(reply, 3);
+        if (!readable(t, address, count))
+            return exception(reply, 2);
+        refresh(slave, t, address, count);
+        reply[2] = count * 2;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            uint16_t v = slave.tables[t][address + i];
+            reply[3 + 2 * i] = v >> 8;
+            reply[4 + 2 * i] = v;
+        }
+        return 3 + reply[2];
+    }
+    case 5: // write single coil: echo
+    case 6: // write single register: echo
+    {
+        Table t = fc == 5 ? COILS : HOLDING;
+        if (fc == 5 && count != 0xFF00 && count != 0)
+            return exception(reply, 3);
+        if (!readable(t, address, 1))
+            return exception(reply, 2);
+        slave.tables[t][address] = fc == 5 ? count == 0xFF00 : count;
+        memcpy(reply, req, 6);
+        return req[0] ? 6 : 0;
+    }
+    case 15: // write multiple coils
+    case 16: // write multiple registers
+    {
+        Table t = fc == 15 ? COILS : HOLDING;
+        uint8_t bytes = req[6];
+        if (count < 1 || bytes != (fc == 15 ? (count + 7) / 8 : count * 2) || len != 9u + bytes)
+            return exception(reply, 3);
+        if (!readable(t, address, count))
+            return exception(reply, 2);
+        for (uint16_t i = 0; i < count; i++)
+            slave.tables[t][address + i] =
+                fc == 15 ? (req[7 + i / 8] >> (i % 8)) & 1 : (uint16_t)(req[7 + 2 * i] << 8 | req[8 + 2 * i]);
+        memcpy(reply, req, 6);
+        return req[0] ? 6 : 0;
+    }
+    default:
+        return exception(reply, 1);
+    }
+}
+
+// ---------------------------------------------------------------- line
+
+struct Line
+{
+    int fd = -1;
+    unsigned baud = 9600;
+    double latency = 0.020, jitter = 0;
+    double crc_errors = 0, drop_bytes = 0, no_reply = 0;
+    bool verbose = false;
+};
+
+static Line line;
+
+static void dump(const char *what, const uint8_t *buf, size_t len)
+{
+    if (!line.verbose)
+        return;
+    fprintf(stderr, "%9.3f %s", now_s(), what);
+    for (size_t i = 0; i < len; i++)
+        fprintf(stderr, " %02X", buf[i]);
+    fputc('\n', stderr);
+}
+
+static void transmit(uint8_t *frame, size_t len)
+{
+    if (line.crc_errors > 0 && drand48() < line.crc_errors)
+    {
+        frame[len - 1 - (lrand48() & 1)] ^= 1 << (lrand48() & 7);
+        total.crc_errors++;
+    }
+    uint8_t out[MODBUS_FRAME_MAX];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (line.drop_bytes > 0 && drand48() < line.drop_bytes)
+            total.dropped_bytes++;
+        else
+            out[n++] = frame[i];
+    }
+    // turnaround, then the whole frame once it would be on the wire:
+    // 10 bits per byte (8N1)
+    double delay = line.latency + uniform(0, line.jitter) + len * 10.0 / line.baud;
+    std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+    dump("<", out, n);
+    for (size_t done = 0; done < n;)
+    {
+        ssize_t w = write(line.fd, out + done, n - done);
+        if (w < 0 && errno == EAGAIN)
+        {
+            poll(NULL, 0, 1);
+            continue;
+        }
+        if (w <= 0)
+            break;
+        done += w;
+    }
+    total.replies++;
+}
+
+// Consumes complete requests from the front of buf.
+static void receive(std::vector<uint8_t> &buf, bool silence)
+{
+    while (!buf.empty())
+    {
+        int len = request_length(buf.data(), buf.size());
+        if (len < 0 && silence)
+            len = buf.size(); // unknown function: the frame is whatever came before the gap
+        if (len <= 0 || (size_t)len > buf.size())
+        {
+            if (silence || buf.size() > MODBUS_FRAME_MAX)
+            {
+                dump("noise", buf.data(), buf.size());
+                total.noise += buf.size();
+                buf.clear();
+            }
+            return;
+        }
+        if (len < 4 || crc16(buf.data(), len - 2) != (buf[len - 2] | buf[len - 1] << 8))
+        { // not a frame boundary: slide by one byte and look again
+            total.bad_crc++;
+            buf.erase(buf.begin());
+            continue;
+        }
+        std::vector<uint8_t> req(buf.begin(), buf.begin() + len);
+        buf.erase(buf.begin(), buf.begin() + len);
+        dump(">", req.data(), req.size());
+        total.requests++;
+
+        Slave *slave = NULL;
+        for (Slave &s : slaves)
+            if (s.id == req[0] || req[0] == 0)
+                slave = &s;
+        if (!slave)
+        {
+            total.foreign++;
+            continue;
+        }
+        if (line.no_reply > 0 && drand48() < line.no_reply)
+        {
+            total.no_replies++;
+            continue;
+        }
+        uint8_t reply[MODBUS_FRAME_MAX];
+        size_t n = serve(*slave, req.data(), req.size(), reply);
+        if (!n || req[0] == 0)
+            continue;
+        uint16_t crc = crc16(reply, n);
+        reply[n++] = crc;
+        reply[n++] = crc >> 8;
+        transmit(reply, n);
+    }
+}
+
+static void report()
+{
+    fprintf(stderr,
+            "meter %7.1fs: %llu requests (fc3 %llu fc4 %llu), %llu replies, %llu exceptions, %llu other slaves | "
+            "line in: %llu bad CRC, %llu noise bytes | injected: %llu CRC errors, %llu bytes dropped, %llu no reply\n",
+            now_s(), (unsigned long long)total.requests, (unsigned long long)total.functions[3],
+            (unsigned long long)total.functions[4], (unsigned long long)total.replies,
+            (unsigned long long)total.exceptions, (unsigned long long)total.foreign, (unsigned long long)total.bad_crc,
+            (unsigned long long)total.noise, (unsigned long long)total.crc_errors,
+            (unsigned long long)total.dropped_bytes, (unsigned long long)total.no_replies);
+}
+
+// ---------------------------------------------------------------- main
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_MAP = 1,
+        OPT_LINK,
+        OPT_BAUD,
+        OPT_LATENCY,
+        OPT_JITTER,
+        OPT_CRC_ERRORS,
+        OPT_DROP_BYTES,
+        OPT_NO_REPLY,
+        OPT_SEED,
+        OPT_STATS,
+        OPT_VERBOSE,
+        OPT_HELP
+    };
+    static const struct option options[] = {
+        {"map", required_argument, NULL, OPT_MAP},
+        {"link", required_argument, NULL, OPT_LINK},
+        {"baud", required_argument, NULL, OPT_BAUD},
+        {"latency", required_argument, NULL, OPT_LATENCY},
+        {"jitter", required_argument, NULL, OPT_JITTER},
+        {"crc-errors", required_argument, NULL, OPT_CRC_ERRORS},
+        {"drop-bytes", required_argument, NULL, OPT_DROP_BYTES},
+        {"no-reply", required_argument, NULL, OPT_NO_REPLY},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"stats", required_argument, NULL, OPT_STATS},
+        {"verbose", no_argument, NULL, OPT_VERBOSE},
+        {"help", no_argument, NULL, OPT_HELP},
+        {NULL, 0, NULL, 0}};
+
+    const char *link = NULL;
+    long seed = 1;
+    double stats = 10;
+
+    for (int opt; (opt = getopt_long(argc, argv, "", options, NULL)) != -1;)
+    {
+        switch (opt)
+        {
+        case OPT_MAP:
+        {
+            Slave slave;
+            const char *colon = strchr(optarg, ':');
+            slave.id = colon ? atoi(optarg) : 1;
+            slave.file = colon ? colon + 1 : optarg;
+            if (!slave.id || slave.id > 247)
+            {
+                fprintf(stderr, "--map: slave ID must be 1..247\n");
+                return 2;
+            }
+            slaves.push_back(slave);
+            break;
+        }
+        case OPT_LINK:
+            link = optarg;
+            break;
+        case OPT_BAUD:
+            line.baud = strtoul(optarg, NULL, 10);
+            break;
+        case OPT_LATENCY:
+            line.latency = atof(optarg) / 1000;
+            break;
+        case OPT_JITTER:
+            line.jitter = atof(optarg) / 1000;
+            break;
+        case OPT_CRC_ERRORS:
+            line.crc_errors = atof(optarg);
+            break;
+        case OPT_DROP_BYTES:
+            line.drop_bytes = atof(optarg);
+            break;
+        case OPT_NO_REPLY:
+            line.no_reply = atof(optarg);
+            break;
+        case OPT_SEED:
+            seed = atol(optarg);
+            break;
+        case OPT_STATS:
+            stats = atof(optarg);
+            break;
+        case OPT_VERBOSE:
+            line.verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == OPT_HELP ? 0 : 2;
+        }
+    }
+    if (slaves.empty() || !line.baud)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    for (Slave &slave : slaves)
+        if (!load_map(slave))
+            return 1;
+    srand48(seed);
+
+    line.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (line.fd < 0 || grantpt(line.fd) < 0 || unlockpt(line.fd) < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+    const char *pty = ptsname(line.fd);
+    // keep the far side open: the master side then survives scada_host
+    // restarts instead of reading EIO, and starts out raw (no echo)
+    int far = open(pty, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (far < 0 || tcgetattr(far, &tio) < 0)
+    {
+        perror(pty);
+        return 1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(far, TCSANOW, &tio);
+    fcntl(line.fd, F_SETFL, fcntl(line.fd, F_GETFL) | O_NONBLOCK);
+    if (link)
+    {
+        unlink(link);
+        if (symlink(pty, link) < 0)
+        {
+            perror(link);
+            return 1;
+        }
+    }
+    for (Slave &slave : slaves)
+        fprintf(stderr, "meter: slave %u from %s (%zu points)\n", slave.id, slave.file.c_str(), slave.points.size());
+    printf("%s\n", link ? link : pty);
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    std::vector<uint8_t> buf;
+    double last_byte = 0, next_stats = stats;
+    uint64_t reported = 0;
+    while (!stop_requested)
+    {
+        struct pollfd p = {line.fd, POLLIN, 0};
+        int ready = poll(&p, 1, buf.empty() ? 200 : METER_SILENCE_MS / 5);
+        if (ready > 0 && p.revents & POLLIN)
+        {
+            uint8_t chunk[MODBUS_FRAME_MAX];
+            ssize_t n = read(line.fd, chunk, sizeof(chunk));
+            if (n > 0)
+            {
+                buf.insert(buf.end(), chunk, chunk + n);
+                last_byte = now_s();
+            }
+        }
+        receive(buf, !buf.empty() && now_s() - last_byte > METER_SILENCE_MS / 1000.0);
+        if (stats > 0 && now_s() >= next_stats)
+        {
+            next_stats += stats;
+            if (total.requests != reported)
+                report();
+            reported = total.requests;
+        }
+    }
+    report();
+    if (link)
+        unlink(link);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// AsyncTCP on POSIX sockets. One "async_tcp" thread polls every server and
+// client and runs their callbacks, as the library's task does on the chip;
+// write() sends from the calling thread. A client the firmware owns is
+// never freed here: after onDisconnect it is only unregistered. Clients
+// without a socket are the connection behind an in-process host_http()
+// request and report loopback addresses.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+
+#include "IPAddress.h"
+
+class AsyncClient;
+
+typedef std::function<void(void *, AsyncClient *)> AcConnectHandler;
+typedef std::function<void(void *, AsyncClient *, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void *, AsyncClient *, uint32_t time)> AcTimeoutHandler;
+
+class AsyncClient
+{
+public:
+    explicit AsyncClient(int fd = -1);
+    ~AsyncClient();
+    AsyncClient(const AsyncClient &) = delete;
+    AsyncClient &operator=(const AsyncClient &) = delete;
+
+    IPAddress localIP();
+    IPAddress remoteIP();
+    uint16_t localPort();
+    uint16_t remotePort();
+
+    bool connected() const { return fd_ >= 0 && !closed_; }
+    size_t space() { return connected() ? 5744 : 0; } // TCP_SND_BUF of the chip
+    size_t add(const char *data, size_t size, uint8_t apiflags = 0) { return write(data, size, apiflags); }
+    bool send() { return true; }
+    size_t write(const char *data) { return write(data, strlen(data)); }
+    size_t write(const char *data, size_t size, uint8_t apiflags = 0);
+    void close(bool now = false);
+    void stop() { close(false); }
+
+    void setNoDelay(bool nodelay);
+    void setRxTimeout(uint32_t timeout) { rx_timeout_ = timeout; } // seconds, 0: none
+
+    void onData(AcDataHandler cb, void *arg = 0) { data_cb_ = cb, data_arg_ = arg; }
+    void onDisconnect(AcConnectHandler cb, void *arg = 0) { disconnect_cb_ = cb, disconnect_arg_ = arg; }
+    void onTimeout(AcTimeoutHandler cb, void *arg = 0) { timeout_cb_ = cb, timeout_arg_ = arg; }
+
+private:
+    friend void host_async_tcp_poll(int wait_ms);
+    int fd_;
+    bool closed_ = false;
+    uint32_t rx_timeout_ = 0;
+    uint64_t last_rx_ms_ = 0;
+    AcDataHandler data_cb_;
+    void *data_arg_ = nullptr;
+    AcConnectHandler disconnect_cb_;
+    void *disconnect_arg_ = nullptr;
+    AcTimeoutHandler timeout_cb_;
+    void *timeout_arg_ = nullptr;
+};
+
+class AsyncServer
+{
+public:
+    explicit AsyncServer(uint16_t port) : port_(port) {}
+    ~AsyncServer() { end(); }
+
+    void onClient(AcConnectHandler cb, void *arg) { client_cb_ = cb, client_arg_ = arg; }
+    void setNoDelay(bool nodelay) { nodelay_ = nodelay; }
+    void begin(); // listens on port + the --port-offset of scada_host
+    void end();
+
+private:
+    friend void host_async_tcp_poll(int wait_ms);
+    uint16_t port_;
+    int fd_ = -1;
+    bool nodelay_ = false;
+    AcConnectHandler client_cb_;
+    void *client_arg_ = nullptr;
+};
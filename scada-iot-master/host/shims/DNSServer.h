@@ -0,0 +1,24 @@
+#pragma once
+
+#include "IPAddress.h"
+#include "WString.h"
+
+enum class DNSReplyCode
+{
+    NoError = 0,
+    FormError = 1,
+    ServerFailure = 2,
+    NonExistentDomain = 3,
+    NotImplemented = 4,
+    Refused = 5
+};
+
+class DNSServer
+{
+public:
+    void setErrorReplyCode(const DNSReplyCode &code) {}
+    void setTTL(const uint32_t &ttl) {}
+    bool start(const uint16_t &port, const String &domainName, const IPAddress &resolvedIP) { return true; }
+    void stop() {}
+    void processNextRequest() {}
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+// ESPAsyncWebServer without sockets. Routes register as on the chip;
+// host_http() (host.h) builds a request, runs the matching handler and
+// drains the response, calling loop() whenever a filler answers
+// RESPONSE_TRY_AGAIN, the same interleaving as the async_tcp task.
+
+#include <stdlib.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Arduino.h"
+#include "AsyncTCP.h"
+#include "FS.h"
+
+typedef enum
+{
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+typedef std::function<size_t(uint8_t *, size_t, size_t)> AwsResponseFiller;
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebServerResponse
+{
+public:
+    virtual ~AsyncWebServerResponse() {}
+    void setCode(int code) { code_ = code; }
+    int code() const { return code_; }
+    void addHeader(const char *name, const char *value) { headers_.push_back({name, value}); }
+    void addHeader(const String &name, const String &value) { headers_.push_back({name, value}); }
+    void setContentType(const char *type) { type_ = type; }
+    const String &contentType() const { return type_; }
+    const std::vector<std::pair<String, String>> &headers() const { return headers_; }
+
+    // next piece of the body: bytes written, 0 at the end, RESPONSE_TRY_AGAIN if not ready yet
+    virtual size_t fill(uint8_t *buffer, size_t maxLen) = 0;
+
+protected:
+    int code_ = 200;
+    String type_;
+    std::vector<std::pair<String, String>> headers_;
+    size_t sent_ = 0;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncBasicResponse(int code, const String &type, const String &content) : content_(content)
+    {
+        code_ = code;
+        type_ = type;
+    }
+    size_t fill(uint8_t *buffer, size_t maxLen) override;
+
+private:
+    String content_;
+};
+
+class AsyncCallbackResponse : public AsyncWebServerResponse
+{
+public:
+    // length 0 with chunked set: the filler decides where the body ends
+    AsyncCallbackResponse(const String &type, size_t length, bool chunked, AwsResponseFiller filler)
+        : length_(length), chunked_(chunked), filler_(filler) { type_ = type; }
+    size_t fill(uint8_t *buffer, size_t maxLen) override;
+
+private:
+    size_t length_;
+    bool chunked_;
+    AwsResponseFiller filler_;
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncFileResponse(fs::FS &fs, const String &path, const String &type, bool download);
+    size_t fill(uint8_t *buffer, size_t maxLen) override;
+
+private:
+    File file_;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+public:
+    explicit AsyncResponseStream(const String &type) { type_ = type; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        content_.concat((const char *)buffer, size);
+        return size;
+    }
+    using Print::write;
+    size_t fill(uint8_t *buffer, size_t maxLen) override;
+
+private:
+    String content_;
+};
+
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebServerRequest(WebRequestMethod method, const String &url);
+    ~AsyncWebServerRequest();
+
+    void *_tempObject = NULL; // freed with the request
+
+    WebRequestMethod method() const { return method_; }
+    const String &url() const { return url_; }
+    size_t contentLength() const { return body_.length(); }
+    AsyncClient *client() { return &client_; }
+
+    size_t args() const { return args_.size(); }
+    bool hasArg(const char *name) const;
+    const String &arg(const char *name) const;
+    const String &arg(const String &name) const { return arg(name.c_str()); }
+    const String &arg(size_t i) const { return args_[i].second; }
+    const String &argName(size_t i) const { return args_[i].first; }
+    bool hasParam(const char *name, bool post = false) const { return hasArg(name); }
+
+    bool hasHeader(const char *name) const;
+    const String &header(const char *name) const;
+    void addRequestHeader(const String &name, const String &value) { headers_.push_back({name, value}); }
+    void addArg(const String &name, const String &value) { args_.push_back({name, value}); }
+    void setBody(const String &body) { body_ = body; }
+    const String &body() const { return body_; }
+
+    void onDisconnect(ArDisconnectHandler fn) { disconnect_ = fn; }
+
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &type = String(), const String &content = String()) { send(beginResponse(code, type, content)); }
+    void send(fs::FS &fs, const String &path, const String &type = String(), bool download = false) { send(beginResponse(fs, path, type, download)); }
+    void sendChunked(const String &type, AwsResponseFiller filler) { send(beginChunkedResponse(type, filler)); }
+    void redirect(const String &url, int code = 302);
+
+    AsyncWebServerResponse *beginResponse(int code, const String &type = String(), const String &content = String())
+    {
+        return new AsyncBasicResponse(code, type, content);
+    }
+    AsyncWebServerResponse *beginResponse(const String &type, size_t length, AwsResponseFiller filler)
+    {
+        return new AsyncCallbackResponse(type, length, false, filler);
+    }
+    AsyncWebServerResponse *beginResponse(fs::FS &fs, const String &path, const String &type = String(), bool download = false)
+    {
+        return new AsyncFileResponse(fs, path, type, download);
+    }
+    AsyncWebServerResponse *beginChunkedResponse(const String &type, AwsResponseFiller filler)
+    {
+        return new AsyncCallbackResponse(type, 0, true, filler);
+    }
+    AsyncResponseStream *beginResponseStream(const String &type) { return new AsyncResponseStream(type); }
+
+    AsyncWebServerResponse *response() { return response_.get(); }
+    void disconnected()
+    {
+        if (disconnect_)
+            disconnect_();
+    }
+
+private:
+    WebRequestMethod method_;
+    String url_;
+    String body_;
+    std::vector<std::pair<String, String>> args_;
+    std::vector<std::pair<String, String>> headers_;
+    std::unique_ptr<AsyncWebServerResponse> response_;
+    ArDisconnectHandler disconnect_;
+    AsyncClient client_;
+};
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest *request) = 0;
+    virtual void handleRequest(AsyncWebServerRequest *request) = 0;
+    virtual void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {}
+    virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+        : uri_(uri), method_(method), onRequest_(onRequest), onUpload_(onUpload), onBody_(onBody) {}
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        if (onRequest_)
+            onRequest_(request);
+        else
+            request->send(500);
+    }
+    void handleUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) override
+    {
+        if (onUpload_)
+            onUpload_(request, filename, index, data, len, final);
+    }
+    void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override
+    {
+        if (onBody_)
+            onBody_(request, data, len, index, total);
+    }
+
+private:
+    String uri_;
+    WebRequestMethodComposite method_;
+    ArRequestHandlerFunction onRequest_;
+    ArUploadHandlerFunction onUpload_;
+    ArBodyHandlerFunction onBody_;
+};
+
+// Server-Sent Events. Host clients are counters: host_events_connect()
+// adds one, and every send() reaches each of them at once.
+class AsyncEventSourceClient
+{
+};
+
+typedef std::function<void(AsyncEventSourceClient *)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler
+{
+public:
+    explicit AsyncEventSource(const String &url) : url_(url) {}
+    void onConnect(ArEventHandlerFunction cb) { connect_ = cb; }
+    size_t count() const { return clients_; }
+    size_t avgPacketsWaiting() const { return 0; }
+    void send(const char *message, const char *event = NULL, uint32_t id = 0, uint32_t reconnect = 0);
+    bool canHandle(AsyncWebServerRequest *request) override { return request->method() == HTTP_GET && request->url() == url_; }
+    void handleRequest(AsyncWebServerRequest *request) override;
+
+    uint32_t sent = 0;       // messages, across all host clients
+    uint64_t sent_bytes = 0; //
+
+private:
+    String url_;
+    size_t clients_ = 0;
+    ArEventHandlerFunction connect_;
+};
+
+class AsyncWebServer
+{
+public:
+    explicit AsyncWebServer(uint16_t port) : port_(port) {}
+    ~AsyncWebServer();
+
+    AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest)
+    {
+        return on(uri, HTTP_ANY, onRequest);
+    }
+    AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler)
+    {
+        handlers_.push_back(handler);
+        return *handler;
+    }
+    void onNotFound(ArRequestHandlerFunction fn) { notFound_ = fn; }
+    void begin() { started_ = true; }
+    void end() { started_ = false; }
+
+    // runs request through the registered handlers, as one full body
+    void handle(AsyncWebServerRequest *request);
+
+private:
+    uint16_t port_;
+    bool started_ = false;
+    std::vector<AsyncWebHandler *> handlers_;
+    std::vector<AsyncCallbackWebHandler *> owned_;
+    ArRequestHandlerFunction notFound_;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+// mDNS with no peers: queries find nothing, so OTA peer lookup falls back
+// to the HTTP URL it was given.
+
+#include "IPAddress.h"
+#include "WString.h"
+
+class MDNSResponder
+{
+public:
+    bool begin(const char *hostName) { return true; }
+    void end() {}
+    void addService(const char *service, const char *proto, uint16_t port) {}
+    void addService(const String &service, const String &proto, uint16_t port) {}
+    bool addServiceTxt(const char *name, const char *proto, const char *key, const char *value) { return true; }
+    bool addServiceTxt(const char *name, const char *proto, const String &key, const String &value) { return true; }
+    int queryService(const char *service, const char *proto) { return 0; }
+    int queryService(const String &service, const String &proto) { return 0; }
+    String hostname(int idx) { return String(); }
+    IPAddress IP(int idx) { return IPAddress(); }
+    uint16_t port(int idx) { return 0; }
+    String txt(int idx, const char *key) { return String(); }
+    String txt(int idx, int txtIdx) { return String(); }
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// ESP object: heap numbers come from the process, restart() exits so a supervisor can start it again
+class EspClass
+{
+public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getHeapSize() { return 320 * 1024; }
+    uint32_t getSketchSize() { return 1024 * 1024; }
+    uint32_t getFreeSketchSpace() { return 1536 * 1024; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    uint64_t getEfuseMac();
+    const char *getSdkVersion() { return "host"; }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,51 @@
+#pragma once
+
+// Host UARTs: each port is a file descriptor (pty, FIFO, plain file).
+// Serial writes to stdout by default; Serial1/Serial2 start detached, reads
+// come back empty and writes are dropped. host_main attaches them from
+// --serialN or SCADA_SERIALn.
+
+#include <stdint.h>
+
+#include "Stream.h"
+
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8E1 0x800001e
+#define SERIAL_8N2 0x800003c
+
+class HardwareSerial : public Stream
+{
+public:
+    explicit HardwareSerial(int uart) : uart_(uart), wfd_(uart == 0 ? 1 : -1) {} // Serial -> stdout
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx = -1, int8_t tx = -1);
+    void end() {}
+    bool attach(const char *path); // opens path, raw mode if it is a tty
+    void attach(int rfd, int wfd) { rfd_ = rfd, wfd_ = wfd; }
+    bool attached() const { return rfd_ >= 0 || wfd_ >= 0; }
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int availableForWrite() override { return 128; }
+    void flush() override {}
+
+    operator bool() const { return true; }
+
+private:
+    int uart_;
+    int rfd_ = -1;
+    int wfd_;
+    unsigned long baud_ = 0;
+    uint8_t buf_[256];
+    size_t head_ = 0, tail_ = 0;
+
+    bool fill();
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
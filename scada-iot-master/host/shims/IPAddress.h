@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Print.h"
+#include "WString.h"
+
+class IPAddress : public Printable
+{
+public:
+    IPAddress() : addr_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    IPAddress(uint32_t addr) : addr_(addr) {} // network byte order, as on the ESP32
+    IPAddress(const uint8_t *addr) : IPAddress(addr[0], addr[1], addr[2], addr[3]) {}
+
+    operator uint32_t() const { return addr_; }
+    uint8_t operator[](int i) const { return addr_ >> (8 * i); }
+    bool operator==(const IPAddress &other) const { return addr_ == other.addr_; }
+    bool operator!=(const IPAddress &other) const { return addr_ != other.addr_; }
+
+    bool fromString(const char *s)
+    {
+        unsigned a, b, c, d;
+        char tail;
+        if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+            return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String &s) { return fromString(s.c_str()); }
+
+    String toString() const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+    size_t printTo(Print &p) const override { return p.print(toString()); }
+
+private:
+    uint32_t addr_;
+};
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
@@ -0,0 +1,45 @@
+#pragma once
+
+// HD44780 with no glass: writes land in a character buffer that
+// host_lcd_line() returns, so a test can check what the panel shows.
+
+#include "Print.h"
+
+class LiquidCrystal : public Print
+{
+public:
+    LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3);
+
+    void begin(uint8_t cols, uint8_t rows)
+    {
+        cols_ = cols < 40 ? cols : 40;
+        rows_ = rows < 4 ? rows : 4;
+        clear();
+    }
+    void clear();
+    void home() { setCursor(0, 0); }
+    void setCursor(uint8_t col, uint8_t row)
+    {
+        col_ = col;
+        row_ = row;
+    }
+    void display() {}
+    void noDisplay() {}
+    void cursor() {}
+    void noCursor() {}
+    void blink() {}
+    void noBlink() {}
+    void createChar(uint8_t, uint8_t[]) {}
+
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    String line(uint8_t row) const;
+
+private:
+    char text_[4][41];
+    uint8_t cols_ = 16, rows_ = 2;
+    uint8_t col_ = 0, row_ = 0;
+};
+
+extern LiquidCrystal *host_lcd; // the last one constructed
@@ -0,0 +1,24 @@
+#pragma once
+
+// NVS key/value store: one file per key under DIR.nvs/NAMESPACE/ next to the
+// SPIFFS directory, so it survives a SPIFFS format like the real partition.
+// Only the unsigned integer accessors the firmware uses.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() { dir_.clear(); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putUInt(const char *key, uint32_t value);
+    bool remove(const char *key);
+
+private:
+    std::string dir_;
+    bool readOnly_ = false;
+};
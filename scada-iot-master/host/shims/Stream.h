@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Print.h"
+
+unsigned long millis();
+void yield();
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+    unsigned long getTimeout() const { return timeout_; }
+
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t n = 0;
+        while (n < length)
+        {
+            int c = timedRead();
+            if (c < 0)
+                break;
+            buffer[n++] = (char)c;
+        }
+        return n;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+    String readString()
+    {
+        String s;
+        for (int c = timedRead(); c >= 0; c = timedRead())
+            s += (char)c;
+        return s;
+    }
+    String readStringUntil(char terminator)
+    {
+        String s;
+        for (int c = timedRead(); c >= 0 && c != terminator; c = timedRead())
+            s += (char)c;
+        return s;
+    }
+
+protected:
+    unsigned long timeout_ = 1000;
+
+    int timedRead()
+    {
+        unsigned long start = millis();
+        do
+        {
+            int c = read();
+            if (c >= 0)
+                return c;
+            yield();
+        } while (millis() - start < timeout_);
+        return -1;
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// Periodic callbacks. On the chip they run in the esp_timer task; here
+// host_tickers_run() fires the due ones on the loop thread, from delay()
+// and between loop() passes, in virtual time.
+
+#include <stdint.h>
+
+class Ticker
+{
+public:
+    typedef void (*callback_t)();
+
+    Ticker();
+    ~Ticker();
+
+    void attach(float seconds, callback_t cb) { attach_ms((uint32_t)(seconds * 1000), cb); }
+    void attach_ms(uint32_t ms, callback_t cb);
+    void once(float seconds, callback_t cb) { once_ms((uint32_t)(seconds * 1000), cb); }
+    void once_ms(uint32_t ms, callback_t cb);
+    void detach() { cb_ = nullptr; }
+    bool active() const { return cb_ != nullptr; }
+
+    void run(uint64_t now_us); // fires if due
+
+private:
+    callback_t cb_ = nullptr;
+    uint64_t period_us_ = 0; // 0: once
+    uint64_t next_us_ = 0;
+    Ticker *next_ = nullptr;
+
+    friend void host_tickers_run();
+};
+
+void host_tickers_run();
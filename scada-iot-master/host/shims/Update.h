@@ -0,0 +1,53 @@
+#pragma once
+
+// Firmware writes are counted and dropped; end() never succeeds, so a
+// test cannot "reboot into" an image the host cannot run.
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+
+class UpdateClass
+{
+public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH)
+    {
+        running_ = true;
+        error_ = NULL;
+        progress_ = 0;
+        return true;
+    }
+    size_t write(uint8_t *data, size_t len)
+    {
+        if (!running_ || error_)
+            return 0;
+        progress_ += len;
+        return len;
+    }
+    bool end(bool evenIfRemaining = false)
+    {
+        running_ = false;
+        if (!error_)
+            error_ = "not supported on the host";
+        return false;
+    }
+    void abort()
+    {
+        running_ = false;
+        error_ = "aborted";
+    }
+    bool isRunning() { return running_; }
+    bool hasError() { return error_ != NULL; }
+    const char *errorString() { return error_ ? error_ : "no error"; }
+    void printError(Print &out) { out.println(errorString()); }
+    size_t progress() { return progress_; }
+    void runAsync(bool) {}
+
+private:
+    bool running_ = false;
+    const char *error_ = NULL;
+    size_t progress_ = 0;
+};
+
+extern UpdateClass Update;
@@ -0,0 +1,231 @@
+#pragma once
+
+// Arduino String on top of std::string
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+class String
+{
+public:
+    String() {}
+    String(const char *s) : s_(s ? s : "") {}
+    String(const char *s, unsigned int length) : s_(s ? std::string(s, length) : "") {}
+    explicit String(const std::string &s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    explicit String(unsigned char v, unsigned char base = 10) { number(v, base); }
+    explicit String(int v, unsigned char base = 10) { number(v, base); }
+    explicit String(unsigned int v, unsigned char base = 10) { number(v, base); }
+    explicit String(long v, unsigned char base = 10) { number(v, base); }
+    explicit String(unsigned long v, unsigned char base = 10) { number(v, base); }
+    explicit String(long long v, unsigned char base = 10) { number(v, base); }
+    explicit String(unsigned long long v, unsigned char base = 10) { number(v, base); }
+    explicit String(float v, unsigned int decimals = 2) { real(v, decimals); }
+    explicit String(double v, unsigned int decimals = 2) { real(v, decimals); }
+
+    const char *c_str() const { return s_.c_str(); }
+    size_t length() const { return s_.length(); }
+    bool isEmpty() const { return s_.empty(); }
+    bool reserve(unsigned int size)
+    {
+        s_.reserve(size);
+        return true;
+    }
+    void clear() { s_.clear(); }
+
+    bool concat(const String &s)
+    {
+        s_ += s.s_;
+        return true;
+    }
+    bool concat(const char *s)
+    {
+        if (s)
+            s_ += s;
+        return s != NULL;
+    }
+    bool concat(const char *s, unsigned int length)
+    {
+        s_.append(s, length);
+        return true;
+    }
+    bool concat(char c)
+    {
+        s_ += c;
+        return true;
+    }
+    template <typename T>
+    bool concat(T v) { return concat(String(v)); }
+
+    String &operator+=(const String &s) { return concat(s), *this; }
+    String &operator+=(const char *s) { return concat(s), *this; }
+    String &operator+=(char c) { return concat(c), *this; }
+    template <typename T>
+    String &operator+=(T v) { return concat(String(v)), *this; }
+
+    char operator[](unsigned int i) const { return i < s_.length() ? s_[i] : 0; }
+    char &operator[](unsigned int i) { return s_[i]; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+    void setCharAt(unsigned int i, char c)
+    {
+        if (i < s_.length())
+            s_[i] = c;
+    }
+
+    bool equals(const String &s) const { return s_ == s.s_; }
+    bool equals(const char *s) const { return s_ == (s ? s : ""); }
+    bool equalsIgnoreCase(const String &s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    bool operator==(const String &s) const { return equals(s); }
+    bool operator==(const char *s) const { return equals(s); }
+    bool operator!=(const String &s) const { return !equals(s); }
+    bool operator!=(const char *s) const { return !equals(s); }
+    bool operator<(const String &s) const { return s_ < s.s_; }
+    int compareTo(const String &s) const { return s_.compare(s.s_); }
+
+    bool startsWith(const String &prefix) const { return s_.compare(0, prefix.s_.length(), prefix.s_) == 0; }
+    bool startsWith(const String &prefix, unsigned int offset) const { return offset <= s_.length() && s_.compare(offset, prefix.s_.length(), prefix.s_) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return s_.length() >= suffix.s_.length() && s_.compare(s_.length() - suffix.s_.length(), suffix.s_.length(), suffix.s_) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(s_.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return found(s_.find(s.s_, from)); }
+    int lastIndexOf(char c) const { return found(s_.rfind(c)); }
+    int lastIndexOf(char c, unsigned int from) const { return found(s_.rfind(c, from)); }
+    int lastIndexOf(const String &s) const { return found(s_.rfind(s.s_)); }
+
+    String substring(unsigned int from) const { return from < s_.length() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= s_.length())
+            return String();
+        return String(s_.substr(from, to - from));
+    }
+
+    void replace(char find, char with)
+    {
+        for (char &c : s_)
+            if (c == find)
+                c = with;
+    }
+    void replace(const String &find, const String &with)
+    {
+        if (find.s_.empty())
+            return;
+        for (size_t at = s_.find(find.s_); at != std::string::npos; at = s_.find(find.s_, at + with.s_.length()))
+            s_.replace(at, find.s_.length(), with.s_);
+    }
+    void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < s_.length())
+            s_.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (char &c : s_)
+            c = tolower((unsigned char)c);
+    }
+    void toUpperCase()
+    {
+        for (char &c : s_)
+            c = toupper((unsigned char)c);
+    }
+    void trim()
+    {
+        size_t begin = s_.find_first_not_of(" \t\r\n\f\v");
+        if (begin == std::string::npos)
+        {
+            s_.clear();
+            return;
+        }
+        s_ = s_.substr(begin, s_.find_last_not_of(" \t\r\n\f\v") - begin + 1);
+    }
+
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+    double toDouble() const { return atof(c_str()); }
+
+    void getBytes(unsigned char *buf, unsigned int size, unsigned int index = 0) const { toCharArray((char *)buf, size, index); }
+    void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const
+    {
+        if (!size)
+            return;
+        size_t n = index < s_.length() ? std::min<size_t>(s_.length() - index, size - 1) : 0;
+        memcpy(buf, s_.data() + std::min<size_t>(index, s_.length()), n);
+        buf[n] = 0;
+    }
+
+    const std::string &str() const { return s_; }
+
+private:
+    std::string s_;
+
+    static int found(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+
+    template <typename T>
+    void number(T v, unsigned char base)
+    {
+        if (base == 10)
+        {
+            s_ = std::to_string(v);
+            return;
+        }
+        unsigned long long u = v < 0 ? (unsigned long long)-(long long)v : (unsigned long long)v;
+        do
+        {
+            s_.insert(s_.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[u % base]);
+            u /= base;
+        } while (u);
+        if (v < 0)
+            s_.insert(s_.begin(), '-');
+    }
+
+    void real(double v, unsigned int decimals)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        s_ = buf;
+    }
+};
+
+inline String operator+(const String &a, const String &b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+inline String operator+(const String &a, const char *b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+inline String operator+(const char *a, const String &b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+inline String operator+(const String &a, char b)
+{
+    String s(a);
+    s += b;
+    return s;
+}
+template <typename T>
+String operator+(const String &a, T b)
+{
+    String s(a);
+    s += String(b);
+    return s;
+}
+inline bool operator==(const char *a, const String &b) { return b == a; }
+inline bool operator!=(const char *a, const String &b) { return b != a; }
+
+typedef String StringSumHelper;
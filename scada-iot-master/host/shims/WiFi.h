@@ -0,0 +1,106 @@
+#pragma once
+
+// WiFi station: the host network is "the" access point. status() follows
+// host_wifi_set_status() so a test can take the link down and back up.
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WPA2_PSK = 3
+} wifi_auth_mode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t m)
+    {
+        mode_ = m;
+        return true;
+    }
+    wifi_mode_t getMode() { return mode_; }
+    wl_status_t status();
+    wl_status_t begin(const char *ssid, const char *password = NULL);
+    bool disconnect(bool wifioff = false);
+    bool reconnect();
+
+    String macAddress();
+    uint8_t *macAddress(uint8_t *mac);
+    IPAddress localIP();
+    String SSID() { return status() == WL_CONNECTED ? String("host") : String(); }
+    int32_t RSSI() { return status() == WL_CONNECTED ? -55 : 0; }
+    bool hostname(const char *name)
+    {
+        hostname_ = name;
+        return true;
+    }
+    bool setHostname(const char *name) { return hostname(name); }
+    const char *getHostname() { return hostname_.c_str(); }
+
+    bool softAP(const char *ssid, const char *password = NULL)
+    {
+        ap_ssid_ = ssid;
+        return true;
+    }
+    bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet)
+    {
+        ap_ip_ = local;
+        return true;
+    }
+    bool softAPdisconnect(bool wifioff = false)
+    {
+        ap_ssid_ = "";
+        return true;
+    }
+    IPAddress softAPIP() { return ap_ip_; }
+    String softAPSSID() { return ap_ssid_; }
+
+    // the scan finds the host network only, and completes at once
+    int16_t scanNetworks(bool async = false)
+    {
+        scanned_ = 1;
+        return scanned_;
+    }
+    int16_t scanComplete() { return scanned_; }
+    void scanDelete() { scanned_ = WIFI_SCAN_FAILED; }
+    String SSID(uint8_t i) { return i < scanned_ ? String("host") : String(); }
+    int32_t RSSI(uint8_t i) { return i < scanned_ ? -55 : 0; }
+    wifi_auth_mode_t encryptionType(uint8_t i) { return WIFI_AUTH_WPA2_PSK; }
+
+private:
+    wifi_mode_t mode_ = WIFI_OFF;
+    String hostname_;
+    String ap_ssid_;
+    IPAddress ap_ip_;
+    int16_t scanned_ = WIFI_SCAN_FAILED;
+};
+
+extern WiFiClass WiFi;
+
+void host_wifi_set_status(wl_status_t status);
@@ -0,0 +1,44 @@
+#pragma once
+
+// TCP client on a POSIX socket. Hostnames go through host_resolve() first,
+// so --host-map can point the broker at a local one.
+
+#include <memory>
+
+#include "Client.h"
+
+class WiFiClient : public Client
+{
+public:
+    WiFiClient() {}
+    ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+    void setNoDelay(bool) {}
+    IPAddress remoteIP() const { return remote_; }
+
+private:
+    int fd_ = -1;
+    IPAddress remote_;
+    uint8_t buf_[1460];
+    size_t head_ = 0, tail_ = 0;
+    bool closed_ = false;
+
+    bool fill();
+};
+
+bool host_resolve(const char *host, IPAddress &ip); // --host-map first, then getaddrinfo()
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "WiFi.h"
+
+class WiFiMulti
+{
+public:
+    bool addAP(const char *ssid, const char *password = NULL) { return ssid != NULL; }
+    uint8_t run(uint32_t connectTimeout = 5000) { return WiFi.status(); }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+// UDP without a socket: a packet sent to port 123 is answered at once with
+// an NTP reply carrying host wall-clock time (or the virtual clock offset
+// from it, see host_epoch()), so NTPClient syncs without a network.
+
+#include <vector>
+
+#include "Udp.h"
+
+class WiFiUDP : public UDP
+{
+public:
+    uint8_t begin(uint16_t port) override { return 1; }
+    void stop() override {}
+    int beginPacket(IPAddress ip, uint16_t port) override;
+    int beginPacket(const char *host, uint16_t port) override;
+    int endPacket() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int parsePacket() override;
+    int available() override { return rx_.size() - pos_; }
+    int read() override { return pos_ < rx_.size() ? rx_[pos_++] : -1; }
+    int read(unsigned char *buffer, size_t len) override;
+    int read(char *buffer, size_t len) override { return read((unsigned char *)buffer, len); }
+    int peek() override { return pos_ < rx_.size() ? rx_[pos_] : -1; }
+    void flush() override {}
+    IPAddress remoteIP() override { return remote_; }
+    uint16_t remotePort() override { return port_; }
+
+private:
+    IPAddress remote_;
+    uint16_t port_ = 0;
+    std::vector<uint8_t> tx_, pending_, rx_;
+    size_t pos_ = 0;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_idf_version.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+
+typedef enum
+{
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// POWERON unless host_main was told otherwise (--reset-reason), so the
+// watchdog-restart path can be exercised
+esp_reset_reason_t esp_reset_reason();
+void esp_restart();
+uint32_t esp_get_free_heap_size();
@@ -0,0 +1,25 @@
+#pragma once
+
+// Task watchdog. The host arms it like the chip does: if loop() stops coming
+// back for longer than the timeout, the process aborts with a message
+// (ESP_RST_TASK_WDT on the next boot if the caller restarts it with
+// --reset-reason task_wdt).
+
+#include <stdint.h>
+
+#include "esp_system.h"
+
+typedef void *TaskHandle_t;
+
+typedef struct
+{
+    uint32_t timeout_ms;
+    uint32_t idle_core_mask;
+    bool trigger_panic;
+} esp_task_wdt_config_t;
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config);
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config);
+esp_err_t esp_task_wdt_add(TaskHandle_t task);
+esp_err_t esp_task_wdt_delete(TaskHandle_t task);
+esp_err_t esp_task_wdt_reset();
@@ -0,0 +1,285 @@
+// SPIFFS on a host directory
+
+#include "host.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "Preferences.h"
+#include "SPIFFS.h"
+
+SPIFFSFS SPIFFS;
+
+#define HOST_FS_SIZE (1472 * 1024) // like the default 4 MB partition table
+
+static std::string fs_root = "host_fs";
+
+void host_fs_root(const char *dir)
+{
+    fs_root = dir;
+    while (fs_root.size() > 1 && fs_root.back() == '/')
+        fs_root.pop_back();
+}
+
+static std::string fs_path(const char *path)
+{
+    std::string full = fs_root;
+    if (!path || path[0] != '/')
+        full += '/';
+    return full + (path ? path : "");
+}
+
+namespace fs
+{
+
+struct FileImpl
+{
+    std::string path; // firmware path, "/a/b.txt"
+    std::string name; // last component
+    FILE *file = NULL;
+    DIR *dir = NULL;
+
+    ~FileImpl()
+    {
+        if (file)
+            fclose(file);
+        if (dir)
+            closedir(dir);
+    }
+};
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    return impl_ && impl_->file ? fwrite(buffer, 1, size, impl_->file) : 0;
+}
+
+int File::available()
+{
+    if (!impl_ || !impl_->file)
+        return 0;
+    return size() - position();
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek()
+{
+    if (!impl_ || !impl_->file)
+        return -1;
+    int c = fgetc(impl_->file);
+    if (c != EOF)
+        ungetc(c, impl_->file);
+    return c == EOF ? -1 : c;
+}
+
+size_t File::read(uint8_t *buffer, size_t size)
+{
+    return impl_ && impl_->file ? fread(buffer, 1, size, impl_->file) : 0;
+}
+
+void File::flush()
+{
+    if (impl_ && impl_->file)
+        fflush(impl_->file);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    return impl_ && impl_->file && fseek(impl_->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const
+{
+    return impl_ && impl_->file ? ftell(impl_->file) : 0;
+}
+
+size_t File::size() const
+{
+    if (!impl_ || !impl_->file)
+        return 0;
+    fflush(impl_->file);
+    struct stat st;
+    return fstat(fileno(impl_->file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() { impl_.reset(); }
+
+File::operator bool() const { return impl_ && (impl_->file || impl_->dir); }
+
+const char *File::path() const { return impl_ ? impl_->path.c_str() : ""; }
+const char *File::name() const { return impl_ ? impl_->name.c_str() : ""; }
+bool File::isDirectory() const { return impl_ && impl_->dir; }
+
+File File::openNextFile(const char *mode)
+{
+    if (!impl_ || !impl_->dir)
+        return File();
+    while (struct dirent *entry = readdir(impl_->dir))
+    {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        std::string child = impl_->path == "/" ? "/" + std::string(entry->d_name) : impl_->path + "/" + entry->d_name;
+        return SPIFFS.open(child.c_str(), mode);
+    }
+    return File();
+}
+
+void File::rewindDirectory()
+{
+    if (impl_ && impl_->dir)
+        rewinddir(impl_->dir);
+}
+
+File FS::open(const char *path, const char *mode, bool create)
+{
+    std::string full = fs_path(path);
+    std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+    impl->path = path;
+    size_t slash = impl->path.rfind('/');
+    impl->name = slash == std::string::npos ? impl->path : impl->path.substr(slash + 1);
+
+    struct stat st;
+    if (stat(full.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        if (!(impl->dir = opendir(full.c_str())))
+            return File();
+        return File(impl);
+    }
+    std::string how = mode;
+    if (how == "r")
+        how = "rb";
+    else if (how == "w")
+        how = "w+b";
+    else if (how == "a")
+        how = "a+b";
+    if (!(impl->file = fopen(full.c_str(), how.c_str())))
+        return File();
+    return File(impl);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat st;
+    return stat(fs_path(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path) { return unlink(fs_path(path).c_str()) == 0; }
+
+bool FS::rename(const char *from, const char *to)
+{
+    if (exists(to))
+        return false; // SPIFFS does not replace an existing file
+    return ::rename(fs_path(from).c_str(), fs_path(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) { return ::mkdir(fs_path(path).c_str(), 0755) == 0 || errno == EEXIST; }
+bool FS::rmdir(const char *path) { return ::rmdir(fs_path(path).c_str()) == 0; }
+
+} // namespace fs
+
+bool SPIFFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+    struct stat st;
+    if (stat(fs_root.c_str(), &st) == 0)
+        return S_ISDIR(st.st_mode);
+    return formatOnFail && ::mkdir(fs_root.c_str(), 0755) == 0;
+}
+
+static void remove_tree(const std::string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *entry = readdir(d))
+    {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        std::string child = dir + "/" + entry->d_name;
+        if (entry->d_type == DT_DIR)
+        {
+            remove_tree(child);
+            ::rmdir(child.c_str());
+        }
+        else
+            unlink(child.c_str());
+    }
+    closedir(d);
+}
+
+bool SPIFFSFS::format()
+{
+    remove_tree(fs_root);
+    return true;
+}
+
+size_t SPIFFSFS::totalBytes() { return HOST_FS_SIZE; }
+
+static size_t used_bytes(const std::string &dir)
+{
+    size_t used = 0;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return 0;
+    while (struct dirent *entry = readdir(d))
+    {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        std::string child = dir + "/" + entry->d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0)
+            continue;
+        used += S_ISDIR(st.st_mode) ? used_bytes(child) : st.st_size;
+    }
+    closedir(d);
+    return used;
+}
+
+size_t SPIFFSFS::usedBytes() { return used_bytes(fs_root); }
+
+// ---------------------------------------------------------------- Preferences
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    std::string nvs = fs_root + ".nvs";
+    ::mkdir(nvs.c_str(), 0755);
+    dir_ = nvs + "/" + name;
+    readOnly_ = readOnly;
+    return ::mkdir(dir_.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+    FILE *f = dir_.empty() ? NULL : fopen((dir_ + "/" + key).c_str(), "r");
+    if (!f)
+        return defaultValue;
+    unsigned long value;
+    if (fscanf(f, "%lu", &value) != 1)
+        value = defaultValue;
+    fclose(f);
+    return value;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    FILE *f = dir_.empty() || readOnly_ ? NULL : fopen((dir_ + "/" + key).c_str(), "w");
+    if (!f)
+        return 0;
+    fprintf(f, "%lu\n", (unsigned long)value);
+    fclose(f);
+    return sizeof(value);
+}
+
+bool Preferences::remove(const char *key)
+{
+    return !dir_.empty() && !readOnly_ && unlink((dir_ + "/" + key).c_str()) == 0;
+}
@@ -0,0 +1,547 @@
+// Arduino core, FreeRTOS and ESP-IDF pieces of the host build
+
+#include "host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "LiquidCrystal.h"
+#include "Ticker.h"
+#include "esp_task_wdt.h"
+
+// ---------------------------------------------------------------- clock
+
+static std::atomic<uint64_t> clock_us{0};
+static double clock_speed = 0; // 0: virtual clock, else firmware seconds per host second
+static uint64_t loop_period_us = 0;
+static uint64_t loop_started_us = 0;
+static const std::chrono::steady_clock::time_point clock_start = std::chrono::steady_clock::now();
+static const time_t clock_epoch = time(NULL);
+static const std::thread::id loop_thread = std::this_thread::get_id();
+
+static uint64_t wdt_timeout_us = 0; // 0: loop watchdog off
+static bool wdt_loop = false;
+static uint64_t wdt_fed_us = 0;
+
+uint64_t host_loops = 0;
+
+static void wdt_check(uint64_t now)
+{
+    if (wdt_loop && wdt_timeout_us && now - wdt_fed_us > wdt_timeout_us)
+    {
+        fprintf(stderr, "E (%llu) task_wdt: loopTask did not reset the watchdog in %llu ms (loop %llu)\n",
+                (unsigned long long)(now / 1000), (unsigned long long)(wdt_timeout_us / 1000),
+                (unsigned long long)host_loops);
+        fflush(NULL);
+        _exit(4);
+    }
+}
+
+uint64_t host_now_us()
+{
+    if (clock_speed > 0)
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - clock_start).count() * clock_speed;
+    uint64_t now = clock_us.fetch_add(HOST_CLOCK_TICK_US, std::memory_order_relaxed) + HOST_CLOCK_TICK_US;
+    if (std::this_thread::get_id() == loop_thread)
+        wdt_check(now);
+    return now;
+}
+
+void host_advance_us(uint64_t us)
+{
+    if (clock_speed > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us / clock_speed));
+    else
+        clock_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+void host_clock_realtime(bool realtime) { clock_speed = realtime ? 1 : 0; }
+void host_clock_speed(double speed) { clock_speed = speed > 0 ? speed : 0; }
+bool host_clock_is_realtime() { return clock_speed > 0; }
+void host_loop_period(uint32_t us) { loop_period_us = us; }
+uint32_t host_epoch() { return clock_epoch + host_now_us() / 1000000; }
+
+unsigned long millis() { return host_now_us() / 1000; }
+unsigned long micros() { return host_now_us(); }
+
+void delay(uint32_t ms)
+{
+    if (std::this_thread::get_id() != loop_thread)
+    {
+        vTaskDelay(ms);
+        return;
+    }
+    host_advance_us((uint64_t)ms * 1000);
+    host_tickers_run();
+}
+
+void delayMicroseconds(uint32_t us) { host_advance_us(us); }
+void yield() { std::this_thread::yield(); }
+
+void host_loop_begin()
+{
+    if (loop_period_us)
+    {
+        uint64_t elapsed = host_now_us() - loop_started_us;
+        if (elapsed < loop_period_us)
+            host_advance_us(loop_period_us - elapsed);
+        loop_started_us = host_now_us();
+    }
+    wdt_fed_us = host_now_us();
+    host_tickers_run();
+    host_loops++;
+}
+
+// ---------------------------------------------------------------- board
+
+uint8_t host_gpio[40];
+uint16_t host_analog[40] = {
+    4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095,
+    4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095, 4095};
+uint32_t host_gpio_writes[40];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < 40)
+    {
+        host_gpio[pin] = value ? HIGH : LOW;
+        host_gpio_writes[pin]++;
+    }
+}
+
+int digitalRead(uint8_t pin) { return pin < 40 ? host_gpio[pin] : LOW; }
+uint16_t analogRead(uint8_t pin) { return pin < 40 ? host_analog[pin] : 0; }
+
+long random(long max) { return max > 0 ? ::random() % max : 0; }
+long random(long min, long max) { return min < max ? min + random(max - min) : min; }
+void randomSeed(unsigned long seed) { srandom(seed); }
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void enableLoopWDT()
+{
+    wdt_loop = true;
+    wdt_fed_us = host_now_us();
+}
+void disableLoopWDT() { wdt_loop = false; }
+void feedLoopWDT() { wdt_fed_us = host_now_us(); }
+
+static esp_reset_reason_t reset_reason = ESP_RST_POWERON;
+
+void host_set_reset_reason(esp_reset_reason_t reason) { reset_reason = reason; }
+esp_reset_reason_t esp_reset_reason() { return reset_reason; }
+
+void esp_restart()
+{
+    printf("\nrestart requested after %llu loops\n", (unsigned long long)host_loops);
+    fflush(NULL);
+    _exit(3); // the supervisor decides whether to boot again
+}
+
+uint32_t esp_get_free_heap_size() { return ESP.getFreeHeap(); }
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config)
+{
+    wdt_timeout_us = (uint64_t)config->timeout_ms * 1000;
+    return ESP_OK;
+}
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config) { return esp_task_wdt_init(config); }
+esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+esp_err_t esp_task_wdt_delete(TaskHandle_t task) { return ESP_OK; }
+esp_err_t esp_task_wdt_reset()
+{
+    feedLoopWDT();
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------- ESP
+
+EspClass ESP;
+
+static uint8_t host_mac[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+
+void host_set_mac(const uint8_t mac[6]) { memcpy(host_mac, mac, 6); }
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+    memcpy(mac, host_mac, 6);
+    return mac;
+}
+
+String WiFiClass::macAddress()
+{
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", host_mac[0], host_mac[1], host_mac[2], host_mac[3],
+             host_mac[4], host_mac[5]);
+    return String(buf);
+}
+
+void EspClass::restart() { esp_restart(); }
+
+// the chip has ~300 KB; report that minus what the process has in use,
+// so leaks show up in the heap gauges the same way
+static const uint32_t heap_size = 320 * 1024;
+static uint32_t heap_min = heap_size;
+
+uint32_t EspClass::getFreeHeap()
+{
+    struct mallinfo2 info = mallinfo2();
+    uint32_t used = info.uordblks > heap_size ? heap_size : info.uordblks;
+    uint32_t free = heap_size - used;
+    if (free < heap_min)
+        heap_min = free;
+    return free;
+}
+uint32_t EspClass::getMinFreeHeap()
+{
+    getFreeHeap();
+    return heap_min;
+}
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap() * 3 / 4; }
+uint64_t EspClass::getEfuseMac()
+{
+    uint64_t mac = 0;
+    for (int i = 5; i >= 0; i--)
+        mac = mac << 8 | host_mac[i];
+    return mac;
+}
+
+// ---------------------------------------------------------------- serial
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rx, int8_t tx)
+{
+    baud_ = baud;
+}
+
+bool HardwareSerial::attach(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Serial%d: %s: %s\n", uart_, path, strerror(errno));
+        return false;
+    }
+    if (isatty(fd))
+    {
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+    rfd_ = wfd_ = fd;
+    return true;
+}
+
+bool HardwareSerial::fill()
+{
+    if (head_ < tail_)
+        return true;
+    if (rfd_ < 0)
+        return false;
+    ssize_t n = ::read(rfd_, buf_, sizeof(buf_));
+    if (n <= 0)
+        return false;
+    head_ = 0;
+    tail_ = n;
+    return true;
+}
+
+int HardwareSerial::available()
+{
+    if (!fill())
+        return 0;
+    int pending = 0;
+    if (ioctl(rfd_, FIONREAD, &pending) < 0)
+        pending = 0;
+    return tail_ - head_ + pending;
+}
+
+int HardwareSerial::read() { return fill() ? buf_[head_++] : -1; }
+int HardwareSerial::peek() { return fill() ? buf_[head_] : -1; }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (wfd_ < 0)
+        return size; // nothing on the pins
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = ::write(wfd_, buffer + done, size - done);
+        if (n < 0 && errno == EAGAIN)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+// ---------------------------------------------------------------- FreeRTOS
+
+namespace
+{
+struct TaskExit // thrown by vTaskDelete(NULL), caught at the bottom of the thread
+{
+};
+} // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    std::thread([task, arg]() {
+        try
+        {
+            task(arg);
+        }
+        catch (TaskExit &)
+        {
+        }
+    }).detach();
+    if (handle)
+        *handle = NULL;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(task, name, stack, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (std::this_thread::get_id() == loop_thread)
+    {
+        delay(ticks);
+        return;
+    }
+    if (clock_speed > 0)
+    {
+        host_advance_us((uint64_t)ticks * 1000);
+        return;
+    }
+    // background tasks follow the virtual clock, checking it every real
+    // millisecond; a task that only yields (ticks 0 or 1) still sleeps once
+    uint64_t until = clock_us.load(std::memory_order_relaxed) + (uint64_t)ticks * 1000;
+    do
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    while (clock_us.load(std::memory_order_relaxed) < until);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL)
+        throw TaskExit();
+}
+
+TickType_t xTaskGetTickCount() { return millis(); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static thread_local char task; // its address names the thread
+    return &task;
+}
+
+struct HostQueue
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length, item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    HostQueue *queue = new HostQueue;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+static bool queue_wait(HostQueue *queue, std::unique_lock<std::mutex> &held, TickType_t wait,
+                       const std::function<bool()> &ready)
+{
+    if (ready())
+        return true;
+    if (wait == 0)
+        return false;
+    if (wait == portMAX_DELAY)
+    {
+        queue->changed.wait(held, ready);
+        return true;
+    }
+    return queue->changed.wait_for(held, std::chrono::milliseconds(wait), ready);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    std::unique_lock<std::mutex> held(queue->lock);
+    if (!queue_wait(queue, held, wait, [queue]() { return queue->items.size() < queue->length; }))
+        return pdFALSE;
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    std::unique_lock<std::mutex> held(queue->lock);
+    if (!queue_wait(queue, held, wait, [queue]() { return !queue->items.empty(); }))
+        return pdFALSE;
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> held(queue->lock);
+    return queue->items.size();
+}
+
+struct HostMutex
+{
+    std::timed_mutex lock;
+    std::atomic<TaskHandle_t> holder{nullptr};
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new HostMutex; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait)
+{
+    bool taken;
+    if (wait == portMAX_DELAY)
+    {
+        mutex->lock.lock();
+        taken = true;
+    }
+    else
+        taken = mutex->lock.try_lock_for(std::chrono::milliseconds(wait));
+    if (taken)
+        mutex->holder = xTaskGetCurrentTaskHandle();
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    if (mutex->holder != xTaskGetCurrentTaskHandle()) // FreeRTOS: only the holder gives a mutex
+        return pdFALSE;
+    mutex->holder = nullptr;
+    mutex->lock.unlock();
+    return pdTRUE;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t mutex) { return mutex->holder; }
+
+// ---------------------------------------------------------------- Ticker
+
+static Ticker *tickers = nullptr;
+
+Ticker::Ticker()
+{
+    next_ = tickers;
+    tickers = this;
+}
+
+Ticker::~Ticker()
+{
+    for (Ticker **t = &tickers; *t; t = &(*t)->next_)
+        if (*t == this)
+        {
+            *t = next_;
+            break;
+        }
+}
+
+void Ticker::attach_ms(uint32_t ms, callback_t cb)
+{
+    cb_ = cb;
+    period_us_ = (uint64_t)ms * 1000;
+    next_us_ = host_now_us() + period_us_;
+}
+
+void Ticker::once_ms(uint32_t ms, callback_t cb)
+{
+    cb_ = cb;
+    period_us_ = 0;
+    next_us_ = host_now_us() + (uint64_t)ms * 1000;
+}
+
+void Ticker::run(uint64_t now_us)
+{
+    if (!cb_ || now_us < next_us_)
+        return;
+    callback_t cb = cb_;
+    if (period_us_)
+        next_us_ += ((now_us - next_us_) / period_us_ + 1) * period_us_; // missed periods are skipped, as with esp_timer
+    else
+        cb_ = nullptr;
+    cb();
+}
+
+void host_tickers_run()
+{
+    uint64_t now = host_now_us();
+    for (Ticker *t = tickers; t; t = t->next_)
+        t->run(now);
+}
+
+// ---------------------------------------------------------------- LCD
+
+LiquidCrystal *host_lcd = nullptr;
+
+LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3)
+{
+    clear();
+    host_lcd = this;
+}
+
+void LiquidCrystal::clear()
+{
+    for (auto &row : text_)
+    {
+        memset(row, ' ', sizeof(row) - 1);
+        row[sizeof(row) - 1] = 0;
+    }
+    col_ = row_ = 0;
+}
+
+size_t LiquidCrystal::write(uint8_t c)
+{
+    if (row_ < rows_ && col_ < cols_)
+        text_[row_][col_] = c;
+    col_++;
+    return 1;
+}
+
+String LiquidCrystal::line(uint8_t row) const
+{
+    return row < rows_ ? String(text_[row], cols_) : String();
+}
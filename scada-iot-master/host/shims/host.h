@@ -0,0 +1,68 @@
+#pragma once
+
+// Controls of the host build that have no Arduino equivalent: the clock,
+// the simulated board (GPIO, MAC, reset reason, WiFi link), and in-process
+// HTTP requests against the firmware's AsyncWebServer routes.
+
+#include <stdint.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "ESPAsyncWebServer.h"
+#include "WiFi.h"
+
+// Virtual clock (default). Time only moves when the firmware looks at it:
+// every millis()/micros() call costs HOST_CLOCK_TICK_US, delay() jumps
+// ahead, so busy-wait timeouts expire and loop() runs as fast as the CPU
+// allows. Realtime mode reads the host monotonic clock instead, scaled
+// by host_clock_speed() (2: the firmware sees two seconds per host second).
+#define HOST_CLOCK_TICK_US 1
+
+uint64_t host_now_us();
+void host_advance_us(uint64_t us);
+void host_clock_realtime(bool realtime);
+void host_clock_speed(double speed); // realtime at speed x, 0 goes back to the virtual clock
+bool host_clock_is_realtime();
+
+// wall-clock seconds (UNIX epoch) that NTP replies carry: host time at
+// start plus the virtual time elapsed since
+uint32_t host_epoch();
+
+// the runner calls host_loop_begin() before each loop() pass: it feeds the
+// loop watchdog and fires due Ticker callbacks
+void host_loop_begin();
+extern uint64_t host_loops; // loop() passes so far
+
+// host_loop_begin() waits until loop() passes start at least this many
+// firmware microseconds apart, 0 (default) spins like the chip. A paced
+// loop lets many realtime instances share the host's cores.
+void host_loop_period(uint32_t us);
+
+// simulated board
+extern uint8_t host_gpio[40];      // digitalWrite() / digitalRead()
+extern uint16_t host_analog[40];   // analogRead(), 4095 by default (buttons released)
+extern uint32_t host_gpio_writes[40];
+void host_set_mac(const uint8_t mac[6]);
+void host_set_reset_reason(esp_reset_reason_t reason);
+void host_set_rolled_back(bool on); // the other OTA slot holds an image that failed its health check
+void host_map_add(const char *name, IPAddress ip); // hostname override for WiFiClient
+void host_fs_root(const char *dir);
+
+// in-process HTTP
+struct HostHttpResponse
+{
+    int code = 0;
+    String type;
+    std::vector<std::pair<String, String>> headers;
+    String body;
+};
+
+void host_server(AsyncWebServer *server); // the one host_http() talks to, set by its constructor
+HostHttpResponse host_http(WebRequestMethod method, const String &url, const String &body = String(),
+                           const std::vector<std::pair<String, String>> &headers = {});
+void host_events_connect(AsyncEventSource &source); // one more SSE client
+
+// AsyncServer listens on its port plus this offset, so port 502 needs no
+// root; host_async_tcp_poll() is one pass of the async_tcp thread
+void host_port_offset(int offset);
+void host_async_tcp_poll(int wait_ms);
@@ -0,0 +1,31 @@
+#pragma once
+
+// No public-key crypto on the host: keys fail to parse, so signed OTA
+// images are always rejected.
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE -0x3980
+
+typedef enum
+{
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6
+} mbedtls_md_type_t;
+
+typedef struct
+{
+    void *pk_info;
+} mbedtls_pk_context;
+
+inline void mbedtls_pk_init(mbedtls_pk_context *ctx) { ctx->pk_info = NULL; }
+inline void mbedtls_pk_free(mbedtls_pk_context *ctx) {}
+inline int mbedtls_pk_parse_public_key(mbedtls_pk_context *ctx, const unsigned char *key, size_t keylen)
+{
+    return MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE;
+}
+inline int mbedtls_pk_verify(mbedtls_pk_context *ctx, mbedtls_md_type_t md_alg, const unsigned char *hash,
+                             size_t hash_len, const unsigned char *sig, size_t sig_len)
+{
+    return MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE;
+}
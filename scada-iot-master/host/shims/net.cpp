@@ -0,0 +1,266 @@
+// WiFi, TCP client, UDP (NTP) and mDNS of the host build
+
+#include "host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "ESPmDNS.h"
+#include "WiFiUdp.h"
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+static wl_status_t wifi_status = WL_CONNECTED;
+
+void host_wifi_set_status(wl_status_t status) { wifi_status = status; }
+
+wl_status_t WiFiClass::status() { return mode_ & WIFI_STA ? wifi_status : WL_DISCONNECTED; }
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password)
+{
+    mode_ = (wifi_mode_t)(mode_ | WIFI_STA);
+    return status();
+}
+
+bool WiFiClass::disconnect(bool wifioff)
+{
+    if (wifioff)
+        mode_ = (wifi_mode_t)(mode_ & ~WIFI_STA);
+    return true;
+}
+
+bool WiFiClass::reconnect() { return status() == WL_CONNECTED; }
+
+IPAddress WiFiClass::localIP() { return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress(); }
+
+// ---------------------------------------------------------------- resolver
+
+static std::mutex host_map_lock;
+static std::map<std::string, uint32_t> host_map;
+
+void host_map_add(const char *name, IPAddress ip)
+{
+    std::lock_guard<std::mutex> held(host_map_lock);
+    host_map[name] = ip;
+}
+
+bool host_resolve(const char *host, IPAddress &ip)
+{
+    {
+        std::lock_guard<std::mutex> held(host_map_lock);
+        auto mapped = host_map.find(host);
+        if (mapped != host_map.end())
+        {
+            ip = mapped->second;
+            return true;
+        }
+    }
+    if (ip.fromString(host))
+        return true;
+    struct addrinfo hints = {}, *found = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found)
+        return false;
+    ip = ((struct sockaddr_in *)found->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(found);
+    return true;
+}
+
+// ---------------------------------------------------------------- TCP
+
+#define WIFI_CLIENT_CONNECT_MS 3000 // real time, the broker is on the host network
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    if (WiFi.status() != WL_CONNECTED || !host_resolve(host, ip))
+        return 0;
+    return connect(ip, port);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    if (WiFi.status() != WL_CONNECTED)
+        return 0;
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+        return 0;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = ip;
+    if (::connect(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        stop();
+        return 0;
+    }
+    struct pollfd pending = {fd_, POLLOUT, 0};
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (poll(&pending, 1, WIFI_CLIENT_CONNECT_MS) != 1 || getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error)
+    {
+        stop();
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    remote_ = ip;
+    closed_ = false;
+    head_ = tail_ = 0;
+    return 1;
+}
+
+bool WiFiClient::fill()
+{
+    if (head_ < tail_)
+        return true;
+    if (fd_ < 0 || closed_)
+        return false;
+    ssize_t n = recv(fd_, buf_, sizeof(buf_), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+        closed_ = true;
+    if (n <= 0)
+        return false;
+    head_ = 0;
+    tail_ = n;
+    return true;
+}
+
+int WiFiClient::available()
+{
+    fill();
+    return tail_ - head_;
+}
+
+int WiFiClient::read() { return fill() ? buf_[head_++] : -1; }
+int WiFiClient::peek() { return fill() ? buf_[head_] : -1; }
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+    if (!fill())
+        return -1;
+    size_t n = std::min(size, tail_ - head_);
+    memcpy(buffer, buf_ + head_, n);
+    head_ += n;
+    return n;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+    size_t done = 0;
+    while (fd_ >= 0 && !closed_ && done < size)
+    {
+        ssize_t n = send(fd_, buffer + done, size - done, MSG_NOSIGNAL);
+        if (n > 0)
+            done += n;
+        else if (errno == EAGAIN)
+        {
+            struct pollfd pending = {fd_, POLLOUT, 0};
+            poll(&pending, 1, 100);
+        }
+        else if (errno != EINTR)
+            closed_ = true;
+    }
+    return done;
+}
+
+void WiFiClient::stop()
+{
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+    closed_ = true;
+    head_ = tail_ = 0;
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (head_ < tail_)
+        return 1;
+    if (fd_ < 0 || closed_)
+        return 0;
+    fill(); // notices an orderly close from the peer
+    return head_ < tail_ || !closed_;
+}
+
+// ---------------------------------------------------------------- UDP
+
+#define NTP_PORT 123
+#define NTP_PACKET_SIZE 48
+#define NTP_UNIX_OFFSET 2208988800ul // 1900 -> 1970
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    remote_ = ip;
+    port_ = port;
+    tx_.clear();
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    host_resolve(host, ip);
+    return beginPacket(ip, port);
+}
+
+size_t WiFiUDP::write(uint8_t c)
+{
+    tx_.push_back(c);
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    tx_.insert(tx_.end(), buffer, buffer + size);
+    return size;
+}
+
+int WiFiUDP::endPacket()
+{
+    if (WiFi.status() != WL_CONNECTED)
+        return 0;
+    if (port_ == NTP_PORT && tx_.size() >= NTP_PACKET_SIZE)
+    { // server mode, stratum 2, transmit timestamp = now
+        pending_.assign(NTP_PACKET_SIZE, 0);
+        pending_[0] = 0x24;
+        pending_[1] = 2;
+        uint32_t seconds = host_epoch() + NTP_UNIX_OFFSET;
+        for (int i = 0; i < 4; i++)
+        {
+            pending_[32 + i] = seconds >> (24 - 8 * i); // receive timestamp
+            pending_[40 + i] = seconds >> (24 - 8 * i); // transmit timestamp
+        }
+    }
+    tx_.clear();
+    return 1;
+}
+
+int WiFiUDP::parsePacket()
+{
+    rx_.swap(pending_);
+    pending_.clear();
+    pos_ = 0;
+    return rx_.size();
+}
+
+int WiFiUDP::read(unsigned char *buffer, size_t len)
+{
+    size_t n = std::min(len, rx_.size() - pos_);
+    memcpy(buffer, rx_.data() + pos_, n);
+    pos_ += n;
+    return n;
+}
@@ -0,0 +1,160 @@
+// OTA side of the host build: partitions, SHA-256 and CRC-32
+
+#include "host.h"
+
+#include "HTTPClient.h"
+#include "Update.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+#include "rom/crc.h"
+
+UpdateClass Update;
+
+// ---------------------------------------------------------------- partitions
+
+static const esp_partition_t app_partition = {0x10000, 1024 * 1024, "app0"};
+
+const esp_partition_t *esp_ota_get_running_partition() { return &app_partition; }
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() { return ESP_OK; }
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot()
+{
+    esp_restart();
+    return ESP_FAIL;
+}
+
+static const esp_partition_t other_partition = {0x110000, 1024 * 1024, "app1"};
+static bool rolled_back = false;
+
+void host_set_rolled_back(bool on) { rolled_back = on; }
+
+// esp-idf keeps returning the failed slot until an update overwrites it
+const esp_partition_t *esp_ota_get_last_invalid_partition() { return rolled_back ? &other_partition : NULL; }
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > partition->size)
+        return ESP_ERR_INVALID_STATE;
+    uint8_t *out = (uint8_t *)dst;
+    for (size_t i = 0; i < size; i++)
+    {
+        uint32_t x = (src_offset + i) * 2654435761u; // stable bytes, no storage
+        out[i] = x >> 24;
+    }
+    if (src_offset == 0 && size)
+        out[0] = 0xE9; // app image magic
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256)
+{
+    mbedtls_sha256_context sha;
+    uint8_t buffer[1024];
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    for (uint32_t offset = 0; offset < partition->size; offset += sizeof(buffer))
+    {
+        esp_partition_read(partition, offset, buffer, sizeof(buffer));
+        mbedtls_sha256_update_ret(&sha, buffer, sizeof(buffer));
+    }
+    mbedtls_sha256_finish_ret(&sha, sha_256);
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------- CRC-32
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++)
+            crc = crc >> 1 ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// ---------------------------------------------------------------- SHA-256
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t ror(uint32_t x, int n) { return x >> n | x << (32 - n); }
+
+static void sha256_block(mbedtls_sha256_context *ctx, const uint8_t *p)
+{
+    uint32_t w[64], s[8];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++)
+        w[i] = w[i - 16] + (ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ w[i - 15] >> 3) + w[i - 7] +
+               (ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ w[i - 2] >> 10);
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = s[7] + (ror(s[4], 6) ^ ror(s[4], 11) ^ ror(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ror(s[0], 2) ^ ror(s[0], 13) ^ ror(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, 7 * sizeof(uint32_t));
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+        ctx->state[i] += s[i];
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    while (ilen)
+    {
+        size_t used = ctx->total % 64;
+        size_t n = std::min(ilen, 64 - used);
+        memcpy(ctx->buffer + used, input, n);
+        ctx->total += n;
+        input += n;
+        ilen -= n;
+        if (used + n == 64)
+            sha256_block(ctx, ctx->buffer);
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad[72] = {0x80};
+    size_t padlen = (ctx->total % 64 < 56 ? 56 : 120) - ctx->total % 64;
+    for (int i = 0; i < 8; i++)
+        pad[padlen + i] = bits >> (56 - 8 * i);
+    mbedtls_sha256_update_ret(ctx, pad, padlen + 8);
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 4; j++)
+            output[4 * i + j] = ctx->state[i] >> (24 - 8 * j);
+    return 0;
+}
@@ -0,0 +1,262 @@
+// AsyncTCP servers and clients of the host build, driven by one poll() thread
+
+#include "host.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AsyncTCP.h"
+
+#define HOST_TCP_POLL_MS 10
+#define HOST_TCP_WRITE_WAIT_MS 1000 // a peer that reads nothing for this long loses the rest
+
+static std::mutex tcp_lock; // the lists only; never held across a callback
+static std::vector<AsyncServer *> tcp_servers;
+static std::vector<AsyncClient *> tcp_clients;
+static int tcp_port_offset = 0;
+
+void host_port_offset(int offset) { tcp_port_offset = offset; }
+
+static uint64_t real_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool registered(AsyncClient *client)
+{
+    return std::find(tcp_clients.begin(), tcp_clients.end(), client) != tcp_clients.end();
+}
+
+static void unregister(AsyncClient *client)
+{
+    std::lock_guard<std::mutex> guard(tcp_lock);
+    tcp_clients.erase(std::remove(tcp_clients.begin(), tcp_clients.end(), client), tcp_clients.end());
+}
+
+// ---------------------------------------------------------------- client
+
+AsyncClient::AsyncClient(int fd) : fd_(fd)
+{
+    if (fd_ < 0)
+        return;
+    last_rx_ms_ = real_ms();
+    std::lock_guard<std::mutex> guard(tcp_lock);
+    tcp_clients.push_back(this);
+}
+
+AsyncClient::~AsyncClient()
+{
+    unregister(this);
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+static IPAddress socket_ip(int fd, bool peer, uint16_t *port)
+{
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || (peer ? getpeername(fd, (struct sockaddr *)&addr, &len) : getsockname(fd, (struct sockaddr *)&addr, &len)) < 0)
+    {
+        *port = 0;
+        return IPAddress(127, 0, 0, 1);
+    }
+    *port = ntohs(addr.sin_port);
+    return IPAddress((uint32_t)addr.sin_addr.s_addr);
+}
+
+IPAddress AsyncClient::localIP()
+{
+    uint16_t port;
+    return socket_ip(fd_, false, &port);
+}
+
+IPAddress AsyncClient::remoteIP()
+{
+    uint16_t port;
+    return socket_ip(fd_, true, &port);
+}
+
+uint16_t AsyncClient::localPort()
+{
+    uint16_t port;
+    socket_ip(fd_, false, &port);
+    return fd_ < 0 ? 80 : port;
+}
+
+uint16_t AsyncClient::remotePort()
+{
+    uint16_t port;
+    socket_ip(fd_, true, &port);
+    return port;
+}
+
+size_t AsyncClient::write(const char *data, size_t size, uint8_t apiflags)
+{
+    size_t done = 0;
+    while (connected() && done < size)
+    {
+        ssize_t n = ::send(fd_, data + done, size - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            done += n;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN)
+        {
+            struct pollfd p = {fd_, POLLOUT, 0};
+            if (poll(&p, 1, HOST_TCP_WRITE_WAIT_MS) > 0)
+                continue;
+        }
+        break;
+    }
+    return done;
+}
+
+void AsyncClient::close(bool now)
+{
+    if (connected()) // the poll thread sees the end of the stream and calls onDisconnect
+        shutdown(fd_, SHUT_RDWR);
+}
+
+void AsyncClient::setNoDelay(bool nodelay)
+{
+    int one = nodelay;
+    if (fd_ >= 0)
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// ---------------------------------------------------------------- server
+
+void AsyncServer::begin()
+{
+    if (fd_ >= 0)
+        return;
+    int port = port_ + tcp_port_offset;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        fprintf(stderr, "AsyncServer: port %d: %s (see --port-offset)\n", port, strerror(errno));
+        ::close(fd);
+        return;
+    }
+    fd_ = fd;
+    std::lock_guard<std::mutex> guard(tcp_lock);
+    tcp_servers.push_back(this);
+    static bool started = false;
+    if (!started)
+    {
+        started = true;
+        std::thread([] {
+            for (;;)
+                host_async_tcp_poll(HOST_TCP_POLL_MS);
+        }).detach();
+    }
+}
+
+void AsyncServer::end()
+{
+    if (fd_ < 0)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(tcp_lock);
+        tcp_servers.erase(std::remove(tcp_servers.begin(), tcp_servers.end(), this), tcp_servers.end());
+    }
+    ::close(fd_);
+    fd_ = -1;
+}
+
+// ---------------------------------------------------------------- async_tcp
+
+void host_async_tcp_poll(int wait_ms)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<void *> owners; // AsyncServer* for the first `servers`, then AsyncClient*
+    size_t servers;
+    {
+        std::lock_guard<std::mutex> guard(tcp_lock);
+        for (AsyncServer *s : tcp_servers)
+        {
+            fds.push_back({s->fd_, POLLIN, 0});
+            owners.push_back(s);
+        }
+        servers = fds.size();
+        for (AsyncClient *c : tcp_clients)
+            if (!c->closed_)
+            {
+                fds.push_back({c->fd_, POLLIN, 0});
+                owners.push_back(c);
+            }
+    }
+    if (poll(fds.data(), fds.size(), wait_ms) < 0)
+        return;
+
+    for (size_t i = 0; i < servers; i++)
+    {
+        if (!(fds[i].revents & POLLIN))
+            continue;
+        AsyncServer *server = (AsyncServer *)owners[i];
+        int fd;
+        while ((fd = accept4(fds[i].fd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+        {
+            AsyncClient *client = new AsyncClient(fd);
+            client->setNoDelay(server->nodelay_);
+            if (server->client_cb_)
+                server->client_cb_(server->client_arg_, client);
+            else
+                delete client;
+        }
+    }
+
+    uint64_t now = real_ms();
+    for (size_t i = servers; i < fds.size(); i++)
+    {
+        AsyncClient *client = (AsyncClient *)owners[i];
+        {
+            std::lock_guard<std::mutex> guard(tcp_lock); // freed by its owner since the snapshot?
+            if (!registered(client))
+                continue;
+        }
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            uint8_t buffer[1460];
+            ssize_t n = recv(client->fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n > 0)
+            {
+                client->last_rx_ms_ = now;
+                if (client->data_cb_)
+                    client->data_cb_(client->data_arg_, client, buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN)
+                continue;
+            // gone: unregister first, the callback may delete the client
+            client->closed_ = true;
+            unregister(client);
+            if (client->disconnect_cb_)
+                client->disconnect_cb_(client->disconnect_arg_, client);
+            continue;
+        }
+        if (client->rx_timeout_ && now - client->last_rx_ms_ > client->rx_timeout_ * 1000ull)
+        {
+            client->last_rx_ms_ = now;
+            if (client->timeout_cb_)
+                client->timeout_cb_(client->timeout_arg_, client, now);
+        }
+    }
+}
@@ -0,0 +1,281 @@
+// AsyncWebServer routes driven in-process by host_http()
+
+#include "host.h"
+
+#include <algorithm>
+
+static AsyncWebServer *host_web = nullptr;
+
+void host_server(AsyncWebServer *server) { host_web = server; }
+
+// ---------------------------------------------------------------- responses
+
+size_t AsyncBasicResponse::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t n = std::min(maxLen, (size_t)content_.length() - sent_);
+    memcpy(buffer, content_.c_str() + sent_, n);
+    sent_ += n;
+    return n;
+}
+
+size_t AsyncCallbackResponse::fill(uint8_t *buffer, size_t maxLen)
+{
+    if (!chunked_)
+    {
+        if (sent_ >= length_)
+            return 0;
+        maxLen = std::min(maxLen, length_ - sent_); // as the library does: never past Content-Length
+    }
+    size_t n = filler_(buffer, maxLen, sent_);
+    if (n != RESPONSE_TRY_AGAIN)
+        sent_ += n;
+    return n;
+}
+
+AsyncFileResponse::AsyncFileResponse(fs::FS &fs, const String &path, const String &type, bool download)
+{
+    file_ = fs.open(path, "r");
+    if (!file_)
+        code_ = 404;
+    type_ = type;
+    if (download)
+    {
+        int slash = path.lastIndexOf('/');
+        addHeader("Content-Disposition", "attachment; filename=\"" + path.substring(slash + 1) + "\"");
+    }
+}
+
+size_t AsyncFileResponse::fill(uint8_t *buffer, size_t maxLen) { return file_ ? file_.read(buffer, maxLen) : 0; }
+
+size_t AsyncResponseStream::fill(uint8_t *buffer, size_t maxLen)
+{
+    size_t n = std::min(maxLen, (size_t)content_.length() - sent_);
+    memcpy(buffer, content_.c_str() + sent_, n);
+    sent_ += n;
+    return n;
+}
+
+// ---------------------------------------------------------------- request
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static String url_decode(const String &s)
+{
+    String out;
+    for (unsigned int i = 0; i < s.length(); i++)
+    {
+        char c = s[i];
+        if (c == '+')
+            c = ' ';
+        else if (c == '%' && i + 2 < s.length() && hex_digit(s[i + 1]) >= 0 && hex_digit(s[i + 2]) >= 0)
+        {
+            c = hex_digit(s[i + 1]) << 4 | hex_digit(s[i + 2]);
+            i += 2;
+        }
+        out += c;
+    }
+    return out;
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(WebRequestMethod method, const String &url) : method_(method)
+{
+    int query = url.indexOf('?');
+    url_ = url_decode(query < 0 ? url : url.substring(0, query));
+    if (query < 0)
+        return;
+    String rest = url.substring(query + 1);
+    while (rest.length())
+    {
+        int amp = rest.indexOf('&');
+        String pair = amp < 0 ? rest : rest.substring(0, amp);
+        rest = amp < 0 ? String() : rest.substring(amp + 1);
+        int eq = pair.indexOf('=');
+        if (pair.length())
+            addArg(url_decode(eq < 0 ? pair : pair.substring(0, eq)), url_decode(eq < 0 ? String() : pair.substring(eq + 1)));
+    }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() { free(_tempObject); }
+
+bool AsyncWebServerRequest::hasArg(const char *name) const
+{
+    for (auto &a : args_)
+        if (a.first == name)
+            return true;
+    return false;
+}
+
+const String &AsyncWebServerRequest::arg(const char *name) const
+{
+    static const String empty;
+    for (auto &a : args_)
+        if (a.first == name)
+            return a.second;
+    return empty;
+}
+
+bool AsyncWebServerRequest::hasHeader(const char *name) const
+{
+    for (auto &h : headers_)
+        if (h.first.equalsIgnoreCase(name))
+            return true;
+    return false;
+}
+
+const String &AsyncWebServerRequest::header(const char *name) const
+{
+    static const String empty;
+    for (auto &h : headers_)
+        if (h.first.equalsIgnoreCase(name))
+            return h.second;
+    return empty;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    if (response_) // the library ignores a second answer the same way
+    {
+        delete response;
+        return;
+    }
+    response_.reset(response);
+}
+
+void AsyncWebServerRequest::redirect(const String &url, int code)
+{
+    AsyncWebServerResponse *response = beginResponse(code);
+    response->addHeader("Location", url);
+    send(response);
+}
+
+// ---------------------------------------------------------------- handlers
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request)
+{
+    if (!(method_ & request->method()))
+        return false;
+    if (uri_.length() == 0 || uri_ == request->url())
+        return true;
+    if (uri_.endsWith("/*")) // "/*" and "/dir/*"
+        return request->url().startsWith(uri_.substring(0, uri_.length() - 1));
+    if (uri_.endsWith("*"))
+        return request->url().startsWith(uri_.substring(0, uri_.length() - 1));
+    return request->url().startsWith(uri_ + "/"); // the library treats "/a" as a prefix of "/a/b"
+}
+
+void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect)
+{
+    sent += clients_;
+    sent_bytes += (uint64_t)clients_ * strlen(message);
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest *request)
+{
+    clients_++;
+    if (connect_)
+    {
+        AsyncEventSourceClient client;
+        connect_(&client);
+    }
+    request->send(200, "text/event-stream", "");
+}
+
+void host_events_connect(AsyncEventSource &source)
+{
+    AsyncWebServerRequest request(HTTP_GET, "");
+    source.handleRequest(&request);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload,
+                                            ArBodyHandlerFunction onBody)
+{
+    AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest, onUpload, onBody);
+    owned_.push_back(handler);
+    addHandler(handler);
+    host_server(this);
+    return *handler;
+}
+
+AsyncWebServer::~AsyncWebServer()
+{
+    for (AsyncCallbackWebHandler *handler : owned_)
+        delete handler;
+}
+
+#define HOST_HTTP_CHUNK 1436 // one TCP segment of body, like async_tcp
+
+void AsyncWebServer::handle(AsyncWebServerRequest *request)
+{
+    for (AsyncWebHandler *handler : handlers_)
+    {
+        if (!handler->canHandle(request))
+            continue;
+        const String &body = request->body();
+        for (size_t index = 0; index < body.length(); index += HOST_HTTP_CHUNK)
+        {
+            size_t len = std::min((size_t)HOST_HTTP_CHUNK, body.length() - index);
+            handler->handleBody(request, (uint8_t *)body.c_str() + index, len, index, body.length());
+        }
+        handler->handleRequest(request);
+        return;
+    }
+    if (notFound_)
+        notFound_(request);
+    else
+        request->send(404);
+}
+
+// ---------------------------------------------------------------- host_http
+
+#define HOST_HTTP_TRIES 100000 // loop() passes a deferred answer may take
+
+HostHttpResponse host_http(WebRequestMethod method, const String &url, const String &body,
+                           const std::vector<std::pair<String, String>> &headers)
+{
+    HostHttpResponse result;
+    if (!host_web)
+        return result;
+    AsyncWebServerRequest request(method, url);
+    for (auto &h : headers)
+        request.addRequestHeader(h.first, h.second);
+    request.setBody(body);
+    host_web->handle(&request);
+
+    AsyncWebServerResponse *response = request.response();
+    for (uint32_t tries = 0; !response && tries < HOST_HTTP_TRIES; tries++)
+    { // handler left the answer to loop()
+        host_loop_begin();
+        loop();
+        response = request.response();
+    }
+    if (!response)
+        return result;
+
+    result.code = response->code();
+    result.type = response->contentType();
+    result.headers = response->headers();
+    uint8_t buffer[HOST_HTTP_CHUNK];
+    for (uint32_t tries = 0; tries < HOST_HTTP_TRIES;)
+    {
+        size_t n = response->fill(buffer, sizeof(buffer));
+        if (n == RESPONSE_TRY_AGAIN)
+        { // the async_tcp task would come back later; meanwhile loop() runs
+            host_loop_begin();
+            loop();
+            tries++;
+            continue;
+        }
+        if (n == 0)
+            break;
+        result.body.concat((const char *)buffer, n);
+    }
+    request.disconnected();
+    return result;
+}
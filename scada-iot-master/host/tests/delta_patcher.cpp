@@ -0,0 +1,129 @@
+// DeltaPatcher against patches made by fastapi-scada/app/utils/delta.py:
+// every sample pair (tests/delta_samples.py there) must come out byte for
+// byte whatever size the patch arrives in, and a cut or damaged patch must
+// never report a finished image.
+//
+//   test_delta_patcher DIR   (DIR holds NAME.old, NAME.new, NAME.sdp)
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "DeltaPatcher.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Images
+{
+    const Bytes *old;
+    Bytes out;
+};
+
+static bool read_old(void *context, uint32_t offset, uint8_t *buffer, size_t size)
+{
+    const Bytes &old = *static_cast<Images *>(context)->old;
+    if (offset > old.size() || size > old.size() - offset)
+        return false;
+    memcpy(buffer, old.data() + offset, size);
+    return true;
+}
+
+static bool write_new(void *context, const uint8_t *data, size_t size)
+{
+    Bytes &out = static_cast<Images *>(context)->out;
+    out.insert(out.end(), data, data + size);
+    return true;
+}
+
+static bool load(const std::string &path, Bytes &bytes)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// feeds patch in chunks of chunk bytes, returns the patcher's verdict
+static bool apply(const Bytes &old, const Bytes &patch, size_t chunk, Bytes &out, const char **error)
+{
+    Images images = {&old, Bytes()};
+    DeltaPatcher patcher(read_old, write_new, &images);
+    for (size_t at = 0; at < patch.size(); at += chunk)
+        if (!patcher.write(patch.data() + at, std::min(chunk, patch.size() - at)))
+            break;
+    out = images.out;
+    *error = patcher.getError();
+    return patcher.isFinished() && patcher.getProduced() == patcher.getNewSize();
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char *name, const char *what, size_t chunk, const char *error)
+{
+    if (ok)
+        return;
+    fprintf(stderr, "%s: %s (chunks of %zu, error %s)\n", name, what, chunk, error ? error : "none");
+    failures++;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s DIR\n", argv[0]);
+        return 2;
+    }
+    static const char *names[] = {"version", "insert", "remove", "rebuild", "same", "empty"};
+    static const size_t chunks[] = {1, 3, 255, 256, 257, 1460, 1 << 20};
+
+    for (const char *name : names)
+    {
+        std::string base = std::string(argv[1]) + "/" + name;
+        Bytes old, expected, patch, out;
+        if (!load(base + ".old", old) || !load(base + ".new", expected) || !load(base + ".sdp", patch))
+        {
+            fprintf(stderr, "%s: missing sample files in %s\n", name, argv[1]);
+            return 1;
+        }
+
+        const char *error;
+        for (size_t chunk : chunks)
+        {
+            bool finished = apply(old, patch, chunk, out, &error);
+            check(finished, name, "not finished", chunk, error);
+            check(out == expected, name, "wrong image", chunk, error);
+        }
+
+        // cut anywhere: never finished, never more than the new image
+        for (size_t cut : {size_t(0), DeltaPatcher::headerSize - 1, patch.size() / 2, patch.size() - 1})
+        {
+            if (cut >= patch.size() || expected.empty())
+                continue;
+            Bytes part(patch.begin(), patch.begin() + cut);
+            check(!apply(old, part, 256, out, &error), name, "cut patch finished", 256, error);
+            check(out.size() <= expected.size(), name, "cut patch wrote too much", 256, error);
+        }
+
+        Bytes bad = patch;
+        bad[0] = 'X';
+        check(!apply(old, bad, 256, out, &error) && out.empty(), name, "bad magic accepted", 256, error);
+
+        // an old image shorter than the patch expects, for the pairs that copy from all of it
+        if (strcmp(name, "rebuild") && strcmp(name, "empty"))
+        {
+            Bytes shorter(old.begin(), old.begin() + old.size() / 2);
+            check(!apply(shorter, patch, 256, out, &error), name, "short old image accepted", 256, error);
+        }
+    }
+
+    if (failures)
+        return 1;
+    printf("delta_patcher: %zu sample patches applied\n", sizeof(names) / sizeof(names[0]));
+    return 0;
+}
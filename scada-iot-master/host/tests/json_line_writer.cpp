@@ -0,0 +1,117 @@
+// JsonLineWriter must write data.json byte for byte as the four
+// String::replace passes of the old format_Json did, so files written by
+// earlier firmware and by this one stay interchangeable.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "Wifi_BaoTran97.h" // fileFS.h with the log and LED macros it uses
+
+void setup() {}
+void loop() {}
+void cmd_available(String data) {}
+
+// format_Json as it was before JsonLineWriter
+static String format_Json(String data)
+{
+    data.replace("{", "{\r\n");
+    data.replace("}", "\r\n}");
+    data.replace("},\"", "},\r\n\r\n\"");
+    data.replace(",\"", ",\r\n\"");
+    return data;
+}
+
+struct StringPrint : Print
+{
+    String text;
+    size_t write(uint8_t c) override
+    {
+        text += (char)c;
+        return 1;
+    }
+};
+
+// strings with the characters the writer reacts to
+static String random_string()
+{
+    static const char alphabet[] = "ab{},\":[] 0\\";
+    String s;
+    for (long n = random(0, 8); n > 0; n--)
+        s += alphabet[random(0, sizeof(alphabet) - 1)];
+    return s;
+}
+
+static void fill(JsonObject object, int depth);
+
+static void fill_array(JsonArray array, int depth)
+{
+    for (long n = random(0, 4); n > 0; n--)
+    {
+        switch (random(0, depth ? 4 : 3))
+        {
+        case 0: array.add(random(-1000, 1000)); break;
+        case 1: array.add(random_string()); break;
+        case 2: array.add(random(0, 2) ? 2.5 : 0.125); break;
+        default: fill(array.createNestedObject(), depth - 1); break;
+        }
+    }
+}
+
+static void fill(JsonObject object, int depth)
+{
+    for (long n = random(0, 6); n > 0; n--)
+    {
+        String key = random_string() + String(n);
+        switch (random(0, depth ? 6 : 4))
+        {
+        case 0: object[key] = random(-100000, 100000); break;
+        case 1: object[key] = random_string(); break;
+        case 2: object[key] = random(0, 2) == 1; break;
+        case 3: object[key] = 10.877990546921161; break;
+        case 4: fill_array(object.createNestedArray(key), depth - 1); break;
+        default: fill(object.createNestedObject(key), depth - 1); break;
+        }
+    }
+}
+
+static int compare(JsonDocument &doc, int round)
+{
+    String plain;
+    serializeJson(doc, plain);
+
+    StringPrint out;
+    {
+        JsonLineWriter writer(out);
+        serializeJson(doc, writer);
+    }
+
+    String expected = format_Json(plain);
+    if (out.text != expected)
+    {
+        fprintf(stderr, "document %d: %s\nexpected: %s\nwritten:  %s\n", round, plain.c_str(), expected.c_str(), out.text.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    DynamicJsonDocument doc(8192);
+
+    // the shape of data.json
+    deserializeJson(doc, "{\"gps_lat\":10.87799055,\"gps_log\":106.8019705,\"auto\":0,\"toggle\":1,"
+                         "\"power_D19\":{\"2024\":1.5,\"x\":[1,2]},\"total_energy\":300}");
+    if (compare(doc, -1))
+        return 1;
+
+    randomSeed(29);
+    for (int round = 0; round < 20000; round++)
+    {
+        doc.clear();
+        fill(doc.to<JsonObject>(), 3);
+        if (compare(doc, round))
+            return 1;
+    }
+    printf("json_line_writer: 20001 documents match format_Json\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+// The meter registers power_meter.h keeps in modbus_cache must outlive the
+// Modbus TCP gateway's reads on the same bus: after the largest reads a
+// client can make (2000 coils, 2000 discrete inputs, 125 holding or input
+// registers at a time), read(METER_MAX_AGE) still finds all 60 of them.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "Wifi_BaoTran97.h" // the metrics and log macros power_meter.h uses
+#include "Modbus.h"
+#include "ModbusCache.h"
+
+void setup() {}
+void loop() {}
+void cmd_available(String data) {}
+
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    while (length--)
+    {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? crc >> 1 ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+// Modbus RTU slave on the other end of Serial2, every value a function of
+// its table and address; answers at once
+struct FakeSlave : Stream
+{
+    uint8_t request[8];
+    size_t received = 0;
+    uint8_t reply[5 + 250];
+    size_t length = 0, sent = 0;
+
+    static uint16_t value(uint8_t table, uint16_t address)
+    {
+        return table <= Discret_Register ? (address * 7 >> 2 ^ table) & 1 : (uint16_t)(table << 12 ^ address * 3);
+    }
+
+    void answer()
+    {
+        uint8_t table = request[1];
+        uint16_t address = request[2] << 8 | request[3], count = request[4] << 8 | request[5];
+        reply[0] = request[0];
+        reply[1] = table;
+        length = 3;
+        if (table <= Discret_Register)
+        {
+            memset(reply + 3, 0, (count + 7) / 8);
+            for (uint16_t i = 0; i < count; i++)
+                reply[3 + i / 8] |= value(table, address + i) << (i % 8);
+            length += (count + 7) / 8;
+        }
+        else
+            for (uint16_t i = 0; i < count; i++)
+            {
+                uint16_t v = value(table, address + i);
+                reply[length++] = v >> 8;
+                reply[length++] = v;
+            }
+        reply[2] = length - 3;
+        uint16_t crc = crc16(reply, length);
+        reply[length++] = crc;
+        reply[length++] = crc >> 8;
+        sent = 0;
+    }
+
+    size_t write(uint8_t c) override
+    {
+        request[received++] = c;
+        if (received == sizeof(request))
+        {
+            answer();
+            received = 0;
+        }
+        return 1;
+    }
+    int available() override { return length - sent; }
+    int read() override { return sent < length ? reply[sent++] : -1; }
+    int peek() override { return sent < length ? reply[sent] : -1; }
+};
+
+FakeSlave meter_bus;
+Modbus modbus(meter_bus);
+ModbusCache modbus_cache;
+DynamicJsonDocument JsonData(4096);
+
+#define SIMULATE_POWER_METER false
+#include "power_meter.h"
+
+// what gateway_bus_read() does with a read it forwards
+static bool gateway_read(uint8_t table, uint16_t address, uint16_t count)
+{
+    if (modbus.requestFrom(METER_SLAVE, table, address, count) <= 0)
+        return false;
+    modbus_cache.store(modbus, METER_SLAVE, table, address, count, millis());
+    return true;
+}
+
+static int check_meter(Power_meter &meter, int round)
+{
+    if (!meter.read(METER_MAX_AGE))
+    {
+        fprintf(stderr, "round %d: meter registers evicted by gateway reads\n", round);
+        return 1;
+    }
+    uint16_t reg[METER_REGISTERS];
+    if (!modbus_cache.getRange(METER_SLAVE, Input_Register, 0x00, METER_REGISTERS, METER_MAX_AGE, reg, millis()))
+        return 1;
+    for (uint16_t i = 0; i < METER_REGISTERS; i++)
+        if (reg[i] != FakeSlave::value(Input_Register, i))
+        {
+            fprintf(stderr, "round %d: meter register %u is %u, not %u\n", round, i, reg[i], FakeSlave::value(Input_Register, i));
+            return 1;
+        }
+    if (JsonData["voltage"].as<double>() != FakeSlave::value(Input_Register, 0) / 10.0)
+    {
+        fprintf(stderr, "round %d: voltage %s\n", round, JsonData["voltage"].as<String>().c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    Power_meter meter;
+    delay(METER_POLL_MS);
+    if (!meter.poll() || check_meter(meter, -1))
+        return 1;
+
+    // an HMI reading everything, the meter's own registers included, between two polls
+    randomSeed(50);
+    for (int round = 0; round < 200; round++)
+    {
+        bool ok = gateway_read(Input_Register, 0, 125) &&
+                  gateway_read(Coil_Register, random(0, 0x10000 - 2000), 2000) &&
+                  gateway_read(Discret_Register, random(0, 0x10000 - 2000), 2000) &&
+                  gateway_read(Holding_Register, random(0, 0x10000 - 250), 125) &&
+                  gateway_read(Holding_Register, random(0, 0x10000 - 250), 125);
+        if (!ok)
+        {
+            fprintf(stderr, "round %d: gateway read failed\n", round);
+            return 1;
+        }
+        if (check_meter(meter, round))
+            return 1;
+        delay(METER_POLL_MS);
+        meter.poll();
+    }
+    printf("meter_cache: meter registers kept through 200 rounds of gateway reads\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#include <ArduinoJson.h>
+#include <catch.hpp>
+
+#include <string>
+
+TEST_CASE("JsonDocument::compact()") {
+  StaticJsonDocument<1024> doc;
+
+  SECTION("empty document") {
+    REQUIRE(doc.compact() == 0);
+    REQUIRE(doc.memoryUsage() == 0);
+    REQUIRE(doc.isNull());
+  }
+
+  SECTION("nothing to reclaim") {
+    deserializeJson(doc, "{\"hello\":\"world\",\"answer\":[4,2]}");
+    size_t usage = doc.memoryUsage();
+
+    REQUIRE(doc.compact() == 0);
+
+    REQUIRE(doc.memoryUsage() == usage);
+    REQUIRE(doc.as<std::string>() == "{\"hello\":\"world\",\"answer\":[4,2]}");
+  }
+
+  SECTION("removed member") {
+    deserializeJson(doc, "{\"blanket\":1,\"dancing\":2}");
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(2) + 16);
+    doc.remove("blanket");
+
+    REQUIRE(doc.compact() == JSON_OBJECT_SIZE(1) + 8);
+
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(1) + 8);
+    REQUIRE(doc.as<std::string>() == "{\"dancing\":2}");
+  }
+
+  SECTION("removed element") {
+    deserializeJson(doc, "[\"alpha\",\"bravo\",\"charlie\"]");
+    doc.remove(0);
+    doc.remove(1);
+
+    doc.compact();
+
+    REQUIRE(doc.memoryUsage() == JSON_ARRAY_SIZE(1) + 6);
+    REQUIRE(doc.as<std::string>() == "[\"bravo\"]");
+  }
+
+  SECTION("replaced string value") {
+    doc["status"] = std::string("starting");
+    doc["status"] = std::string("running");
+    doc["status"] = std::string("idle");
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(1) + 9 + 8 + 5);
+
+    doc.compact();
+
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(1) + 5);
+    REQUIRE(doc.as<std::string>() == "{\"status\":\"idle\"}");
+  }
+
+  SECTION("nested collections") {
+    deserializeJson(doc,
+                    "{\"a\":{\"x\":[1,2,3],\"y\":\"yy\"},\"b\":[{\"z\":\"zz\"}],"
+                    "\"c\":true}");
+    doc["a"].remove("x");
+    doc["b"][0]["z"] = std::string("zzz");
+    doc.remove("c");
+
+    doc.compact();
+
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(5) + 2 + 2 + 2 + 3 + 2 + 4);
+    REQUIRE(doc.as<std::string>() ==
+            "{\"a\":{\"y\":\"yy\"},\"b\":[{\"z\":\"zzz\"}]}");
+
+    // the document is still usable after the move
+    doc["b"].add(4);
+    doc["a"]["w"] = std::string("ww");
+    REQUIRE(doc.as<std::string>() ==
+            "{\"a\":{\"y\":\"yy\",\"w\":\"ww\"},\"b\":[{\"z\":\"zzz\"},4]}");
+  }
+
+  SECTION("deduplicated strings") {
+    deserializeJson(doc, "[{\"id\":\"id\"},{\"id\":\"id\"},{\"x\":0}]");
+    doc.remove(0);
+
+    doc.compact();
+
+    REQUIRE(doc.as<std::string>() == "[{\"id\":\"id\"},{\"x\":0}]");
+    REQUIRE(doc.memoryUsage() ==
+            JSON_ARRAY_SIZE(2) + JSON_OBJECT_SIZE(2) + 3 + 2);
+  }
+
+  SECTION("owned raw value") {
+    doc["raw"] = serialized(std::string("[1,2]"));
+    doc["tmp"] = std::string("garbage");
+    doc.remove("tmp");
+    doc["raw"] = serialized(std::string("[3,4]"));
+
+    doc.compact();
+
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(1) + 6);
+    REQUIRE(doc.as<std::string>() == "{\"raw\":[3,4]}");
+  }
+
+  SECTION("linked strings are left alone") {
+    doc["linked"] = "value";
+    doc["owned"] = std::string("value");
+    doc.remove("owned");
+
+    doc.compact();
+
+    REQUIRE(doc.memoryUsage() == JSON_OBJECT_SIZE(1));
+    REQUIRE(doc.as<std::string>() == "{\"linked\":\"value\"}");
+  }
+
+  SECTION("idempotent") {
+    deserializeJson(doc, "{\"a\":1,\"b\":\"bb\",\"c\":[1,2]}");
+    doc.remove("a");
+    doc["c"].remove(0);
+
+    doc.compact();
+    size_t usage = doc.memoryUsage();
+
+    REQUIRE(doc.compact() == 0);
+    REQUIRE(doc.memoryUsage() == usage);
+    REQUIRE(doc.as<std::string>() == "{\"b\":\"bb\",\"c\":[2]}");
+  }
+
+  SECTION("resets overflowed()") {
+    StaticJsonDocument<JSON_ARRAY_SIZE(1)> small;
+    small.add(0);
+    small.add(0);
+    REQUIRE(small.overflowed() == true);
+
+    small.compact();
+
+    REQUIRE(small.overflowed() == false);
+  }
+
+  SECTION("works with DynamicJsonDocument") {
+    DynamicJsonDocument dyn(4096);
+    deserializeJson(dyn, "{\"blanket\":1,\"dancing\":2}");
+    dyn.remove("blanket");
+
+    dyn.compact();
+
+    REQUIRE(dyn.capacity() == 4096);
+    REQUIRE(dyn.memoryUsage() == JSON_OBJECT_SIZE(1) + 8);
+    REQUIRE(dyn.as<std::string>() == "{\"dancing\":2}");
+  }
+}
+
+// Replays the mutation pattern of a long-lived document (energy counters keyed
+// by day and month, schedule updated from string payloads, raw config replaced
+// every hour) for a month of one-minute ticks in a fixed 4 KB pool.
+TEST_CASE("JsonDocument::compact() soak") {
+  StaticJsonDocument<4096> doc;
+  deserializeJson(doc,
+                  "{\"auto\":0,\"toggle\":0,\"hour_on\":18,\"minute_on\":0,"
+                  "\"hour_off\":6,\"minute_off\":0,\"total_energy\":0}");
+  size_t peak = 0;
+
+  for (int minute = 0; minute < 31 * 24 * 60; minute++) {
+    int day = minute / (24 * 60) + 1;
+    double energy = minute * 0.01;
+
+    doc["total_energy"] = energy;
+    doc[std::string("power_D") + std::to_string(day)] = doc["total_energy"];
+    doc[std::string("power_M") + std::to_string(1)] = doc["total_energy"];
+
+    if (minute % 15 == 0) {  // schedule command with string values
+      doc["hour_on"] = std::to_string(17 + minute % 3);
+      doc["minute_on"] = std::to_string(minute % 60);
+      doc["status"] = std::string(minute % 2 ? "on" : "off");
+    }
+
+    if (minute % 60 == 0) {  // whole state pushed from the web page
+      doc["config"] = serialized(std::string("{\"rev\":") +
+                                 std::to_string(minute) + "}");
+    }
+
+    if (doc.memoryUsage() > doc.capacity() * 3 / 4)
+      doc.compact();
+
+    REQUIRE(doc.overflowed() == false);
+    if (doc.memoryUsage() > peak)
+      peak = doc.memoryUsage();
+  }
+
+  REQUIRE(doc.size() == 7 + 31 + 1 + 2);
+  REQUIRE(doc["power_D31"] == doc["total_energy"]);
+  REQUIRE(peak <= doc.capacity());
+}
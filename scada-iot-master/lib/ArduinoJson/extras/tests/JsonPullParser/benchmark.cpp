@@ -0,0 +1,60 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#include <ArduinoJson.h>
+
+#include <catch.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Run with: JsonPullParserTests "[.benchmark]"
+TEST_CASE("JsonPullParser vs deserializeJson()", "[.benchmark]") {
+  std::string input = "[";
+  for (int i = 0; i < 2000; i++) {
+    if (i)
+      input += ",";
+    input += "{\"id\":" + std::to_string(i) + ",\"name\":\"sensor-" +
+             std::to_string(i) + "\",\"value\":" + std::to_string(i % 100) +
+             ".5}";
+  }
+  input += "]";
+
+  const int rounds = 200;
+  typedef std::chrono::steady_clock clock;
+  double sum1 = 0, sum2 = 0;
+
+  clock::time_point start = clock::now();
+  for (int r = 0; r < rounds; r++) {
+    DynamicJsonDocument doc(512 * 1024);
+    deserializeJson(doc, input);
+    for (JsonObject obj : doc.as<JsonArray>())
+      sum1 += obj["value"].as<double>();
+  }
+  clock::duration domTime = clock::now() - start;
+
+  start = clock::now();
+  for (int r = 0; r < rounds; r++) {
+    JsonPullParser<const char*, 32> parser(input.c_str());
+    for (JsonEvent::Type e = parser.next(); e != JsonEvent::End;
+         e = parser.next()) {
+      REQUIRE(e != JsonEvent::Error);
+      if (e == JsonEvent::Value && parser.key() == "value")
+        sum2 += parser.value().as<double>();
+    }
+  }
+  clock::duration pullTime = clock::now() - start;
+
+  REQUIRE(sum1 == sum2);
+
+  using std::chrono::microseconds;
+  using std::chrono::duration_cast;
+  std::cout << "deserializeJson(): "
+            << duration_cast<microseconds>(domTime).count() / rounds
+            << " us, 512 KB pool\n"
+            << "JsonPullParser:    "
+            << duration_cast<microseconds>(pullTime).count() / rounds
+            << " us, " << sizeof(JsonPullParser<const char*, 32>)
+            << " bytes\n";
+}
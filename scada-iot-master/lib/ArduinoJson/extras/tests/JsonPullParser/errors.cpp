@@ -0,0 +1,85 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#include <ArduinoJson.h>
+
+#include <catch.hpp>
+#include <string>
+
+template <typename TParser>
+static DeserializationError drain(TParser& parser) {
+  for (;;) {
+    switch (parser.next()) {
+      case JsonEvent::End:
+        return DeserializationError::Ok;
+      case JsonEvent::Error:
+        REQUIRE(parser.next() == JsonEvent::Error);  // sticky
+        return parser.error();
+      default:
+        break;
+    }
+  }
+}
+
+static DeserializationError drain(const char* input) {
+  JsonPullParser<const char*> parser(input);
+  return drain(parser);
+}
+
+TEST_CASE("JsonPullParser errors") {
+  SECTION("EmptyInput") {
+    CHECK(drain("") == DeserializationError::EmptyInput);
+    CHECK(drain("  ") == DeserializationError::EmptyInput);
+  }
+
+  SECTION("IncompleteInput") {
+    CHECK(drain("[") == DeserializationError::IncompleteInput);
+    CHECK(drain("[1,") == DeserializationError::IncompleteInput);
+    CHECK(drain("{\"a\"") == DeserializationError::IncompleteInput);
+    CHECK(drain("{\"a\":") == DeserializationError::IncompleteInput);
+    CHECK(drain("\"abc") == DeserializationError::IncompleteInput);
+    CHECK(drain("tru") == DeserializationError::IncompleteInput);
+  }
+
+  SECTION("InvalidInput") {
+    CHECK(drain("[1 2]") == DeserializationError::InvalidInput);
+    CHECK(drain("{\"a\" 1}") == DeserializationError::InvalidInput);
+    CHECK(drain("{\"a\":1 \"b\":2}") == DeserializationError::InvalidInput);
+    CHECK(drain("[}") == DeserializationError::InvalidInput);
+    CHECK(drain("{]") == DeserializationError::InvalidInput);
+    CHECK(drain("[1,]") == DeserializationError::InvalidInput);
+  }
+
+  SECTION("NoMemory when a string exceeds the buffer") {
+    JsonPullParser<const char*, 8> parser("[\"1234567\",\"12345678\"]");
+    REQUIRE(parser.next() == JsonEvent::BeginArray);
+    REQUIRE(parser.next() == JsonEvent::Value);
+    REQUIRE(parser.value() == "1234567");
+    REQUIRE(parser.next() == JsonEvent::Error);
+    REQUIRE(parser.error() == DeserializationError::NoMemory);
+  }
+
+  SECTION("NoMemory when a key exceeds the buffer") {
+    JsonPullParser<const char*, 4> parser("{\"abcd\":1}");
+    CHECK(drain(parser) == DeserializationError::NoMemory);
+  }
+
+  SECTION("TooDeep") {
+    JsonPullParser<const char*> p1("[[[]]]",
+                                   DeserializationOption::NestingLimit(2));
+    CHECK(drain(p1) == DeserializationError::TooDeep);
+
+    JsonPullParser<const char*> p2("[[[]]]",
+                                   DeserializationOption::NestingLimit(3));
+    CHECK(drain(p2) == DeserializationError::Ok);
+  }
+
+  SECTION("depth is capped at 32") {
+    std::string deep(33, '[');
+    deep += std::string(33, ']');
+    JsonPullParser<const char*> parser(deep.c_str(),
+                                       DeserializationOption::NestingLimit(64));
+    CHECK(drain(parser) == DeserializationError::TooDeep);
+  }
+}
@@ -0,0 +1,125 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#include <ArduinoJson.h>
+
+#include <catch.hpp>
+#include <sstream>
+#include <string>
+
+// Replays the events as a compact text, e.g. {k:v,}
+static std::string trace(const char* input) {
+  JsonPullParser<const char*> parser(input);
+  std::string result;
+  for (;;) {
+    switch (parser.next()) {
+      case JsonEvent::BeginObject:
+        result += "{";
+        break;
+      case JsonEvent::EndObject:
+        result += "}";
+        break;
+      case JsonEvent::BeginArray:
+        result += "[";
+        break;
+      case JsonEvent::EndArray:
+        result += "]";
+        break;
+      case JsonEvent::Key:
+        result += parser.key().c_str();
+        result += ":";
+        break;
+      case JsonEvent::Value:
+        result += parser.value().as<std::string>();
+        result += ",";
+        break;
+      case JsonEvent::End:
+        return result;
+      case JsonEvent::Error:
+        return result + "!" + parser.error().c_str();
+    }
+  }
+}
+
+TEST_CASE("JsonPullParser events") {
+  SECTION("scalars") {
+    CHECK(trace("42") == "42,");
+    CHECK(trace("-3.5") == "-3.5,");
+    CHECK(trace("\"hello\"") == "hello,");
+    CHECK(trace("true") == "true,");
+    CHECK(trace("false") == "false,");
+    CHECK(trace("null") == "null,");
+  }
+
+  SECTION("empty collections") {
+    CHECK(trace("[]") == "[]");
+    CHECK(trace("{}") == "{}");
+    CHECK(trace(" [ ] ") == "[]");
+  }
+
+  SECTION("array") {
+    CHECK(trace("[1,\"two\",true,null]") == "[1,two,true,null,]");
+  }
+
+  SECTION("object") {
+    CHECK(trace("{\"a\":1,\"b\":\"bb\"}") == "{a:1,b:bb,}");
+  }
+
+  SECTION("nested") {
+    CHECK(trace("{\"a\":[{\"b\":[]},{}],\"c\":{\"d\":[1,[2]]}}") ==
+          "{a:[{b:[]}{}]c:{d:[1,[2,]]}}");
+  }
+
+  SECTION("spaces") {
+    CHECK(trace(" { \"a\" :\n\t1 , \"b\" : [ ] } ") == "{a:1,b:[]}");
+  }
+
+  SECTION("single quotes and escapes") {
+    CHECK(trace("['a\\tb','\\u00e9']") == "[a\tb,\xC3\xA9,]");
+  }
+
+  SECTION("stops after the root") {
+    CHECK(trace("{}{}") == "{}");
+    CHECK(trace("1 2") == "1,");
+  }
+}
+
+TEST_CASE("JsonPullParser accessors") {
+  JsonPullParser<const char*> parser("{\"key\":[\"value\",2]}");
+
+  REQUIRE(parser.depth() == 0);
+  REQUIRE(parser.next() == JsonEvent::BeginObject);
+  REQUIRE(parser.depth() == 1);
+  REQUIRE(parser.next() == JsonEvent::Key);
+  REQUIRE(parser.key() == "key");
+  REQUIRE(parser.next() == JsonEvent::BeginArray);
+  REQUIRE(parser.depth() == 2);
+  REQUIRE(parser.next() == JsonEvent::Value);
+  REQUIRE(parser.value().is<const char*>());
+  REQUIRE(parser.value() == "value");
+  REQUIRE(parser.key() == "key");  // still valid
+  REQUIRE(parser.next() == JsonEvent::Value);
+  REQUIRE(parser.value().as<int>() == 2);
+  REQUIRE(parser.next() == JsonEvent::EndArray);
+  REQUIRE(parser.depth() == 1);
+  REQUIRE(parser.next() == JsonEvent::EndObject);
+  REQUIRE(parser.depth() == 0);
+  REQUIRE(parser.next() == JsonEvent::End);
+  REQUIRE(parser.next() == JsonEvent::End);
+  REQUIRE(parser.error() == DeserializationError::Ok);
+}
+
+TEST_CASE("JsonPullParser<std::istream>") {
+  std::istringstream input("{\"a\":1} trailing");
+
+  JsonPullParser<std::istream> parser(input);
+  REQUIRE(parser.next() == JsonEvent::BeginObject);
+  REQUIRE(parser.next() == JsonEvent::Key);
+  REQUIRE(parser.next() == JsonEvent::Value);
+  REQUIRE(parser.next() == JsonEvent::EndObject);
+  REQUIRE(parser.next() == JsonEvent::End);
+
+  // doesn't consume more than needed
+  REQUIRE(input.get() == ' ');
+}
@@ -0,0 +1,161 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#include <ArduinoJson.h>
+
+#include <catch.hpp>
+#include <string>
+
+// Serializes the events back to JSON
+template <typename TParser>
+static std::string rebuild(TParser& parser) {
+  std::string result;
+  bool needComma = false;
+  for (;;) {
+    JsonEvent::Type event = parser.next();
+    bool closing = event == JsonEvent::EndObject ||
+                   event == JsonEvent::EndArray || event == JsonEvent::End;
+    if (needComma && !closing)
+      result += ",";
+    switch (event) {
+      case JsonEvent::BeginObject:
+        result += "{";
+        needComma = false;
+        break;
+      case JsonEvent::EndObject:
+        result += "}";
+        needComma = true;
+        break;
+      case JsonEvent::BeginArray:
+        result += "[";
+        needComma = false;
+        break;
+      case JsonEvent::EndArray:
+        result += "]";
+        needComma = true;
+        break;
+      case JsonEvent::Key: {
+        StaticJsonDocument<64> key;
+        key.set(parser.key());
+        serializeJson(key, result);
+        result += ":";
+        needComma = false;
+        break;
+      }
+      case JsonEvent::Value:
+        serializeJson(parser.value(), result);
+        needComma = true;
+        break;
+      case JsonEvent::End:
+        return result;
+      case JsonEvent::Error:
+        return parser.error().c_str();
+    }
+  }
+}
+
+// Produces [{"id":0,"name":"sensor-0","value":0.5,"ok":true},...] on the fly
+class GeneratedReader {
+ public:
+  GeneratedReader(int count) : count_(count), index_(-1), pos_(0) {
+    chunk_ = "[";
+  }
+
+  int read() {
+    if (pos_ >= chunk_.size() && !refill())
+      return -1;
+    return static_cast<unsigned char>(chunk_[pos_++]);
+  }
+
+  size_t readBytes(char* buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = read();
+      if (c < 0)
+        break;
+      buffer[n++] = static_cast<char>(c);
+    }
+    return n;
+  }
+
+ private:
+  bool refill() {
+    index_++;
+    pos_ = 0;
+    if (index_ > count_)
+      return false;
+    if (index_ == count_) {
+      chunk_ = "]";
+      return true;
+    }
+    std::string id = std::to_string(index_);
+    chunk_ = index_ ? "," : "";
+    chunk_ += "{\"id\":" + id + ",\"name\":\"sensor-" + id +
+              "\",\"value\":" + std::to_string(index_ % 100) +
+              ".5,\"ok\":" + (index_ % 2 ? "false" : "true") + "}";
+    return true;
+  }
+
+  int count_;
+  int index_;
+  size_t pos_;
+  std::string chunk_;
+};
+
+TEST_CASE("JsonPullParser matches deserializeJson()") {
+  const char* inputs[] = {
+      "{\"hello\":\"world\",\"answer\":42}",
+      "[1,-2,3.25,true,false,null,\"x\\ny\"]",
+      "{\"a\":{\"b\":{\"c\":[[],{},[{}]]}},\"d\":\"\\u00e9\"}",
+      " [ 1 , { \"k\" : [ \"v\" ] } ] ",
+      "{\"auto\":0,\"toggle\":1,\"hour_on\":18,\"minute_on\":30,"
+      "\"hour_off\":6,\"minute_off\":0,\"total_energy\":12.5}",
+  };
+
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    DynamicJsonDocument doc(4096);
+    REQUIRE(deserializeJson(doc, inputs[i]) == DeserializationError::Ok);
+    std::string expected;
+    serializeJson(doc, expected);
+
+    JsonPullParser<const char*> parser(inputs[i]);
+    CHECK(rebuild(parser) == expected);
+  }
+}
+
+TEST_CASE("JsonPullParser reads a large stream in constant memory") {
+  const int count = 100000;  // about 5 MB of JSON
+  GeneratedReader reader(count);
+  JsonPullParser<GeneratedReader, 16> parser(reader);
+
+  REQUIRE(parser.next() == JsonEvent::BeginArray);
+
+  int objects = 0;
+  long idSum = 0;
+  int okCount = 0;
+  for (;;) {
+    JsonEvent::Type event = parser.next();
+    if (event == JsonEvent::EndArray)
+      break;
+    REQUIRE(event == JsonEvent::BeginObject);
+    while ((event = parser.next()) == JsonEvent::Key) {
+      JsonString key = parser.key();
+      REQUIRE(parser.next() == JsonEvent::Value);
+      if (key == "id")
+        idSum += parser.value().as<long>();
+      else if (key == "ok" && parser.value().as<bool>())
+        okCount++;
+    }
+    REQUIRE(event == JsonEvent::EndObject);
+    objects++;
+  }
+
+  REQUIRE(parser.next() == JsonEvent::End);
+  REQUIRE(objects == count);
+  REQUIRE(idSum == long(count) * (count - 1) / 2);
+  REQUIRE(okCount == count / 2);
+
+  // the state is fixed, whatever the size of the input
+  CHECK(sizeof(parser) < 256);
+}
@@ -16,6 +16,8 @@ class VariantData;
 class VariantSlot;
 
 class CollectionData {
+  friend class PoolCompactor;
+
   VariantSlot* head_;
   VariantSlot* tail_;
 
@@ -6,6 +6,7 @@
 
 #include <ArduinoJson/Array/ElementProxy.hpp>
 #include <ArduinoJson/Memory/MemoryPool.hpp>
+#include <ArduinoJson/Memory/PoolCompactor.hpp>
 #include <ArduinoJson/Object/JsonObject.hpp>
 #include <ArduinoJson/Object/MemberProxy.hpp>
 #include <ArduinoJson/Strings/StoragePolicy.hpp>
@@ -82,6 +83,13 @@ class JsonDocument : public detail::VariantOperators<const JsonDocument&> {
     return variantNesting(&data_);
   }
 
+  // Reclaims the memory leaked when removing and replacing values.
+  // Unlike garbageCollect(), works in place: no temporary copy is made.
+  // Returns the number of bytes reclaimed.
+  size_t compact() {
+    return detail::PoolCompactor(&pool_, &data_).compact();
+  }
+
   // Returns the capacity of the memory pool.
   // https://arduinojson.org/v6/api/jsondocument/capacity/
   size_t capacity() const {
@@ -5,12 +5,8 @@
 #pragma once
 
 #include <ArduinoJson/Deserialization/deserialize.hpp>
-#include <ArduinoJson/Json/EscapeSequence.hpp>
-#include <ArduinoJson/Json/Latch.hpp>
-#include <ArduinoJson/Json/Utf16.hpp>
-#include <ArduinoJson/Json/Utf8.hpp>
+#include <ArduinoJson/Json/JsonTokenizer.hpp>
 #include <ArduinoJson/Memory/MemoryPool.hpp>
-#include <ArduinoJson/Numbers/parseNumber.hpp>
 #include <ArduinoJson/Polyfills/assert.hpp>
 #include <ArduinoJson/Polyfills/type_traits.hpp>
 #include <ArduinoJson/Polyfills/utility.hpp>
@@ -19,14 +15,26 @@
 ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
 
 template <typename TReader, typename TStringStorage>
-class JsonDeserializer {
+class JsonDeserializer : JsonTokenizer<TReader, TStringStorage> {
+  typedef JsonTokenizer<TReader, TStringStorage> tokenizer_type;
+  using tokenizer_type::current;
+  using tokenizer_type::eat;
+  using tokenizer_type::latch_;
+  using tokenizer_type::move;
+  using tokenizer_type::parseKey;
+  using tokenizer_type::parseNumericValue;
+  using tokenizer_type::parseQuotedString;
+  using tokenizer_type::skipKey;
+  using tokenizer_type::skipKeyword;
+  using tokenizer_type::skipNumericValue;
+  using tokenizer_type::skipQuotedString;
+  using tokenizer_type::skipSpacesAndComments;
+  using tokenizer_type::stringStorage_;
+
  public:
   JsonDeserializer(MemoryPool* pool, TReader reader,
                    TStringStorage stringStorage)
-      : stringStorage_(stringStorage),
-        foundSomething_(false),
-        latch_(reader),
-        pool_(pool) {}
+      : tokenizer_type(reader, stringStorage), pool_(pool) {}
 
   template <typename TFilter>
   DeserializationError parse(VariantData& variant, TFilter filter,
@@ -44,21 +52,6 @@ class JsonDeserializer {
   }
 
  private:
-  char current() {
-    return latch_.current();
-  }
-
-  void move() {
-    latch_.clear();
-  }
-
-  bool eat(char charToSkip) {
-    if (current() != charToSkip)
-      return false;
-    move();
-    return true;
-  }
-
   template <typename TFilter>
   DeserializationError::Code parseVariant(
       VariantData& variant, TFilter filter,
@@ -376,15 +369,6 @@ class JsonDeserializer {
     }
   }
 
-  DeserializationError::Code parseKey() {
-    stringStorage_.startString();
-    if (isQuote(current())) {
-      return parseQuotedString();
-    } else {
-      return parseNonQuotedString();
-    }
-  }
-
   DeserializationError::Code parseStringValue(VariantData& variant) {
     DeserializationError::Code err;
 
@@ -399,273 +383,7 @@ class JsonDeserializer {
     return DeserializationError::Ok;
   }
 
-  DeserializationError::Code parseQuotedString() {
-#if ARDUINOJSON_DECODE_UNICODE
-    Utf16::Codepoint codepoint;
-    DeserializationError::Code err;
-#endif
-    const char stopChar = current();
-
-    move();
-    for (;;) {
-      char c = current();
-      move();
-      if (c == stopChar)
-        break;
-
-      if (c == '\0')
-        return DeserializationError::IncompleteInput;
-
-      if (c == '\\') {
-        c = current();
-
-        if (c == '\0')
-          return DeserializationError::IncompleteInput;
-
-        if (c == 'u') {
-#if ARDUINOJSON_DECODE_UNICODE
-          move();
-          uint16_t codeunit;
-          err = parseHex4(codeunit);
-          if (err)
-            return err;
-          if (codepoint.append(codeunit))
-            Utf8::encodeCodepoint(codepoint.value(), stringStorage_);
-#else
-          stringStorage_.append('\\');
-#endif
-          continue;
-        }
-
-        // replace char
-        c = EscapeSequence::unescapeChar(c);
-        if (c == '\0')
-          return DeserializationError::InvalidInput;
-        move();
-      }
-
-      stringStorage_.append(c);
-    }
-
-    if (!stringStorage_.isValid())
-      return DeserializationError::NoMemory;
-
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code parseNonQuotedString() {
-    char c = current();
-    ARDUINOJSON_ASSERT(c);
-
-    if (canBeInNonQuotedString(c)) {  // no quotes
-      do {
-        move();
-        stringStorage_.append(c);
-        c = current();
-      } while (canBeInNonQuotedString(c));
-    } else {
-      return DeserializationError::InvalidInput;
-    }
-
-    if (!stringStorage_.isValid())
-      return DeserializationError::NoMemory;
-
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code skipKey() {
-    if (isQuote(current())) {
-      return skipQuotedString();
-    } else {
-      return skipNonQuotedString();
-    }
-  }
-
-  DeserializationError::Code skipQuotedString() {
-    const char stopChar = current();
-
-    move();
-    for (;;) {
-      char c = current();
-      move();
-      if (c == stopChar)
-        break;
-      if (c == '\0')
-        return DeserializationError::IncompleteInput;
-      if (c == '\\') {
-        if (current() != '\0')
-          move();
-      }
-    }
-
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code skipNonQuotedString() {
-    char c = current();
-    while (canBeInNonQuotedString(c)) {
-      move();
-      c = current();
-    }
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code parseNumericValue(VariantData& result) {
-    uint8_t n = 0;
-
-    char c = current();
-    while (canBeInNumber(c) && n < 63) {
-      move();
-      buffer_[n++] = c;
-      c = current();
-    }
-    buffer_[n] = 0;
-
-    if (!parseNumber(buffer_, result))
-      return DeserializationError::InvalidInput;
-
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code skipNumericValue() {
-    char c = current();
-    while (canBeInNumber(c)) {
-      move();
-      c = current();
-    }
-    return DeserializationError::Ok;
-  }
-
-  DeserializationError::Code parseHex4(uint16_t& result) {
-    result = 0;
-    for (uint8_t i = 0; i < 4; ++i) {
-      char digit = current();
-      if (!digit)
-        return DeserializationError::IncompleteInput;
-      uint8_t value = decodeHex(digit);
-      if (value > 0x0F)
-        return DeserializationError::InvalidInput;
-      result = uint16_t((result << 4) | value);
-      move();
-    }
-    return DeserializationError::Ok;
-  }
-
-  static inline bool isBetween(char c, char min, char max) {
-    return min <= c && c <= max;
-  }
-
-  static inline bool canBeInNumber(char c) {
-    return isBetween(c, '0', '9') || c == '+' || c == '-' || c == '.' ||
-#if ARDUINOJSON_ENABLE_NAN || ARDUINOJSON_ENABLE_INFINITY
-           isBetween(c, 'A', 'Z') || isBetween(c, 'a', 'z');
-#else
-           c == 'e' || c == 'E';
-#endif
-  }
-
-  static inline bool canBeInNonQuotedString(char c) {
-    return isBetween(c, '0', '9') || isBetween(c, '_', 'z') ||
-           isBetween(c, 'A', 'Z');
-  }
-
-  static inline bool isQuote(char c) {
-    return c == '\'' || c == '\"';
-  }
-
-  static inline uint8_t decodeHex(char c) {
-    if (c < 'A')
-      return uint8_t(c - '0');
-    c = char(c & ~0x20);  // uppercase
-    return uint8_t(c - 'A' + 10);
-  }
-
-  DeserializationError::Code skipSpacesAndComments() {
-    for (;;) {
-      switch (current()) {
-        // end of string
-        case '\0':
-          return foundSomething_ ? DeserializationError::IncompleteInput
-                                 : DeserializationError::EmptyInput;
-
-        // spaces
-        case ' ':
-        case '\t':
-        case '\r':
-        case '\n':
-          move();
-          continue;
-
-#if ARDUINOJSON_ENABLE_COMMENTS
-        // comments
-        case '/':
-          move();  // skip '/'
-          switch (current()) {
-            // block comment
-            case '*': {
-              move();  // skip '*'
-              bool wasStar = false;
-              for (;;) {
-                char c = current();
-                if (c == '\0')
-                  return DeserializationError::IncompleteInput;
-                if (c == '/' && wasStar) {
-                  move();
-                  break;
-                }
-                wasStar = c == '*';
-                move();
-              }
-              break;
-            }
-
-            // trailing comment
-            case '/':
-              // no need to skip "//"
-              for (;;) {
-                move();
-                char c = current();
-                if (c == '\0')
-                  return DeserializationError::IncompleteInput;
-                if (c == '\n')
-                  break;
-              }
-              break;
-
-            // not a comment, just a '/'
-            default:
-              return DeserializationError::InvalidInput;
-          }
-          break;
-#endif
-
-        default:
-          foundSomething_ = true;
-          return DeserializationError::Ok;
-      }
-    }
-  }
-
-  DeserializationError::Code skipKeyword(const char* s) {
-    while (*s) {
-      char c = current();
-      if (c == '\0')
-        return DeserializationError::IncompleteInput;
-      if (*s != c)
-        return DeserializationError::InvalidInput;
-      ++s;
-      move();
-    }
-    return DeserializationError::Ok;
-  }
-
-  TStringStorage stringStorage_;
-  bool foundSomething_;
-  Latch<TReader> latch_;
   MemoryPool* pool_;
-  char buffer_[64];  // using a member instead of a local variable because it
-                     // ended in the recursive path after compiler inlined the
-                     // code
 };
 
 ARDUINOJSON_END_PRIVATE_NAMESPACE
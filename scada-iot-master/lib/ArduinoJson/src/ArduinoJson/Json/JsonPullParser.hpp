@@ -0,0 +1,294 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#pragma once
+
+#include <ArduinoJson/Deserialization/DeserializationError.hpp>
+#include <ArduinoJson/Deserialization/NestingLimit.hpp>
+#include <ArduinoJson/Deserialization/Reader.hpp>
+#include <ArduinoJson/Json/JsonTokenizer.hpp>
+#include <ArduinoJson/StringStorage/StringBuffer.hpp>
+#include <ArduinoJson/Variant/JsonVariantConst.hpp>
+
+#include <string.h>  // memcpy
+
+ARDUINOJSON_BEGIN_PUBLIC_NAMESPACE
+
+namespace JsonEvent {
+enum Type {
+  BeginObject,
+  EndObject,
+  BeginArray,
+  EndArray,
+  Key,    // see JsonPullParser::key()
+  Value,  // see JsonPullParser::value()
+  End,    // the root value is complete
+  Error,  // see JsonPullParser::error()
+};
+}  // namespace JsonEvent
+
+// Parses a JSON input one event at a time, without building a document.
+// The memory usage is constant: strings longer than stringCapacity - 1 fail
+// with DeserializationError::NoMemory.
+//
+//   JsonPullParser<File> parser(file);
+//   while (parser.next() == JsonEvent::Key) ...
+template <typename TInput, size_t stringCapacity = 64>
+class JsonPullParser
+    : detail::JsonTokenizer<detail::Reader<TInput>,
+                            detail::StringBuffer<stringCapacity>> {
+  typedef detail::JsonTokenizer<detail::Reader<TInput>,
+                                detail::StringBuffer<stringCapacity>>
+      tokenizer_type;
+  using tokenizer_type::current;
+  using tokenizer_type::eat;
+  using tokenizer_type::move;
+  using tokenizer_type::parseKey;
+  using tokenizer_type::parseNumericValue;
+  using tokenizer_type::parseQuotedString;
+  using tokenizer_type::skipKeyword;
+  using tokenizer_type::skipSpacesAndComments;
+  using tokenizer_type::stringStorage_;
+
+  static const uint8_t maxDepth = 32;  // one bit per level in objects_
+
+ public:
+  template <typename T>
+  explicit JsonPullParser(
+      T&& input, DeserializationOption::NestingLimit nestingLimit =
+                     DeserializationOption::NestingLimit())
+      : tokenizer_type(detail::Reader<TInput>(input),
+                       detail::StringBuffer<stringCapacity>()),
+        state_(ExpectRoot),
+        depth_(0),
+        depthLimit_(toDepth(nestingLimit)),
+        objects_(0),
+        keySize_(0),
+        error_(DeserializationError::Ok) {
+    key_[0] = 0;
+  }
+
+  // Reads the input up to the next event
+  JsonEvent::Type next() {
+    DeserializationError::Code err = DeserializationError::Ok;
+    JsonEvent::Type event = JsonEvent::Error;
+
+    switch (state_) {
+      case ExpectRoot:
+        err = parseValue(event);
+        break;
+
+      case ExpectFirstElement:
+      case ExpectNextElement:
+        err = skipSpacesAndComments();
+        if (err)
+          break;
+        if (eat(']')) {
+          event = JsonEvent::EndArray;
+          leave();
+          break;
+        }
+        if (state_ == ExpectNextElement && !eat(',')) {
+          err = DeserializationError::InvalidInput;
+          break;
+        }
+        err = parseValue(event);
+        break;
+
+      case ExpectFirstMember:
+      case ExpectNextMember:
+        err = skipSpacesAndComments();
+        if (err)
+          break;
+        if (eat('}')) {
+          event = JsonEvent::EndObject;
+          leave();
+          break;
+        }
+        if (state_ == ExpectNextMember) {
+          if (!eat(',')) {
+            err = DeserializationError::InvalidInput;
+            break;
+          }
+          err = skipSpacesAndComments();
+          if (err)
+            break;
+        }
+        err = parseMemberKey(event);
+        break;
+
+      case ExpectMemberValue:
+        err = parseValue(event);
+        break;
+
+      case Done:
+        return JsonEvent::End;
+
+      case Failed:
+        return JsonEvent::Error;
+    }
+
+    if (err) {
+      error_ = err;
+      state_ = Failed;
+      return JsonEvent::Error;
+    }
+    return event;
+  }
+
+  // The key of the current member.
+  // Valid from a Key event until the next Key event.
+  JsonString key() const {
+    return JsonString(key_, keySize_, JsonString::Linked);
+  }
+
+  // The scalar of the last Value event.
+  // Strings remain valid until the next call to next().
+  JsonVariantConst value() const {
+    return JsonVariantConst(&value_);
+  }
+
+  // The number of enclosing arrays and objects.
+  uint8_t depth() const {
+    return depth_;
+  }
+
+  DeserializationError error() const {
+    return error_;
+  }
+
+ private:
+  enum State {
+    ExpectRoot,
+    ExpectFirstElement,
+    ExpectNextElement,
+    ExpectFirstMember,
+    ExpectNextMember,
+    ExpectMemberValue,
+    Done,
+    Failed,
+  };
+
+  DeserializationError::Code parseValue(JsonEvent::Type& event) {
+    DeserializationError::Code err;
+
+    err = skipSpacesAndComments();
+    if (err)
+      return err;
+
+    value_.setNull();
+
+    switch (current()) {
+      case '[':
+        move();
+        event = JsonEvent::BeginArray;
+        return enter(false);
+
+      case '{':
+        move();
+        event = JsonEvent::BeginObject;
+        return enter(true);
+
+      case '\"':
+      case '\'':
+        stringStorage_.startString();
+        err = parseQuotedString();
+        if (!err)
+          value_.setString(stringStorage_.save());
+        break;
+
+      case 't':
+        value_.setBoolean(true);
+        err = skipKeyword("true");
+        break;
+
+      case 'f':
+        value_.setBoolean(false);
+        err = skipKeyword("false");
+        break;
+
+      case 'n':
+        err = skipKeyword("null");
+        break;
+
+      default:
+        err = parseNumericValue(value_);
+        break;
+    }
+
+    event = JsonEvent::Value;
+    afterValue();
+    return err;
+  }
+
+  DeserializationError::Code parseMemberKey(JsonEvent::Type& event) {
+    DeserializationError::Code err;
+
+    err = parseKey();
+    if (err)
+      return err;
+
+    JsonString key = stringStorage_.str();
+    memcpy(key_, key.c_str(), key.size() + 1);
+    keySize_ = key.size();
+
+    err = skipSpacesAndComments();
+    if (err)
+      return err;
+
+    if (!eat(':'))
+      return DeserializationError::InvalidInput;
+
+    event = JsonEvent::Key;
+    state_ = ExpectMemberValue;
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError::Code enter(bool isObject) {
+    if (depth_ >= depthLimit_)
+      return DeserializationError::TooDeep;
+    if (isObject)
+      objects_ |= uint32_t(1) << depth_;
+    else
+      objects_ &= ~(uint32_t(1) << depth_);
+    depth_++;
+    state_ = isObject ? ExpectFirstMember : ExpectFirstElement;
+    return DeserializationError::Ok;
+  }
+
+  void leave() {
+    ARDUINOJSON_ASSERT(depth_ > 0);
+    depth_--;
+    afterValue();
+  }
+
+  void afterValue() {
+    if (depth_ == 0)
+      state_ = Done;
+    else if (objects_ & (uint32_t(1) << (depth_ - 1)))
+      state_ = ExpectNextMember;
+    else
+      state_ = ExpectNextElement;
+  }
+
+  static uint8_t toDepth(DeserializationOption::NestingLimit limit) {
+    uint8_t depth = 0;
+    while (!limit.reached() && depth < maxDepth) {
+      limit = limit.decrement();
+      depth++;
+    }
+    return depth;
+  }
+
+  State state_;
+  uint8_t depth_;
+  uint8_t depthLimit_;
+  uint32_t objects_;
+  char key_[stringCapacity];
+  size_t keySize_;
+  detail::VariantData value_;
+  DeserializationError error_;
+};
+
+ARDUINOJSON_END_PUBLIC_NAMESPACE
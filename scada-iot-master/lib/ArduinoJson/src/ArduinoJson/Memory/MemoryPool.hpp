@@ -35,6 +35,8 @@ ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
 //             left_          right_
 
 class MemoryPool {
+  friend class PoolCompactor;
+
  public:
   MemoryPool(char* buf, size_t capa)
       : begin_(buf),
@@ -0,0 +1,164 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#pragma once
+
+#include <ArduinoJson/Memory/MemoryPool.hpp>
+#include <ArduinoJson/Variant/VariantData.hpp>
+
+#include <string.h>  // memmove, strlen
+
+ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
+
+// Reclaims, in place, the strings and variants that are no longer reachable
+// from the root.
+//
+// Before:
+// +-----+---+-----+------------+---+-----+---+
+// | str | x | str |   (free)   | v | xxx | v |
+// +-----+---+-----+------------+---+-----+---+
+//
+// After:
+// +-----+-----+------------------------+---+---+
+// | str | str |         (free)         | v | v |
+// +-----+-----+------------------------+---+---+
+//
+// Strings slide toward the beginning and variants toward the end, in their
+// original order, so no temporary buffer is needed. Every move walks the tree
+// to update the references, so the cost is quadratic in the number of nodes;
+// call it occasionally, not in a tight loop.
+class PoolCompactor {
+ public:
+  PoolCompactor(MemoryPool* pool, VariantData* root)
+      : pool_(pool), root_(root) {}
+
+  // Returns the number of bytes reclaimed
+  size_t compact() {
+    size_t before = pool_->size();
+    compactStrings();
+    compactVariants();
+    pool_->overflowed_ = false;
+    return before - pool_->size();
+  }
+
+ private:
+  struct StringSearch {
+    const char* from;  // inclusive lower bound
+    const char* found;
+    size_t size;  // including the terminator
+  };
+
+  void compactStrings() {
+    char* dst = pool_->begin_;
+    StringSearch search = {pool_->begin_, 0, 0};
+    for (;;) {
+      search.found = 0;
+      findString(root_, search);
+      if (!search.found)
+        break;
+      const char* src = search.found;
+      if (src != dst) {
+        memmove(dst, src, search.size);
+        relocateString(root_, src, dst);
+      }
+      dst += search.size;
+      search.from = src + search.size;
+    }
+    pool_->left_ = dst;
+  }
+
+  void compactVariants() {
+    VariantSlot* dst = reinterpret_cast<VariantSlot*>(pool_->end_);
+    VariantSlot* below = dst;  // exclusive upper bound
+    for (;;) {
+      VariantSlot* src = 0;
+      findSlot(root_, below, src);
+      if (!src)
+        break;
+      --dst;
+      if (src != dst)
+        moveSlot(src, dst);
+      below = src;
+    }
+    pool_->right_ = reinterpret_cast<char*>(dst);
+  }
+
+  // Finds the owned string with the lowest address above search.from
+  void findString(const VariantData* var, StringSearch& search) const {
+    if (var->flags_ & OWNED_VALUE_BIT)
+      considerString(var->content_.asString.data,
+                     var->content_.asString.size + 1, search);
+    const CollectionData* col = var->asCollection();
+    if (!col)
+      return;
+    for (const VariantSlot* s = col->head_; s; s = s->next()) {
+      if (s->ownsKey())
+        considerString(s->key(), strlen(s->key()) + 1, search);
+      findString(s->data(), search);
+    }
+  }
+
+  void considerString(const char* s, size_t size, StringSearch& search) const {
+    if (!pool_->owns(const_cast<char*>(s)) || s < search.from)
+      return;
+    if (search.found && s >= search.found)
+      return;
+    search.found = s;
+    search.size = size;
+  }
+
+  void relocateString(VariantData* var, const char* from, const char* to) {
+    if ((var->flags_ & OWNED_VALUE_BIT) && var->content_.asString.data == from)
+      var->content_.asString.data = to;
+    CollectionData* col = var->isCollection() ? &var->content_.asCollection : 0;
+    if (!col)
+      return;
+    for (VariantSlot* s = col->head_; s; s = s->next()) {
+      if (s->ownsKey() && s->key() == from)
+        s->setKey(JsonString(to, JsonString::Copied));
+      relocateString(s->data(), from, to);
+    }
+  }
+
+  // Finds the reachable slot with the highest address below the bound
+  void findSlot(const VariantData* var, const VariantSlot* below,
+                VariantSlot*& found) const {
+    const CollectionData* col = var->asCollection();
+    if (!col)
+      return;
+    for (VariantSlot* s = col->head_; s; s = s->next()) {
+      ARDUINOJSON_ASSERT(pool_->owns(s));
+      if (s < below && (!found || s > found))
+        found = s;
+      findSlot(s->data(), below, found);
+    }
+  }
+
+  void moveSlot(VariantSlot* from, VariantSlot* to) {
+    VariantSlot* next = from->next();
+    *to = *from;
+    to->setNext(next);
+    relinkSlot(root_, from, to);
+  }
+
+  void relinkSlot(VariantData* var, VariantSlot* from, VariantSlot* to) {
+    CollectionData* col = var->isCollection() ? &var->content_.asCollection : 0;
+    if (!col)
+      return;
+    if (col->head_ == from)
+      col->head_ = to;
+    if (col->tail_ == from)
+      col->tail_ = to;
+    for (VariantSlot* s = col->head_; s; s = s->next()) {
+      if (s->next() == from)
+        s->setNextNotNull(to);
+      relinkSlot(s->data(), from, to);
+    }
+  }
+
+  MemoryPool* pool_;
+  VariantData* root_;
+};
+
+ARDUINOJSON_END_PRIVATE_NAMESPACE
@@ -0,0 +1,54 @@
+// ArduinoJson - https://arduinojson.org
+// Copyright © 2014-2023, Benoit BLANCHON
+// MIT License
+
+#pragma once
+
+#include <ArduinoJson/Namespace.hpp>
+#include <ArduinoJson/Strings/JsonString.hpp>
+
+ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
+
+// A string storage backed by a fixed-size buffer: each string replaces the
+// previous one, so the memory usage doesn't depend on the input.
+template <size_t N>
+class StringBuffer {
+ public:
+  StringBuffer() : size_(0), valid_(true) {}
+
+  void startString() {
+    size_ = 0;
+    valid_ = true;
+  }
+
+  JsonString save() {
+    return str();
+  }
+
+  void append(char c) {
+    if (size_ + 1 < N)  // keep room for the terminator
+      buffer_[size_++] = c;
+    else
+      valid_ = false;
+  }
+
+  bool isValid() const {
+    return valid_;
+  }
+
+  JsonString str() {
+    buffer_[size_] = 0;
+    return JsonString(buffer_, size_, JsonString::Linked);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  char buffer_[N];
+  size_t size_;
+  bool valid_;
+};
+
+ARDUINOJSON_END_PRIVATE_NAMESPACE
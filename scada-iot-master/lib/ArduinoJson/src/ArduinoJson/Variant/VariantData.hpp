@@ -14,6 +14,8 @@
 ARDUINOJSON_BEGIN_PRIVATE_NAMESPACE
 
 class VariantData {
+  friend class PoolCompactor;
+
   VariantContent content_;  // must be first to allow cast from array to variant
   uint8_t flags_;
 
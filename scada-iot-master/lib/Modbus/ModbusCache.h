@@ -0,0 +1,105 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   bộ nhớ đệm thanh ghi Modbus: mỗi giá trị (slave, bảng, địa chỉ) kèm millis() lúc đọc được
+   - bảng là mã hàm đọc: 1 coil, 2 discrete, 3 holding, 4 input; coil/discrete lưu 0/1
+   - người đọc đưa tuổi tối đa chấp nhận được, giá trị cũ hơn coi như không có
+   - bảng băm địa chỉ mở, đầy thì đè ô cũ nhất trong vùng dò
+   - thanh ghi ghim (công tơ của power_meter) không bị thanh ghi khác đè; vùng dò toàn ô ghim thì giá trị mới
+     không được lưu, cổng Modbus TCP vẫn trả lời từ khung RTU vừa đọc
+*/
+
+#include <Arduino.h>
+#include "Modbus.h"
+
+#define MODBUS_CACHE_SIZE  256 // số thanh ghi, lũy thừa của 2
+#define MODBUS_CACHE_PROBE 8   // số ô dò tối đa cho một khóa
+
+class ModbusCache
+{
+  struct Entry
+  {
+    uint32_t key;   // slave << 24 | bảng << 16 | địa chỉ
+    uint32_t time;  // millis() lúc đọc
+    uint16_t value; //
+    bool used;      //
+    bool pinned;    // không bao giờ bị đè bởi khóa khác
+  };
+  Entry entries[MODBUS_CACHE_SIZE] = {};
+
+  static uint32_t makeKey(uint8_t slave, uint8_t table, uint16_t address) { return (uint32_t)slave << 24 | (uint32_t)table << 16 | address; }
+  static uint32_t slot(uint32_t key) { return (key * 2654435761u) >> 24 & (MODBUS_CACHE_SIZE - 1); } // băm Knuth
+
+  const Entry *find(uint8_t slave, uint8_t table, uint16_t address) const
+  {
+    uint32_t key = makeKey(slave, table, address);
+    for (uint32_t i = 0, s = slot(key); i < MODBUS_CACHE_PROBE; i++, s = (s + 1) & (MODBUS_CACHE_SIZE - 1))
+    {
+      const Entry &e = entries[s];
+      if (!e.used)
+        return NULL;
+      if (e.key == key)
+        return &e;
+    }
+    return NULL;
+  }
+
+public:
+  // pin: giữ ô này cho khóa mãi mãi; ô đã ghim vẫn ghim khi put lại không có pin
+  void put(uint8_t slave, uint8_t table, uint16_t address, uint16_t value, uint32_t now, bool pin = false)
+  {
+    uint32_t key = makeKey(slave, table, address);
+    Entry *victim = NULL;
+    for (uint32_t i = 0, s = slot(key); i < MODBUS_CACHE_PROBE; i++, s = (s + 1) & (MODBUS_CACHE_SIZE - 1))
+    {
+      Entry &e = entries[s];
+      if (!e.used || e.key == key)
+      {
+        victim = &e;
+        break;
+      }
+      if (!e.pinned && (!victim || now - e.time > now - victim->time)) // cũ nhất trong vùng dò
+        victim = &e;
+    }
+    if (victim)
+      *victim = {key, now, value, true, pin || (victim->pinned && victim->key == key)};
+  }
+
+  // true khi có giá trị không cũ hơn max_age ms
+  bool get(uint8_t slave, uint8_t table, uint16_t address, uint32_t max_age, uint16_t &value, uint32_t now) const
+  {
+    const Entry *e = find(slave, table, address);
+    if (!e || now - e->time > max_age)
+      return false;
+    value = e->value;
+    return true;
+  }
+
+  // số ms từ lần đọc được giá trị, -1 khi không có
+  int32_t age(uint8_t slave, uint8_t table, uint16_t address, uint32_t now) const
+  {
+    const Entry *e = find(slave, table, address);
+    return e ? (int32_t)(now - e->time) : -1;
+  }
+
+  // cả dải đều đủ mới mới trả true, out có count phần tử
+  bool getRange(uint8_t slave, uint8_t table, uint16_t first, uint16_t count, uint32_t max_age, uint16_t *out, uint32_t now) const
+  {
+    for (uint16_t i = 0; i < count; i++)
+      if (!get(slave, table, first + i, max_age, out[i], now))
+        return false;
+    return true;
+  }
+
+  // chép kết quả của lần modbus.requestFrom(slave, table, first, count) vừa thành công
+  void store(Modbus &bus, uint8_t slave, uint8_t table, uint16_t first, uint16_t count, uint32_t now, bool pin = false)
+  {
+    for (uint16_t i = 0; i < count; i++)
+    {
+      uint16_t value = table <= Discret_Register ? bus.byteRead(i / 8) >> (i % 8) & 1 : bus.uint16(i);
+      put(slave, table, first + i, value, now, pin);
+    }
+  }
+
+  void clear() { memset(entries, 0, sizeof(entries)); }
+};
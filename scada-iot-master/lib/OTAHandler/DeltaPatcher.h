@@ -0,0 +1,245 @@
+#ifndef DELTAPATCHER_H
+#define DELTAPATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Applies an "SDP1" patch (see fastapi-scada/app/utils/delta.py) as it
+// arrives: the patch is fed in chunks of any size, the old image is read
+// through a callback and the new image comes out through another one. RAM
+// use is the two fixed buffers below, whatever the image size.
+//
+// Header: "SDP1" | old_size u32 | new_size u32 | old_sha256 | new_sha256
+// Record: diff_len u32 | runs (zeros varint, count varint, count bytes)
+//         | extra_len u32 | extra bytes | seek i32
+class DeltaPatcher {
+public:
+  typedef bool (*ReadOld)(void* context, uint32_t offset, uint8_t* buffer, size_t size);
+  typedef bool (*WriteNew)(void* context, const uint8_t* data, size_t size);
+
+  static const size_t headerSize = 4 + 4 + 4 + 32 + 32;
+
+  DeltaPatcher(ReadOld readOld, WriteNew writeNew, void* context)
+      : readOld(readOld), writeNew(writeNew), context(context) {
+    reset();
+  }
+
+  void reset() {
+    state = HEADER;
+    fieldSize = 0;
+    oldPos = 0;
+    produced = 0;
+    outSize = 0;
+    lastError = NULL;
+  }
+
+  // Feeds the next bytes of the patch, returns false on error
+  bool write(const uint8_t* data, size_t size) {
+    while (size > 0 && !lastError) {
+      size_t used = step(data, size);
+      data += used;
+      size -= used;
+    }
+    return lastError == NULL;
+  }
+
+  // The header has been read: sizes and hashes are valid
+  bool hasHeader() const { return state != HEADER; }
+  // The whole new image has been written
+  bool isFinished() const { return state == DONE && lastError == NULL; }
+
+  uint32_t getOldSize() const { return read32(header + 4); }
+  uint32_t getNewSize() const { return read32(header + 8); }
+  const uint8_t* getOldHash() const { return header + 12; }
+  const uint8_t* getNewHash() const { return header + 44; }
+  uint32_t getProduced() const { return produced; }
+  const char* getError() const { return lastError; }
+
+private:
+  enum State {
+    HEADER,
+    DIFF_LEN,
+    ZEROS,
+    COUNT,
+    DIFF_BYTES,
+    EXTRA_LEN,
+    EXTRA_BYTES,
+    SEEK,
+    DONE,
+  };
+
+  // Consumes some of the input, returns the number of bytes used
+  size_t step(const uint8_t* data, size_t size) {
+    switch (state) {
+      case HEADER: {
+        size_t n = fill(header, headerSize, data, size);
+        if (fieldSize == headerSize) {
+          fieldSize = 0;
+          if (memcmp(header, "SDP1", 4) != 0)
+            return fail("bad magic", n);
+          state = getNewSize() ? DIFF_LEN : DONE;
+        }
+        return n;
+      }
+
+      case DIFF_LEN:
+      case EXTRA_LEN:
+      case SEEK: {
+        size_t n = fill(field, 4, data, size);
+        if (fieldSize == 4) {
+          fieldSize = 0;
+          uint32_t value = read32(field);
+          if (state == DIFF_LEN) {
+            if (oldPos + (uint64_t)value > getOldSize())
+              return fail("diff outside the old image", n);
+            remaining = value;
+            state = remaining ? ZEROS : EXTRA_LEN;
+          } else if (state == EXTRA_LEN) {
+            remaining = value;
+            state = remaining ? EXTRA_BYTES : SEEK;
+          } else {
+            oldPos += (int32_t)value;
+            state = produced == getNewSize() ? DONE : DIFF_LEN;
+          }
+          if ((state == ZEROS || state == EXTRA_BYTES) && produced + (uint64_t)remaining > getNewSize())
+            return fail("record past the end of the image", n);
+        }
+        return n;
+      }
+
+      case ZEROS:
+      case COUNT: {
+        uint8_t byte = data[0];
+        if (fieldSize == 0)
+          varint = 0;
+        if (fieldSize >= 5)
+          return fail("bad varint", 1);
+        varint |= (uint32_t)(byte & 0x7F) << (7 * fieldSize++);
+        if (byte & 0x80)
+          return 1;
+        fieldSize = 0;
+        if (varint > remaining)
+          return fail("diff run too long", 1);
+        if (state == ZEROS) {
+          if (!copyOld(varint))
+            return 1;
+          remaining -= varint;
+          state = COUNT;
+        } else {
+          run = varint;
+          state = run ? DIFF_BYTES : endOfRun();
+        }
+        return 1;
+      }
+
+      case DIFF_BYTES: {
+        size_t n = size < run ? size : run;
+        if (n > sizeof(oldBuffer))
+          n = sizeof(oldBuffer);
+        if (!readOld(context, oldPos, oldBuffer, n))
+          return fail("cannot read the old image", n);
+        for (size_t i = 0; i < n; i++)
+          if (!put(data[i] + oldBuffer[i]))
+            return n;
+        oldPos += n;
+        run -= n;
+        remaining -= n;
+        if (run == 0)
+          state = endOfRun();
+        return n;
+      }
+
+      case EXTRA_BYTES: {
+        size_t n = size < remaining ? size : remaining;
+        for (size_t i = 0; i < n; i++)
+          if (!put(data[i]))
+            return n;
+        remaining -= n;
+        if (remaining == 0)
+          state = SEEK;
+        return n;
+      }
+
+      case DONE:
+        return size;  // nothing after the last record
+    }
+    return size;
+  }
+
+  State endOfRun() {
+    return remaining ? ZEROS : EXTRA_LEN;
+  }
+
+  // Copies bytes of the old image unchanged (a run of zeros in the diff)
+  bool copyOld(uint32_t size) {
+    while (size > 0) {
+      size_t n = size < sizeof(oldBuffer) ? size : sizeof(oldBuffer);
+      if (!readOld(context, oldPos, oldBuffer, n)) {
+        fail("cannot read the old image", 0);
+        return false;
+      }
+      for (size_t i = 0; i < n; i++)
+        if (!put(oldBuffer[i]))
+          return false;
+      oldPos += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  bool put(uint8_t byte) {
+    outBuffer[outSize++] = byte;
+    produced++;
+    if (outSize == sizeof(outBuffer) || produced == getNewSize())
+      return flush();
+    return true;
+  }
+
+  bool flush() {
+    if (outSize && !writeNew(context, outBuffer, outSize)) {
+      fail("cannot write the new image", 0);
+      return false;
+    }
+    outSize = 0;
+    return true;
+  }
+
+  size_t fill(uint8_t* dest, size_t target, const uint8_t* data, size_t size) {
+    size_t n = target - fieldSize;
+    if (n > size)
+      n = size;
+    memcpy(dest + fieldSize, data, n);
+    fieldSize += n;
+    return n;
+  }
+
+  size_t fail(const char* error, size_t used) {
+    lastError = error;
+    return used;
+  }
+
+  static uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  ReadOld readOld;
+  WriteNew writeNew;
+  void* context;
+
+  State state;
+  uint8_t header[headerSize];
+  uint8_t field[4];
+  size_t fieldSize;       // bytes already collected in header / field / varint
+  uint32_t varint;
+  uint32_t remaining;     // bytes left in the current diff or extra section
+  uint32_t run;           // bytes left in the current diff run
+  uint32_t oldPos;
+  uint32_t produced;
+  uint8_t oldBuffer[256];
+  uint8_t outBuffer[256];
+  size_t outSize;
+  const char* lastError;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef GZIPDECODER_H
+#define GZIPDECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// inflate and CRC-32 from the ESP32 ROM, nothing to link
+#if __has_include(<esp32/rom/miniz.h>)
+#include <esp32/rom/crc.h>
+#include <esp32/rom/miniz.h>
+#else
+#include <rom/crc.h>
+#include <rom/miniz.h>
+#endif
+
+// Passes a firmware image through, inflating it on the fly when it starts
+// with the gzip magic (an ESP32 app image starts with 0xE9, so raw images
+// are never mistaken for gzip). The input is fed in chunks of any size and
+// the output comes out through a callback. Gzip needs a fixed 32 KB window
+// and the inflate state (~11 KB), both allocated on the first gzip chunk.
+class GzipDecoder {
+public:
+  typedef bool (*Output)(void* context, const uint8_t* data, size_t size);
+
+  GzipDecoder(Output output, void* context)
+      : output(output), context(context), inflator(NULL), window(NULL) {
+    reset();
+  }
+
+  ~GzipDecoder() {
+    free(inflator);
+    free(window);
+  }
+
+  void reset() {
+    state = DETECT;
+    fieldSize = 0;
+    input = 0;
+    produced = 0;
+    crc = 0;
+    windowPos = 0;
+    lastError = NULL;
+  }
+
+  // Feeds the next bytes of the image, returns false on error
+  bool write(const uint8_t* data, size_t size) {
+    input += size;
+    while (size > 0 && !lastError) {
+      size_t used = step(data, size);
+      data += used;
+      size -= used;
+    }
+    return lastError == NULL;
+  }
+
+  // Call at the end of the input: a gzip stream must be complete
+  bool finish() {
+    if (!lastError && state == DETECT && fieldSize == 1)
+      emit(header, 1);  // a one byte "image"
+    if (!lastError && state != RAW && state != DONE)
+      lastError = "truncated gzip stream";
+    return lastError == NULL;
+  }
+
+  bool isGzip() const { return state > RAW; }
+  uint32_t getInput() const { return input; }
+  uint32_t getOutput() const { return produced; }
+  const char* getError() const { return lastError; }
+
+private:
+  enum State {
+    DETECT,
+    RAW,
+    HEADER,
+    EXTRA_LEN,
+    EXTRA,
+    NAME,
+    COMMENT,
+    HEADER_CRC,
+    DEFLATE,
+    TRAILER,
+    DONE,
+  };
+
+  enum Flags {
+    FHCRC = 0x02,
+    FEXTRA = 0x04,
+    FNAME = 0x08,
+    FCOMMENT = 0x10,
+  };
+
+  static const size_t windowSize = TINFL_LZ_DICT_SIZE;  // power of 2
+
+  size_t step(const uint8_t* data, size_t size) {
+    switch (state) {
+      case DETECT:
+        header[fieldSize++] = data[0];
+        if (header[0] != 0x1f || (fieldSize == 2 && header[1] != 0x8b)) {
+          state = RAW;
+          emit(header, fieldSize);
+          fieldSize = 0;
+        } else if (fieldSize == 2) {
+          state = HEADER;
+        }
+        return 1;
+
+      case RAW:
+        emit(data, size);
+        return size;
+
+      case HEADER: {
+        size_t n = fill(10, data, size);
+        if (fieldSize == 10) {
+          if (header[2] != 8)
+            return fail("gzip method is not deflate", n);
+          flags = header[3];
+          fieldSize = 0;
+          nextHeaderField(EXTRA_LEN);
+        }
+        return n;
+      }
+
+      case EXTRA_LEN:
+      case HEADER_CRC: {
+        size_t n = fill(2, data, size);
+        if (fieldSize == 2) {
+          fieldSize = 0;
+          if (state == EXTRA_LEN) {
+            skip = header[0] | (header[1] << 8);
+            if (skip)
+              state = EXTRA;
+            else
+              nextHeaderField(NAME);
+          } else {
+            nextHeaderField(DEFLATE);
+          }
+        }
+        return n;
+      }
+
+      case EXTRA: {
+        size_t n = size < skip ? size : skip;
+        skip -= n;
+        if (skip == 0)
+          nextHeaderField(NAME);
+        return n;
+      }
+
+      case NAME:
+      case COMMENT:
+        if (data[0] == 0)
+          nextHeaderField(state == NAME ? COMMENT : HEADER_CRC);
+        return 1;
+
+      case DEFLATE:
+        return inflate(data, size);
+
+      case TRAILER: {
+        size_t n = fill(8, data, size);
+        if (fieldSize == 8) {
+          uint32_t expectedCrc = read32(header);
+          uint32_t expectedSize = read32(header + 4);
+          if (expectedCrc != crc)
+            return fail("gzip CRC mismatch", n);
+          if (expectedSize != produced)
+            return fail("gzip size mismatch", n);
+          state = DONE;
+        }
+        return n;
+      }
+
+      case DONE:
+        return size;  // padding after the stream
+    }
+    return size;
+  }
+
+  // Moves to the first header field present from the given one
+  void nextHeaderField(State from) {
+    state = from;
+    if (state == EXTRA_LEN && !(flags & FEXTRA))
+      state = NAME;
+    if (state == NAME && !(flags & FNAME))
+      state = COMMENT;
+    if (state == COMMENT && !(flags & FCOMMENT))
+      state = HEADER_CRC;
+    if (state == HEADER_CRC && !(flags & FHCRC))
+      state = DEFLATE;
+    if (state == DEFLATE)
+      startInflate();
+  }
+
+  bool startInflate() {
+    if (!inflator)
+      inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    if (!window)
+      window = (uint8_t*)malloc(windowSize);
+    if (!inflator || !window) {
+      fail("not enough memory to inflate", 0);
+      return false;
+    }
+    tinfl_init(inflator);
+    windowPos = 0;
+    return true;
+  }
+
+  size_t inflate(const uint8_t* data, size_t size) {
+    size_t in = size;
+    size_t out = windowSize - windowPos;
+    tinfl_status status = tinfl_decompress(inflator, data, &in, window, window + windowPos, &out,
+                                           TINFL_FLAG_HAS_MORE_INPUT);
+    if (out) {
+      crc = crc32_le(crc, window + windowPos, out);
+      emit(window + windowPos, out);
+      windowPos = (windowPos + out) & (windowSize - 1);
+    }
+    if (status < TINFL_STATUS_DONE)
+      return fail("corrupted deflate data", in);
+    if (in == 0 && out == 0 && status != TINFL_STATUS_DONE)
+      return fail("inflate made no progress", 0);
+    if (status == TINFL_STATUS_DONE) {
+      state = TRAILER;
+      fieldSize = 0;
+    }
+    return in;
+  }
+
+  void emit(const uint8_t* data, size_t size) {
+    if (lastError)
+      return;
+    produced += size;
+    if (!output(context, data, size))
+      fail("cannot write the image", 0);
+  }
+
+  size_t fill(size_t target, const uint8_t* data, size_t size) {
+    size_t n = target - fieldSize;
+    if (n > size)
+      n = size;
+    for (size_t i = 0; i < n; i++)
+      header[fieldSize + i] = data[i];
+    fieldSize += n;
+    return n;
+  }
+
+  size_t fail(const char* error, size_t used) {
+    lastError = error;
+    return used;
+  }
+
+  static uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  Output output;
+  void* context;
+  tinfl_decompressor* inflator;
+  uint8_t* window;
+
+  State state;
+  uint8_t header[10];     // gzip header, then the small fields and the trailer
+  size_t fieldSize;
+  uint8_t flags;
+  uint32_t skip;          // bytes left in FEXTRA
+  uint32_t input;
+  uint32_t produced;
+  uint32_t crc;
+  size_t windowPos;
+  const char* lastError;
+};
+
+#endif
@@ -2,14 +2,74 @@
 #define OTAHANDLER_H
 
 #include <WiFi.h>
+#include <ESPmDNS.h>
 #include <HTTPClient.h>
+#include <ESPAsyncWebServer.h>
 #include <Update.h>
+#include <Preferences.h>
 #include <PubSubClient.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
 
+#include "DeltaPatcher.h"
+#include "GzipDecoder.h"
+#include "OTAPublicKey.h"
 
-// Firmware Update URL
-#define FIRMWARE_URL "http://api.chaugiaphat.com/api/file/firmware.bin"
 
+// mDNS service of the devices sharing their running image with the site LAN
+#define OTA_PEER_SERVICE "scadaota"
+#define OTA_PEER_PATH "/ota/firmware.bin"
+
+// Firmware Update URL, gzip-compressed (a plain image is accepted too)
+#define FIRMWARE_URL "http://api.chaugiaphat.com/api/file/firmware.bin.gz"
+// Patch from the running image, followed by its SHA-256 in hex (404 if unknown)
+#define FIRMWARE_DELTA_URL "http://api.chaugiaphat.com/api/firmware/delta/?from="
+
+// Version of this build, compared with the one of a rollout manifest
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "0.1.0"
+#endif
+
+// NVS namespace: "rolled_back" holds the address of the slot whose rollback was reported
+#define OTA_PREFS_NAMESPACE "ota"
+
+// A new image has this long to connect to MQTT before it is rolled back
+#ifndef OTA_VERIFY_TIMEOUT
+#define OTA_VERIFY_TIMEOUT (5 * 60 * 1000ul)
+#endif
+
+enum OTAState {
+  OTA_IDLE,
+  OTA_DOWNLOADING,
+  OTA_DONE,       // image verified, restarting soon
+  OTA_FAILED,
+  OTA_SCHEDULED,  // waiting for the time slot of this device
+  OTA_SKIPPED,    // already on the version, or not part of the rollout
+  OTA_ROLLED_BACK,  // the last new image failed its health check
+};
+
+// Downloads the firmware in a FreeRTOS task so that loop() keeps running
+// (MQTT keepalive, Modbus polling, lamp schedule). A dropped connection is
+// resumed with an HTTP Range request from the last byte written.
+// A delta against the running image is tried first (see DeltaPatcher.h).
+// A gzip image is inflated on the fly (see GzipDecoder.h): written and total
+// then count compressed bytes, which is what a resumed Range request uses.
+//
+// A rollout manifest (see scheduleOTA) spreads the downloads of a fleet over
+// time instead of sending every device to the file server at once.
+//
+// The image is hashed while it is written and must match the SHA-256 of the
+// manifest and the ECDSA signature made with the key of OTAPublicKey.h.
+// After the restart the new image is pending verification: it must call
+// confirm() within OTA_VERIFY_TIMEOUT, or the previous one boots again (this
+// needs the rollback option of the bootloader, see verifyRollbackLater()).
+//
+// Once confirmed, the running image is served on OTA_PEER_PATH and announced
+// over mDNS with its version. A device updating from a manifest downloads
+// from such a neighbour first, so a site only fetches the image once over
+// the WAN. Peers are not trusted: the manifest hash and signature apply.
 class OTAHandler {
 public:
   //    OTAHandler(PubSubClient& client) {
@@ -29,82 +89,687 @@ public:
   //      }
   //    }
 
-  OTAHandler() {}
+  OTAHandler() : decoder(writeImage, this) {
+    mbedtls_sha256_init(&imageSha);
+  }
 
-  void performOTA() {
-    WiFiClient client;
-    HTTPClient http;
+  // Starts the download in the background, returns false if one is running
+  bool performOTA(const char* url = FIRMWARE_URL) {
+    if (state == OTA_DOWNLOADING) {
+      Serial.println("OTAHandler - OTA already in progress");
+      return false;
+    }
+
+    targetVersion = "";
+    expectedSize = 0;
+    hasHash = false;
+    signatureSize = 0;  // from the X-Signature header
+    return start(url, !strcmp(url, FIRMWARE_URL));  // delta only for the default image
+  }
+
+  // Handles a rollout manifest. The device ID gives a fixed slot in 0..99
+  // and a start delay: with rollout = N only the slots below N update, so
+  // raising N later adds new devices, and the downloads start spread over
+  // window seconds. url, sha256 and size may be empty / 0.
+  // signatureHex is the DER ECDSA signature of the SHA-256 (may be empty).
+  // Returns true if the update is scheduled.
+  bool scheduleOTA(const String& deviceId, const char* version, const char* url,
+                   const char* sha256, const char* signatureHex, uint32_t size, int rollout,
+                   uint32_t window) {
+    if (state == OTA_DOWNLOADING || state == OTA_DONE) {
+      Serial.println("OTAHandler - OTA already in progress");
+      return false;
+    }
+
+    targetVersion = version;
+    if (targetVersion == FIRMWARE_VERSION) {
+      skip("already on this version");
+      return false;
+    }
+    if (!canVerify()) {
+      skip("no OTA public key in this build");
+      return false;
+    }
+    uint32_t slot = rolloutSlot(deviceId);
+    if ((int)(slot % 100) >= rollout) {
+      skip("not in this rollout");
+      return false;
+    }
+
+    manifestUrl = url && *url ? url : FIRMWARE_URL;
+    expectedSize = size;
+    hasHash = parseHex(sha256, expectedHash, sizeof(expectedHash)) == sizeof(expectedHash);
+    signatureSize = parseHex(signatureHex, signature, sizeof(signature));
+    uint32_t wait = window ? (slot / 100) % window : 0;
+    startTime = millis() + wait * 1000;
+    lastError = "";
+    state = OTA_SCHEDULED;
+    Serial.println("OTAHandler - Update to " + targetVersion + " in " + String(wait) + " s");
+    return true;
+  }
+
+  // Call from setup(): starts the health check of a new image
+  void begin() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_ota_img_states_t imageState;
+    if (running && esp_ota_get_state_partition(running, &imageState) == ESP_OK &&
+        imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+      pendingVerify = true;
+      Serial.println("OTAHandler - New image, waiting for MQTT to confirm it");
+    } else if (const esp_partition_t* invalid = esp_ota_get_last_invalid_partition()) {
+      // esp-idf returns the failed slot on every boot until an update overwrites it
+      Preferences prefs;
+      prefs.begin(OTA_PREFS_NAMESPACE, true);
+      if (prefs.getUInt("rolled_back", 0) != invalid->address) {
+        rolledBackSlot = invalid->address;
+        lastError = "the new image failed its health check";
+        state = OTA_ROLLED_BACK;
+      }
+      prefs.end();
+    }
+  }
+
+  // Call once OTA_ROLLED_BACK has reached the backend: later boots stay quiet
+  // about this rollback
+  void rollbackReported() {
+    if (state != OTA_ROLLED_BACK || !rolledBackSlot)
+      return;
+    Preferences prefs;
+    if (prefs.begin(OTA_PREFS_NAMESPACE)) {
+      prefs.putUInt("rolled_back", rolledBackSlot);
+      prefs.end();
+    }
+    rolledBackSlot = 0;
+  }
+
+  // Serves the running image to the neighbours (call before server.begin())
+  void serverOn(AsyncWebServer& server) {
+    sharing = true;
+    server.on(OTA_PEER_PATH, HTTP_GET, [this](AsyncWebServerRequest* request) { serveImage(request); });
+  }
+
+  // Call once the device is healthy (connected to MQTT): keeps the new image
+  void confirm() {
+    if (!pendingVerify)
+      return;
+    pendingVerify = false;
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK)
+      Serial.println("OTAHandler - New image confirmed");
+  }
+
+  // Legacy "update_firmware" message: update at once from the default URL
+  void handleOtaMessage(const String& message) {
+    if (message == "update_firmware") {
+      Serial.println("OTAHandler - Initiating OTA update...");
+      performOTA();
+    }
+  }
+
+  // Call from loop(): starts a scheduled update, restarts once the new image is
+  // ready, rolls back a new image that was not confirmed
+  void loop() {
+    if (!advertised && !pendingVerify && sharing && WiFi.status() == WL_CONNECTED)
+      advertise();
+    if (pendingVerify && millis() > OTA_VERIFY_TIMEOUT) {
+      Serial.println("OTAHandler - New image not confirmed in time, rolling back...");
+      esp_ota_mark_app_invalid_rollback_and_reboot();
+      pendingVerify = false;  // only returns without a previous image
+    }
+    if (state == OTA_SCHEDULED && (int32_t)(millis() - startTime) >= 0)
+      start(manifestUrl.c_str(), true);
+    if (state == OTA_DONE && millis() - doneTime > restartDelay) {
+      Serial.println("OTAHandler - Update successfully completed. Rebooting...");
+      ESP.restart();
+    }
+  }
+
+  OTAState getState() const { return state; }
+  uint32_t getWritten() const { return written; }
+  uint32_t getTotal() const { return total; }
+  int getAttempt() const { return attempt; }
+  const char* getError() const { return lastError; }  // also the reason of OTA_SKIPPED
+  const String& getTargetVersion() const { return targetVersion; }
+
+  const char* getStateString() const {
+    switch (state) {
+      case OTA_DOWNLOADING: return "downloading";
+      case OTA_DONE:        return "done";
+      case OTA_FAILED:      return "failed";
+      case OTA_SCHEDULED:   return "scheduled";
+      case OTA_SKIPPED:     return "skipped";
+      case OTA_ROLLED_BACK: return "rolled_back";
+      default:              return "idle";
+    }
+  }
+
+private:
+  bool start(const char* url, bool delta) {
+    firmwareUrl = url;
+    tryDelta = delta;
+    written = 0;
+    total = 0;
+    attempt = 0;
+    lastError = "";
+    decoder.reset();
+    if (!canVerify()) {  // the image would be refused after the download
+      fail("no OTA public key in this build");
+      return false;
+    }
+    state = OTA_DOWNLOADING;
 
     Serial.println("OTAHandler - Starting OTA...");
+    // core 0 next to the WiFi stack, loop() stays alone on core 1
+    if (xTaskCreatePinnedToCore(taskEntry, "ota", 12288, this, 1, NULL, 0) != pdPASS) {
+      fail("cannot create task");
+      return false;
+    }
+    return true;
+  }
+
+  static void taskEntry(void* arg) {
+    static_cast<OTAHandler*>(arg)->run();
+    vTaskDelete(NULL);
+  }
+
+  void skip(const char* reason) {
+    Serial.println(String("OTAHandler - Skipping ") + targetVersion + ": " + reason);
+    lastError = reason;
+    state = OTA_SKIPPED;
+  }
+
+  // FNV-1a of the device ID, the same on every boot
+  static uint32_t rolloutSlot(const String& deviceId) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < deviceId.length(); i++)
+      hash = (hash ^ (uint8_t)deviceId[i]) * 16777619u;
+    return hash;
+  }
+
+  // Returns the number of bytes decoded, 0 if hex is not valid
+  static size_t parseHex(const char* hex, uint8_t* buffer, size_t capacity) {
+    size_t length = hex ? strlen(hex) : 0;
+    if (length % 2 || length / 2 > capacity)
+      return 0;
+    for (size_t i = 0; i < length / 2; i++) {
+      char byte[3] = {hex[2 * i], hex[2 * i + 1], 0};
+      char* end;
+      buffer[i] = strtoul(byte, &end, 16);
+      if (*end)
+        return 0;
+    }
+    return length / 2;
+  }
+
+  // Signature from the X-Signature header, unless the manifest gave one
+  void readSignature(HTTPClient& http) {
+    if (!signatureSize)
+      signatureSize = parseHex(http.header("X-Signature").c_str(), signature, sizeof(signature));
+  }
+
+  // A build without a key refuses updates, unless built with OTA_ALLOW_UNSIGNED
+  static bool canVerify() { return strlen(OTA_PUBLIC_KEY) || OTA_ALLOW_UNSIGNED; }
+
+  bool checkSignature() {
+    if (!strlen(OTA_PUBLIC_KEY)) {
+      if (!OTA_ALLOW_UNSIGNED) {
+        fail("no OTA public key in this build");
+        return false;
+      }
+      Serial.println("OTAHandler - WARNING: accepting an unsigned image (OTA_ALLOW_UNSIGNED)");
+      return true;
+    }
+    if (!signatureSize) {
+      fail("image is not signed");
+      return false;
+    }
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    int ret = mbedtls_pk_parse_public_key(&key, (const unsigned char*)OTA_PUBLIC_KEY,
+                                          sizeof(OTA_PUBLIC_KEY));  // PEM: with the '\0'
+    if (ret == 0)
+      ret = mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, imageHash, sizeof(imageHash), signature,
+                              signatureSize);
+    mbedtls_pk_free(&key);
+    if (ret != 0) {
+      fail("bad image signature");
+      return false;
+    }
+    return true;
+  }
+
+  void run() {
+    // a neighbour only when the manifest can vouch for its image
+    bool done = hasHash && downloadFromPeer();
+    if (!done && state == OTA_DOWNLOADING && tryDelta)
+      done = downloadDelta();
+    if (!done && state == OTA_DOWNLOADING)
+      done = downloadFull(firmwareUrl, maxRetries);
+
+    if (state != OTA_DOWNLOADING)
+      return;  // fatal error already reported
+    if (!done) {
+      fail("too many attempts");
+      return;
+    }
+
+    finish();
+  }
 
-    int retryCount = 0;
-    bool otaSuccess = false;
+  // Drops what was written of a previous try
+  void restartImage() {
+    if (Update.isRunning())
+      Update.abort();
+    written = 0;
+    total = 0;
+    decoder.reset();
+    mbedtls_sha256_starts_ret(&imageSha, 0);
+  }
 
-    while (retryCount < maxRetries && !otaSuccess) {
-      retryCount++;
+  // Returns true once the whole image is written and hashed into imageHash
+  bool downloadFull(const char* url, int retries) {
+    restartImage();
+    for (int i = 0; i < retries && state == OTA_DOWNLOADING; i++) {
+      attempt++;
       Serial.print("OTAHandler - Attempt ");
-      Serial.print(retryCount);
+      Serial.print(attempt);
       Serial.println(" to download firmware...");
 
-      http.begin(client, FIRMWARE_URL);
-      int httpCode = http.GET();
-
-      if (httpCode == HTTP_CODE_OK) {
-        int contentLength = http.getSize();
-        bool canBegin = Update.begin(contentLength);
-
-        if (canBegin) {
-          Serial.println("OTAHandler - Begin OTA update...");
-          int written = Update.writeStream(http.getStream());
-
-          if (written == contentLength) {
-            Serial.println("OTAHandler - Written " + String(written) + " bytes successfully");
-            otaSuccess = true;
-          } else {
-            Serial.println("OTAHandler - Written only: " + String(written) + "/" + String(contentLength));
-          }
-
-          if (Update.end()) {
-            Serial.println("OTAHandler - OTA done!");
-            if (Update.isFinished()) {
-              Serial.println("OTAHandler - Update successfully completed. Rebooting...");
-              ESP.restart();
-            } else {
-              Serial.println("OTAHandler - Update not finished? Something went wrong!");
-            }
-          } else {
-            Serial.println("OTAHandler - Error #: " + String(Update.getError()));
-          }
-        } else {
-          Serial.println("OTAHandler - Not enough space to begin OTA");
+      if (download(url))
+        break;
+
+      if (state == OTA_DOWNLOADING && i + 1 < retries) {
+        Serial.println("OTAHandler - Resuming OTA in 5 seconds...");
+        vTaskDelay(pdMS_TO_TICKS(retryDelay));  // only this task waits
+      }
+    }
+
+    if (state != OTA_DOWNLOADING || total == 0 || written != total)
+      return false;
+    if (!decoder.finish()) {
+      fail(decoder.getError());
+      return false;
+    }
+    mbedtls_sha256_finish_ret(&imageSha, imageHash);
+    return true;
+  }
+
+  // Looks for a neighbour already running the target version
+  bool downloadFromPeer() {
+    if (!mdnsStarted)
+      return false;  // no responder to ask
+    int count = MDNS.queryService(OTA_PEER_SERVICE, "tcp");
+    for (int i = 0; i < count && state == OTA_DOWNLOADING; i++) {
+      if (MDNS.txt(i, "version") != targetVersion)
+        continue;
+      String url = "http://" + MDNS.IP(i).toString() + ":" + String(MDNS.port(i)) + OTA_PEER_PATH;
+      Serial.println("OTAHandler - Downloading from peer " + url);
+      if (!downloadFull(url.c_str(), peerRetries))
+        continue;
+      const char* error = checkImage();
+      if (!error)
+        return true;
+      Serial.println(String("OTAHandler - Peer image rejected: ") + error);
+    }
+    if (state == OTA_DOWNLOADING)
+      restartImage();
+    return false;
+  }
+
+  // Size and hash against the manifest, NULL if they match
+  const char* checkImage() {
+    if (expectedSize && Update.progress() != expectedSize)
+      return "image size does not match the manifest";
+    if (hasHash && memcmp(imageHash, expectedHash, sizeof(imageHash)) != 0)
+      return "image SHA-256 does not match the manifest";
+    return NULL;
+  }
+
+  // imageHash holds the SHA-256 of what was written
+  void finish() {
+    const char* error = checkImage();
+    if (error) {
+      fail(error);
+      return;
+    }
+    if (!checkSignature())
+      return;
+    if (!Update.end(true)) {  // true: the size of a gzip image is only known now
+      fail(Update.errorString());
+      return;
+    }
+
+    Preferences prefs;  // the slot holds a new image now, a rollback from it is a new one
+    if (prefs.begin(OTA_PREFS_NAMESPACE)) {
+      prefs.remove("rolled_back");
+      prefs.end();
+    }
+
+    Serial.println("OTAHandler - OTA done!");
+    doneTime = millis();
+    state = OTA_DONE;
+  }
+
+  // Tries a patch against the running image. On any failure the partial
+  // image is dropped and the caller falls back to the full download.
+  bool downloadDelta() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    uint8_t digest[32];
+    if (!running || esp_partition_get_sha256(running, digest) != ESP_OK)
+      return false;
+
+    String url = FIRMWARE_DELTA_URL;
+    for (int i = 0; i < 32; i++) {
+      char hex[3];
+      sprintf(hex, "%02x", digest[i]);
+      url += hex;
+    }
+    if (targetVersion.length())
+      url += "&version=" + targetVersion;
+
+    WiFiClient client;
+    HTTPClient http;
+    const char* headers[] = {"X-Signature"};
+    http.begin(client, url);
+    http.setTimeout(readTimeout);
+    http.collectHeaders(headers, 1);
+    int httpCode = http.GET();
+    if (httpCode != HTTP_CODE_OK) {
+      Serial.println("OTAHandler - No delta available (" + String(httpCode) + "), using the full image");
+      http.end();
+      return false;
+    }
+    readSignature(http);
+
+    DeltaContext context = {running, this};
+    DeltaPatcher patcher(readRunning, writeUpdate, &context);
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t buffer[512];
+    uint32_t lastData = millis();
+    bool ok = true;
+
+    mbedtls_sha256_starts_ret(&imageSha, 0);
+
+    Serial.println("OTAHandler - Applying delta...");
+    while (ok && !patcher.isFinished()) {
+      size_t available = stream->available();
+      if (available == 0) {
+        if (!stream->connected() || millis() - lastData > readTimeout) {
+          Serial.println("OTAHandler - Delta download interrupted");
+          ok = false;
         }
-      } else {
-        Serial.println("OTAHandler - Firmware download failed, HTTP error: " + String(httpCode));
+        vTaskDelay(1);
+        continue;
       }
 
+      // the header alone first, to check the base image before writing
+      size_t want = patcher.hasHeader() ? sizeof(buffer) : DeltaPatcher::headerSize;
+      size_t n = stream->readBytes(buffer, min(available, want));
+      lastData = millis();
+      bool hadHeader = patcher.hasHeader();
+      ok = patcher.write(buffer, n);
+
+      if (ok && !hadHeader && patcher.hasHeader()) {
+        ok = checkRunning(running, patcher.getOldSize(), patcher.getOldHash()) &&
+             Update.begin(patcher.getNewSize());
+        total = patcher.getNewSize();
+        if (!ok)
+          Serial.println("OTAHandler - Delta does not match the running image");
+      }
+      written = patcher.getProduced();
+    }
+    http.end();
+
+    mbedtls_sha256_finish_ret(&imageSha, imageHash);
+
+    if (ok && memcmp(imageHash, patcher.getNewHash(), sizeof(imageHash)) != 0) {
+      Serial.println("OTAHandler - Delta hash mismatch");
+      ok = false;
+    }
+    if (!ok) {
+      if (patcher.getError())
+        Serial.println(String("OTAHandler - Delta error: ") + patcher.getError());
+      restartImage();
+      return false;
+    }
+
+    Serial.println("OTAHandler - Delta applied, " + String(written) + " bytes");
+    return true;
+  }
+
+  struct DeltaContext {
+    const esp_partition_t* running;
+    OTAHandler* ota;
+  };
+
+  static bool readRunning(void* context, uint32_t offset, uint8_t* buffer, size_t size) {
+    DeltaContext* delta = static_cast<DeltaContext*>(context);
+    return esp_partition_read(delta->running, offset, buffer, size) == ESP_OK;
+  }
+
+  static bool writeUpdate(void* context, const uint8_t* data, size_t size) {
+    DeltaContext* delta = static_cast<DeltaContext*>(context);
+    mbedtls_sha256_update_ret(&delta->ota->imageSha, data, size);
+    return Update.write(const_cast<uint8_t*>(data), size) == size;
+  }
+
+  // SHA-256 of the first size bytes of the running partition
+  static bool checkRunning(const esp_partition_t* running, uint32_t size, const uint8_t* expected) {
+    if (size > running->size)
+      return false;
+    mbedtls_sha256_context sha;
+    uint8_t buffer[256];
+    uint8_t hash[32];
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    for (uint32_t offset = 0; offset < size; offset += sizeof(buffer)) {
+      size_t n = min((size_t)(size - offset), sizeof(buffer));
+      if (esp_partition_read(running, offset, buffer, n) != ESP_OK)
+        break;
+      mbedtls_sha256_update_ret(&sha, buffer, n);
+    }
+    mbedtls_sha256_finish_ret(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    return memcmp(hash, expected, sizeof(hash)) == 0;
+  }
+
+  // Returns true when the whole image has been written
+  bool download(const char* url) {
+    WiFiClient client;
+    HTTPClient http;
+    const char* headers[] = {"Content-Range", "X-Signature"};
+
+    http.begin(client, url);
+    http.setTimeout(readTimeout);
+    http.collectHeaders(headers, 2);
+    if (written > 0)
+      http.addHeader("Range", "bytes=" + String(written) + "-");
+
+    int httpCode = http.GET();
+
+    if (httpCode == HTTP_CODE_OK) {
+      if (written > 0) {  // server ignored the Range header, start over
+        Serial.println("OTAHandler - Server cannot resume, restarting download");
+        restartImage();
+      }
+      int contentLength = http.getSize();
+      if (contentLength <= 0) {
+        fail("Unknown firmware size");
+        http.end();
+        return false;
+      }
+      total = contentLength;  // Update.begin() waits for the first bytes (gzip or not)
+      readSignature(http);
+      startTime = millis();
+      Serial.println("OTAHandler - Begin OTA update...");
+    } else if (httpCode == HTTP_CODE_PARTIAL_CONTENT && written > 0) {
+      // Content-Range: bytes <first>-<last>/<total>
+      String range = http.header("Content-Range");
+      if ((uint32_t)range.substring(6).toInt() != written) {
+        Serial.println("OTAHandler - Unexpected Content-Range: " + range);
+        http.end();
+        return false;
+      }
+      Serial.println("OTAHandler - Resuming at " + String(written) + "/" + String(total));
+    } else {
+      Serial.println("OTAHandler - Firmware download failed, HTTP error: " + String(httpCode));
       http.end();
+      return false;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t buffer[1024];
+    uint32_t lastData = millis();
+
+    while (written < total) {
+      size_t available = stream->available();
+      if (available == 0) {
+        if (!stream->connected() || millis() - lastData > readTimeout)
+          break;  // dropped, resume on the next attempt
+        vTaskDelay(1);
+        continue;
+      }
 
-      if (!otaSuccess) {
-        Serial.println("OTAHandler - Retrying OTA in 5 seconds...");
-        delay(5000);
+      size_t n = stream->readBytes(buffer, min(available, sizeof(buffer)));
+      if (!decoder.write(buffer, n)) {
+        fail(Update.hasError() ? Update.errorString() : decoder.getError());
+        break;
       }
+      written += n;
+      lastData = millis();
     }
 
-    if (!otaSuccess) {
-      Serial.println("OTAHandler - Failed to perform OTA after " + String(maxRetries) + " attempts.");
+    http.end();
+    if (written == total)
+      printThroughput();
+
+    if (written != total && state == OTA_DOWNLOADING)
+      Serial.println("OTAHandler - Written only: " + String(written) + "/" + String(total));
+    return state == OTA_DOWNLOADING && written == total;
+  }
+
+  // Output of the decoder: the image, inflated if it was compressed
+  static bool writeImage(void* context, const uint8_t* data, size_t size) {
+    OTAHandler* ota = static_cast<OTAHandler*>(context);
+    if (!Update.isRunning() && !Update.begin(ota->decoder.isGzip() ? UPDATE_SIZE_UNKNOWN : ota->total)) {
+      Serial.println("OTAHandler - Not enough space to begin OTA");
+      return false;
     }
+    mbedtls_sha256_update_ret(&ota->imageSha, data, size);
+    return Update.write(const_cast<uint8_t*>(data), size) == size;
   }
 
-  void handleOtaMessage(const String& message) {
-    if (message == "update_firmware") {
-      Serial.println("OTAHandler - Initiating OTA update...");
-      performOTA();
+  void printThroughput() {
+    uint32_t elapsed = millis() - startTime;
+    if (elapsed == 0)
+      elapsed = 1;
+    Serial.printf("OTAHandler - %u bytes downloaded, %u bytes flashed (%s) in %u ms, %u kB/s\n",
+                  (unsigned)decoder.getInput(), (unsigned)decoder.getOutput(),
+                  decoder.isGzip() ? "gzip" : "raw", (unsigned)elapsed,
+                  (unsigned)(decoder.getInput() / elapsed));  // bytes per ms ~ kB/s
+  }
+
+  void advertise() {
+    String host = "scada-" + WiFi.macAddress();
+    host.replace(":", "");
+    host.toLowerCase();
+    advertised = true;  // once, even if it fails
+    imageSize = ESP.getSketchSize();  // reads and hashes the whole image: here on loop(), not on async_tcp
+    if (!MDNS.begin(host.c_str())) {
+      Serial.println("OTAHandler - mDNS failed, not sharing the image");
+      return;
     }
+    mdnsStarted = true;
+    MDNS.addService(OTA_PEER_SERVICE, "tcp", 80);
+    MDNS.addServiceTxt(OTA_PEER_SERVICE, "tcp", "version", FIRMWARE_VERSION);
+    Serial.println("OTAHandler - Sharing " FIRMWARE_VERSION " as " + host + ".local");
+  }
+
+  // GET OTA_PEER_PATH: the running image, "Range: bytes=N-" resumes it. The body is read
+  // from flash as the client acknowledges it, without holding the async_tcp task
+  void serveImage(AsyncWebServerRequest* request) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (pendingVerify || !running || !imageSize) {  // imageSize: set by advertise() once confirmed
+      request->send(503, "text/plain", "image not confirmed");
+      return;
+    }
+
+    uint32_t first = 0;
+    if (request->hasHeader("Range")) {
+      String range = request->header("Range");
+      if (range.startsWith("bytes="))
+        first = range.substring(6).toInt();
+    }
+    if (first >= imageSize) {
+      AsyncWebServerResponse* response = request->beginResponse(416, "text/plain", "");
+      response->addHeader("Content-Range", "bytes */" + String(imageSize));
+      request->send(response);
+      return;
+    }
+
+    uint32_t size = imageSize;
+    AsyncWebServerResponse* response = request->beginResponse(
+        "application/octet-stream", size - first,
+        [running, first](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+          // maxLen is capped by the response to what is left of Content-Length
+          if (esp_partition_read(running, first + index, buffer, maxLen) != ESP_OK)
+            return 0;  // the peer resumes with a Range request
+          return maxLen;
+        });
+    response->addHeader("X-Version", FIRMWARE_VERSION);
+    response->addHeader("Accept-Ranges", "bytes");
+    if (first) {
+      response->setCode(206);
+      response->addHeader("Content-Range", "bytes " + String(first) + "-" + String(size - 1) + "/" + String(size));
+    }
+    request->send(response);
+  }
+
+  void fail(const char* error) {
+    Serial.print("OTAHandler - Error: ");
+    Serial.println(error);
+    if (Update.isRunning())
+      Update.abort();
+    lastError = error;
+    state = OTA_FAILED;
   }
 
-private:
   //    PubSubClient& mqttClient;
-  const int maxRetries = 10;  // Maximum number of OTA retry attempts
+  const int maxRetries = 10;                // Maximum number of OTA retry attempts
+  const int peerRetries = 2;                // per neighbour, before the next one or the WAN
+  const uint32_t retryDelay = 5000;         // ms between two attempts
+  const uint32_t readTimeout = 15000;       // ms without data before resuming
+  const uint32_t restartDelay = 2000;       // ms to publish the final state
+
+  const char* firmwareUrl = FIRMWARE_URL;
+  const char* lastError = "";
+  volatile OTAState state = OTA_IDLE;       // written by the task, read by loop()
+  volatile uint32_t written = 0;
+  volatile uint32_t total = 0;
+  volatile int attempt = 0;
+  uint32_t doneTime = 0;
+  uint32_t startTime = 0;                   // first byte requested, or the scheduled start
+  bool tryDelta = false;
+  GzipDecoder decoder;
+  mbedtls_sha256_context imageSha;          // of the image written, whatever the transfer
+  uint8_t imageHash[32];
+
+  // rollout manifest
+  String targetVersion;
+  String manifestUrl;
+  uint32_t expectedSize = 0;
+  uint8_t expectedHash[32];
+  bool hasHash = false;
+  uint8_t signature[80];                    // DER, 72 bytes at most for P-256
+  size_t signatureSize = 0;
+
+  bool pendingVerify = false;               // running a new image not confirmed yet
+  uint32_t rolledBackSlot = 0;              // address of the invalid slot until rollbackReported()
+
+  // sharing with the neighbours
+  bool sharing = false;                     // serverOn() was called
+  bool advertised = false;                  // advertise() was tried
+  bool mdnsStarted = false;                 // and the responder runs
+  volatile uint32_t imageSize = 0;          // of the running image, 0 until advertise()
 };
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef OTAPUBLICKEY_H
+#define OTAPUBLICKEY_H
+
+// ECDSA P-256 public key checking the signature of every OTA image, in PEM.
+// Generate the pair once with
+//     python -m utils.signing genkey firmware_key.pem
+// (fastapi-scada/app), paste the public key printed here and give the
+// private key to the backend with FIRMWARE_SIGNING_KEY.
+// Left empty, every update is refused. A development build can define
+// OTA_ALLOW_UNSIGNED=1 to accept images checked only against their SHA-256;
+// each one is then logged as unsigned.
+#ifndef OTA_PUBLIC_KEY
+#define OTA_PUBLIC_KEY ""
+#endif
+
+#ifndef OTA_ALLOW_UNSIGNED
+#define OTA_ALLOW_UNSIGNED 0
+#endif
+
+#if OTA_ALLOW_UNSIGNED
+#warning "OTA_ALLOW_UNSIGNED: firmware images without a signature are accepted"
+#endif
+
+#endif
@@ -2,14 +2,21 @@
 #pragma once // chỉ đọc một lần
 #define _CMD_
 
+#define CMD_LINE_WAIT_MS 100 // chờ task khác ghi hết dòng tối đa, quá hạn (dòng bỏ dở) thì ghi chen vào
+
 class CMD : public Print // class CMD dùng chung hàm với class Print
 {
 public:
-    char buf[2048];      // biến đệm cmd
+    char buf[2048];      // vòng đệm cmd, byte thứ k (tính từ lúc khởi động) nằm ở buf[k % sizeof(buf)]
+    uint32_t seq = 0;    // tổng số byte đã ghi: vị trí ghi (head) là seq % sizeof(buf), byte cũ nhất (tail) là seq - sizeof(buf)
     uint8_t new_row = 1; // nếu là đầu dòng
     uint8_t count;       // đánh dấu thứ tự trong 1 giây
     uint32_t oldtime;    // đánh dấu thời gian
     uint8_t dir = 0;     //
+#if defined(ESP32)
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED; // loop() và task async_tcp cùng ghi / đọc
+    SemaphoreHandle_t line_mutex = xSemaphoreCreateMutex(); // mỗi dòng thuộc về một task: loop() và task log không chen vào dòng của nhau
+#endif
 
     CMD()
     {
@@ -23,10 +30,40 @@ public:
 
     void clear()
     {
-        for (unsigned int i = 0; i < sizeof(buf); i++) // quét loàn bộ dữ liệu của cmd
-        {                                              //
-            buf[i] = '-';                              // xóa dữ liệu
+        seq = 0; // vòng đệm rỗng
+    }
+
+    String lines_since(uint32_t &cursor) // các dòng đủ (kết thúc bằng '\n') ghi sau cursor, cursor trả về vị trí mới
+    {
+        static_assert((sizeof(buf) & (sizeof(buf) - 1)) == 0, "buf size must be a power of 2");
+        char copy[sizeof(buf)]; // chụp nhanh trong lúc khóa, xử lý sau
+#if defined(ESP32)
+        portENTER_CRITICAL(&lock);
+#endif
+        uint32_t end = seq;
+        memcpy(copy, buf, sizeof(buf));
+#if defined(ESP32)
+        portEXIT_CRITICAL(&lock);
+#endif
+
+        uint32_t oldest = end > sizeof(buf) ? end - sizeof(buf) : 0;
+        uint32_t start = cursor;
+        if (start < oldest || start > end)
+        { // client chậm hơn vòng đệm hoặc thiết bị vừa khởi động lại: gửi từ dòng đủ cũ nhất
+            start = oldest;
+            if (oldest > 0)
+                while (start < end && copy[start++ & (sizeof(buf) - 1)] != '\n')
+                    ;
         }
+        while (end > start && copy[(end - 1) & (sizeof(buf) - 1)] != '\n')
+            end--; // dòng đang ghi dở để lần sau
+
+        String output;
+        output.reserve(end - start);
+        for (uint32_t i = start; i < end; i++)
+            output += copy[i & (sizeof(buf) - 1)];
+        cursor = end;
+        return output;
     }
 
     String time_to_string()                                                               // chuyển ngày giờ thành chuỗi
@@ -45,8 +82,25 @@ public:
         return TimeStr; //
     } //
 
+    void line_lock() // đầu dòng, hoặc dòng dở của task khác: chờ đến lượt
+    {
+#if defined(ESP32)
+        if (xSemaphoreGetMutexHolder(line_mutex) != xTaskGetCurrentTaskHandle())
+            xSemaphoreTake(line_mutex, pdMS_TO_TICKS(CMD_LINE_WAIT_MS));
+#endif
+    }
+
+    void line_unlock() // hết dòng
+    {
+#if defined(ESP32)
+        if (xSemaphoreGetMutexHolder(line_mutex) == xTaskGetCurrentTaskHandle())
+            xSemaphoreGive(line_mutex);
+#endif
+    }
+
     virtual size_t write(uint8_t data) // hàm liên kết write
     {
+        line_lock();                       // giờ ở đầu dòng và nội dung dòng đi liền nhau
         if (new_row)                       //
         {                                  //
             new_row = 0;                   //
@@ -58,14 +112,22 @@ public:
             dir = 0;                       //
         }
 
-        for (unsigned int i = 0; i < sizeof(buf) - 1; i++) // chạy toàn bọ dũ liệu cmd
-            buf[i] = buf[i + 1];                           // dịch chuyển dữ liệu lên 1 ô
-        buf[sizeof(buf) - 1] = data;                       // ô cuối cùng lưu dữ liệu mới
+#if defined(ESP32)
+        portENTER_CRITICAL(&lock);
+#endif
+        buf[seq & (sizeof(buf) - 1)] = data; // ghi đè byte cũ nhất, không dịch chuyển
+        seq++;                               //
+#if defined(ESP32)
+        portEXIT_CRITICAL(&lock);
+#endif
         if (data == '\n')
             new_row = 1;    //
         Serial.write(data); // xuất lên serial
+        if (new_row)
+            line_unlock();  // task khác được ghi
         return 1;           // báo thành công và tiếp tục
     }
+    using Print::write; // write(buffer, size) của Print, ghi từng byte qua write(uint8_t)
 };
 CMD cmd; // tạo class CMD với định dạng của class cmd
 
@@ -76,28 +138,32 @@ void cmd_available(String data);
 void cmd_server_on() // hàm khởi chạy cmd từ server
 {
 
-    server.on("/CMD", HTTP_GET, []() {                    // nếu yêu cầu mở cmd
-        FLASH_ACTIVE_LED;                                 // bật đèn
-        server.sendHeader("Location", "/CMD.html", true); // chuyển hướng đến file CMD.html
-        server.send(302, "text/plain", "");               // xác nhận chuyển hướng
-    });                                                   //
-
-    server.on("/cmd", HTTP_GET, []() {                    // nếu yêu cầu mở cmd
-        FLASH_ACTIVE_LED;                                 // bật đèn
-        server.sendHeader("Location", "/CMD.html", true); // chuyển hướng đến file CMD.html
-        server.send(302, "text/plain", "");               // xác nhận chuyển hướng
-    });                                                   //
-
-    server.on("/_CMD_", HTTP_GET, []() {         // nếu yêu cầu dữ liệu từ cmd
-        FLASH_ACTIVE_LED;                        // bật đèn
-        server.send(200, "text/plain", cmd.buf); // gửi dữ liệu
-    });                                          //
-
-    server.on("/_CMD_", HTTP_PUT, []() {  // nhận dữ liệu
-        FLASH_ACTIVE_LED;                 // bật led báo
-        String buf = server.arg("plain"); //
-        cmd_available(buf);               //
-        cmd.dir = 1;                      //
-        cmd.println(buf);                 //
-    });                                   //
+    server.on("/CMD", HTTP_GET, [](AsyncWebServerRequest *request) { // nếu yêu cầu mở cmd
+        FLASH_ACTIVE_LED;                                            // bật đèn
+        request->redirect("/CMD.html");                              // chuyển hướng đến file CMD.html
+    });                                                              //
+
+    server.on("/cmd", HTTP_GET, [](AsyncWebServerRequest *request) { // nếu yêu cầu mở cmd
+        FLASH_ACTIVE_LED;                                            // bật đèn
+        request->redirect("/CMD.html");                              // chuyển hướng đến file CMD.html
+    });                                                              //
+
+    server.on("/_CMD_", HTTP_GET, [](AsyncWebServerRequest *request) {               // nếu yêu cầu dữ liệu từ cmd
+        FLASH_ACTIVE_LED;                                                            // bật đèn
+        uint32_t cursor = strtoul(request->arg("since").c_str(), NULL, 10);          // vị trí client đã đọc tới, mặc định 0
+        String lines = cmd.lines_since(cursor);                                      // chỉ các dòng mới
+        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", lines);
+        response->addHeader("X-Cmd-Seq", String(cursor));                            // since của lần hỏi sau
+        request->send(response);                                                     // gửi dữ liệu
+    });                                                                              //
+
+    server.on("/_CMD_", HTTP_PUT, [](AsyncWebServerRequest *request) { // nhận dữ liệu
+        FLASH_ACTIVE_LED;                                              // bật led báo
+        String buf = web_body(request);                                //
+        web_defer(request, "text/plain", [buf](String &output) {       // lệnh chạy trên loop()
+            cmd_available(buf);                                        //
+            cmd.dir = 1;                                               //
+            cmd.println(buf);                                          //
+        });                                                            //
+    }, NULL, web_body_collect);                                        //
 }
@@ -11,15 +11,7 @@
 #define FLASH_ACTIVE_LED digitalWrite(LED_BUILTIN, LED_BUILTIN_ON_STATE); // thay thế chớp led
 #endif
 
-#if defined(ESP8266)          //
-#include <ESP8266WebServer.h> // thư viện server
-ESP8266WebServer server(80);  // chạy server port 80
-#endif                        //
-
-#if defined(ESP32)
-#include <WebServer.h> // thư viện server
-WebServer server(80);  // chạy server port 80
-#endif                 //
+#include "web_server.h" // server bất đồng bộ, chạy server port 80
 
 #include <Arduino.h> // thư viện hàm arduino
 
@@ -43,30 +35,33 @@ RTCDateTime DayTime;                                                  // biến
 
 
 #include "CMD.h"          // thư viện xuất serial trên web
+#include "log.h"          // log có cấp độ, xuất nền qua cmd
+#include "metrics.h"      // bộ đếm, histogram thời gian, /metrics
 #include "fileFS.h"       // thư viện xử lý file
 #include "firmware.h"     // thư viện xử lý update frimware
 #include "wifi_setting.h" // thư viện xử lý kết nối wifi
 
-void handleNotFound()
-{                                                              // hàm thực hiện khi trang yêu cầu không tồn tại
-    FLASH_ACTIVE_LED;                                          // bật đèn
-    String message = "File Not Found\n\n";                     // báo trang yêu cầu không tồn tại
-    message += "URI: ";                                        // URI
-    message += server.uri();                                   // hiện thị URI
-    message += "\nMethod: ";                                   // Method
-    message += (server.method() == HTTP_GET) ? "GET" : "POST"; // hiện thị loại Method
-    message += "\nArguments: ";                                // Arguments
-    message += server.args();                                  // hiện thị Arguments
-    message += "\n";                                           // xuống hàng
-    for (uint8_t i = 0; i < server.args(); i++)
-    {                                                                     // tìm tất cả các arg
-        message += " " + server.argName(i) + ": " + server.arg(i) + "\n"; // hiển thị arg và giá trị
+void handleNotFound(AsyncWebServerRequest *request)
+{                                                                // hàm thực hiện khi trang yêu cầu không tồn tại
+    FLASH_ACTIVE_LED;                                            // bật đèn
+    String message = "File Not Found\n\n";                       // báo trang yêu cầu không tồn tại
+    message += "URI: ";                                          // URI
+    message += request->url();                                   // hiện thị URI
+    message += "\nMethod: ";                                     // Method
+    message += (request->method() == HTTP_GET) ? "GET" : "POST"; // hiện thị loại Method
+    message += "\nArguments: ";                                  // Arguments
+    message += request->args();                                  // hiện thị Arguments
+    message += "\n";                                             // xuống hàng
+    for (uint8_t i = 0; i < request->args(); i++)
+    {                                                                         // tìm tất cả các arg
+        message += " " + request->argName(i) + ": " + request->arg(i) + "\n"; // hiển thị arg và giá trị
     } //
-    server.send(404, "text/plain", message); // trả về kết quả dạng text
+    request->send(404, "text/plain", message); // trả về kết quả dạng text
 } //
 
 void Wifi_und_file_begin()
 {
+    log_begin();    // task xuất log
     fileFS_begin(); // khỏi tạo fileFS nếu lỗi trả về 0 nếu hoàn thành trả về 1
     wifi_begin();   // thiết lập wifi
 
@@ -76,19 +71,23 @@ void Wifi_und_file_begin()
 void Wifi_und_file_server_on()
 {
     cmd_server_on();             // hàm chạy cmd từ web
+    log_server_on();             // log nhị phân /log
+    metrics_server_on();         // số liệu Prometheus /metrics
     fileFS_server_on();          // hàm chạy fileFS từ web
     firmware_update_server_on(); // hàm chạy firmware update từ web
     wifi_server_on();            // hàm chạy wifi từ web
 
-    server.on("/reset", []() {                  // lệnh reset
-        FLASH_ACTIVE_LED;                       // bật đèn
-        server.send(200, "text/html", "reset"); // thông báo
-        delay(100);                             // đợi một chút
-        ESP.restart();                          // reset
-    });                                         //
+    server.on("/reset", [](AsyncWebServerRequest *request) { // lệnh reset
+        FLASH_ACTIVE_LED;                                    // bật đèn
+        request->send(200, "text/html", "reset");            // thông báo
+        web_restart();                                       // reset khi đã gửi xong
+    });                                                      //
 
+    server.on("/*", HTTP_GET, [](AsyncWebServerRequest *request) { // file trong FILESYSTEM, đăng ký sau cùng
+        if (!fileFS_send_static(request, "max-age=86400"))           // bản nén sẵn .gz nếu có, kèm ETag
+            handleNotFound(request);                                 //
+    });                                                              //
     server.onNotFound(handleNotFound); // không tìn thấy trang yêu cầu
-    server.serveStatic("/", FILESYSTEM, "/", "max-age=86400");
 }
 
 void Wifi_und_file_loop()
@@ -1,13 +1,7 @@
 
 #pragma once // chỉ đọc một lần
 
-#if defined(ESP8266)          // nếu là ESP8266
-#include <ESP8266WebServer.h> // thư viện server
-#endif                        // ESP8266                                                          //
-
-#if defined(ESP32)     // nếu là ESP32
-#include <WebServer.h> // thư viện server
-#endif                 // ESP32
+#include "web_server.h" // thư viện server
 
 #include <FS.h>                  // thư viện quản lý file
 #include <ArduinoJson.h>         // thư viện chuẩn dữ liệu
@@ -60,10 +54,11 @@ String getContentType(String filename)   // chuyển đổi phần mở rộng t
 
 uint8_t fileFS_begin()                              // khỏi tạo fileFS nếu lỗi trả về 0 nếu hoàn thành trả về 1
 {                                                   //
-    SERIAL.println("mounting " FILESYSTEMSTR "..."); // thông báo khởi động hệ thống file
+    LOG_I(LOG_FILE, "mounting %s...", FILESYSTEMSTR); // thông báo khởi động hệ thống file
     if (!FILESYSTEM.begin(true))                    //
     {                                               // nếu hệ thống file khởi động không thành công
-        SERIAL.println("Failed to mount file system"); // thông báo không thể khởi động hệ thống file
+        LOG_E(LOG_FILE, "failed to mount file system"); // thông báo không thể khởi động hệ thống file
+        delay(100);                                 // đợi task log xuất dòng trên
         ESP.restart();                              // khỏi động lại ESP
         return 0;                                   // thoát
     }
@@ -87,14 +82,186 @@ uint8_t fileFS_begin()                              // khỏi tạo fileFS nếu
 //     file.close();                             // đóng tệp
 // }
 
-String format_Json(String data){
-    data.replace("{", "{\r\n");               // thêm dấu enter sau dấu {
-    data.replace("}", "\r\n}");               // thêm dấu enter trước dấu }
-    data.replace("},\"", "},\r\n\r\n\"");     // thêm 2 dấu enter giữa 2 nhóm dữ liệu
-    data.replace(",\"", ",\r\n\"");           // thêm dấu enter sau mỗi dữ liệu
-    return data;
+// Định dạng json khi đang ghi, không cần chuỗi trung gian:
+//   JsonLineWriter writer(file);
+//   serializeJson(JsonData, writer);
+// cho kết quả giống hệt 4 lần String::replace của format_Json trước đây:
+//   "{" -> "{\r\n", "}" -> "\r\n}", "},\"" -> "},\r\n\r\n\"", ",\"" -> ",\r\n\""
+class JsonLineWriter : public Print
+{
+public:
+    JsonLineWriter(Print &out) : out(out) {}
+    ~JsonLineWriter() { flush(); }
+    using Print::write; // giữ write(buf, size) của Print
+
+    virtual size_t write(uint8_t c)
+    {
+        if (comma)
+        {                                // dấu phẩy đang chờ ký tự kế tiếp
+            comma = 0;                   //
+            if (c == '"')                // ,"  -> thêm enter
+                out.print(prev == '}' ? ",\r\n\r\n" : ",\r\n");
+            else                         //
+                out.write(',');          // giữ nguyên dấu phẩy
+            prev = ',';                  //
+        }
+
+        if (c == '{')
+            out.print("{\r\n");          // thêm dấu enter sau dấu {
+        else if (c == '}')
+            out.print("\r\n}");          // thêm dấu enter trước dấu }
+        else if (c == ',')
+        {                                // chưa biết ký tự sau dấu phẩy
+            comma = 1;                   //
+            return 1;                    //
+        }
+        else
+            out.write(c);                //
+        prev = c;                        // ký tự gốc trước đó
+        return 1;
+    }
+
+    virtual void flush()
+    {                                    // ghi dấu phẩy còn treo ở cuối
+        if (comma)
+            out.write(',');
+        comma = 0;
+    }
+
+private:
+    Print &out;         // nơi ghi thật (File, Serial...)
+    uint8_t prev = 0;   // ký tự gốc trước dấu phẩy
+    uint8_t comma = 0;  // có dấu phẩy đang chờ
+};
+
+uint32_t fileFS_crc32(uint32_t crc, uint8_t data) // CRC-32 (IEEE), bắt đầu với crc = 0xFFFFFFFF, kết thúc đảo bit
+{                                                 //
+    crc ^= data;                                  //
+    for (uint8_t i = 0; i < 8; i++)               //
+        crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    return crc;
+}
+
+class CrcPrint : public Print // đếm byte và tính CRC trên dữ liệu ghi đi qua
+{
+public:
+    CrcPrint(Print &out) : out(out) {}
+    using Print::write;
+
+    virtual size_t write(uint8_t c)
+    {
+        crc = fileFS_crc32(crc, c); //
+        count++;                    //
+        return out.write(c);        // ghi tiếp ra nơi thật
+    }
+
+    uint32_t value() { return ~crc; } // giá trị CRC đến hiện tại
+
+    uint32_t count = 0;            // số byte đã ghi
+
+private:
+    Print &out;                    //
+    uint32_t crc = 0xFFFFFFFF;     //
+};
+
+bool fileFS_commit(const char *tmp, const char *path) // thay file path bằng file tạm đã ghi xong
+{                                                     //
+    if (FILESYSTEM.exists(path) && !FILESYSTEM.remove(path)) // SPIFFS không rename đè lên file có sẵn
+        return false;                                 //
+    return FILESYSTEM.rename(tmp, path);              // đổi tên là bước cuối cùng
+}
+
+
+// Trang web trong FILESYSTEM được nén sẵn lúc build (tools/gzip_data.py): index.html -> index.html.gz, giữ cả bản gốc
+//  - trình duyệt nhận gzip: gửi file .gz với Content-Encoding: gzip, ít byte phải đọc từ SPIFFS hơn
+//  - client không nhận gzip (curl không --compressed, HMI nhúng, proxy): gửi bản gốc, không có thì 406
+//  - ETag mạnh lấy từ CRC-32 và kích thước ở 8 byte cuối file .gz, không cần đọc cả file
+//  - If-None-Match trùng ETag: trả 304, không đọc file
+String fileFS_gzip_etag(File &file) // "crc-kích thước" của nội dung gốc, rỗng nếu file không phải gzip
+{
+    uint8_t trailer[8];
+    size_t size = file.size();
+    if (size < 18 || !file.seek(size - 8) || file.read(trailer, 8) != 8) // 10 byte header + 8 byte trailer
+        return String();
+    file.seek(0);
+    uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+    uint32_t length = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08lx-%lx\"", (unsigned long)crc, (unsigned long)length);
+    return etag;
+}
+
+bool fileFS_send_static(AsyncWebServerRequest *request, const char *cache_control) // false nếu không có file
+{
+    String path = request->url();
+    if (path.endsWith("/"))
+        path += "index.html";
+    String gz = path + ".gz";
+
+    if (!FILESYSTEM.exists(gz))
+    { // file không nén (json, ảnh...): như serveStatic trước đây
+        if (!FILESYSTEM.exists(path))
+            return false;
+        AsyncWebServerResponse *response = request->beginResponse(FILESYSTEM, path, getContentType(path));
+        response->addHeader("Cache-Control", cache_control);
+        request->send(response);
+        return true;
+    }
+
+    if (!request->hasHeader("Accept-Encoding") || request->header("Accept-Encoding").indexOf("gzip") < 0)
+    {
+        if (!FILESYSTEM.exists(path)) // chỉ có bản nén (upload riêng file .gz)
+        {
+            request->send(406, "text/plain", "406: gzip encoding required");
+            return true;
+        }
+        AsyncWebServerResponse *response = request->beginResponse(FILESYSTEM, path, getContentType(path));
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Vary", "Accept-Encoding");
+        request->send(response);
+        return true;
+    }
+
+    File file = FILESYSTEM.open(gz, "r");
+    String etag = fileFS_gzip_etag(file);
+    AsyncWebServerResponse *response;
+    if (etag.length() && request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag)
+    { // trình duyệt đã có bản này
+        response = request->beginResponse(304);
+    }
+    else
+    {
+        response = request->beginResponse(getContentType(path), file.size(), [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+            return file.read(buffer, maxLen); // file đóng khi response kết thúc
+        });
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    if (etag.length())
+        response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache"); // luôn hỏi lại bằng ETag: cập nhật trang thấy ngay, không đổi thì 304
+    response->addHeader("Vary", "Accept-Encoding");
+    request->send(response);
+    return true;
+}
+
+bool fileFS_web_page(const String &filename) // loại file tools/gzip_data.py nén sẵn
+{
+    return filename.endsWith(".html") || filename.endsWith(".htm") || filename.endsWith(".css") ||
+           filename.endsWith(".js") || filename.endsWith(".svg");
 }
 
+void fileFS_drop_copy(const String &filename) // file vừa ghi thay cho bản kia (nén sẵn / gốc) của cùng trang
+{
+    if (!filename.endsWith(".gz"))
+    {
+        if (FILESYSTEM.exists(filename + ".gz")) // bản nén cũ sẽ che file mới
+            FILESYSTEM.remove(filename + ".gz");
+        return;
+    }
+    String plain = filename.substring(0, filename.length() - 3);
+    if (fileFS_web_page(plain) && FILESYSTEM.exists(plain)) // bản gốc cũ sẽ đến tay client không nhận gzip
+        FILESYSTEM.remove(plain);
+}
 
 // void DataFile_read()                                                  // đọc file data
 // {                                                                     //
@@ -115,292 +282,490 @@ String format_Json(String data){
 //     format_Json_document("/data.json");             // định dạng lại file
 // }
 
-File fsUploadFile;                                       // tạo hệ thống tệp để lưu file
-void handleFileUpload()                                  // hàm upload file vào FILESYSTEM
-{                                                        //
-    HTTPUpload &upload = server.upload();                // thư viện upload
-    if (upload.status == UPLOAD_FILE_START)              // nếu là bắt đầu upload
-    {                                                    //
-        String filename = upload.filename;               // đọc tên file
-        if (!filename.startsWith("/"))                   //
-            filename = "/" + filename;                   // nếu tên file không bắt đầu bằng dấu "/" thì thêm dấu "/" vào tên file
-        SERIAL.print("handleFileUpload Name: " + filename); // xuất lên serial
-        fsUploadFile = FILESYSTEM.open(filename, "w");   // mở file ở chế độ ghi
-        filename = String();                             // xóa tên file
+// Danh sách file gửi dạng chunked trong lúc duyệt thư mục, bộ nhớ cố định:
+// mỗi lần server cần thêm dữ liệu thì đọc thêm một mục và định dạng nó vào một dòng đệm
+#define FILE_LIST_DEPTH 4   // số cấp thư mục tối đa
+#define FILE_LIST_LINE  1024 // byte, một dòng của bảng: đủ cho tên SPIFFS 31 ký tự đã escape hết
+
+const char FILE_LIST_HEAD[] =
+    "<!DOCTYPE html><html><head><meta charset='utf-8'>"
+    "<meta http-equiv='X-UA-Compatible' content='IE=edge'>"
+    "<title>File Manager</title>"
+    "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
+    "</head><body>"
+    "<style>" // định dạng table
+    "table {border-collapse:collapse;border-spacing:0;width:100%;display:table;border:1px solid #ccc;}"
+    "tr:nth-child(odd)  {background-color:#fff}"
+    "tr:nth-child(even) {background-color: #dddddd;}"
+    "</style>"
+    "<table><thead><tr height='30px' style='background-color: #ff8888;'>"
+    "<th width='100%' align='left'><a>Hyperlink</a></th>"
+    "</tr></thead>"
+    "<tr><td align='left'><a href='/reset'>Reset</a></td></tr>"
+    "<tr><td align='left'><a href='/'>Home page</a></td></tr>"
+    "<tr><td align='left'><a href='/wifi'>Wifi setting</a></td></tr>"
+    "<tr><td align='left'><a href='/cmd'>Comman Port</a></td></tr>"
+    "<tr><td align='left'><a href='/firmware'>Firmware Update</a></td></tr>"
+    "<tr><td align='left'><a href='/DataFileRead'>Read data flie</a></td></tr>"
+    "<tr><td align='left'><a href='/DataFileWrite'>Write data flie</a></td></tr>"
+    "</table><br>"
+    "<table><thead><tr height='30px' style='background-color: #ff8888;'>"
+    "<th width='30%' align='left'><a>filename</a></th>"
+    "<th width='10%' align='center'><a>size</a></th>"
+    "<th width='20%' align='center'><a>download</a></th>"
+    "<th width='20%' align='center'><a>edit</a></th>"
+    "<th width='20%' align='center'><a>delete</a></th>"
+    "</tr></thead>";
+
+const char FILE_LIST_TAIL[] =
+    "<form method='post' enctype='multipart/form-data'>" // form upload file
+    "<input type='file' name='name'>"
+    "<input class='button' type='submit' value='Upload'>"
+    "</form><br><br></body></html>";
+
+struct FileList
+{
+    bool json;                   // /file_list hay /file
+    uint8_t part = 0;            // 0 đầu trang, 1 các dòng, 2 cuối trang, 3 hết
+    File dirs[FILE_LIST_DEPTH];  // các thư mục đang duyệt
+    uint8_t depth = 0;           //
+    bool first = true;           // mục Json đầu tiên, chưa cần dấu phẩy
+    const char *out = NULL;      // phần đang gửi dở
+    size_t out_len = 0;          //
+    size_t out_pos = 0;          //
+    char line[FILE_LIST_LINE];   // dòng đệm
+};
+
+enum FileListEscape // cách chép tên file vào dòng
+{
+    FILE_LIST_RAW,  // phần cố định của dòng
+    FILE_LIST_JSON, // trong chuỗi Json: " \ và ký tự điều khiển
+    FILE_LIST_HTML, // chữ trong trang: & < > " '
+    FILE_LIST_URL,  // href và ?name=: %XX trừ chữ, số, - _ . ~ /
+};
+
+// chép text vào list.line từ vị trí at, false khi dòng đệm không đủ chỗ
+bool fileList_put(FileList &list, size_t &at, const char *text, FileListEscape escape = FILE_LIST_RAW)
+{
+    for (; *text; text++)
+    {
+        uint8_t c = *text;
+        char piece[8] = {(char)c, 0};
+        const char *out = piece;
+        switch (escape)
+        {
+        case FILE_LIST_JSON:
+            if (c == '"' || c == '\\')
+                snprintf(piece, sizeof(piece), "\\%c", c);
+            else if (c < 0x20)
+                snprintf(piece, sizeof(piece), "\\u%04x", c);
+            break;
+        case FILE_LIST_HTML:
+            if (c == '&')
+                out = "&amp;";
+            else if (c == '<')
+                out = "&lt;";
+            else if (c == '>')
+                out = "&gt;";
+            else if (c == '"')
+                out = "&quot;";
+            else if (c == '\'')
+                out = "&#39;";
+            break;
+        case FILE_LIST_URL:
+            if (!isalnum(c) && !strchr("-_.~/", c))
+                snprintf(piece, sizeof(piece), "%%%02X", c);
+            break;
+        default:
+            break;
+        }
+        size_t n = strlen(out);
+        if (at + n >= sizeof(list.line))
+            return false;
+        memcpy(list.line + at, out, n);
+        at += n;
     }
+    list.line[at] = 0;
+    return true;
+}
 
-    else if (upload.status == UPLOAD_FILE_WRITE)                // nếu ở giai đoạn ghi giữ liệu
-    {                                                           //
-        if (fsUploadFile)                                       //
-            fsUploadFile.write(upload.buf, upload.currentSize); // ghi dữ liệu nhận được vào file
+bool fileList_next(FileList &list) // chuẩn bị phần kế tiếp vào list.out, false khi hết
+{
+    list.out = list.line;
+    list.out_pos = 0;
+    switch (list.part)
+    {
+    case 0: // đầu trang, mở thư mục gốc
+        list.dirs[0] = FILESYSTEM.open("/");
+        list.depth = list.dirs[0] ? 1 : 0;
+        list.part = 1;
+        list.out = list.json ? "[" : FILE_LIST_HEAD;
+        list.out_len = strlen(list.out);
+        return true;
+
+    case 1: // một file hoặc thư mục
+        while (list.depth)
+        {
+            File file = list.dirs[list.depth - 1].openNextFile();
+            if (!file)
+            { // hết thư mục này, quay về thư mục cha
+                list.dirs[--list.depth].close();
+                continue;
+            }
+#if defined(ESP32)
+            const char *path = file.path(); // đường dẫn đầy đủ, dùng cho link
+#else
+            const char *path = file.fullName();
+#endif
+            const char *name = file.name(); // tên trong thư mục
+            if (list.depth == 1 && path[0] == '/')
+                name = path + 1; // SPIFFS không có thư mục thật: "/a/b.txt" nằm ngay ở gốc
+            bool directory = file.isDirectory();
+            char tab[6 * FILE_LIST_DEPTH + 1] = ""; // thụt lề theo cấp thư mục
+            for (uint8_t i = 1; i < list.depth; i++)
+                strcat(tab, "&emsp;");
+
+            // tên file do người upload đặt: escape mọi chỗ chèn vào Json / trang
+            size_t at = 0;
+            bool ok;
+            if (list.json)
+            {
+                char tail[48];
+                snprintf(tail, sizeof(tail), "\",\"size\":%u,\"dir\":%s}", directory ? 0u : (unsigned)file.size(),
+                         directory ? "true" : "false");
+                ok = fileList_put(list, at, list.first ? "{\"name\":\"" : ",{\"name\":\"") &&
+                     fileList_put(list, at, path, FILE_LIST_JSON) &&
+                     fileList_put(list, at, tail);
+            }
+            else if (directory)
+                ok = fileList_put(list, at, "<tr><td width='30%' align='left'>") &&
+                     fileList_put(list, at, tab) &&
+                     fileList_put(list, at, name, FILE_LIST_HTML) &&
+                     fileList_put(list, at, "</td><td></td><td></td><td></td><td></td></tr>");
+            else
+            {
+                char size[48];
+                snprintf(size, sizeof(size), "</a></td><td align='center'>%uB</td>", (unsigned)file.size());
+                ok = fileList_put(list, at, "<tr><td align='left'>") &&
+                     fileList_put(list, at, tab) &&
+                     fileList_put(list, at, "<a href='") &&
+                     fileList_put(list, at, path, FILE_LIST_URL) &&
+                     fileList_put(list, at, "'>") &&
+                     fileList_put(list, at, name, FILE_LIST_HTML) &&
+                     fileList_put(list, at, size) &&
+                     fileList_put(list, at, "<td align='center'><a href='/file_download?name=") &&
+                     fileList_put(list, at, path, FILE_LIST_URL) &&
+                     fileList_put(list, at, "'>download</a></td><td align='center'><a href='/file_edit.html?name=") &&
+                     fileList_put(list, at, path, FILE_LIST_URL) &&
+                     fileList_put(list, at, "'>edit</a></td><td align='center'><a href='/file_delete?name=") &&
+                     fileList_put(list, at, path, FILE_LIST_URL) &&
+                     fileList_put(list, at, "'>delete</a></td></tr>");
+            }
+            if (directory && list.depth < FILE_LIST_DEPTH)
+                list.dirs[list.depth++] = file; // vào thư mục con ở lần sau
+            if (!ok)
+            { // dòng bị cắt sẽ hỏng Json / trang: bỏ file này
+                LOG_W(LOG_FILE, "list: %s too long", path);
+                continue;
+            }
+            list.first = false;
+            list.out_len = at;
+            return true;
+        }
+        list.part = 2;
+        // fall through: hết file thì gửi cuối trang
+
+    case 2: // cuối trang, kèm dung lượng đã dùng
+        list.part = 3;
+        if (list.json)
+            list.out_len = snprintf(list.line, sizeof(list.line), "]");
+        else
+            list.out_len = snprintf(list.line, sizeof(list.line), "</table><p>%u / %u B</p>%s",
+                                    (unsigned)FILESYSTEM.usedBytes(), (unsigned)FILESYSTEM.totalBytes(),
+                                    FILE_LIST_TAIL);
+        return list.out_len < sizeof(list.line); // FILE_LIST_TAIL vừa dòng đệm
+
+    default:
+        list.out_len = 0; // đã gửi hết
+        return false;
     }
+}
 
-    else if (upload.status == UPLOAD_FILE_END)      // nếu kết thúc quá trình ghi
-    {                                               //
-        if (fsUploadFile)                           //
-        {                                           // nếu hoàn tất quá trình ghi file
-            fsUploadFile.close();                   // đóng file
-            server.sendHeader("Location", "/file"); // chuyển hướng
-            server.send(303);                       // xác nhận lệnh chuyển hướng
+void fileList_send(AsyncWebServerRequest *request, bool json)
+{
+    std::shared_ptr<FileList> list = std::make_shared<FileList>(); // file đóng khi response kết thúc
+    list->json = json;
+    request->sendChunked(json ? "application/json" : "text/html", [list](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        size_t n = 0;
+        while (n < maxLen)
+        {
+            if (list->out_pos == list->out_len && !fileList_next(*list))
+                break; // hết, trả về 0 ở lần gọi sau
+            size_t k = list->out_len - list->out_pos;
+            if (k > maxLen - n)
+                k = maxLen - n;
+            memcpy(buffer + n, list->out + list->out_pos, k);
+            list->out_pos += k;
+            n += k;
         }
-        else                                                             //
-        {                                                                // nếu quá trình ghi bị lỗi
-            server.send(500, "text/plain", "500: couldn't create file"); // báo không thể hoàn thành ghi dữ liệu
-        } //
-    } //
-} //
+        return n;
+    });
+}
 
-void fileFS_server_on()                  // server on
-{                                        //
-    server.on("/file", HTTP_POST, []() { // nếu máy khách đăng upload file
-        FLASH_ACTIVE_LED;                // bật đèn
-        server.send(200);                // gửi status 200 (OK) tới máy khách báo đã sẵn sàng nhận file
-    },                                   //
-              handleFileUpload);         // nhận và lưu file
-
-    server.on("/file", HTTP_GET, []() {                                                   // trang quản lý file
-        FLASH_ACTIVE_LED;                                                                 // bật đèn
-        String html;                                                                      //
-        html += "<!DOCTYPE html>";                                                        //
-        html += "<html>";                                                                 //
-        html += "<head>";                                                                 //
-        html += "<meta charset='utf-8'>";                                                 //
-        html += "<meta http-equiv='X-UA-Compatible' content='IE=edge'>";                  //
-        html += "<title>File Manager</title>";                                            //
-        html += "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"; //
-        html += "</head>";                                                                //
-        html += "<body>";                                                                 //
-
-        html += "<style>";                                                                                           // định dạng table
-        html += "table {border-collapse:collapse;border-spacing:0;width:100%;display:table;border:1px solid #ccc;}"; //
-        html += "tr:nth-child(odd)  {background-color:#fff}";                                                        //
-        html += "tr:nth-child(even) {background-color: #dddddd;}";                                                   //
-        html += "</style>";                                                                                          //
-
-        html += "<table>";                                                                     //
-        html += "<thead>";                                                                     //
-        html += "<tr height='30px' style='background-color: #ff8888;'>";                       //
-        html += "<th width='100%' align='left'><a>Hyperlink</a></th>";                         //
-        html += "</tr>";                                                                       //
-        html += "</thead>";                                                                    //
-        html += "<tr><td align='left'><a href='/reset'>Reset</a></td></tr>";                   //
-        html += "<tr><td align='left'><a href='/'>Home page</a></td></tr>";                    //
-        html += "<tr><td align='left'><a href='/wifi'>Wifi setting</a></td></tr>";             //
-        html += "<tr><td align='left'><a href='/cmd'>Comman Port</a></td></tr>";               //
-        html += "<tr><td align='left'><a href='/firmware'>Firmware Update</a></td></tr>";             //
-        html += "<tr><td align='left'><a href='/DataFileRead'>Read data flie</a></td></tr>";   //
-        html += "<tr><td align='left'><a href='/DataFileWrite'>Write data flie</a></td></tr>"; //
-        html += "</table>";                                                                    //
-        html += "<br>";                                                                        //
-
-        html += "<table>";                                               // tạo table
-        html += "<thead>";                                               //
-        html += "<tr height='30px' style='background-color: #ff8888;'>"; // tạo dấu ngắt định dạng table
-        html += "<th width='30%' align='left'><a>filename</a></th>";     // hiển thị tên file
-        html += "<th width='10%' align='center'><a>size</a></th>";       // hiển thị kích thước file
-        html += "<th width='20%' align='center'><a>download</a></th>";   // hiển thị phím tải xuống file
-        html += "<th width='20%' align='center'><a>edit</a></th>";       // hiển thị phím sửa file
-        html += "<th width='20%' align='center'><a>delete</a></th>";     // hiển thị phím xóa file
-        html += "</tr>";                                                 // kết thúc dòng table
-        html += "</thead>";                                              //
-
-        SERIAL.println("scan file");                    // hiển thị tên file lên serial
-        DynamicJsonDocument root(4096);                 // tạo tệp Json
-        String filehref;                                //
-        String filename;                                //
-        String filesize;                                //
-        String tab_str;                                 //
-        String dir_str;                                 //
-        int tab_of_dir = 1;                             //
-        root["dir" + String(tab_of_dir)] = "/";         //
-        root["dir" + String(tab_of_dir) + "count"] = 0; //
-
-    next_dir: //
-#if defined(ESP8266)
-        dir_str = String(root["dir" + String(tab_of_dir)]); //
-        Dir dir = FILESYSTEM.openDir(dir_str);              //
-        SERIAL.println("open directory: " + dir_str);       // hiển thị tên file lên serial
-
-        for (int i = 0; i < int(root["dir" + String(tab_of_dir) + "count"]); i++)
-            dir.next(); // bỏ qua các tệp đã đọc trước đó
-
-    next_file:
-        root["dir" + String(tab_of_dir) + "count"] = int(root["dir" + String(tab_of_dir) + "count"]) + 1;
-
-        if (dir.next())
-        { //
-
-            filename = String(dir.fileName()); // đọc tên file
-            filesize = String(dir.fileSize()); // đọc kích thước file
-            tab_str = "";                      //
-            for (int i = 1; i < tab_of_dir; i++)
-                tab_str += "&emsp;"; //
-
-            if (filename.startsWith("/"))
-                filename = filename.substring(1); // nếu tên file bắt đầu bằng dấu "/" thì xóa dấu "/"
-            if (dir.isDirectory())
-            {                                            // nếu là thư mục
-                cmd.println(filename + " is directory"); // hiển thị tên file lên serial
-                tab_of_dir++;                            //
-                root["dir" + String(tab_of_dir)] = String(root["dir" + String(tab_of_dir - 1)]) + filename + "/";
-                root["dir" + String(tab_of_dir) + "count"] = 0; //
-                goto label_html_directory;                      //
-            }
-            else
-            {                                                                   //
-                filehref = String(root["dir" + String(tab_of_dir)]) + filename; //
-                goto label_html_flie;                                           //
-            } //
-        } //
+// /file_read, /file_download gửi thẳng từ file, hỗ trợ "Range: bytes=a-b" (206)
+// /file_write ghi từng mảnh body vào file tạm ngay khi nhận, đủ thì mới thay file cũ
+#define FILE_WRITE_MAX 262144            // byte, body lớn hơn bị từ chối (413)
+#define FILE_WRITE_TMP "/file_write.tmp" // file tạm trong lúc nhận
+
+uint32_t fileFS_read_bytes = 0;     // tổng số byte đã gửi đi
+uint32_t fileFS_written_bytes = 0;  // tổng số byte đã ghi
+uint32_t fileFS_write_rate = 0;     // kB/s của lần ghi gần nhất
+
+bool fileFS_parse_range(String range, size_t size, size_t &first, size_t &last)
+{ // "bytes=a-b", "bytes=a-", "bytes=-n"; false nếu nằm ngoài file
+    first = 0;
+    last = size - 1;
+    if (!range.startsWith("bytes=") || range.indexOf(',') >= 0)
+        return size > 0; // không có hoặc nhiều khoảng: gửi cả file
+    range = range.substring(6);
+    int dash = range.indexOf('-');
+    if (dash < 0)
+        return size > 0;
+    String a = range.substring(0, dash);
+    String b = range.substring(dash + 1);
+    if (a.length() == 0)
+    { // n byte cuối
+        size_t n = b.toInt();
+        if (n == 0 || size == 0)
+            return false;
+        first = n < size ? size - n : 0;
+        return true;
+    }
+    first = a.toInt();
+    if (b.length() && (size_t)b.toInt() < last)
+        last = b.toInt();
+    return first < size && first <= last;
+}
 
-#endif // ESP8266
+void fileFS_send_file(AsyncWebServerRequest *request, const String &filename, const char *type, bool download)
+{
+    if (!FILESYSTEM.exists(filename))
+    {
+        if (FILESYSTEM.exists(filename + ".gz"))
+            request->send(FILESYSTEM, filename, type, download); // trang nén sẵn, trình duyệt tự giải nén
+        else
+            request->send(404, "text/plain", "404: file not found");
+        return;
+    }
 
-#if defined(ESP32)
-        dir_str = root["dir" + String(tab_of_dir)].as<String>(); //
-        File dir = FILESYSTEM.open(dir_str);                     // mở FILESYSTEM
-        SERIAL.println("open directory: " + dir_str);            // hiển thị tên file lên serial
-
-        for (int i = 0; i < int(root["dir" + String(tab_of_dir) + "count"]); i++)
-            dir.openNextFile(); // bỏ qua các tệp đã đọc trước đó
-
-    next_file:
-        root["dir" + String(tab_of_dir) + "count"] = int(root["dir" + String(tab_of_dir) + "count"]) + 1;
-        String NextFileName = dir.getNextFileName();
-        File file = FILESYSTEM.open(NextFileName); // mở file tiếp theo
-        if (file)
-        {                                   // đọc tất cả các file
-            filename = NextFileName;        // đọc tên file
-            filesize = String(file.size()); // đọc kích thước file
-            tab_str = "";                   //
-            for (int i = 1; i < tab_of_dir; i++)
-                tab_str += "&emsp;"; //
-
-            if (filename.startsWith("/"))
-                filename = filename.substring(1); // nếu tên file bắt đầu bằng dấu "/" thì xóa dấu "/"
-            if (file.isDirectory())
-            {                                            // nếu là thư mục
-                SERIAL.println(filename + " is directory"); // hiển thị tên file lên serial
-                tab_of_dir++;                            //
-                root["dir" + String(tab_of_dir)] = root["dir" + String(tab_of_dir - 1)].as<String>() + filename + "/";
-                root["dir" + String(tab_of_dir) + "count"] = 0; //
-                goto label_html_directory;                      //
-            }
-            else
-            {                                                                        //
-                filehref = root["dir" + String(tab_of_dir)].as<String>() + filename; //
-                goto label_html_flie;                                                //
-            } //
-        }
-#endif // ESP32
-
-        tab_of_dir--;
-        if (tab_of_dir)
-            goto next_dir;
-
-        if (0)
-        { // bỏ qua khi chạy từ trên xuống
-
-        label_html_directory:                      //
-            SERIAL.println("DIRECTORY: " + filename); // hiển thị tên file lên serial
-
-            html += "<tr>";                                                         // tạo dấu ngắt định dạng table
-            html += "<td width='30%' align='left'>" + tab_str + filename + "</td>"; // hiển thị tên file
-            html += "<td></td>";                                                    //
-            html += "<td></td>";                                                    //
-            html += "<td></td>";                                                    //
-            html += "<td></td>";                                                    //
-            html += "</tr>";                                                        // kết thúc dòng table
-            goto next_dir;                                                          //
-
-        label_html_flie:
-            SERIAL.println("FILE: " + filename + " \t" + filesize + "B"); // hiển thị tên file lên serial
-
-            html += "<tr>";                                                                                 // tạo dấu ngắt định dạng table
-            html += "<td align='left'>" + tab_str + "<a href='" + filehref + "'>" + filename + "</a></td>"; // hiển thị tên file
-            html += "<td align='center'>" + filesize + "B</td>";                                            // hiển thị kích thước file
-            html += "<td align='center'><a href='/file_download?name=" + filehref + "'>download</a></td>";  // hiển thị phím xóa file
-            html += "<td align='center'><a href='/file_edit.html?name=" + filehref + "'>edit</a></td>";     // hiển thị phím xóa file
-            html += "<td align='center'><a href='/file_delete?name=" + filehref + "'>delete</a></td>";      // hiển thị phím xóa file
-            html += "</tr>";                                                                                // kết thúc dòng table
-            goto next_file;
+    File file = FILESYSTEM.open(filename, "r");
+    size_t size = file.size();
+    size_t first, last;
+    bool ranged = request->hasHeader("Range");
+    if (!fileFS_parse_range(ranged ? request->header("Range") : String(), size, first, last))
+    {
+        if (size == 0 && !ranged)
+        { // file rỗng
+            request->send(200, type, "");
+            return;
         }
+        AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "");
+        response->addHeader("Content-Range", "bytes */" + String(size));
+        request->send(response);
+        return;
+    }
+    file.seek(first);
+
+    AsyncWebServerResponse *response = request->beginResponse(type, last - first + 1, [file](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+        size_t n = file.read(buffer, maxLen); // maxLen không vượt quá phần còn lại của Content-Length
+        fileFS_read_bytes += n;
+        return n;
+    });
+    response->addHeader("Accept-Ranges", "bytes");
+    if (first != 0 || last != size - 1)
+    {
+        response->setCode(206);
+        response->addHeader("Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(size));
+    }
+    if (download)
+    {
+        String name = filename.substring(filename.lastIndexOf('/') + 1);
+        response->addHeader("Content-Disposition", "attachment; filename=" + name);
+    }
+    request->send(response);
+}
 
-        html += "</table>"; // kết thúc table
+File fsWriteFile;                            // file tạm của /file_write đang nhận
+AsyncWebServerRequest *fsWriteOwner = NULL;  // request đang ghi, mỗi lúc chỉ một
+const char *fsWriteError = NULL;             // lỗi của lần ghi đang chạy
+uint32_t fsWriteStart = 0;                   // millis() lúc bắt đầu, để tính tốc độ
+size_t fsWriteSize = 0;                      // số byte đã ghi vào file tạm
+
+void fileFS_write_abort()
+{ // bỏ file tạm, giữ nguyên file cũ
+    fsWriteFile.close();
+    FILESYSTEM.remove(FILE_WRITE_TMP);
+    fsWriteOwner = NULL;
+}
 
-        html += "<form method='post' enctype='multipart/form-data'>";  // form uoload file
-        html += "<input type='file' name='name'>";                     //
-        html += "<input class='button' type='submit' value='Upload'>"; //
-        html += "</form>";                                             //
-        html += "<br><br>";                                            //
+void fileFS_write_body(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{ // gọi với từng mảnh body, ghi ngay xuống flash
+    if (index == 0)
+    {
+        if (fsWriteOwner)
+            return; // đang có request khác ghi, request này nhận 409
+        fsWriteOwner = request;
+        fsWriteError = NULL;
+        fsWriteStart = millis();
+        fsWriteSize = 0;
+        request->onDisconnect([request]() { // client bỏ dở
+            if (fsWriteOwner == request)
+                fileFS_write_abort();
+        });
+
+        size_t free_bytes = FILESYSTEM.totalBytes() - FILESYSTEM.usedBytes();
+        if (total > FILE_WRITE_MAX || total > free_bytes)
+            fsWriteError = "413: file too large";
+        else if (!(fsWriteFile = FILESYSTEM.open(FILE_WRITE_TMP, "w")))
+            fsWriteError = "500: couldn't create file";
+    }
+    if (fsWriteOwner != request || fsWriteError)
+        return;
+    if (fsWriteFile.write(data, len) != len)
+        fsWriteError = "500: write failed, filesystem full?";
+    fsWriteSize += len;
+}
 
-        html += "</body>"; //
-        html += "</html>"; //
+void fileFS_write_done(AsyncWebServerRequest *request) // đã nhận hết body
+{
+    String filename = request->arg("name");           // đọc tên file
+    if (!filename.startsWith("/"))                    //
+        filename = "/" + filename;                    // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
+
+    if (request->contentLength() == 0 && !fsWriteOwner)
+    { // body rỗng: tạo file rỗng
+        fsWriteOwner = request;
+        fsWriteError = NULL;
+        fsWriteStart = millis();
+        fsWriteSize = 0;
+        if (!(fsWriteFile = FILESYSTEM.open(FILE_WRITE_TMP, "w")))
+            fsWriteError = "500: couldn't create file";
+    }
+    if (fsWriteOwner != request)
+    {
+        request->send(409, "text/plain", "409: another file is being written");
+        return;
+    }
+
+    size_t written = fsWriteSize;
+    fsWriteFile.close();
+    if (!fsWriteError && written != request->contentLength())
+        fsWriteError = "500: body incomplete";
+    if (!fsWriteError)
+    {
+        fileFS_drop_copy(filename); // bản nén / bản gốc cũ của cùng trang
+        if (!fileFS_commit(FILE_WRITE_TMP, filename.c_str()))
+            fsWriteError = "500: couldn't replace file";
+    }
+    if (fsWriteError)
+    {
+        fileFS_write_abort();
+        request->send(atoi(fsWriteError), "text/plain", fsWriteError);
+        LOG_W(LOG_FILE, "write %s: %s", filename, fsWriteError);
+        return;
+    }
+    fsWriteOwner = NULL;
+
+    uint32_t elapsed = millis() - fsWriteStart + 1; // tránh chia cho 0
+    fileFS_written_bytes += written;
+    fileFS_write_rate = written / elapsed; // byte/ms ~ kB/s
+    request->send(200, "text/plain", "saved " + String(written) + " B");
+    LOG_I(LOG_FILE, "write %s: %u B in %u ms, %u kB/s", filename, written, elapsed, fileFS_write_rate);
+}
+
+File fsUploadFile;                                       // tạo hệ thống tệp để lưu file
+bool fsUploadOk = false;                                 // file upload gần nhất đã ghi xong
+void handleFileUpload(AsyncWebServerRequest *request, const String &name, size_t index, uint8_t *data, size_t len, bool final)
+{                                                        // hàm upload file vào FILESYSTEM, gọi với từng mảnh dữ liệu
+    if (index == 0)                                      // nếu là bắt đầu upload
+    {                                                    //
+        String filename = name;                          // đọc tên file
+        if (!filename.startsWith("/"))                   //
+            filename = "/" + filename;                   // nếu tên file không bắt đầu bằng dấu "/" thì thêm dấu "/" vào tên file
+        LOG_I(LOG_FILE, "upload %s", filename);          // ghi log
+        fileFS_drop_copy(filename);                      // bản nén / bản gốc cũ của cùng trang
+        fsUploadFile = FILESYSTEM.open(filename, "w");   // mở file ở chế độ ghi
+        fsUploadOk = false;                              //
+    }
+
+    if (fsUploadFile && len)                             // nếu ở giai đoạn ghi giữ liệu
+        fsUploadFile.write(data, len);                   // ghi dữ liệu nhận được vào file
 
-        server.send(200, "text/html", html); // gửi dưới dạng html
-    });                                      //
+    if (final && fsUploadFile)                           // nếu kết thúc quá trình ghi
+    {                                                    //
+        fsUploadFile.close();                            // đóng file
+        fsUploadOk = true;                               // hoàn tất quá trình ghi file
+    } //
+} //
 
-    server.on("/file_read", HTTP_GET, []() {             // đọc file
+void fileFS_server_on()                  // server on
+{                                        //
+    server.on("/file", HTTP_POST, [](AsyncWebServerRequest *request) { // nếu máy khách đăng upload file, gọi khi đã nhận hết
+        FLASH_ACTIVE_LED;                                              // bật đèn
+        if (fsUploadOk)                                                //
+            web_redirect(request, "/file", 303);                       // chuyển hướng về trang quản lý file
+        else                                                           //
+            request->send(500, "text/plain", "500: couldn't create file"); // báo không thể hoàn thành ghi dữ liệu
+    },                                                                 //
+              handleFileUpload);                                       // nhận và lưu file
+
+    server.on("/file", HTTP_GET, [](AsyncWebServerRequest *request) { // trang quản lý file
+        FLASH_ACTIVE_LED;                                              // bật đèn
+        fileList_send(request, false);                                 // gửi từng dòng trong lúc duyệt thư mục
+    });                                                                //
+
+    server.on("/file_list", HTTP_GET, [](AsyncWebServerRequest *request) { // danh sách file dạng Json
+        FLASH_ACTIVE_LED;                                                   // bật đèn
+        fileList_send(request, true);                                       // [{"name":..,"size":..,"dir":..},...]
+    });                                                                     //
+
+    server.on("/file_read", HTTP_GET, [](AsyncWebServerRequest *request) { // đọc file
         FLASH_ACTIVE_LED;                                // bật đèn
-        String filename = server.arg("name");            // đọc tên file
+        String filename = request->arg("name");          // đọc tên file
         if (!filename.startsWith("/"))                   //
             filename = "/" + filename;                   // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
-        File file = FILESYSTEM.open(filename, "r");      // mở tệp ở chế độ đọc
-        String DataFile = file.readString();             // đọc file
-        file.close();                                    // đóng file
-        server.send(200, "text/plain", DataFile);        // gửi dữ liệu
-        SERIAL.print("Handle File Read Name: " + filename); // xuất lên serial
-        SERIAL.println(DataFile);                           // hiển thị lên Serial
+        fileFS_send_file(request, filename, "text/plain", false); // gửi thẳng từ file, không đọc vào RAM
+        LOG_D(LOG_FILE, "read %s", filename);            // ghi log
     });                                                  //
 
-    server.on("/file_write", HTTP_POST, []() {            // lưu file
-        FLASH_ACTIVE_LED;                                 // bật đèn
-        String filename = server.arg("name");             // đọc tên file
-        if (!filename.startsWith("/"))                    //
-            filename = "/" + filename;                    // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
-        File file = FILESYSTEM.open(filename, "w");       // mở tệp ở chế độ ghi
-        String DataFile = server.arg("plain");            // lấy nội dung file
-        file.print(DataFile);                             // ghi file
-        file.close();                                     // đóng file
-        server.send(200, "text/plain", DataFile);         // gửi dữ liệu
-        SERIAL.print("Handle Fil eWrite Name: " + filename); // xuất lên serial
-        SERIAL.println(DataFile);                            // hiển thị lên Serial
-    });                                                   //
-
-    server.on("/file_delete", []() {                     // lệnh xóa file
+    server.on("/file_write", HTTP_POST, fileFS_write_done, NULL, fileFS_write_body); // lưu file, ghi trong lúc nhận
+
+    server.on("/file_delete", [](AsyncWebServerRequest *request) { // lệnh xóa file
         FLASH_ACTIVE_LED;                                // bật led báo
-        String filename = server.arg("name");            // đọc tên file
+        String filename = request->arg("name");          // đọc tên file
         if (!filename.startsWith("/"))                   //
             filename = "/" + filename;                   // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
         FILESYSTEM.remove(filename);                     // xóa file
-        server.sendHeader("Location", "/file");          // chuyển hướng đến trang quản lý file
-        server.send(303);                                // xác nhận chuyển hướng file
-        SERIAL.print("handleFileDelete Name: " + filename); // xuất lên serial
+        web_redirect(request, "/file", 303);             // chuyển hướng đến trang quản lý file
+        LOG_I(LOG_FILE, "delete %s", filename);          // ghi log
     });                                                  //
 
-    server.on("/file_download", []() {                                                    // lệnh tải file
-        FLASH_ACTIVE_LED;                                                                 // bật led báo
-        String filename = server.arg("name");                                             // đọc tên file
-        if (!filename.startsWith("/"))                                                    //
-            filename = "/" + filename;                                                    // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
-        File download = FILESYSTEM.open(filename, "r");                                   // mở file ở chế độ đọc
-        if (filename.startsWith("/"))                                                     //
-            filename = filename.substring(1);                                             // nếu tên file bắt đầu bằng dấu "/" thì xóa dấu "/"
-        if (download)                                                                     //
-        {                                                                                 // nếu file không lỗi
-            server.sendHeader("Content-Type", "text/text");                               //
-            server.sendHeader("Content-Disposition", "attachment; filename=" + filename); //
-            server.sendHeader("Connection", "close");                                     //
-            server.streamFile(download, "application/octet-stream");                      //
-            download.close();                                                             //
-        } 
-        server.send(500, "text/plain", "500: couldn't load file"); // báo không thể hoàn thành mở file                                                                     //
+    server.on("/file_download", [](AsyncWebServerRequest *request) {  // lệnh tải file
+        FLASH_ACTIVE_LED;                                            // bật led báo
+        String filename = request->arg("name");                      // đọc tên file
+        if (!filename.startsWith("/"))                               //
+            filename = "/" + filename;                               // nếu tên file không bắt đầu bằng "/" thì thêm dấu "/" vào tên file
+        fileFS_send_file(request, filename, "application/octet-stream", true); // tải về dạng attachment, tải tiếp được
+    });                                                              //
+
+    server.on("/file_format", [](AsyncWebServerRequest *request) { // lệnh xóa tất cả các file
+        FLASH_ACTIVE_LED;                                          // bật led báo
+        AsyncWebServerResponse *response = web_defer_response(request, "text/plain", [](String &output) {
+            FILESYSTEM.format();                                   // format trên loop(), mất vài giây
+            output = "formatted";                                  //
+        });                                                        //
+        response->addHeader("Refresh", "0; url=/file");            // về trang quản lý file khi format xong
+        request->send(response);                                   //
     });                                                            //
 
-    server.on("/file_format", []() {            // lệnh xóa tất cả các file
-        FLASH_ACTIVE_LED;                       // bật led báo
-        FILESYSTEM.format();                    // format
-        server.sendHeader("Location", "/file"); // chuyển hướng đến trang quản lý file
-        server.send(303);                       // xác nhận chuyển hướng file
-    });                                         //
-
-} 
+}
@@ -8,17 +8,27 @@
 
 #if defined(ESP8266)                 // nếu là ESP8266
 #include <ESP8266WiFi.h>             // thư viện wifi
-#include <ESP8266WebServer.h>        // thư viện server
 #include <ESP8266HTTPUpdateServer.h> // thư viện cập nhật code online
 #endif                               // ESP8266                                                          //
 
 #if defined(ESP32)
 #include <WiFi.h>      // thư viện wifi
-#include <WebServer.h> // thư viện server
 #include <Update.h>    // thư viện cập nhật code online
+#include <GzipDecoder.h> // giải nén firmware .gz khi đang nạp
 #endif                 // ESP32
 
 #include <WiFiClient.h> //
+#include "web_server.h" // thư viện server
+
+#if defined(ESP32)
+GzipDecoder *firmware_decoder = NULL; // chỉ tồn tại trong lúc upload
+uint32_t firmware_start_time = 0;     // thời điểm bắt đầu upload, để tính tốc độ
+
+bool firmware_write(void *context, const uint8_t *data, size_t size)
+{                                                                  // ảnh đã giải nén (hoặc nguyên bản) ghi vào flash
+    return Update.write(const_cast<uint8_t *>(data), size) == size; //
+}
+#endif // ESP32
 
 
 
@@ -28,36 +38,33 @@
 
 
 void firmware_update_server_on()
-{                                                           //
-    server.on("/log_in", HTTP_GET, []() {                   //
-        FLASH_ACTIVE_LED;                                   // bật led báo
-        server.sendHeader("Location", "log_in.html", true); // chuyển hướng đến trang
-        server.send(302, "text/plain", "");                 // xác nhận chuyển hướng
-    });                                                     //
-
-    server.on("/firmware", HTTP_GET, []() {                          //
-        FLASH_ACTIVE_LED;                                            // bật led báo
-        server.sendHeader("Location", "firmware_update.html", true); // chuyển hướng đến trang
-        server.send(302, "text/plain", "");                          // xác nhận chuyển hướng
-    });                                                              //
-
-    server.on("/update_firmware", HTTP_POST, []() {                          // handling uploading firmware file
-        FLASH_ACTIVE_LED;                                                    // bật led báo
-        server.sendHeader("Connection", "close");                            //
-        server.send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK"); //
-        delay(100);                                                          //
-        ESP.restart();                                                       //
+{                                                                      //
+    server.on("/log_in", HTTP_GET, [](AsyncWebServerRequest *request) { //
+        FLASH_ACTIVE_LED;                                              // bật led báo
+        request->redirect("log_in.html");                              // chuyển hướng đến trang
+    });                                                                //
+
+    server.on("/firmware", HTTP_GET, [](AsyncWebServerRequest *request) { //
+        FLASH_ACTIVE_LED;                                                // bật led báo
+        request->redirect("firmware_update.html");                       // chuyển hướng đến trang
+    });                                                                  //
+
+    server.on("/update_firmware", HTTP_POST, [](AsyncWebServerRequest *request) { // handling uploading firmware file
+        FLASH_ACTIVE_LED;                                                          // bật led báo
+        AsyncWebServerResponse *response =                                         //
+            request->beginResponse(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
+        response->addHeader("Connection", "close");                                //
+        request->send(response);                                                   //
+        web_restart();                                                             // reset khi đã gửi xong
     },
-              []() {                //
+              [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {
                   FLASH_ACTIVE_LED; // bật led báo
-                  HTTPUpload &upload = server.upload();
-                  if (upload.status == UPLOAD_FILE_START)
+                  if (index == 0)
                   {
-                      Serial.printf("Update: %s\n", upload.filename.c_str());
+                      Serial.printf("Update: %s\n", filename.c_str());
 
 #if defined(ESP8266)
-                      Serial.setDebugOutput(true);
-                      WiFiUDP::stopAll();
+                      Update.runAsync(true);
                       uint32_t maxSketchSpace = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
                       if (!Update.begin(maxSketchSpace))
                       { // start with max available size
@@ -70,30 +77,61 @@ void firmware_update_server_on()
                       { // start with max available size UPDATE_SIZE_UNKNOWN=0xFFFFFFFF
                           Update.printError(Serial);
                       }
+                      delete firmware_decoder;                                 // upload trước bị ngắt giữa chừng
+                      firmware_decoder = new GzipDecoder(firmware_write, NULL); // tự nhận .bin hoặc .bin.gz
+                      firmware_start_time = millis();                          //
 #endif // ESP32
                   }
-                  else if (upload.status == UPLOAD_FILE_WRITE)
+
+                  if (len)
                   {
                       /* flashing firmware to ESP*/
-                      if (Update.write(upload.buf, upload.currentSize) != upload.currentSize)
+#if defined(ESP32)
+                      if (firmware_decoder && !firmware_decoder->write(data, len))
+                      {
+                          if (!Update.hasError())
+                          { // lỗi giải nén: hủy để trả về FAIL
+                              Serial.printf("Update: %s\n", firmware_decoder->getError());
+                              Update.abort();
+                          }
+                          Update.printError(Serial);
+                      }
+#else
+                      if (Update.write(data, len) != len)
                       {
                           Update.printError(Serial);
                       }
+#endif // ESP32
                   }
-                  else if (upload.status == UPLOAD_FILE_END)
+
+                  if (final)
                   {
+#if defined(ESP32)
+                      if (firmware_decoder)
+                      {
+                          if (!firmware_decoder->finish() && !Update.hasError())
+                          { // file .gz bị cắt cụt
+                              Serial.printf("Update: %s\n", firmware_decoder->getError());
+                              Update.abort();
+                          }
+                          uint32_t elapsed = millis() - firmware_start_time + 1; // tránh chia cho 0
+                          Serial.printf("Update: %u -> %u bytes (%s), %u kB/s\n",
+                                        (unsigned)firmware_decoder->getInput(), (unsigned)firmware_decoder->getOutput(),
+                                        firmware_decoder->isGzip() ? "gzip" : "raw",
+                                        (unsigned)(firmware_decoder->getInput() / elapsed));
+                          delete firmware_decoder; // trả lại 43 KB cho heap
+                          firmware_decoder = NULL;
+                      }
+#endif // ESP32
                       if (Update.end(true))
                       { // true to set the size to the current progress
-                          Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
+                          Serial.printf("Update Success: %u\nRebooting...\n", (unsigned)(index + len));
                       }
                       else
                       {
                           Update.printError(Serial);
                       }
                   }
-#if defined(ESP8266)
-                  yield();
-#endif
               });
 }
 
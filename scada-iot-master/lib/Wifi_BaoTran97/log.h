@@ -0,0 +1,477 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   ghi log có cấp độ, thay cho SERIAL.println rải rác
+   - LOG_E / LOG_W / LOG_I / LOG_D(module, "định dạng %d", ...): cấp thấp hơn LOG_LEVEL bị bỏ lúc biên dịch,
+     tham số không được tính, chuỗi định dạng không nằm trong firmware
+   - nơi gọi chỉ chép tham số (chuỗi được chép tối đa LOG_STRS byte) vào hàng đợi không khóa rồi đi tiếp;
+     định dạng và xuất serial 115200 (~35 ms cho 400 byte) do task log chạy nền làm
+   - mỗi module có giới hạn số dòng / giây, dòng vượt giới hạn bị bỏ và được báo lại bằng một dòng tổng
+   - các dòng gần nhất lưu dạng nhị phân, đọc qua GET /log?since=N hoặc lệnh MQTT {"command":"LOG","payload":N}
+
+   bản ghi nhị phân (little endian), nối liền nhau:
+     uint32 seq | uint32 millis | uint8 level | uint8 module | uint8 len | len byte văn bản (không có '\0')
+*/
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_NONE  0
+#define LOG_ERROR 1
+#define LOG_WARN  2
+#define LOG_INFO  3
+#define LOG_DEBUG 4
+
+#ifndef LOG_LEVEL          // đặt -DLOG_LEVEL=LOG_DEBUG trong build_flags để xem cả payload
+#define LOG_LEVEL LOG_INFO //
+#endif                     //
+
+#define LOG_QUEUE   32 // bản ghi chờ task log, lũy thừa của 2
+#define LOG_ARGS    6  // số tham số tối đa của một dòng
+#define LOG_STRS    64 // byte dành cho tham số chuỗi, chuỗi dài hơn bị cắt
+#define LOG_TEXT    96 // byte văn bản tối đa của một dòng sau khi định dạng
+#define LOG_HISTORY 32 // số dòng giữ lại cho /log và MQTT
+#define LOG_DRAIN_MS 10 // task log nghỉ khi hàng đợi rỗng
+
+#define LOG_AT(level, module, ...)                       \
+    do                                                   \
+    {                                                    \
+        if ((level) <= LOG_LEVEL)                        \
+            log_write(level, module, __VA_ARGS__);       \
+    } while (0)
+#define LOG_E(module, ...) LOG_AT(LOG_ERROR, module, __VA_ARGS__)
+#define LOG_W(module, ...) LOG_AT(LOG_WARN, module, __VA_ARGS__)
+#define LOG_I(module, ...) LOG_AT(LOG_INFO, module, __VA_ARGS__)
+#define LOG_D(module, ...) LOG_AT(LOG_DEBUG, module, __VA_ARGS__)
+
+enum LogModule : uint8_t
+{
+    LOG_MAIN,
+    LOG_MQTT,
+    LOG_WEB,
+    LOG_FILE,
+    LOG_WIFI,
+    LOG_DATA,
+    LOG_METER,
+    LOG_OTA,
+    LOG_MODULES
+};
+
+const char *const log_module_names[LOG_MODULES] = {"MAIN", "MQTT", "WEB", "FILE", "WIFI", "DATA", "METER", "OTA"};
+
+struct LogLimit
+{
+    uint16_t per_second; // số dòng trung bình mỗi giây
+    uint16_t burst;      // số dòng liên tiếp tối đa
+};
+
+const LogLimit log_limits[LOG_MODULES] = {
+    {5, 20},  // MAIN
+    {5, 20},  // MQTT: mỗi lệnh vài dòng
+    {10, 20}, // WEB
+    {5, 10},  // FILE
+    {2, 20},  // WIFI: danh sách quét
+    {2, 10},  // DATA
+    {1, 5},   // METER: lỗi đọc lặp lại mỗi chu kỳ
+    {5, 20},  // OTA
+};
+
+enum LogArgType : uint8_t
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_FLOAT,
+    LOG_ARG_STR
+};
+
+struct LogRecord // dòng chưa định dạng: chuỗi định dạng nằm trong flash, chỉ chép tham số
+{
+    uint32_t time;
+    const char *fmt;
+    uint8_t level;
+    uint8_t module;
+    uint8_t nargs;
+    uint8_t strs_used;
+    uint8_t type[LOG_ARGS];
+    union
+    {
+        int32_t i;
+        uint32_t u;
+        float f;
+        uint16_t s; // vị trí chuỗi trong strs
+    } arg[LOG_ARGS];
+    char strs[LOG_STRS];
+};
+
+// hàng đợi nhiều bên ghi, một bên đọc, không khóa (bounded MPMC của D. Vyukov):
+// mỗi ô có số thứ tự cho biết ô đang trống (== vị trí ghi) hay đã có dữ liệu (== vị trí ghi + 1)
+struct LogQueue
+{
+    struct Cell
+    {
+        std::atomic<uint32_t> seq;
+        LogRecord record;
+    } cell[LOG_QUEUE];
+    std::atomic<uint32_t> head{0}; // vị trí ghi tiếp theo
+    uint32_t tail = 0;             // vị trí đọc tiếp theo, chỉ task log dùng
+
+    LogQueue()
+    {
+        static_assert((LOG_QUEUE & (LOG_QUEUE - 1)) == 0, "LOG_QUEUE must be a power of 2");
+        for (uint32_t i = 0; i < LOG_QUEUE; i++)
+            cell[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    LogRecord *reserve(uint32_t &pos) // ô trống để ghi, NULL nếu hàng đợi đầy
+    {
+        pos = head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &c = cell[pos & (LOG_QUEUE - 1)];
+            int32_t dif = (int32_t)(c.seq.load(std::memory_order_acquire) - pos);
+            if (dif == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &c.record;
+            }
+            else if (dif < 0)
+                return NULL; // task log chưa đọc kịp
+            else
+                pos = head.load(std::memory_order_relaxed); // bên ghi khác vừa lấy ô này
+        }
+    }
+
+    void commit(uint32_t pos) // ô đã ghi xong, task log được phép đọc
+    {
+        cell[pos & (LOG_QUEUE - 1)].seq.store(pos + 1, std::memory_order_release);
+    }
+
+    bool pop(LogRecord &record)
+    {
+        Cell &c = cell[tail & (LOG_QUEUE - 1)];
+        if (c.seq.load(std::memory_order_acquire) != tail + 1)
+            return false; // rỗng hoặc bên ghi chưa commit
+        record = c.record;
+        c.seq.store(tail + LOG_QUEUE, std::memory_order_release); // trả ô cho vòng sau
+        tail++;
+        return true;
+    }
+};
+
+LogQueue log_queue;
+std::atomic<uint16_t> log_suppressed[LOG_MODULES]; // dòng bị bỏ do vượt giới hạn, báo lại khi rảnh
+std::atomic<uint16_t> log_overflow{0};            // dòng bị bỏ do hàng đợi đầy
+
+// giới hạn tốc độ theo module (token bucket, đơn vị 1/1000 dòng). Mỗi module gần như chỉ ghi từ một task,
+// hai task ghi cùng lúc chỉ làm lệch vài token nên không cần khóa
+struct LogBucket
+{
+    uint32_t last;
+    uint32_t tokens;
+} log_buckets[LOG_MODULES];
+
+bool log_allow(uint8_t module, uint32_t now)
+{
+    LogBucket &b = log_buckets[module];
+    const LogLimit &limit = log_limits[module];
+    uint32_t full = limit.burst * 1000ul;
+    uint32_t elapsed = now - b.last;
+    if (!b.last || elapsed > full / (limit.per_second ? limit.per_second : 1)) // lần đầu hoặc lâu rồi không ghi: đầy lại
+        b.tokens = full;
+    else
+        b.tokens = min(full, b.tokens + elapsed * limit.per_second);
+    b.last = now;
+    if (b.tokens < 1000)
+        return false;
+    b.tokens -= 1000;
+    return true;
+}
+
+inline void log_capture(LogRecord &r, uint8_t type, uint32_t value)
+{
+    if (r.nargs >= LOG_ARGS)
+        return; // thừa tham số: bỏ, phần định dạng tương ứng in "?"
+    r.type[r.nargs] = type;
+    r.arg[r.nargs++].u = value;
+}
+
+inline void log_capture(LogRecord &r, int v) { log_capture(r, LOG_ARG_INT, (uint32_t)v); }
+inline void log_capture(LogRecord &r, long v) { log_capture(r, LOG_ARG_INT, (uint32_t)v); }
+inline void log_capture(LogRecord &r, unsigned int v) { log_capture(r, LOG_ARG_UINT, v); }
+inline void log_capture(LogRecord &r, unsigned long v) { log_capture(r, LOG_ARG_UINT, (uint32_t)v); }
+inline void log_capture(LogRecord &r, long long v) { log_capture(r, LOG_ARG_INT, (uint32_t)v); }                   // cắt còn 32 bit
+inline void log_capture(LogRecord &r, unsigned long long v) { log_capture(r, LOG_ARG_UINT, (uint32_t)v); }         //
+
+inline void log_capture(LogRecord &r, double v)
+{
+    if (r.nargs >= LOG_ARGS)
+        return;
+    r.type[r.nargs] = LOG_ARG_FLOAT;
+    r.arg[r.nargs++].f = (float)v;
+}
+
+inline void log_capture(LogRecord &r, const char *v)
+{
+    if (r.nargs >= LOG_ARGS)
+        return;
+    if (!v)
+        v = "(null)";
+    size_t room = LOG_STRS - r.strs_used; // luôn còn ít nhất 1 byte cho '\0'
+    size_t n = strnlen(v, room - 1);
+    memcpy(r.strs + r.strs_used, v, n);
+    r.strs[r.strs_used + n] = 0;
+    r.type[r.nargs] = LOG_ARG_STR;
+    r.arg[r.nargs++].s = r.strs_used;
+    r.strs_used += n + (r.strs_used + n + 1 < LOG_STRS); // hết chỗ: các chuỗi sau rỗng
+}
+
+inline void log_capture(LogRecord &r, char *v) { log_capture(r, (const char *)v); }
+inline void log_capture(LogRecord &r, const String &v) { log_capture(r, v.c_str()); }
+
+void log_drain_now();
+
+template <typename... Args>
+void log_write(uint8_t level, uint8_t module, const char *fmt, const Args &...args)
+{
+    uint32_t now = millis();
+    if (!log_allow(module, now))
+    {
+        log_suppressed[module]++;
+        return;
+    }
+    uint32_t pos;
+    LogRecord *r = log_queue.reserve(pos);
+    if (!r)
+    {
+        log_overflow++;
+        return;
+    }
+    r->time = now;
+    r->fmt = fmt;
+    r->level = level;
+    r->module = module;
+    r->nargs = 0;
+    r->strs_used = 0;
+    int expand[] = {0, (log_capture(*r, args), 0)...};
+    (void)expand;
+    log_queue.commit(pos);
+#if !defined(ESP32)
+    log_drain_now(); // không có task nền: xuất luôn
+#endif
+}
+
+// định dạng printf với tham số đã chép. Kiểu lấy từ lúc ghi chứ không từ chuỗi định dạng,
+// nên "%d" nhận float hay "%s" nhận số vẫn in đúng thay vì đọc sai bộ nhớ
+size_t log_format(const LogRecord &r, char *out, size_t size)
+{
+    size_t len = 0;
+    uint8_t next = 0;
+    for (const char *p = r.fmt; *p && len + 1 < size; p++)
+    {
+        if (*p != '%')
+        {
+            out[len++] = *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[len++] = '%';
+            p++;
+            continue;
+        }
+
+        char spec[16] = "%"; // cờ, độ rộng, độ chính xác giữ nguyên; bỏ h/l/z
+        size_t n = 1;
+        const char *q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q) && n < sizeof(spec) - 3)
+            spec[n++] = *q++;
+        while (*q && strchr("hlLzjt", *q))
+            q++;
+        char conv = *q;
+        if (!conv)
+            break;
+        p = q;
+
+        if (next >= r.nargs)
+        {
+            out[len++] = '?';
+            continue;
+        }
+        uint8_t type = r.type[next];
+        int written;
+        switch (type)
+        {
+        case LOG_ARG_INT:
+        case LOG_ARG_UINT:
+            if (!strchr("diouxXc", conv))
+                conv = type == LOG_ARG_INT ? 'd' : 'u';
+            spec[n++] = conv;
+            spec[n] = 0;
+            written = snprintf(out + len, size - len, spec, r.arg[next].u);
+            break;
+        case LOG_ARG_FLOAT:
+            if (!strchr("fFeEgG", conv))
+                conv = 'f';
+            spec[n++] = conv;
+            spec[n] = 0;
+            written = snprintf(out + len, size - len, spec, (double)r.arg[next].f);
+            break;
+        default:
+            spec[n++] = 's';
+            spec[n] = 0;
+            written = snprintf(out + len, size - len, spec, r.strs + r.arg[next].s);
+            break;
+        }
+        next++;
+        if (written > 0)
+            len = min(len + written, size - 1);
+    }
+    out[len] = 0;
+    return len;
+}
+
+struct LogEntry // dòng đã định dạng, giữ lại cho /log và MQTT
+{
+    uint32_t seq;
+    uint32_t time;
+    uint8_t level;
+    uint8_t module;
+    uint8_t len;
+    char text[LOG_TEXT];
+};
+
+LogEntry log_history[LOG_HISTORY];
+uint32_t log_history_seq = 0; // số dòng đã lưu từ lúc khởi động
+#if defined(ESP32)
+portMUX_TYPE log_history_lock = portMUX_INITIALIZER_UNLOCKED; // task log ghi, async_tcp và loop() đọc
+#endif
+
+void log_emit(uint32_t time, uint8_t level, uint8_t module, const char *text, size_t len)
+{
+#if defined(ESP32)
+    portENTER_CRITICAL(&log_history_lock);
+#endif
+    LogEntry &e = log_history[log_history_seq % LOG_HISTORY];
+    e.seq = log_history_seq++;
+    e.time = time;
+    e.level = level;
+    e.module = module;
+    e.len = min(len, (size_t)LOG_TEXT);
+    memcpy(e.text, text, e.len);
+#if defined(ESP32)
+    portEXIT_CRITICAL(&log_history_lock);
+#endif
+
+    cmd.write("?EWID"[level < 5 ? level : 0]); // ra serial và CMD web, cmd thêm giờ ở đầu dòng
+    cmd.print(' ');
+    cmd.print(log_module_names[module]);
+    cmd.print(": ");
+    cmd.write((const uint8_t *)text, len);
+    cmd.println();
+}
+
+bool log_drain() // xuất các dòng đang chờ, trả về false nếu không có gì
+{
+    LogRecord record;
+    char text[LOG_TEXT + 1];
+    bool any = false;
+
+    for (uint8_t m = 0; m < LOG_MODULES; m++)
+    {
+        uint16_t n = log_suppressed[m].exchange(0);
+        if (n)
+        {
+            int len = snprintf(text, sizeof(text), "%u lines suppressed (rate limit)", n);
+            log_emit(millis(), LOG_WARN, m, text, len);
+        }
+    }
+    uint16_t n = log_overflow.exchange(0);
+    if (n)
+    {
+        int len = snprintf(text, sizeof(text), "%u lines lost (queue full)", n);
+        log_emit(millis(), LOG_WARN, LOG_MAIN, text, len);
+    }
+
+    while (log_queue.pop(record)) // sau dòng tổng: các dòng bị bỏ nằm trước dòng đang chờ
+    {
+        any = true;
+        log_emit(record.time, record.level, record.module, text, log_format(record, text, sizeof(text)));
+    }
+    return any;
+}
+
+void log_drain_now()
+{
+    log_drain();
+}
+
+// các bản ghi nhị phân có seq >= cursor, cursor trả về seq của lần hỏi sau.
+// cursor cũ hơn vùng lưu hoặc lớn hơn seq hiện tại (thiết bị vừa khởi động lại): gửi từ dòng cũ nhất
+size_t log_since(uint32_t &cursor, Print &out, size_t max_bytes = SIZE_MAX)
+{
+#if defined(ESP32)
+    portENTER_CRITICAL(&log_history_lock);
+#endif
+    uint32_t end = log_history_seq;
+#if defined(ESP32)
+    portEXIT_CRITICAL(&log_history_lock);
+#endif
+    uint32_t oldest = end > LOG_HISTORY ? end - LOG_HISTORY : 0;
+    if (cursor < oldest || cursor > end)
+        cursor = oldest;
+
+    size_t total = 0;
+    for (; cursor < end; cursor++)
+    {
+        LogEntry e;
+#if defined(ESP32)
+        portENTER_CRITICAL(&log_history_lock);
+#endif
+        e = log_history[cursor % LOG_HISTORY];
+#if defined(ESP32)
+        portEXIT_CRITICAL(&log_history_lock);
+#endif
+        if (e.seq != cursor)
+            continue; // vừa bị ghi đè
+        size_t size = 11 + e.len;
+        if (total + size > max_bytes)
+            break;
+        uint8_t head[11] = {
+            (uint8_t)e.seq, (uint8_t)(e.seq >> 8), (uint8_t)(e.seq >> 16), (uint8_t)(e.seq >> 24),
+            (uint8_t)e.time, (uint8_t)(e.time >> 8), (uint8_t)(e.time >> 16), (uint8_t)(e.time >> 24),
+            e.level, e.module, e.len};
+        out.write(head, sizeof(head));
+        out.write((const uint8_t *)e.text, e.len);
+        total += size;
+    }
+    return total;
+}
+
+#if defined(ESP32)
+void log_task(void *)
+{
+    for (;;)
+        if (!log_drain())
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+}
+#endif
+
+void log_begin()
+{
+#if defined(ESP32)
+    // lõi 0 cùng WiFi, ưu tiên 1: chờ UART ở đây thay vì trong loop() (lõi 1)
+    xTaskCreatePinnedToCore(log_task, "log", 4096, NULL, 1, NULL, 0);
+#endif
+}
+
+void log_server_on()
+{
+    server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {                   // các dòng log gần nhất, nhị phân
+        FLASH_ACTIVE_LED;                                                              // bật đèn
+        uint32_t cursor = strtoul(request->arg("since").c_str(), NULL, 10);            // mặc định 0: tất cả
+        AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+        log_since(cursor, *response);                                                  //
+        response->addHeader("X-Log-Seq", String(cursor));                              // since của lần hỏi sau
+        request->send(response);                                                       //
+    });                                                                                //
+}
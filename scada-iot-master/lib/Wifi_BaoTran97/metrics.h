@@ -0,0 +1,203 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   bộ đếm và histogram thời gian chạy, đọc qua GET /metrics (định dạng văn bản của Prometheus)
+   - MetricHistogram h("tên", "nhãn", "mô tả"): h.observe(µs) chỉ cộng vài số nguyên, không cấp phát
+   - METRIC_CALL(h, lệnh) hoặc MetricTimer t(h) đo thời gian một đoạn chương trình
+   - MetricCounter, MetricGauge (đọc giá trị lúc xuất) cho số lần và số đo tức thời
+   - các metric tự đăng ký lúc khởi tạo, ghi trên loop() và được xuất cũng trên loop() nên không cần khóa
+*/
+
+#include <Arduino.h>
+
+#define METRIC_BUCKETS 10 // giới hạn bucket 16 µs × 4^k, k = 0..9 (16 µs .. 4.2 s), thêm +Inf
+
+enum MetricType : uint8_t
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+const char *const metric_type_names[] = {"counter", "gauge", "histogram"};
+
+struct Metric
+{
+    const char *name;   // tên Prometheus, các metric cùng tên đặt liền nhau
+    const char *labels; // vd "phase=\"mqtt\"", "" nếu không có nhãn
+    const char *help;   //
+    MetricType type;    //
+    Metric *next;       //
+
+    Metric(const char *name, const char *labels, const char *help, MetricType type);
+    virtual void render(String &out) = 0;
+
+    void line(String &out, const char *suffix, const char *extra, const String &value) // name_suffix{labels,extra} value
+    {
+        out += name;
+        out += suffix;
+        if (*labels || *extra)
+        {
+            out += '{';
+            out += labels;
+            if (*labels && *extra)
+                out += ',';
+            out += extra;
+            out += '}';
+        }
+        out += ' ';
+        out += value;
+        out += '\n';
+    }
+};
+
+Metric *metric_list = NULL; // theo thứ tự đăng ký
+Metric **metric_tail = &metric_list;
+
+Metric::Metric(const char *name, const char *labels, const char *help, MetricType type)
+    : name(name), labels(labels), help(help), type(type), next(NULL)
+{
+    *metric_tail = this;
+    metric_tail = &next;
+}
+
+struct MetricCounter : Metric
+{
+    uint32_t value = 0;
+
+    MetricCounter(const char *name, const char *labels, const char *help) : Metric(name, labels, help, METRIC_COUNTER) {}
+    void inc(uint32_t n = 1) { value += n; }
+    void render(String &out) override { line(out, "", "", String(value)); }
+};
+
+struct MetricGauge : Metric
+{
+    int32_t (*read)(); // đọc lúc xuất, không tốn gì giữa hai lần
+
+    MetricGauge(const char *name, const char *labels, const char *help, int32_t (*read)())
+        : Metric(name, labels, help, METRIC_GAUGE), read(read) {}
+    void render(String &out) override { line(out, "", "", String(read())); }
+};
+
+struct MetricHistogram : Metric
+{
+    uint32_t bucket[METRIC_BUCKETS + 1] = {0}; // bucket cuối là +Inf
+    uint32_t count = 0;
+    uint64_t sum = 0;        // µs
+    uint32_t max = 0;        // µs, từ lúc khởi động
+    uint32_t window_max = 0; // µs, từ lần take_window_max() trước
+
+    MetricHistogram(const char *name, const char *labels, const char *help) : Metric(name, labels, help, METRIC_HISTOGRAM) {}
+
+    static uint32_t bound(uint8_t k) { return 16ul << (2 * k); } // µs
+
+    void observe(uint32_t us)
+    {
+        uint8_t k = 0;
+        if (us > 16) // số bit của (us - 1) quyết định bucket, không cần vòng lặp
+            k = min((uint8_t)((32 - __builtin_clz(us - 1) - 3) / 2), (uint8_t)METRIC_BUCKETS);
+        bucket[k]++;
+        count++;
+        sum += us;
+        if (us > max)
+            max = us;
+        if (us > window_max)
+            window_max = us;
+    }
+
+    uint32_t percentile(uint8_t p) // µs, cận trên của bucket chứa phân vị p
+    {
+        uint32_t target = ((uint64_t)count * p + 99) / 100;
+        uint32_t seen = 0;
+        for (uint8_t k = 0; k < METRIC_BUCKETS; k++)
+        {
+            seen += bucket[k];
+            if (seen >= target)
+                return min(bound(k), max);
+        }
+        return max;
+    }
+
+    uint32_t take_window_max()
+    {
+        uint32_t m = window_max;
+        window_max = 0;
+        return m;
+    }
+
+    void render(String &out) override
+    {
+        char le[24];
+        uint32_t cumulative = 0;
+        for (uint8_t k = 0; k <= METRIC_BUCKETS; k++)
+        {
+            cumulative += bucket[k];
+            if (k < METRIC_BUCKETS)
+                snprintf(le, sizeof(le), "le=\"%.7g\"", bound(k) / 1e6);
+            else
+                strcpy(le, "le=\"+Inf\"");
+            line(out, "_bucket", le, String(cumulative));
+        }
+        line(out, "_sum", "", String(sum / 1e6, 6));
+        line(out, "_count", "", String(count));
+    }
+};
+
+struct MetricTimer // đo từ lúc tạo tới khi ra khỏi khối
+{
+    MetricHistogram &histogram;
+    uint32_t start;
+
+    MetricTimer(MetricHistogram &histogram) : histogram(histogram), start(micros()) {}
+    ~MetricTimer() { histogram.observe(micros() - start); }
+};
+
+#define METRIC_CALL(histogram, ...)                   \
+    do                                                \
+    {                                                 \
+        uint32_t metric_start = micros();             \
+        __VA_ARGS__;                                  \
+        histogram.observe(micros() - metric_start);   \
+    } while (0)
+
+String metrics_render()
+{
+    String out;
+    out.reserve(4096);
+    const char *last = "";
+    for (Metric *m = metric_list; m; m = m->next)
+    {
+        if (strcmp(m->name, last)) // HELP / TYPE một lần cho mỗi tên
+        {
+            out += "# HELP ";
+            out += m->name;
+            out += ' ';
+            out += m->help;
+            out += "\n# TYPE ";
+            out += m->name;
+            out += ' ';
+            out += metric_type_names[m->type];
+            out += '\n';
+            last = m->name;
+        }
+        m->render(out);
+    }
+    return out;
+}
+
+#if defined(ESP32)
+MetricGauge metric_heap_free("scada_heap_free_bytes", "", "Free heap", []() -> int32_t { return ESP.getFreeHeap(); });
+MetricGauge metric_heap_min("scada_heap_min_free_bytes", "", "Lowest free heap since boot", []() -> int32_t { return ESP.getMinFreeHeap(); });
+MetricGauge metric_heap_block("scada_heap_max_alloc_bytes", "", "Largest allocatable heap block", []() -> int32_t { return ESP.getMaxAllocHeap(); });
+#endif
+MetricGauge metric_uptime("scada_uptime_seconds", "", "Seconds since boot", []() -> int32_t { return millis() / 1000; });
+
+void metrics_server_on()
+{
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {       // Prometheus
+        FLASH_ACTIVE_LED;                                                      // bật đèn
+        web_defer(request, "text/plain; version=0.0.4", [](String &output) {   // số liệu ghi trên loop(), đọc trên loop()
+            output = metrics_render();                                         //
+        });                                                                    //
+    });                                                                        //
+}
@@ -0,0 +1,125 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   máy chủ web bất đồng bộ (ESPAsyncWebServer)
+   - request được xử lý trong task async_tcp ngay khi dữ liệu đến, không còn chờ loop() gọi handleClient()
+   - nhiều kết nối chạy song song, một trình duyệt chậm không giữ server lại
+   - việc đụng tới JsonData, cmd hay chặn lâu (format, wifiMulti.run) được chuyển về loop() bằng web_defer()
+*/
+
+#if defined(ESP8266)     // nếu là ESP8266
+#include <ESPAsyncTCP.h> // thư viện TCP bất đồng bộ
+#endif                   // ESP8266
+
+#if defined(ESP32)     // nếu là ESP32
+#include <AsyncTCP.h>  // thư viện TCP bất đồng bộ
+#endif                 // ESP32
+
+#include <ESPAsyncWebServer.h> // thư viện server bất đồng bộ
+#include <atomic>
+#include <functional>
+#include <memory>
+
+AsyncWebServer server(80); // chạy server port 80
+
+#define WEB_BODY_MAX   16384 // byte, body lớn hơn bị bỏ qua
+#define WEB_TASKS_SIZE 8     // số việc chờ loop() tối đa
+
+// body của PUT/POST đến từng mảnh: gom vào request->_tempObject (request tự free khi kết thúc)
+void web_body_collect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+    if (total > WEB_BODY_MAX) // quá lớn, handler nhận body rỗng
+        return;
+    if (index == 0)
+        request->_tempObject = malloc(total + 1);
+    char *body = (char *)request->_tempObject;
+    if (!body)
+        return;
+    memcpy(body + index, data, len);
+    if (index + len == total)
+        body[total] = 0; // kết thúc chuỗi
+}
+
+String web_body(AsyncWebServerRequest *request) // body đã gom, thay cho server.arg("plain")
+{
+    return request->_tempObject ? String((const char *)request->_tempObject) : String();
+}
+
+void web_redirect(AsyncWebServerRequest *request, const char *url, int code = 302)
+{                                                                   // chuyển hướng với mã tùy chọn (303 sau khi ghi)
+    AsyncWebServerResponse *response = request->beginResponse(code); //
+    response->addHeader("Location", url);                            //
+    request->send(response);                                         //
+}
+
+// việc chạy trên loop(): task async_tcp chạy song song với loop() nên không được đụng trực tiếp
+// vào JsonData, cmd... Hàng đợi FIFO, web_loop() chạy hết các việc đang chờ
+typedef std::function<void()> WebTask;
+
+#if defined(ESP32)
+QueueHandle_t web_tasks = xQueueCreate(WEB_TASKS_SIZE, sizeof(WebTask *));
+#endif
+
+bool web_run_in_loop(WebTask task)
+{
+#if defined(ESP32)
+    WebTask *pending = new WebTask(task);
+    if (xQueueSend(web_tasks, &pending, 0) == pdTRUE)
+        return true;
+    delete pending; // hàng đợi đầy
+    return false;
+#else
+    task(); // ESP8266 chỉ có một luồng, callback đã chạy tuần tự với loop()
+    return true;
+#endif
+}
+
+void web_loop() // gọi trong loop()
+{
+#if defined(ESP32)
+    WebTask *pending;
+    while (xQueueReceive(web_tasks, &pending, 0) == pdTRUE)
+    {
+        (*pending)();
+        delete pending;
+    }
+#endif
+}
+
+// trả lời bằng chuỗi do work() tạo ra trên loop(). Header đi ngay, phần thân trả RESPONSE_TRY_AGAIN
+// cho tới khi loop() làm xong nên task async_tcp không bị chặn trong lúc chờ
+AsyncWebServerResponse *web_defer_response(AsyncWebServerRequest *request, const char *type,
+                                           std::function<void(String &)> work)
+{
+    struct Job
+    {
+        std::atomic<bool> ready{false};
+        String output;
+    };
+    std::shared_ptr<Job> job = std::make_shared<Job>(); // còn sống tới khi cả hai bên xong
+    if (!web_run_in_loop([job, work]() { work(job->output); job->ready = true; }))
+        return request->beginResponse(503, "text/plain", "busy");
+
+    return request->beginChunkedResponse(type, [job](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if (!job->ready)
+            return RESPONSE_TRY_AGAIN;
+        size_t n = job->output.length() - index;
+        if (n > maxLen)
+            n = maxLen;
+        memcpy(buffer, job->output.c_str() + index, n);
+        return n; // 0 là kết thúc
+    });
+}
+
+void web_defer(AsyncWebServerRequest *request, const char *type, std::function<void(String &)> work)
+{
+    request->send(web_defer_response(request, type, work));
+}
+
+void web_restart() // khởi động lại sau khi câu trả lời đã đi
+{
+    web_run_in_loop([]() {
+        delay(500);    // đợi gửi xong
+        ESP.restart(); // reset
+    });
+}
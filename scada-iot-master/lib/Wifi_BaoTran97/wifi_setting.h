@@ -12,7 +12,6 @@
 #if defined(ESP8266)     // nếu là ESP8266
 #include <ESP8266WiFi.h> // thư viện wifi
 #include <ESP8266mDNS.h>
-#include <ESP8266WebServer.h> // thư viện server
 #include <ESP8266WiFiMulti.h> // thư viện kết nối nhiều wifi
 #include <LittleFS.h>         // thư viện quản lý file
 ESP8266WiFiMulti wifiMulti;   // tạo đối tượng
@@ -21,7 +20,6 @@ ESP8266WiFiMulti wifiMulti;   // tạo đối tượng
 #if defined(ESP32)
 #include <WiFi.h>      // thư viện wifi
 #include <ESPmDNS.h>   // thư viện DNS
-#include <WebServer.h> // thư viện server
 #include <WiFiMulti.h> // thư viện kết nối nhiều wifi
 #include <SPIFFS.h>    // thư viện quản lý file
 WiFiMulti wifiMulti;   // tạo đối tượng
@@ -31,6 +29,7 @@ WiFiMulti wifiMulti;   // tạo đối tượng
 #include <Arduino.h>
 #include <ArduinoJson.h> // thư viện chuẩn dữ liệu
 #include "fileFS.h"      // thư viện xử lý file
+#include "web_server.h"  // thư viện server
 #include <DNSServer.h>
 
 // ============== WIFI CONFIGURATION (Static) ==============
@@ -91,15 +90,13 @@ void wifi_begin()
     WiFi.mode(WIFI_AP_STA);
     delay(100);  // Allow time for WiFi to initialize
     
-    SERIAL.print("MAC Address: ");
-    SERIAL.println(WiFi.macAddress());  // Debug: verify MAC is available
+    LOG_I(LOG_WIFI, "MAC address: %s", WiFi.macAddress()); // Debug: verify MAC is available
     
     // Sử dụng cấu hình WiFi tĩnh
     WiFi.softAPConfig(apIP, apIP, netMsk);
-    SERIAL.print("Setting soft-AP with: ssid->" WIFI_AP_SSID " password->" WIFI_AP_PASSWORD " ..."); //
-    SERIAL.println(WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD) ? "Ready" : "Failed!");       // khởi chạy softAP và thông báo kết quả lên serial
-    SERIAL.print("Soft-AP IP address = ");                                                   //
-    SERIAL.println(WiFi.softAPIP());                                                         // thông báo IP của softAP
+    bool ap = WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD);                               // khởi chạy softAP
+    LOG_I(LOG_WIFI, "soft-AP %s: %s", WIFI_AP_SSID, ap ? "ready" : "failed");            // thông báo kết quả, không in mật khẩu
+    LOG_I(LOG_WIFI, "soft-AP IP address: %s", toStringIp(WiFi.softAPIP()));             // thông báo IP của softAP
 
     dnsServer.setErrorReplyCode(DNSReplyCode::NoError); // nếu không tìm được DNS
     dnsServer.start(DNS_PORT, "*", apIP);               // thiết lập DNS server chuyển hướng tất cả domains về apIP
@@ -107,22 +104,19 @@ void wifi_begin()
     WiFi.hostname(WIFI_HOSTNAME); // đặt tên cho thiết bị
 
     // Thêm các WiFi từ cấu hình tĩnh
-    SERIAL.println("num of wifi: " + String(WIFI_CREDENTIALS_COUNT));
+    LOG_I(LOG_WIFI, "num of wifi: %d", WIFI_CREDENTIALS_COUNT);
     for (int i = 0; i < WIFI_CREDENTIALS_COUNT; i++)
     {
-        SERIAL.println("connect wifi: " + String(i + 1) + " ->  " + WIFI_CREDENTIALS[i].ssid);
+        LOG_I(LOG_WIFI, "wifi %d: %s", i + 1, WIFI_CREDENTIALS[i].ssid);
         wifiMulti.addAP(WIFI_CREDENTIALS[i].ssid, WIFI_CREDENTIALS[i].password);
     }
 
-    SERIAL.println("Connecting Wifi...");                            // hiển thị tình trạng kết nối wifi
-    if (wifiMulti.run() == WL_CONNECTED)                             // nếu kết nối wifi thành công
-    {                                                                //
-        SERIAL.println("WiFi connected: " + String(WiFi.SSID()));    // thông báo tên wifi đã kết nối
-        SERIAL.println("IP address: " + toStringIp(WiFi.localIP())); // thông báo ip thiết bị
-    }
+    LOG_I(LOG_WIFI, "connecting...");                                                     // hiển thị tình trạng kết nối wifi
+    if (wifiMulti.run() == WL_CONNECTED)                                                  // nếu kết nối wifi thành công
+        LOG_I(LOG_WIFI, "connected: %s, IP %s", WiFi.SSID(), toStringIp(WiFi.localIP())); // thông báo tên wifi và ip thiết bị
 } //*/
 
-String Wifi_scan_data()
+String Wifi_scan_data(IPAddress client_IP) // kết quả của lần quét nền WiFi.scanNetworks(true) vừa xong
 {
     DynamicJsonDocument root(4096); // tạo tệp Json lưu dữ liệu tạm thời
 
@@ -134,35 +128,24 @@ String Wifi_scan_data()
         root["ssid" + String(i + 1)] = WIFI_CREDENTIALS[i].ssid;
     }
 
-    root["client_ID"] = toStringIp(server.client().localIP());
+    root["client_ID"] = toStringIp(client_IP);
     root["softAPSSID"] = String(WiFi.softAPSSID());
     root["softAPIP"] = toStringIp(WiFi.softAPIP());
     root["SSID"] = String(WiFi.SSID());
     root["localIP"] = toStringIp(WiFi.localIP());
 
-    SERIAL.println("\r\nWifi scan...");   //
-    unsigned int n = WiFi.scanNetworks(); // tìm các wifi lân cận
+    int n = WiFi.scanComplete(); // số wifi lân cận đã tìm thấy
+    if (n < 0)                   // quét lỗi
+        n = 0;                   //
 
     root["num_wifi_scan"] = n;
 
-    SERIAL.println("scan success"); //
-    if (n == 0)
-    {                                        // nếu không có wifi lân cận
-        SERIAL.println("no networks found"); //
-    }
-    else
-    {                                                  // nếu có wifi lân cận
-        SERIAL.println(String(n) + " networks found"); //
-
+    LOG_D(LOG_WIFI, "scan: %d networks found", n); //
+    if (n > 0)
+    { // nếu có wifi lân cận
         for (int i = 0; i < n; ++i)
-        {                                           //
-            SERIAL.print(i + 1);                    //
-            SERIAL.print(":\t");                    //
-            SERIAL.print(WiFi.SSID(i));             //
-            SERIAL.print("\t");                     //
-            SERIAL.print(WiFi.RSSI(i));             //
-            SERIAL.print("\t");                     //
-            SERIAL.println(WiFi.encryptionType(i)); // Print SSID and RSSI for each network found
+        {                                                                                                    //
+            LOG_D(LOG_WIFI, "%d: %s %d dBm enc %d", i + 1, WiFi.SSID(i), WiFi.RSSI(i), WiFi.encryptionType(i)); // SSID and RSSI for each network found
 
             root["SSID" + String(i)] = String(WiFi.SSID(i));
             root["RSSI" + String(i)] = WiFi.RSSI(i);
@@ -203,7 +186,7 @@ void wifi_loop()
 {
 
     dnsServer.processNextRequest(); //
-    server.handleClient();          // chạy web server
+    web_loop();                     // việc web server chuyển về loop()
 
     static uint8_t lastConnectionState; // Trạng thái kết nối trước đó
 
@@ -211,14 +194,9 @@ void wifi_loop()
     if (currentConnectionState != lastConnectionState) // Kiểm tra nếu trạng thái kết nối thay đổi
     {                                                  //
         if (currentConnectionState == WL_CONNECTED)
-        {
-            SERIAL.println("WiFi connected: " + String(WiFi.SSID()));    // thông báo tên wifi đã kết nối
-            SERIAL.println("IP address: " + toStringIp(WiFi.localIP())); // thông báo ip thiết bị
-        }
+            LOG_I(LOG_WIFI, "connected: %s, IP %s", WiFi.SSID(), toStringIp(WiFi.localIP())); // thông báo tên wifi và ip thiết bị
         else
-        {
-            Serial.println(get_wifi_connection_state());
-        }
+            LOG_W(LOG_WIFI, "%s", get_wifi_connection_state());
         lastConnectionState = currentConnectionState; // Cập nhật lại trạng thái kết nối
     }
 
@@ -228,8 +206,7 @@ void wifi_loop()
     {
         t = millis() + 30000;
         FLASH_ACTIVE_LED
-        SERIAL.print(millis());
-        SERIAL.println(" Reconnecting to WiFi...");
+        LOG_I(LOG_WIFI, "reconnecting...");
         wifiMulti.run(); //
 
         // WiFi.disconnect();
@@ -244,40 +221,58 @@ void wifi_loop()
 void wifi_server_on() // hàm gọi kết nối wifi
 {
 
-    server.on("/wifi", HTTP_GET, []() {                          // gọi hàm trả về giao diện thiết lập wifi
-        FLASH_ACTIVE_LED;                                        // bật led báo
-        server.sendHeader("Location", "Config_wifi.html", true); // chuyển hướng đến trang
-        server.send(302, "text/plain", "");                      // xác nhận chuyển hướng
-    });                                                          //
-
-    server.on("/_WIFI_SCAN_", HTTP_GET, []() { // gọi hàm trả về giao diện thiết lập wifi
-        FLASH_ACTIVE_LED;                      // bật led báo
-        String re = Wifi_scan_data();          // lấy dữ liệu giao diện
-        server.send(200, "text/plain", re);    // gửi đi
+    server.on("/wifi", HTTP_GET, [](AsyncWebServerRequest *request) { // gọi hàm trả về giao diện thiết lập wifi
+        FLASH_ACTIVE_LED;                                             // bật led báo
+        request->redirect("Config_wifi.html");                        // chuyển hướng đến trang
+    });                                                               //
+
+    server.on("/_WIFI_SCAN_", HTTP_GET, [](AsyncWebServerRequest *request) { // gọi hàm trả về giao diện thiết lập wifi
+        FLASH_ACTIVE_LED;                                                    // bật led báo
+        if (WiFi.scanComplete() != WIFI_SCAN_RUNNING)                        // chưa có lần quét nào đang chạy
+        {                                                                    //
+            LOG_D(LOG_WIFI, "scan...");                                      //
+            WiFi.scanDelete();                                               // bỏ kết quả cũ
+            WiFi.scanNetworks(true);                                         // quét nền, không chặn server
+        }                                                                    //
+        IPAddress client_IP = request->client()->localIP();                  //
+        std::shared_ptr<String> re = std::make_shared<String>();             // dữ liệu giao diện
+        request->sendChunked("text/plain", [client_IP, re](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            if (index == 0 && re->length() == 0)                             //
+            {                                                                //
+                if (WiFi.scanComplete() == WIFI_SCAN_RUNNING)                //
+                    return RESPONSE_TRY_AGAIN;                               // đang quét, hỏi lại sau
+                *re = Wifi_scan_data(client_IP);                             // lấy dữ liệu giao diện
+            }                                                                //
+            size_t n = re->length() - index;                                 //
+            if (n > maxLen)                                                  //
+                n = maxLen;                                                  //
+            memcpy(buffer, re->c_str() + index, n);                          // gửi đi
+            return n;                                                        //
+        });                                                                  //
     });
 
-    server.on("/wifisave", HTTP_PUT, []() { //
-        FLASH_ACTIVE_LED;                   // bật led báo
+    server.on("/wifisave", HTTP_PUT, [](AsyncWebServerRequest *request) { //
+        FLASH_ACTIVE_LED;                                                 // bật led báo
 
-        DynamicJsonDocument data(4096);                                          // đệm Json
-        DeserializationError error = deserializeJson(data, server.arg("plain")); // chuyển dữ liệu nhận được về dạng Json
+        DynamicJsonDocument data(4096);                                         // đệm Json
+        DeserializationError error = deserializeJson(data, web_body(request)); // chuyển dữ liệu nhận được về dạng Json
         if (error)
-        {                                                                                  // nếu lỗi
-            server.send(500, "text/plain", "FAIL to convert json. " + server.arg("plain")); // báo lỗi
+        {                                                                                     // nếu lỗi
+            request->send(500, "text/plain", "FAIL to convert json. " + web_body(request)); // báo lỗi
         }
         else
         { // nếu không lỗi
             String ssid = data["ssid"].as<String>();         // đọc tên wifi
             String password = data["password"].as<String>(); // đọc mật khẩu
-            SERIAL.println("ssid: " + ssid);                 // xuất lên serial
-            SERIAL.println("password: " + password);         // xuất lên serial
+            LOG_I(LOG_WIFI, "add ssid: %s", ssid);           // không ghi mật khẩu ra log
 
-            wifiMulti.addAP(ssid.c_str(), password.c_str()); // thêm wifi vào danh sách kết nối (chỉ lưu trong RAM)
-            wifiMulti.run();                                 //
+            web_defer(request, "text/plain", [ssid, password](String &output) { // kết nối trên loop()
+                wifiMulti.addAP(ssid.c_str(), password.c_str()); // thêm wifi vào danh sách kết nối (chỉ lưu trong RAM)
+                wifiMulti.run();                                 //
 
-            // Trả về thông báo thành công (WiFi chỉ được thêm tạm thời, sẽ mất khi khởi động lại)
-            String output = "{\"status\":\"ok\",\"message\":\"WiFi added (runtime only, not persistent)\",\"ssid\":\"" + ssid + "\"}";
-            server.send(200, "text/plain", output);
+                // Trả về thông báo thành công (WiFi chỉ được thêm tạm thời, sẽ mất khi khởi động lại)
+                output = "{\"status\":\"ok\",\"message\":\"WiFi added (runtime only, not persistent)\",\"ssid\":\"" + ssid + "\"}";
+            });
         }
-    });
-}
\ No newline at end of file
+    }, NULL, web_body_collect);
+}
@@ -16,6 +16,18 @@ String getDeviceID() {
   return getFormattedMAC();
 }
 
+MetricHistogram metric_mqtt_publish("scada_mqtt_publish_seconds", "", "Time spent in client.publish()");
+MetricCounter metric_mqtt_ok(  "scada_mqtt_publish_total", "result=\"ok\"",   "MQTT publishes");
+MetricCounter metric_mqtt_fail("scada_mqtt_publish_total", "result=\"fail\"", "MQTT publishes");
+MetricHistogram metric_mqtt_command("scada_mqtt_command_seconds", "", "Time spent in handleCommand()");
+
+bool MQTTpublish(const String &topic, const char *payload, unsigned int length) {
+  bool ok;
+  METRIC_CALL(metric_mqtt_publish, ok = client.publish(topic.c_str(), (const uint8_t *)payload, length));
+  (ok ? metric_mqtt_ok : metric_mqtt_fail).inc();
+  return ok;
+}
+
 void MQTTsendDATA(int key = 0) {
   static unsigned long t;
   if (key) t = millis() + 2000ul;
@@ -23,7 +35,7 @@ void MQTTsendDATA(int key = 0) {
   t = millis() + 10000ul;
   FLASH_ACTIVE_LED;
 
-  power_meter.read(1);
+  power_meter.read(METER_MAX_AGE); // từ modbus_cache, không chờ bus
   DynamicJsonDocument root(4096); // tạo tệp Json lưu dữ liệu tạm thời
 
   root["time"]          = DayTime.unixtime;
@@ -45,99 +57,252 @@ void MQTTsendDATA(int key = 0) {
 
   String output; // Serialize JSON and publish
   serializeJson(root, output);
-  SERIAL.println("Publishing JSON data:");
-  SERIAL.println(output);
+  LOG_D(LOG_MQTT, "status %s", output); // chỉ 64 byte đầu, bật LOG_DEBUG khi cần
 
   String topic_status = MQTT_TOPIC_PREFIX + getDeviceID() + MQTT_STATUS_TOPIC;
 
-  if (client.publish(topic_status.c_str(), output.c_str()))
-    SERIAL.println("JSON data published successfully");
-  else
-    SERIAL.println("Failed to publish JSON data");
+  if (!MQTTpublish(topic_status, output.c_str(), output.length()))
+    LOG_W(LOG_MQTT, "status publish failed (%u B)", output.length());
+}
+
+// Recent log lines in the binary format of log.h, as many as fit in the MQTT buffer.
+void MQTTsendLOG(uint32_t since) {
+  struct Buffer : Print {
+    uint8_t data[448]; // client.setBufferSize(512) minus header and topic
+    size_t len = 0;
+    size_t write(uint8_t c) override { return len < sizeof(data) ? (data[len++] = c, 1) : 0; }
+  } buffer;
+  log_since(since, buffer, sizeof(buffer.data));
+
+  String topic_log = MQTT_TOPIC_PREFIX + getDeviceID() + MQTT_LOG_TOPIC;
+  if (!MQTTpublish(topic_log, (const char *)buffer.data, buffer.len))
+    LOG_W(LOG_MQTT, "log publish failed");
 }
 
-void handleCommand(const String &command) {
-  DynamicJsonDocument root(4096);
-  DeserializationError error = deserializeJson(root, command);
+// Commands look like {"command":"TOGGLE","payload":"on"} or
+// {"command":"SCHEDULE","payload":{"hour_on":18,"minute_on":0,"hour_off":6,"minute_off":0}}
+// The document only needs room for these slots: strings stay in the MQTT buffer.
+#define COMMAND_JSON_SIZE (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(4))
+#define COMMAND_FILTER_SIZE JSON_OBJECT_SIZE(2)
+
+// Decodes a command in place, the payload buffer is modified (zero-copy).
+void handleCommand(char *json, size_t length) {
+  static StaticJsonDocument<COMMAND_FILTER_SIZE> filter;
+  if (filter.isNull()) {
+    filter["command"] = true;
+    filter["payload"] = true;
+  }
+
+  StaticJsonDocument<COMMAND_JSON_SIZE> root;
+  DeserializationError error = deserializeJson(root, json, length, DeserializationOption::Filter(filter));
 
   if (error) {
-    SERIAL.println("Failed to parse command JSON.");
+    LOG_W(LOG_MQTT, "bad command: %s", error.c_str());
     return;
   }
 
-  String commandType = root["command"];
+  const char *commandType = root["command"] | "";
 
-  if (commandType == "REBOOT") {
-    SERIAL.println("Rebooting device...");
+  if (!strcmp(commandType, "REBOOT")) {
+    LOG_I(LOG_MQTT, "rebooting");
     ESP.restart();
 
-  } else if (commandType == "AUTO") {
-    String state = root["payload"];
+  } else if (!strcmp(commandType, "AUTO")) {
+    const char *state = root["payload"] | "";
 
-    if (state == "on") {
-      SERIAL.println("Enabling auto mode...");
+    if (!strcmp(state, "on")) {
+      LOG_I(LOG_MQTT, "auto on");
       JsonData["auto"] = 1;
-    } else if (state == "off") {
-      SERIAL.println("Disabling auto mode...");
+      DataFile_journal({"auto"});
+    } else if (!strcmp(state, "off")) {
+      LOG_I(LOG_MQTT, "auto off");
       JsonData["auto"] = 0;
+      DataFile_journal({"auto"});
     } else {
-      SERIAL.print("Unknown auto state: ");
-      SERIAL.println(state);
+      LOG_W(LOG_MQTT, "unknown auto state: %s", state);
     }
 
-  } else if (commandType == "TOGGLE") {
-    String state = root["payload"];
-    if (state == "on") {
-      SERIAL.println("Toggling device ON...");
+  } else if (!strcmp(commandType, "TOGGLE")) {
+    const char *state = root["payload"] | "";
+    if (!strcmp(state, "on")) {
+      LOG_I(LOG_MQTT, "toggle on");
       JsonData["toggle"] = 1;
-    } else if (state == "off") {
-      SERIAL.println("Toggling device OFF...");
+      timing_command();
+      DataFile_journal({"toggle"});
+    } else if (!strcmp(state, "off")) {
+      LOG_I(LOG_MQTT, "toggle off");
       JsonData["toggle"] = 0;
+      timing_command();
+      DataFile_journal({"toggle"});
     } else {
-      SERIAL.print("Unknown toggle state: ");
-      SERIAL.println(state);
+      LOG_W(LOG_MQTT, "unknown toggle state: %s", state);
     }
-  } else if (commandType == "SCHEDULE") {
+  } else if (!strcmp(commandType, "SCHEDULE")) {
     JsonObject payload      = root[   "payload"];
-    JsonData["hour_on"]     = payload["hour_on"];
-    JsonData["minute_on"]   = payload["minute_on"];
-    JsonData["hour_off"]    = payload["hour_off"];
-    JsonData["minute_off"]  = payload["minute_off"];
+    // thiếu khóa hay sai kiểu thì bỏ cả lệnh, as<int>() sẽ biến nó thành 0 (nửa đêm)
+    if (!payload["hour_on"].is<int>() || !payload["minute_on"].is<int>() ||
+        !payload["hour_off"].is<int>() || !payload["minute_off"].is<int>() ||
+        payload["hour_on"].as<unsigned>() > 23 || payload["minute_on"].as<unsigned>() > 59 ||
+        payload["hour_off"].as<unsigned>() > 23 || payload["minute_off"].as<unsigned>() > 59) {
+      LOG_W(LOG_MQTT, "bad schedule, ignored");
+      return;
+    }
+    // as<int>(): strings in root point into the MQTT buffer, never link them into JsonData
+    JsonData["hour_on"]     = payload["hour_on"].as<int>();
+    JsonData["minute_on"]   = payload["minute_on"].as<int>();
+    JsonData["hour_off"]    = payload["hour_off"].as<int>();
+    JsonData["minute_off"]  = payload["minute_off"].as<int>();
+    DataFile_journal({"hour_on", "minute_on", "hour_off", "minute_off"});
+    LOG_I(LOG_MQTT, "schedule %d:%02d - %d:%02d", JsonData["hour_on"].as<int>(), JsonData["minute_on"].as<int>(),
+          JsonData["hour_off"].as<int>(), JsonData["minute_off"].as<int>());
+  } else if (!strcmp(commandType, "LOG")) {
+    MQTTsendLOG(root["payload"] | 0); // payload: since, 0 = tất cả
+    return;
   } else {
-    SERIAL.print("Unknown command type: ");
-    SERIAL.println(commandType);
+    LOG_W(LOG_MQTT, "unknown command: %s", commandType);
   }
 
-  DataFile_write();
   MQTTsendDATA(1);
 }
 
+// Tiến độ OTA: {"state":"downloading","written":123456,"total":987654,"attempt":1,"version":"0.2.0","current":"0.1.0"}
+// state: scheduled, skipped (kèm "error" là lý do), downloading, done, failed (kèm "error"),
+//        rolled_back (firmware mới không kết nối được MQTT, đã quay về bản cũ)
+void MQTTsendOTA() {
+  static OTAState last_state = OTA_IDLE;
+  static uint32_t last_written;
+  static unsigned long t;
+
+  OTAState state = otaHandler.getState();
+  if (state == OTA_IDLE)
+    return;
+  uint32_t written = otaHandler.getWritten();
+  if (state == last_state && (written == last_written || t > millis()))
+    return; // tối đa mỗi 2 giây một lần khi đang tải
+  t = millis() + 2000ul;
+  last_written = written;
+
+  StaticJsonDocument<JSON_OBJECT_SIZE(7)> root;
+  root["state"]   = otaHandler.getStateString();
+  root["written"] = written;
+  root["total"]   = otaHandler.getTotal();
+  root["attempt"] = otaHandler.getAttempt();
+  if (otaHandler.getTargetVersion().length())
+    root["version"] = otaHandler.getTargetVersion().c_str();
+  root["current"] = FIRMWARE_VERSION;
+  if (state == OTA_FAILED || state == OTA_SKIPPED || state == OTA_ROLLED_BACK)
+    root["error"] = otaHandler.getError();
+
+  char output[256];
+  size_t length = serializeJson(root, output);
+  String topic_ota = MQTT_TOPIC_PREFIX + getDeviceID() + MQTT_OTA_TOPIC;
+  if (MQTTpublish(topic_ota, output, length))
+  {
+    last_state = state; // trạng thái mới chỉ được coi là đã gửi khi publish thành công
+    if (state == OTA_ROLLED_BACK)
+      otaHandler.rollbackReported(); // các lần khởi động sau không báo lại lần quay về này
+  }
+}
+
+// Sức khỏe thiết bị mỗi phút, bản gọn của /metrics (thời gian tính bằng µs):
+// {"up":3600,"heap":150000,"heap_min":120000,"loop_p99":1024,"loop_max":8200,"period_p99":4096,"period_max":9100,
+//  "modbus_p99":65536,"modbus_err":0,"pub_fail":0,"rssi":-67}
+void MQTTsendHealth() {
+  static unsigned long t;
+  if (t > millis())
+    return;
+  t = millis() + 60000ul;
+
+  StaticJsonDocument<JSON_OBJECT_SIZE(11)> root;
+  root["up"]         = millis() / 1000;
+  root["heap"]       = ESP.getFreeHeap();
+  root["heap_min"]   = ESP.getMinFreeHeap();
+  root["loop_p99"]   = metric_loop.percentile(99);
+  root["loop_max"]   = metric_loop.take_window_max(); // trong phút vừa qua
+  root["period_p99"] = metric_loop_period.percentile(99);
+  root["period_max"] = metric_loop_period.take_window_max();
+  root["modbus_p99"] = metric_modbus.percentile(99);
+  root["modbus_err"] = metric_modbus_error.value;
+  root["pub_fail"]   = metric_mqtt_fail.value;
+  root["rssi"]       = WiFi.RSSI();
+
+  char output[256];
+  size_t length = serializeJson(root, output);
+  String topic_health = MQTT_TOPIC_PREFIX + getDeviceID() + MQTT_HEALTH_TOPIC;
+  MQTTpublish(topic_health, output, length);
+}
+
+// Vượt ngân sách thời gian (timing.h), gộp lại và báo tối đa mỗi phút một lần cho mỗi loại:
+// {"alarm":"loop_period","count":3,"worst_us":180000,"budget_us":100000,"p99_us":4096}
+void MQTTsendAlarm() {
+  for (TimingAlarm &a : timing_alarms) {
+    if (!a.count || (a.sent && millis() - a.sent < TIMING_ALARM_INTERVAL))
+      continue;
+
+    StaticJsonDocument<JSON_OBJECT_SIZE(5)> root;
+    root["alarm"] = a.name;
+    root["count"] = a.count;
+    if (a.budget) {
+      root["worst_us"]  = a.worst;
+      root["budget_us"] = a.budget;
+      root["p99_us"]    = (&a == &timing_alarms[TIMING_ALARM_PERIOD] ? metric_loop_period : metric_control_latency).percentile(99);
+    }
+
+    char output[160];
+    size_t length = serializeJson(root, output);
+    String topic_alarm = MQTT_TOPIC_PREFIX + getDeviceID() + MQTT_ALARM_TOPIC;
+    if (MQTTpublish(topic_alarm, output, length)) { // chưa gửi được: giữ lại, gộp tiếp
+      LOG_W(LOG_MAIN, "timing alarm %s: %u times, worst %u us", a.name, a.count, a.worst);
+      a.sent  = millis();
+      a.count = 0;
+      a.worst = 0;
+    }
+  }
+}
+
+// Manifest của đợt cập nhật:
+// {"version":"0.2.0","sha256":"<hex>","signature":"<hex>","size":1234567,"url":"http://...","rollout":25,"window":3600}
+// rollout: % thiết bị tham gia, window: số giây để rải đều thời điểm bắt đầu tải
+void handleManifest(char *json, size_t length) {
+  StaticJsonDocument<JSON_OBJECT_SIZE(7) + 32> manifest;
+  DeserializationError error = deserializeJson(manifest, json, length); // chuỗi nằm luôn trong buffer MQTT
+  if (error || !manifest["version"].is<const char *>()) {
+    LOG_W(LOG_OTA, "invalid manifest: %s", error ? error.c_str() : "no version");
+    return;
+  }
+
+  otaHandler.scheduleOTA(getDeviceID(),
+                         manifest["version"],
+                         manifest["url"] | "",
+                         manifest["sha256"] | "",
+                         manifest["signature"] | "",
+                         manifest["size"] | 0,
+                         manifest["rollout"] | 100,
+                         manifest["window"] | 0);
+}
+
 void MQTTcallback(char *topic, uint8_t *payload, unsigned int length) {
+  timing_message_us = micros(); // gốc đo độ trễ điều khiển
   FLASH_ACTIVE_LED
 
-  String topicStr = String(topic);
-  String message;
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-  SERIAL.print("Main - Message arrived on topic: ");
-  SERIAL.println(topicStr);
-  SERIAL.print("Main - Message: ");
-  SERIAL.println(message);
+  LOG_I(LOG_MQTT, "%s (%u B)", topic, length); // payload không in: có thể dài, lệnh tự ghi log
 
   String topic_ID         = getDeviceID();
   String topic_command    = MQTT_TOPIC_PREFIX + topic_ID + MQTT_COMMAND_TOPIC;
-  String topic_status     = MQTT_TOPIC_PREFIX + topic_ID + MQTT_STATUS_TOPIC;
-  String topic_alive      = MQTT_TOPIC_PREFIX + topic_ID + MQTT_ALIVE_TOPIC;
   String topic_updateID   = MQTT_TOPIC_PREFIX + topic_ID + MQTT_FIRMWARE_UPDATE_TOPIC;
-  String topic_update     = MQTT_FIRMWARE_UPDATE_TOPIC;
 
-  if ((topicStr == topic_update) || (topicStr == topic_updateID)) { // Handle OTA messages{
+  if ((!strcmp(topic, MQTT_FIRMWARE_UPDATE_TOPIC) || (topic_updateID == topic)) && length && payload[0] == '{') {
+    handleManifest((char *)payload, length); // cập nhật theo đợt
+  } else if (!strcmp(topic, MQTT_FIRMWARE_UPDATE_TOPIC) || (topic_updateID == topic)) { // Handle OTA messages
+    String message;
+    message.reserve(length);
+    for (unsigned int i = 0; i < length; i++) {
+      message += (char)payload[i];
+    }
     Lcd.print_message("OTA update...", 0, true);
     otaHandler.handleOtaMessage(message);
-  } else if (topicStr == topic_command) { // Handle business logic messages{
-    SERIAL.println("Main - Processing business logic command...");
-    handleCommand(message); // Handle the command logic
+  } else if (topic_command == topic) { // Handle business logic messages
+    METRIC_CALL(metric_mqtt_command, handleCommand((char *)payload, length)); // decoded in place in the MQTT buffer
   }
 }
 
@@ -170,13 +335,13 @@ void MQTTClient_loop() {
     String client_id      = "esp32-client-" + topic_ID;
 
     client.setBufferSize(512);
-    SERIAL.printf("The client %s connects to the public MQTT broker\n", client_id.c_str());
+    LOG_I(LOG_MQTT, "connecting %s to %s", client_id, mqtt_broker);
     if (client.connect(client_id.c_str(), mqtt_username, mqtt_password, topic_alive.c_str(), 1, false, lwt_message.c_str())) {
-      SERIAL.println("Public EMQX MQTT broker connected");
+      LOG_I(LOG_MQTT, "connected");
+      otaHandler.confirm(); // firmware mới chạy được tới đây: giữ lại, không rollback
     }
     else {
-      SERIAL.print("Failed with state ");
-      SERIAL.println(client.state());
+      LOG_W(LOG_MQTT, "connect failed, state %d", client.state());
     }
 
     client.publish(  topic_alive.c_str(), "6", true);
@@ -188,4 +353,7 @@ void MQTTClient_loop() {
 
   client.loop(); // Handle MQTT communication
   MQTTsendDATA();
+  MQTTsendOTA();
+  MQTTsendHealth();
+  MQTTsendAlarm();
 }
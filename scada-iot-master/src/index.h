@@ -1,7 +1,14 @@
 #include <ArduinoJson.h> // thư viện chuẩn dữ liệu
+#include <vector>
 
 unsigned long time_save = 1ul * 60ul * 1000ul;
 
+// Thống kê bộ nhớ của JsonData (telemetry)
+size_t        JsonData_peak_usage   = 0; // mức sử dụng pool cao nhất
+size_t        JsonData_reclaimed    = 0; // tổng số byte đã thu hồi
+unsigned long JsonData_compactions  = 0; // số lần thu gom
+unsigned long JsonData_overflows    = 0; // số lần pool bị đầy (ghi bị mất)
+
 void InitializeDefaults()
 {
   // Set default GPS coordinates if null
@@ -27,26 +34,355 @@ void InitializeDefaults()
   if (JsonData["frequency"].isNull())    JsonData["frequency"] = 0;
 }
 
+// Lưu JsonData an toàn khi mất điện giữa chừng:
+//  - ảnh chụp đầy đủ ghi luân phiên vào slot A/B: ghi file tạm, flush, đọc lại kiểm tra, rồi mới đổi tên
+//    => lúc nào cũng còn ít nhất một slot nguyên vẹn, hoặc file tạm đã kiểm tra (mất điện giữa xóa và đổi tên)
+//  - cuối mỗi slot có dòng "#crc seq", khi đọc chọn slot đúng CRC có seq lớn nhất
+//  - thay đổi nhỏ (toggle, auto, schedule) chỉ ghi thêm một dòng vào journal, không ghi lại cả file
+//  - journal đầy thì gom vào ảnh chụp mới và xóa đi
+#define DATA_SLOT_A      "/data_a.json"
+#define DATA_SLOT_B      "/data_b.json"
+#define DATA_TMP         "/data.tmp"
+#define DATA_LEGACY      "/data.json" // file cũ, chỉ đọc khi chưa có slot nào
+#define DATA_JOURNAL     "/data.jnl"
+#define DATA_JOURNAL_MAX 2048         // byte, quá mức này thì gom lại
+#define DATA_TRAILER_LEN 22           // "\r\n#" + 8 crc + " " + 8 seq + "\r\n"
+
+uint32_t DataFile_seq = 0; // số thứ tự ảnh chụp đang dùng
+
+bool DataFile_check(const char *path, uint32_t &seq)
+{ // kiểm tra CRC của một slot, trả về seq của nó
+  File file = FILESYSTEM.open(path, "r");
+  if (!file)
+    return false;
+
+  size_t size = file.size();
+  char trailer[DATA_TRAILER_LEN + 1];
+  if (size < DATA_TRAILER_LEN || !file.seek(size - DATA_TRAILER_LEN) ||
+      file.readBytes(trailer, DATA_TRAILER_LEN) != DATA_TRAILER_LEN || trailer[2] != '#')
+  { // không có dòng kiểm tra, file ghi dở
+    file.close();
+    return false;
+  }
+  trailer[DATA_TRAILER_LEN] = 0;
+  uint32_t expected = strtoul(trailer + 3, NULL, 16);
+  seq = strtoul(trailer + 12, NULL, 16);
+
+  uint32_t crc = 0xFFFFFFFF;
+  uint8_t buf[64];
+  size_t remaining = size - DATA_TRAILER_LEN;
+  file.seek(0);
+  while (remaining)
+  { // tính CRC phần json
+    size_t n = file.read(buf, remaining < sizeof(buf) ? remaining : sizeof(buf));
+    if (!n)
+      break;
+    for (size_t i = 0; i < n; i++)
+      crc = fileFS_crc32(crc, buf[i]);
+    remaining -= n;
+  }
+  file.close();
+  return remaining == 0 && ~crc == expected;
+}
+
+void DataFile_replay()
+{ // áp dụng các thay đổi trong journal lên ảnh chụp vừa đọc
+  File file = FILESYSTEM.open(DATA_JOURNAL, "r");
+  if (!file)
+    return;
+
+  String line = file.readStringUntil('\n');
+  if (!line.startsWith("#") || strtoul(line.c_str() + 1, NULL, 16) != DataFile_seq)
+  { // journal của ảnh chụp cũ, nội dung đã nằm trong slot
+    file.close();
+    FILESYSTEM.remove(DATA_JOURNAL);
+    return;
+  }
+
+  unsigned records = 0;
+  while (file.available())
+  {
+    line = file.readStringUntil('\n');
+    int star = line.lastIndexOf('*');
+    if (star < 0)
+      break; // dòng ghi dở lúc mất điện
+    uint32_t crc = 0xFFFFFFFF;
+    for (int i = 0; i < star; i++)
+      crc = fileFS_crc32(crc, line[i]);
+    if (~crc != strtoul(line.c_str() + star + 1, NULL, 16))
+      break; // sai CRC, bỏ từ đây về sau
+
+    StaticJsonDocument<256> record;
+    if (deserializeJson(record, line.c_str(), star))
+      break;
+    for (JsonPair kv : record.as<JsonObject>())
+      JsonData[kv.key()] = kv.value(); // key và chuỗi được chép vào JsonData
+    records++;
+  }
+  file.close();
+  LOG_I(LOG_DATA, "%u journal records", records);
+}
+
 void DataFile_read()
-{                                                                   // đọc file data
-  File file = FILESYSTEM.open("/data.json", "r");                   // mở tệp ở chế độ đọc
-  String DataFile = file.readString();                              // đọc file
-  cmd.println(DataFile);                                            // hiển thị lên Serial
-  DeserializationError error = deserializeJson(JsonData, DataFile); // chuyển dữ liệu về dạng Json
-  if (error)                                                        //
-    SERIAL.println("erro converter data to json");                  // hiển thị lên Serial
-  file.close();                                                     // đóng file
-  InitializeDefaults();                                             // fill null values with defaults
+{ // đọc ảnh chụp mới nhất còn nguyên vẹn rồi áp dụng journal
+  uint32_t seq_a = 0, seq_b = 0, seq_tmp = 0;
+  bool use_tmp = false;
+  bool ok_a = DataFile_check(DATA_SLOT_A, seq_a);
+  bool ok_b = DataFile_check(DATA_SLOT_B, seq_b);
+
+  if (DataFile_check(DATA_TMP, seq_tmp) && (!ok_a || seq_tmp > seq_a) && (!ok_b || seq_tmp > seq_b))
+  { // mất điện giữa remove và rename của fileFS_commit: file tạm là bản mới nhất, đưa nó vào slot của nó
+    LOG_W(LOG_DATA, "recovering %s seq %u", DATA_TMP, seq_tmp);
+    if (!(seq_tmp & 1) && fileFS_commit(DATA_TMP, DATA_SLOT_A))
+    {
+      ok_a = true;
+      seq_a = seq_tmp;
+    }
+    else if ((seq_tmp & 1) && fileFS_commit(DATA_TMP, DATA_SLOT_B))
+    {
+      ok_b = true;
+      seq_b = seq_tmp;
+    }
+    else
+      use_tmp = true; // đổi tên không được: đọc thẳng file tạm, lần ghi sau sẽ thay nó
+  }
+  else if (FILESYSTEM.exists(DATA_TMP))
+    FILESYSTEM.remove(DATA_TMP); // ghi dở hoặc cũ hơn slot
+
+  const char *path = DATA_LEGACY;
+  uint32_t seq = 0;
+  if (use_tmp)
+  {
+    path = DATA_TMP;
+    seq = seq_tmp;
+  }
+  else if (ok_a && (!ok_b || seq_a > seq_b))
+  {
+    path = DATA_SLOT_A;
+    seq = seq_a;
+  }
+  else if (ok_b)
+  {
+    path = DATA_SLOT_B;
+    seq = seq_b;
+  }
+
+  File file = FILESYSTEM.open(path, "r");                       // mở tệp ở chế độ đọc
+  DeserializationError error = deserializeJson(JsonData, file); // đọc thẳng từ file, dòng "#crc seq" ở cuối được bỏ qua
+  file.close();                                                 // đóng file
+  if (error)                                                    //
+    LOG_E(LOG_DATA, "%s: %s", path, error.c_str());             // ghi log
+  LOG_I(LOG_DATA, "%s seq %u", path, seq);
+
+  DataFile_seq = seq;
+  DataFile_replay();
+#if LOG_LEVEL >= LOG_DEBUG
+  serializeJson(JsonData, SERIAL); // toàn bộ dữ liệu, chỉ khi gỡ lỗi
+  SERIAL.println();
+#endif
+  InitializeDefaults(); // fill null values with defaults
 } //
 
 void DataFile_write()
-{                                                 // chèn thêm enter vào tài liệu
-  String output;                                  //
-  serializeJson(JsonData, output);                // chuyển json thành dữ liệu thuần
-  output = format_Json(output);                   //
-  File file = FILESYSTEM.open("/data.json", "w"); // mở tệp ở chế độ ghi
-  file.print(output);                             //
-  file.close();                                   // đóng tệp
+{ // ghi ảnh chụp mới vào slot cũ hơn, slot còn lại vẫn giữ bản trước đó
+  uint32_t seq = DataFile_seq + 1;
+  const char *slot = (seq & 1) ? DATA_SLOT_B : DATA_SLOT_A;
+
+  File file = FILESYSTEM.open(DATA_TMP, "w"); // mở tệp tạm ở chế độ ghi
+  if (!file)
+  {
+    LOG_E(LOG_DATA, "cannot open %s", DATA_TMP);
+    return;
+  }
+  CrcPrint crc(file);              // tính CRC trên dữ liệu ghi
+  JsonLineWriter writer(crc);      // định dạng từng ký tự, không dùng String trung gian
+  serializeJson(JsonData, writer); // chuyển json thành dữ liệu thuần
+  writer.flush();                  //
+  file.printf("\r\n#%08lx %08lx\r\n", (unsigned long)crc.value(), (unsigned long)seq);
+  file.flush(); // đẩy xuống flash trước khi đổi tên
+  file.close(); // đóng tệp
+
+  uint32_t written = 0;
+  if (!DataFile_check(DATA_TMP, written) || written != seq || !fileFS_commit(DATA_TMP, slot))
+  { // flash đầy hoặc lỗi ghi: giữ nguyên slot cũ và journal
+    LOG_E(LOG_DATA, "save failed");
+    FILESYSTEM.remove(DATA_TMP);
+    return;
+  }
+
+  DataFile_seq = seq;
+  FILESYSTEM.remove(DATA_JOURNAL); // đã nằm trong ảnh chụp
+  if (FILESYSTEM.exists(DATA_LEGACY))
+    FILESYSTEM.remove(DATA_LEGACY); // đã chuyển sang slot
+}
+
+void DataFile_journal(std::initializer_list<const char *> keys)
+{ // ghi thêm giá trị hiện tại của các key vào journal: {"key":value,...}*crc
+  StaticJsonDocument<256> record;
+  for (const char *key : keys)
+    record[key] = JsonData[key];
+
+  char buf[160];
+  size_t n = measureJson(record);
+  if (n >= sizeof(buf))
+  { // quá dài cho một dòng journal
+    DataFile_write();
+    return;
+  }
+  serializeJson(record, buf, sizeof(buf));
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < n; i++)
+    crc = fileFS_crc32(crc, buf[i]);
+
+  bool fresh = !FILESYSTEM.exists(DATA_JOURNAL);
+  File file = FILESYSTEM.open(DATA_JOURNAL, "a"); // chỉ ghi thêm vào cuối
+  if (!file)
+  {
+    DataFile_write();
+    return;
+  }
+  if (fresh)
+    file.printf("#%08lx\n", (unsigned long)DataFile_seq); // journal áp dụng cho ảnh chụp này
+  file.write((const uint8_t *)buf, n);
+  file.printf("*%08lx\n", (unsigned long)~crc);
+  file.flush();
+  size_t size = file.size();
+  file.close();
+
+  if (size > DATA_JOURNAL_MAX)
+    DataFile_write(); // gom journal vào ảnh chụp mới
+}
+
+void JsonData_maintain()
+{ // thu gom chuỗi / biến bị bỏ rơi trong pool của JsonData
+  size_t usage = JsonData.memoryUsage();
+  if (usage > JsonData_peak_usage)
+    JsonData_peak_usage = usage;
+
+  static size_t settled_usage; // mức sử dụng sau lần thu gom trước
+  bool overflowed = JsonData.overflowed();
+  if (!overflowed && (usage <= JsonData.capacity() * 3 / 4 || usage <= settled_usage))
+    return; // còn đủ chỗ trống hoặc không có gì mới để thu gom
+
+  size_t reclaimed = JsonData.compact(); // thu gom tại chỗ, không cấp phát thêm
+  settled_usage = JsonData.memoryUsage();
+  JsonData_reclaimed += reclaimed;
+  JsonData_compactions++;
+  if (overflowed)
+  {
+    JsonData_overflows++;
+    LOG_W(LOG_DATA, "JsonData overflowed, some values were not saved");
+  }
+  LOG_I(LOG_DATA, "JsonData compact: %u bytes reclaimed, %u/%u used", reclaimed, JsonData.memoryUsage(), JsonData.capacity());
+}
+
+void server_send_memory_data(AsyncWebServerRequest *request)
+{ // trả về thống kê bộ nhớ dạng Json, đọc trên loop()
+  web_defer(request, "text/plain", [](String &output) {
+    StaticJsonDocument<256> root;
+    root["capacity"]    = JsonData.capacity();
+    root["usage"]       = JsonData.memoryUsage();
+    root["peak_usage"]  = JsonData_peak_usage;
+    root["reclaimed"]   = JsonData_reclaimed;
+    root["compactions"] = JsonData_compactions;
+    root["overflows"]   = JsonData_overflows;
+    root["free_heap"]   = ESP.getFreeHeap();
+    serializeJson(root, output);
+  });
+}
+
+// Đẩy JsonData tới trình duyệt qua Server-Sent Events (/events), thay cho việc hỏi /state mỗi 500 ms
+//  - mỗi 100 ms so từng key với lần gửi trước (lưu hash), chỉ gửi các key thay đổi: event "state" {"key":value,...}
+//  - tab mới kết nối hoặc có key bị xóa thì gửi toàn bộ: event "full", trình duyệt thay hẳn dữ liệu cũ
+//  - tính một lần chung cho mọi tab đang mở, không có tab nào thì không làm gì
+#define STATE_EVENTS_INTERVAL 100 // ms, tối đa 10 lần mỗi giây
+#define STATE_EVENTS_BACKLOG  4   // tin trung bình còn chờ mỗi tab, quá mức thì đợi chứ không gửi thêm
+
+AsyncEventSource state_events("/events");
+std::atomic<bool> state_events_full{true}; // có tab mới (task async_tcp đặt), chờ ảnh chụp đầy đủ
+
+class HashPrint : public Print // FNV-1a của dữ liệu ghi qua, không cần chuỗi trung gian
+{
+public:
+  using Print::write;
+  virtual size_t write(uint8_t c)
+  {
+    hash = (hash ^ c) * 16777619u;
+    return 1;
+  }
+  uint32_t hash = 2166136261u;
+};
+
+struct StateSent
+{
+  uint32_t key;   // hash của tên key
+  uint32_t value; // hash của giá trị đã gửi
+  bool seen;      // còn trong JsonData ở lần so sánh này
+};
+std::vector<StateSent> state_sent;
+
+void state_events_loop()
+{
+  static unsigned long last;
+  if (millis() - last < STATE_EVENTS_INTERVAL)
+    return;
+  last = millis();
+  if (state_events.count() == 0)
+    return; // không có ai xem
+  if (state_events.avgPacketsWaiting() > STATE_EVENTS_BACKLOG)
+    return; // tab chậm: giữ nguyên bảng, thay đổi được gửi gộp ở lần sau
+
+  bool full = state_events_full.exchange(false) || state_sent.empty();
+  DynamicJsonDocument diff(full ? 0 : JsonData.memoryUsage() + JSON_OBJECT_SIZE(8)); // đủ chứa toàn bộ JsonData
+  for (StateSent &sent : state_sent)
+    sent.seen = false;
+
+  for (JsonPair kv : JsonData.as<JsonObject>())
+  {
+    HashPrint key, value;
+    key.print(kv.key().c_str());
+    serializeJson(kv.value(), value);
+
+    StateSent *sent = NULL;
+    for (StateSent &s : state_sent)
+      if (s.key == key.hash)
+      {
+        sent = &s;
+        break;
+      }
+    if (!sent)
+    { // key mới
+      state_sent.push_back({key.hash, ~value.hash, false});
+      sent = &state_sent.back();
+    }
+    sent->seen = true;
+    if (sent->value != value.hash)
+    {
+      if (!full)
+        diff[kv.key()] = kv.value();
+      sent->value = value.hash;
+    }
+  }
+
+  for (size_t i = 0; i < state_sent.size();)
+  { // key đã bị xóa khỏi JsonData (PUT /state thay toàn bộ)
+    if (state_sent[i].seen)
+      i++;
+    else
+    {
+      state_sent.erase(state_sent.begin() + i);
+      full = true;
+    }
+  }
+
+  String output;
+  if (full)
+    serializeJson(JsonData, output);
+  else if (diff.size())
+    serializeJson(diff, output);
+  else
+    return; // không có gì thay đổi
+  state_events.send(output.c_str(), full ? "full" : "state", millis());
 }
 
 void Index_begin()
@@ -62,6 +398,9 @@ void Index_loop()
     JsonData[String("power_M") + String(DayTime.month)] = JsonData["total_energy"];
   }
 
+  JsonData_maintain(); // thu gom bộ nhớ khi pool gần đầy
+  state_events_loop(); // đẩy thay đổi tới trình duyệt
+
   if (time_save < millis())
   {
     DataFile_write();
@@ -69,46 +408,57 @@ void Index_loop()
   }
 }
 
-void server_send_json_data()
-{
-  String output;                          //
-  serializeJson(JsonData, output);        // chuyển json thành dữ liệu thuần
-  server.send(200, "text/plain", output); // gửi đi
+void server_send_json_data(AsyncWebServerRequest *request)
+{ // JsonData chỉ được đọc / ghi trên loop(), server chạy ở task khác
+  web_defer(request, "text/plain", [](String &output) {
+    serializeJson(JsonData, output); // chuyển json thành dữ liệu thuần
+  });
 }
 
 void Index_server_on() // server on
 {
-  server.on("/DataFileRead", HTTP_GET, []() { // lấy dữ liệu
-    FLASH_ACTIVE_LED;                         // bật led báo
-    DataFile_read();                          //
-    server_send_json_data();                  // trả về json data
-  });                                         //
-
-  server.on("/DataFileWrite", HTTP_GET, []() { // lấy dữ liệu
-    FLASH_ACTIVE_LED;                          // bật led báo
-    DataFile_write();                          //
-    server_send_json_data();                   // trả về json data
-  });                                          //
-
-  server.on("/state", HTTP_GET, []() { // lấy dữ liệu
-    FLASH_ACTIVE_LED;                  // bật led báo
-    server_send_json_data();           // trả về json data
-  });                                  //
-
-  server.on("/state", HTTP_PUT, []() {                                       // nhận dữ liệu
-    FLASH_ACTIVE_LED;                                                        // bật led báo
-    DynamicJsonDocument root(4096);                                          // đệm Json
-    DeserializationError error = deserializeJson(root, server.arg("plain")); // chuyển dữ liệu nhận được về dạng Json
+  state_events.onConnect([](AsyncEventSourceClient *client) { // tab mới hoặc kết nối lại
+    state_events_full = true;                                  // chạy trong task async_tcp: chỉ đặt cờ
+  });                                                          //
+  server.addHandler(&state_events);                            // GET /events
+
+  server.on("/DataFileRead", HTTP_GET, [](AsyncWebServerRequest *request) { // lấy dữ liệu
+    FLASH_ACTIVE_LED;                                                     // bật led báo
+    web_run_in_loop(DataFile_read);                                       // chạy trước việc gửi bên dưới
+    server_send_json_data(request);                                       // trả về json data
+  });                                                                     //
+
+  server.on("/DataFileWrite", HTTP_GET, [](AsyncWebServerRequest *request) { // lấy dữ liệu
+    FLASH_ACTIVE_LED;                                                      // bật led báo
+    web_run_in_loop(DataFile_write);                                       //
+    server_send_json_data(request);                                        // trả về json data
+  });                                                                      //
+
+  server.on("/memory", HTTP_GET, [](AsyncWebServerRequest *request) { // thống kê bộ nhớ JsonData
+    FLASH_ACTIVE_LED;                                                 // bật led báo
+    server_send_memory_data(request);                                 // trả về json data
+  });                                                                 //
+
+  server.on("/state", HTTP_GET, [](AsyncWebServerRequest *request) { // lấy dữ liệu
+    FLASH_ACTIVE_LED;                                                // bật led báo
+    server_send_json_data(request);                                  // trả về json data
+  });                                                                //
+
+  server.on("/state", HTTP_PUT, [](AsyncWebServerRequest *request) {                         // nhận dữ liệu
+    FLASH_ACTIVE_LED;                                                                        // bật led báo
+    std::shared_ptr<DynamicJsonDocument> root = std::make_shared<DynamicJsonDocument>(4096); // đệm Json
+    DeserializationError error = deserializeJson(*root, web_body(request));                  // chuyển dữ liệu nhận được về dạng Json
     if (error)
-    {                                                                                // nếu lỗi
-      server.send(500, "text/plain", "FAIL to conver json. " + server.arg("plain")); // báo lỗi
+    {                                                                                  // nếu lỗi
+      request->send(500, "text/plain", "FAIL to conver json. " + web_body(request)); // báo lỗi
     }
     else
     { // nếu không lỗi
-
-      JsonData = root;
-      time_save = millis() + 1ul * 60ul * 1000ul;
-      server_send_json_data(); // trả về json data
+      web_defer(request, "text/plain", [root](String &output) { // thay JsonData trên loop()
+        JsonData = *root;
+        time_save = millis() + 1ul * 60ul * 1000ul;
+        serializeJson(JsonData, output); // trả về json data
+      });
     } //
-  }); //
+  }, NULL, web_body_collect); //
 } //
@@ -25,6 +25,8 @@ void cmd_available(String data) {
 
 #include "Modbus.h"     // thư viện giao tiếp modbus
 Modbus modbus(Serial2); // kết nối modbus RTU với serial 2
+#include "ModbusCache.h"  // thanh ghi đã đọc kèm thời điểm
+ModbusCache modbus_cache; // power_meter ghi, MQTT / web / Modbus TCP đọc
 
 #include <TinyGPS.h> // thư viện sử lý dữ liệu GPS
 GPS_time gps;        // khởi tạo thư viện GPS
@@ -43,6 +45,10 @@ PubSubClient client(espClient);
 #define MQTT_ALIVE_TOPIC "/alive"
 #define MQTT_COMMAND_TOPIC "/command"
 #define MQTT_STATUS_TOPIC "/status"
+#define MQTT_OTA_TOPIC "/ota"
+#define MQTT_LOG_TOPIC "/log"
+#define MQTT_HEALTH_TOPIC "/health"
+#define MQTT_ALARM_TOPIC "/alarm"
 #define MQTT_FIRMWARE_UPDATE_TOPIC "firmware/update"
 
 #include <button.h>                              // file lưu các hàm sử lý button
@@ -59,12 +65,31 @@ Ticker timer; // Khai báo Ticker
 #include "OTAHandler.h"
 OTAHandler otaHandler;
 
+// firmware mới chỉ được giữ lại khi otaHandler.confirm() (kết nối MQTT), không phải ngay khi khởi động
+bool verifyRollbackLater() {
+  return true;
+}
+
 #include <ArduinoJson.h>            // thư viện chuẩn dữ liệu
 DynamicJsonDocument JsonData(4096); // biến dạng Json lưu dữ liệu
 
+// thời gian từng phần của loop(), xem /metrics
+MetricHistogram metric_loop("scada_loop_seconds", "", "Time of a whole loop() pass");
+MetricHistogram metric_phase_out(   "scada_loop_phase_seconds", "phase=\"out\"",   "Time spent in each loop() phase");
+MetricHistogram metric_phase_mqtt(  "scada_loop_phase_seconds", "phase=\"mqtt\"",  "Time spent in each loop() phase");
+MetricHistogram metric_phase_ota(   "scada_loop_phase_seconds", "phase=\"ota\"",   "Time spent in each loop() phase");
+MetricHistogram metric_phase_index( "scada_loop_phase_seconds", "phase=\"index\"", "Time spent in each loop() phase");
+MetricHistogram metric_phase_meter( "scada_loop_phase_seconds", "phase=\"meter\"", "Time spent in each loop() phase");
+MetricHistogram metric_phase_gateway("scada_loop_phase_seconds", "phase=\"gateway\"", "Time spent in each loop() phase");
+MetricHistogram metric_phase_lcd(   "scada_loop_phase_seconds", "phase=\"lcd\"",   "Time spent in each loop() phase");
+MetricHistogram metric_phase_time(  "scada_loop_phase_seconds", "phase=\"time\"",  "Time spent in each loop() phase");
+MetricHistogram metric_phase_wifi(  "scada_loop_phase_seconds", "phase=\"wifi\"",  "Time spent in each loop() phase");
+
 #include "printLCD.h"    // file lưu các hàm sử lý LCD
 #include "index.h"       // file chương trình
 #include "power_meter.h" // file chương trình
+#include "modbus_gateway.h" // Modbus TCP cổng 502 -> công tơ RS-485
+#include "timing.h"      // chu kỳ loop(), độ trễ điều khiển, task watchdog
 #include "MQTTClient.h"  //
 
 // Hàm xử lý ngắt
@@ -88,26 +113,28 @@ void setup()
   Serial2.begin(9600, SERIAL_8N1, RX_PIN, TX_PIN);         //
 
   delay(100);            // ổn định nguồn
+  otaHandler.begin();    // firmware mới: bắt đầu đếm giờ kiểm tra
   Wifi_und_file_begin(); //
   MQTTClient_begin();    //
   DataFile_read();       // đọc dứ liệu được lưu
   Index_begin();         // khỏi chạy chính
   power_meter.begin();   // hàm khỏi chạy bộ đếm đồng hồ công tơ
 
-  server.on("/", []() {                                  // server get home
-    FLASH_ACTIVE_LED;                                    // bật đèn
-    if (WiFi.status() == WL_CONNECTED) {                  //  // nếu đã kết nối
-
-      server.sendHeader("Location", "index.html", true); // chuyển hướng đến trang chủ
+  server.on("/", [](AsyncWebServerRequest *request) { // server get home
+    FLASH_ACTIVE_LED;                                   // bật đèn
+    if (WiFi.status() == WL_CONNECTED) {                 //  // nếu đã kết nối
+      request->redirect("index.html");                  // chuyển hướng đến trang chủ
     } else { // nếu không có kết nối
-      server.sendHeader("Location", "wifi", true); // chuyển hướng đến thiết lập wifi
+      request->redirect("wifi");                        // chuyển hướng đến thiết lập wifi
     }
-    server.send(302, "text/plain", ""); // xác nhận chuyển hướng
-  });                                   //
+  });                                                   //
 
   Index_server_on();
-  Wifi_und_file_server_on(); //
+  otaHandler.serverOn(server); // chia sẻ firmware đang chạy cho các tủ cùng mạng LAN
+  Wifi_und_file_server_on();   // cuối cùng: trả file tĩnh cho mọi đường dẫn còn lại
   server.begin();            // bắt đầu server
+  modbus_gateway_begin();    // Modbus TCP cho HMI/SCADA
+  timing_begin();            // task watchdog cho loop()
 }
 
 void FLASH_ACTIVE_led(unsigned long t_on, unsigned long T) {
@@ -164,22 +191,27 @@ void OUT_checking() {
     JsonData["toggle"] = 0;
 
   digitalWrite(OUTPUT_CRT, JsonData["toggle"]);
+  timing_actuated();                            // đo độ trễ nếu có lệnh TOGGLE đang chờ
   digitalWrite(LED_TOGGLE, JsonData["toggle"]); // LED theo trạng thái toggle
 }
 
 void loop() {
+  timing_loop();
+  MetricTimer loop_timer(metric_loop);
   FLASH_ACTIVE_led(10, 1000);
 
   digitalWrite(PR_LED, millis() % 1000 < 500);
   digitalWrite(PWM_AUTO_RESET, !digitalRead(PWM_AUTO_RESET));
 
-  OUT_checking();
-  MQTTClient_loop();
-  Index_loop();       // hàm chạy chính
-  power_meter.loop(); // hàm đọc công tơ
-  Lcd.print();
-  time_update();
+  METRIC_CALL(metric_phase_out,   OUT_checking());
+  METRIC_CALL(metric_phase_mqtt,  MQTTClient_loop());
+  METRIC_CALL(metric_phase_ota,   otaHandler.loop());  // khởi động lại khi firmware mới đã sẵn sàng
+  METRIC_CALL(metric_phase_index, Index_loop());       // hàm chạy chính
+  METRIC_CALL(metric_phase_meter, power_meter.loop()); // hàm đọc công tơ
+  METRIC_CALL(metric_phase_gateway, modbus_gateway_loop()); // yêu cầu Modbus TCP đang chờ bus
+  METRIC_CALL(metric_phase_lcd,   Lcd.print());
+  METRIC_CALL(metric_phase_time,  time_update());
 
-  Wifi_und_file_loop();
+  METRIC_CALL(metric_phase_wifi,  Wifi_und_file_loop());
   digitalWrite(LED_BUILTIN, !LED_BUILTIN_ON_STATE); //
 }
\ No newline at end of file
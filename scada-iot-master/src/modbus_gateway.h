@@ -0,0 +1,372 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   cổng Modbus TCP -> RTU: HMI/SCADA đọc trực tiếp công tơ RS-485 sau tủ qua cổng 502
+   - task async_tcp nhận kết nối, tách khung MBAP, đưa yêu cầu vào hàng đợi; bus chỉ được dùng trên loop()
+     (cùng luồng với power_meter nên không tranh nhau Serial2), mọi câu trả lời kể cả lỗi cũng gửi từ loop()
+   - yêu cầu đọc lặp lại trong MODBUS_TCP_CACHE_TTL được trả từ bộ nhớ đệm, không ra bus; lần đọc RTU gần nhất
+     được giữ nguyên khung nên dải lớn hơn bộ nhớ đệm (tới 2000 coil) vẫn trả lời được
+   - một client gửi liên tiếp nhiều yêu cầu (pipelining) được trả theo đúng thứ tự, mỗi câu một transaction id;
+     các yêu cầu đang chờ cùng slave, cùng bảng và gần nhau được gộp thành một lần đọc RTU
+   - mỗi lần loop() tối đa một giao dịch RTU để chu kỳ loop() không bị kéo dài
+   - chỉ chuyển tiếp các hàm đọc 1..4; ghi trả lỗi 01 (Modbus.h chưa có hàm ghi)
+*/
+
+#include <AsyncTCP.h>
+#include "ModbusCache.h"
+
+#define MODBUS_TCP_PORT         502
+#define MODBUS_TCP_CLIENTS      4    // kết nối đồng thời tối đa
+#define MODBUS_TCP_QUEUE        16   // yêu cầu chờ bus tối đa, quá thì trả lỗi 06 (busy)
+#define MODBUS_TCP_BACKLOG      32   // khung chờ loop() tối đa kể cả câu trả lỗi, quá thì đóng kết nối
+#define MODBUS_TCP_CACHE_TTL    1000 // ms
+#define MODBUS_TCP_BUS_TIMEOUT  300  // ms chờ slave trả lời
+#define MODBUS_TCP_DEFAULT_UNIT 1    // unit 0 và 255 (chính cổng) chuyển cho slave này
+#define MODBUS_TCP_IDLE_TIMEOUT 60   // giây không có dữ liệu thì đóng kết nối
+
+#define MODBUS_EX_FUNCTION 0x01 // mã lỗi Modbus
+#define MODBUS_EX_ADDRESS  0x02
+#define MODBUS_EX_VALUE    0x03
+#define MODBUS_EX_BUSY     0x06
+#define MODBUS_EX_TARGET   0x0B // slave không trả lời
+
+MetricCounter metric_gateway_cache("scada_modbus_tcp_requests_total", "result=\"cache\"", "Modbus TCP requests by outcome");
+MetricCounter metric_gateway_bus(  "scada_modbus_tcp_requests_total", "result=\"bus\"",   "Modbus TCP requests by outcome");
+MetricCounter metric_gateway_error("scada_modbus_tcp_requests_total", "result=\"error\"", "Modbus TCP requests by outcome");
+MetricCounter metric_gateway_busy( "scada_modbus_tcp_requests_total", "result=\"busy\"",  "Modbus TCP requests by outcome");
+MetricCounter metric_gateway_rtu("scada_modbus_tcp_bus_reads_total", "", "RTU reads made for Modbus TCP requests");
+
+struct GatewayRequest
+{
+    uint8_t  client;     // ô trong gateway_clients
+    uint8_t  generation; // của ô lúc nhận, khác thì client đã đi
+    uint16_t tid;        // transaction id MBAP
+    uint8_t  unit;       //
+    uint8_t  function;   // 1..4
+    uint16_t address;    //
+    uint16_t count;      //
+    uint8_t  error;      // mã lỗi trả về thay cho dữ liệu, 0: đọc
+};
+
+struct GatewayClient
+{
+    AsyncClient *client;          // NULL: ô trống
+    uint8_t generation;           //
+    volatile bool closed;         // async_tcp báo ngắt, loop() mới được delete
+    volatile bool overrun;        // hàng đợi đầy, đã đóng kết nối
+    uint8_t buffer[260];          // khung MBAP chưa đủ
+    uint16_t length;              //
+};
+
+GatewayClient gateway_clients[MODBUS_TCP_CLIENTS];
+portMUX_TYPE gateway_mux = portMUX_INITIALIZER_UNLOCKED;
+QueueHandle_t gateway_queue = xQueueCreate(MODBUS_TCP_BACKLOG, sizeof(GatewayRequest));
+AsyncServer gateway_server(MODBUS_TCP_PORT);
+
+struct GatewayWindow // lần đọc RTU gần nhất, nguyên dữ liệu khung trả lời
+{
+    uint8_t  slave;     // 0: chưa có
+    uint8_t  function;  //
+    uint16_t address;   //
+    uint16_t count;     //
+    uint32_t time;      // millis() lúc đọc
+    uint8_t  data[250]; // coil/discrete nén bit, thanh ghi big-endian, như trong PDU
+} gateway_window;
+
+GatewayRequest gateway_pending[MODBUS_TCP_BACKLOG]; // đã lấy khỏi hàng đợi, chờ trả lời, theo thứ tự đến
+uint8_t gateway_pending_count;
+uint8_t gateway_reads; // số câu trong gateway_pending cần dữ liệu (error == 0)
+
+MetricGauge metric_gateway_clients("scada_modbus_tcp_clients", "", "Connected Modbus TCP clients", []() -> int32_t {
+    int32_t n = 0;
+    for (GatewayClient &c : gateway_clients)
+        n += c.client && !c.closed;
+    return n;
+});
+
+// gửi một câu trả lời MBAP: pdu là mã hàm và dữ liệu
+void gateway_send(AsyncClient *client, uint16_t tid, uint8_t unit, const uint8_t *pdu, uint16_t length)
+{
+    uint8_t frame[7 + 256];
+    frame[0] = tid >> 8;
+    frame[1] = tid;
+    frame[2] = 0; // protocol id
+    frame[3] = 0;
+    frame[4] = (length + 1) >> 8;
+    frame[5] = length + 1;
+    frame[6] = unit;
+    memcpy(frame + 7, pdu, length);
+    client->write((const char *)frame, 7 + length);
+}
+
+void gateway_exception(AsyncClient *client, uint16_t tid, uint8_t unit, uint8_t function, uint8_t code)
+{
+    uint8_t pdu[2] = {(uint8_t)(function | 0x80), code};
+    gateway_send(client, tid, unit, pdu, 2);
+}
+
+// chạy trong task async_tcp: tách khung, kiểm tra, xếp hàng; false khi hàng đợi đầy
+bool gateway_frame(uint8_t slot, const uint8_t *frame, uint16_t length)
+{
+    GatewayClient &c = gateway_clients[slot];
+    GatewayRequest r = {slot, c.generation, (uint16_t)(frame[0] << 8 | frame[1]), frame[6], frame[7],
+                        (uint16_t)(frame[8] << 8 | frame[9]), (uint16_t)(frame[10] << 8 | frame[11]), 0};
+    uint16_t limit = r.function <= Discret_Register ? 2000 : 125; // giới hạn của chuẩn
+
+    if (r.function < Coil_Register || r.function > Input_Register)
+        r.error = MODBUS_EX_FUNCTION;
+    else if (length != 12 || r.count == 0 || r.count > limit)
+        r.error = MODBUS_EX_VALUE;
+    else if ((uint32_t)r.address + r.count > 0x10000)
+        r.error = MODBUS_EX_ADDRESS;
+    return xQueueSend(gateway_queue, &r, 0) == pdTRUE; // lỗi cũng xếp hàng để trả đúng thứ tự
+}
+
+void gateway_data(uint8_t slot, const uint8_t *data, size_t len)
+{
+    GatewayClient &c = gateway_clients[slot];
+    while (len)
+    {
+        size_t n = min(len, sizeof(c.buffer) - c.length);
+        memcpy(c.buffer + c.length, data, n);
+        c.length += n;
+        data += n;
+        len -= n;
+
+        while (c.length >= 7) // MBAP: tid(2) protocol(2) length(2) unit(1), length tính từ unit
+        {
+            uint16_t size = 6 + (c.buffer[4] << 8 | c.buffer[5]);
+            if (c.buffer[2] || c.buffer[3] || size < 8 || size > sizeof(c.buffer))
+            { // không phải Modbus TCP
+                c.client->close();
+                c.length = 0;
+                return;
+            }
+            if (c.length < size)
+                break;
+            if (!gateway_frame(slot, c.buffer, size))
+            { // client gửi dồn quá MODBUS_TCP_BACKLOG khung: không trả lời đúng thứ tự được nữa
+                c.overrun = true;
+                c.client->close();
+                c.length = 0;
+                return;
+            }
+            memmove(c.buffer, c.buffer + size, c.length - size);
+            c.length -= size;
+        }
+    }
+}
+
+void gateway_accept(void *arg, AsyncClient *client)
+{
+    int slot = -1;
+    portENTER_CRITICAL(&gateway_mux);
+    for (int i = 0; i < MODBUS_TCP_CLIENTS && slot < 0; i++)
+        if (!gateway_clients[i].client)
+        {
+            slot = i;
+            gateway_clients[i].client = client;
+            gateway_clients[i].closed = false;
+            gateway_clients[i].overrun = false;
+            gateway_clients[i].length = 0;
+        }
+    portEXIT_CRITICAL(&gateway_mux);
+    if (slot < 0)
+    { // đủ chỗ rồi: đóng, async_tcp gọi onDisconnect nên delete ở đó
+        client->onDisconnect([](void *, AsyncClient *c) { delete c; }, NULL);
+        client->close(true);
+        return;
+    }
+
+    client->setNoDelay(true);
+    client->setRxTimeout(MODBUS_TCP_IDLE_TIMEOUT);
+    client->onData([](void *arg, AsyncClient *c, void *data, size_t len) {
+        gateway_data((uintptr_t)arg, (const uint8_t *)data, len);
+    }, (void *)(uintptr_t)slot);
+    client->onTimeout([](void *arg, AsyncClient *c, uint32_t time) { c->close(); }, NULL);
+    client->onDisconnect([](void *arg, AsyncClient *c) {
+        gateway_clients[(uintptr_t)arg].closed = true; // loop() delete, không đụng tới client nữa
+    }, (void *)(uintptr_t)slot);
+}
+
+// giá trị không cũ hơn MODBUS_TCP_CACHE_TTL, từ lần đọc RTU gần nhất hoặc bộ nhớ đệm
+bool gateway_value(uint8_t slave, uint8_t function, uint16_t address, uint16_t &value, uint32_t now)
+{
+    const GatewayWindow &w = gateway_window;
+    uint16_t i = address - w.address; // địa chỉ nhỏ hơn thì tràn thành số lớn, ngoài dải
+    if (w.slave == slave && w.function == function && i < w.count && now - w.time <= MODBUS_TCP_CACHE_TTL)
+    {
+        value = function <= Discret_Register ? w.data[i / 8] >> (i % 8) & 1 : w.data[2 * i] << 8 | w.data[2 * i + 1];
+        return true;
+    }
+    return modbus_cache.get(slave, function, address, MODBUS_TCP_CACHE_TTL, value, now);
+}
+
+// trả lời các yêu cầu đang chờ mà dữ liệu đủ mới, true nếu đã trả lời r
+bool gateway_answer(const GatewayRequest &r, bool from_bus)
+{
+    GatewayClient &c = gateway_clients[r.client];
+    uint8_t slave = r.unit == 0 || r.unit == 255 ? MODBUS_TCP_DEFAULT_UNIT : r.unit;
+    uint8_t pdu[2 + 250];
+    uint32_t now = millis();
+    bool bits = r.function <= Discret_Register;
+
+    if (r.error)
+    {
+        if (c.generation == r.generation && !c.closed)
+            gateway_exception(c.client, r.tid, r.unit, r.function, r.error);
+        return true;
+    }
+
+    uint16_t length = 2 + (bits ? (r.count + 7) / 8 : 2 * r.count);
+    memset(pdu + 2, 0, length - 2);
+    for (uint16_t i = 0; i < r.count; i++)
+    {
+        uint16_t v;
+        if (!gateway_value(slave, r.function, r.address + i, v, now))
+            return false;
+        if (bits)
+            pdu[2 + i / 8] |= (v & 1) << (i % 8);
+        else
+        {
+            pdu[2 + 2 * i] = v >> 8;
+            pdu[3 + 2 * i] = v;
+        }
+    }
+    pdu[0] = r.function;
+    pdu[1] = length - 2;
+    (from_bus ? metric_gateway_bus : metric_gateway_cache).inc();
+    if (c.generation == r.generation && !c.closed)
+        gateway_send(c.client, r.tid, r.unit, pdu, length);
+    return true;
+}
+
+void gateway_drop(uint8_t index) // bỏ gateway_pending[index], giữ thứ tự
+{
+    gateway_reads -= !gateway_pending[index].error;
+    memmove(gateway_pending + index, gateway_pending + index + 1, (gateway_pending_count - index - 1) * sizeof(GatewayRequest));
+    gateway_pending_count--;
+}
+
+// một lần đọc RTU cho yêu cầu đầu tiên chưa có trong bộ nhớ đệm, nới rộng để phủ luôn
+// các yêu cầu đang chờ cùng slave, cùng bảng nếu tổng vẫn trong giới hạn một khung
+void gateway_bus_read()
+{
+    const GatewayRequest first = gateway_pending[0]; // bản sao: gateway_drop() dời mảng
+    uint8_t slave = first.unit == 0 || first.unit == 255 ? MODBUS_TCP_DEFAULT_UNIT : first.unit;
+    uint32_t lo = first.address, hi = (uint32_t)first.address + first.count;
+    uint16_t limit = first.function <= Discret_Register ? 2000 : 125;
+    for (uint8_t i = 1; i < gateway_pending_count; i++)
+    {
+        const GatewayRequest &r = gateway_pending[i];
+        uint8_t s = r.unit == 0 || r.unit == 255 ? MODBUS_TCP_DEFAULT_UNIT : r.unit;
+        if (r.error || s != slave || r.function != first.function)
+            continue;
+        uint32_t l = min(lo, (uint32_t)r.address), h = max(hi, (uint32_t)r.address + r.count);
+        if (h - l <= limit)
+            lo = l, hi = h;
+    }
+
+    modbus.setTimeout(MODBUS_TCP_BUS_TIMEOUT);
+    int received;
+    METRIC_CALL(metric_modbus, received = modbus.requestFrom(slave, first.function, lo, hi - lo));
+    (received > 0 ? metric_modbus_ok : metric_modbus_error).inc();
+    metric_gateway_rtu.inc();
+    if (received > 0)
+    {
+        uint32_t now = millis();
+        uint16_t count = hi - lo;
+        uint16_t bytes = first.function <= Discret_Register ? (count + 7) / 8 : 2 * count;
+        gateway_window = {slave, first.function, (uint16_t)lo, count, now, {}};
+        for (uint16_t i = 0; i < bytes; i++)
+            gateway_window.data[i] = modbus.byteRead(i);
+        modbus_cache.store(modbus, slave, first.function, lo, count, now);
+        return;
+    }
+
+    // slave không trả lời: mọi yêu cầu đang chờ nằm trong dải này nhận lỗi 0B
+    for (uint8_t i = 0; i < gateway_pending_count;)
+    {
+        const GatewayRequest &r = gateway_pending[i];
+        uint8_t s = r.unit == 0 || r.unit == 255 ? MODBUS_TCP_DEFAULT_UNIT : r.unit;
+        if (!r.error && s == slave && r.function == first.function && r.address >= lo && r.address + r.count <= hi)
+        {
+            GatewayClient &c = gateway_clients[r.client];
+            if (c.generation == r.generation && !c.closed)
+                gateway_exception(c.client, r.tid, r.unit, r.function, MODBUS_EX_TARGET);
+            metric_gateway_error.inc();
+            gateway_drop(i);
+        }
+        else
+            i++;
+    }
+}
+
+void modbus_gateway_begin()
+{
+    gateway_server.setNoDelay(true);
+    gateway_server.onClient(gateway_accept, NULL);
+    gateway_server.begin();
+}
+
+void modbus_gateway_loop()
+{
+    for (GatewayClient &c : gateway_clients) // kết nối đã ngắt: giải phóng ô
+        if (c.client && c.closed)
+        {
+            if (c.overrun)
+                metric_gateway_busy.inc();
+            delete c.client;
+            portENTER_CRITICAL(&gateway_mux);
+            c.generation++;
+            c.client = NULL;
+            portEXIT_CRITICAL(&gateway_mux);
+        }
+
+    GatewayRequest r;
+    while (gateway_pending_count < MODBUS_TCP_BACKLOG && xQueueReceive(gateway_queue, &r, 0) == pdTRUE)
+    {
+        GatewayClient &c = gateway_clients[r.client];
+        if (c.generation != r.generation || c.closed) // client đã đi
+            continue;
+        if (!r.error && gateway_reads >= MODBUS_TCP_QUEUE) // đủ câu chờ bus rồi
+        {
+            r.error = MODBUS_EX_BUSY;
+            metric_gateway_busy.inc();
+        }
+        gateway_reads += !r.error;
+        gateway_pending[gateway_pending_count++] = r;
+    }
+    for (uint8_t i = 0; i < gateway_pending_count;) // client đã đi: không đọc bus cho ai cả
+    {
+        GatewayClient &c = gateway_clients[gateway_pending[i].client];
+        if (c.generation != gateway_pending[i].generation || c.closed)
+            gateway_drop(i);
+        else
+            i++;
+    }
+    if (!gateway_pending_count)
+        return;
+
+    // trả lời theo thứ tự đến: một câu chưa trả được thì các câu sau của cùng client phải chờ
+    bool from_bus = false;
+    for (uint8_t round = 0; round < 2; round++)
+    {
+        uint8_t blocked = 0; // bit i: client i có câu đang chờ bus
+        for (uint8_t i = 0; i < gateway_pending_count;)
+        {
+            GatewayRequest &r = gateway_pending[i];
+            if (!(blocked & 1 << r.client) && gateway_answer(r, from_bus))
+                gateway_drop(i);
+            else
+            {
+                blocked |= 1 << r.client;
+                i++;
+            }
+        }
+        if (!gateway_pending_count || round)
+            break;
+        gateway_bus_read(); // một giao dịch RTU, rồi trả lời lại những gì đã đủ
+        from_bus = true;
+    }
+}
@@ -2,17 +2,34 @@
 #include <Arduino.h>
 #include "WiFi.h"
 #include "Modbus.h"
+#include "ModbusCache.h"
 
 // Set to true to use simulated values, false to use real power meter
+// (-DSIMULATE_POWER_METER=false from the build flags works too)
+#ifndef SIMULATE_POWER_METER
 #define SIMULATE_POWER_METER true
+#endif
+
+#define METER_SLAVE     0x01  // địa chỉ công tơ trên RS-485
+#define METER_REGISTERS 60    // thanh ghi input 0..59
+#define METER_POLL_MS   2000  // chu kỳ đọc công tơ vào modbus_cache
+#define METER_MAX_AGE   30000 // ms, số liệu cũ hơn coi như mất công tơ
+
+MetricHistogram metric_modbus("scada_modbus_seconds", "", "Modbus RTU transaction time (request to reply or timeout)");
+MetricCounter metric_modbus_ok(   "scada_modbus_transactions_total", "result=\"ok\"",    "Modbus RTU transactions");
+MetricCounter metric_modbus_error("scada_modbus_transactions_total", "result=\"error\"", "Modbus RTU transactions");
+
+MetricGauge metric_meter_age("scada_meter_data_age_ms", "", "Age of the meter registers in modbus_cache, -1 before the first read", []() -> int32_t {
+  return modbus_cache.age(METER_SLAVE, Input_Register, 0x00, millis());
+});
 
 class Power_meter
 {
 
 public:
 
-unsigned long timer;
-uint8_t mun_erro;
+unsigned long timer;       // millis() lần đọc / mô phỏng trước
+bool stale = false;        // đã xóa số liệu vì quá cũ
 double simulated_total_energy = 0.0;
 
   // Add slight random fluctuation to a value (±percentage)
@@ -54,65 +71,80 @@ double simulated_total_energy = 0.0;
     }
   }
 
-  void read(uint8_t key=0)
+  // đọc công tơ vào modbus_cache; chỉ loop() chờ bus, người dùng số liệu thì không
+  // true khi vừa hỏi công tơ
+  bool poll()
   {
-    if ((millis() < timer)&(!key)) return;
-    timer = millis() + 10000;  // Update every 10 seconds
+    if (millis() - timer < METER_POLL_MS) return false;
+    timer = millis();
 
+    modbus.setTimeout(300);
+    int received;
+    METRIC_CALL(metric_modbus, received = modbus.requestFrom(METER_SLAVE, Input_Register, 0x00, METER_REGISTERS));
+    (received > 0 ? metric_modbus_ok : metric_modbus_error).inc();
+    if (received > 0)
+      modbus_cache.store(modbus, METER_SLAVE, Input_Register, 0x00, METER_REGISTERS, millis(), true); // ghim: đọc lớn của cổng Modbus TCP không đẩy ra được
+    return true;
+  }
+
+  // chép số liệu không cũ hơn max_age ms từ modbus_cache vào JsonData, false khi không có
+  bool read(uint32_t max_age)
+  {
 #if SIMULATE_POWER_METER
-    simulate_telemetry();
-    return;
+    if (millis() - timer >= max_age)
+    {
+      timer = millis();
+      simulate_telemetry();
+    }
+    return true;
 #endif
 
-    modbus.setTimeout(300);
-    if (modbus.requestFrom(0x01, 0x04, 0x00, 60) > 0)
+    uint16_t reg[METER_REGISTERS];
+    if (!modbus_cache.getRange(METER_SLAVE, Input_Register, 0x00, METER_REGISTERS, max_age, reg, millis()))
     {
-      double voltage = modbus.uint16(0) / 10.0;
-      if (voltage > 0)
+      if (!stale)
       {
-        JsonData["total_energy"] = modbus.uint32(29) / 100.0;
-        JsonData["total_energy_reverse"] = modbus.uint32(39) / 100.0;
-        JsonData["total_energy_forward"] = modbus.uint32(49) / 100.0;
-        JsonData["voltage"] = voltage;
-        JsonData["current"] = modbus.int16(3) / 100.0;
-        JsonData["power"] = modbus.int16(8) / 1.0;
-        JsonData["power_factor"] = modbus.int16(20) / 1000.0;
-        JsonData["frequency"] = modbus.int16(26) / 100.0;
+        JsonData["voltage"] = 0;
+        JsonData["current"] = 0;
+        JsonData["power"] = 0;
+        JsonData["power_factor"] = 0;
+        JsonData["frequency"] = 0;
+        LOG_W(LOG_METER, "erro reading");
       }
-      //    SERIAL.printf("tong:      %4.2f kWh\r\n", meter.total);
-      //    SERIAL.printf("tieu thu:  %4.2f kWh\r\n", meter.forward);
-      //    SERIAL.printf("tai len:   %4.2f kWh\r\n", meter.reverse);
-      //    SERIAL.printf("dien ap:   %4.2f V\r\n",   meter.voltage);
-      //    SERIAL.printf("dong dien: %4.2f A\r\n",   meter.current);
-      //    SERIAL.printf("cong suat: %4.2f W\r\n",   meter.wattage);
-      //    SERIAL.printf("cos phi:   %4.2f \r\n",    meter.Pfactor);
-      //    SERIAL.printf("tan so:    %4.2f Hz\r\n",  meter.frequency);
-      //    SERIAL.println();
-      mun_erro = 0;
-    }
-    else if (mun_erro > 100)
-    {
-      JsonData["voltage"] = 0;
-      JsonData["current"] = 0;
-      JsonData["power"] = 0;
-      JsonData["power_factor"] = 0;
-      JsonData["frequency"] = 0;
-      cmd.println("erro reading");
+      stale = true;
+      return false;
     }
-    else
+    stale = false;
+
+    double voltage = reg[0] / 10.0;
+    if (voltage > 0)
     {
-      mun_erro++;
+      JsonData["total_energy"] = ((uint32_t)reg[29] << 16 | reg[30]) / 100.0;
+      JsonData["total_energy_reverse"] = ((uint32_t)reg[39] << 16 | reg[40]) / 100.0;
+      JsonData["total_energy_forward"] = ((uint32_t)reg[49] << 16 | reg[50]) / 100.0;
+      JsonData["voltage"] = voltage;
+      JsonData["current"] = (int16_t)reg[3] / 100.0;
+      JsonData["power"] = (int16_t)reg[8] / 1.0;
+      JsonData["power_factor"] = (int16_t)reg[20] / 1000.0;
+      JsonData["frequency"] = (int16_t)reg[26] / 100.0;
     }
+    return true;
   }
 
   void begin()
   {
     modbus.init();
+    timer = millis() - METER_MAX_AGE; // đọc / mô phỏng ngay lần loop() đầu
   }
 
   void loop()
   {
-    read();
+#if SIMULATE_POWER_METER
+    read(10000); // giá trị mô phỏng mới mỗi 10 giây
+#else
+    if (poll())
+      read(METER_MAX_AGE); // /state thấy số liệu mới nhất
+#endif
   }
 };
 Power_meter power_meter;
@@ -0,0 +1,109 @@
+#pragma once // chỉ đọc một lần
+
+/*
+   giám sát thời gian thực của loop()
+   - chu kỳ loop(): rơ-le (OUTPUT_CRT) và chân nuôi watchdog ngoài (PWM_AUTO_RESET) chỉ được ghi mỗi lần loop() chạy
+   - độ trễ điều khiển: từ lúc nhận lệnh MQTT TOGGLE tới lúc OUT_checking() ghi GPIO
+   - vượt ngân sách: tăng bộ đếm, ghi log và báo lên MQTT (unit/<mac>/alarm, tối đa mỗi phút một lần cho mỗi loại)
+   - loop() treo quá LOOP_WDT_TIMEOUT_S: task watchdog của ESP32 reset, lần khởi động sau báo "task_wdt"
+*/
+
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+#define LOOP_PERIOD_BUDGET_US     100000ul // µs giữa hai lần vào loop()
+#define CONTROL_LATENCY_BUDGET_US 250000ul // µs từ lệnh TOGGLE tới khi ghi GPIO
+#define LOOP_WDT_TIMEOUT_S        30       // giây, lớn hơn wifiMulti.run() (quét + kết nối ~8 s)
+#define TIMING_ALARM_INTERVAL     60000ul  // ms giữa hai lần báo cùng loại
+
+MetricHistogram metric_loop_period("scada_loop_period_seconds", "", "Time between the starts of two loop() passes");
+MetricHistogram metric_control_latency("scada_control_latency_seconds", "", "MQTT TOGGLE received to relay GPIO written");
+MetricCounter metric_budget_period( "scada_timing_budget_exceeded_total", "budget=\"loop_period\"",     "Timing budget violations");
+MetricCounter metric_budget_control("scada_timing_budget_exceeded_total", "budget=\"control_latency\"", "Timing budget violations");
+
+struct TimingAlarm
+{
+    const char *name;
+    uint32_t budget;     // µs, 0: không có ngân sách (sự kiện)
+    uint32_t worst;      // µs, lớn nhất từ lần báo trước
+    uint16_t count;      // số lần vượt từ lần báo trước
+    unsigned long sent;  // millis() lần báo trước
+};
+
+TimingAlarm timing_alarms[] = {
+    {"loop_period",     LOOP_PERIOD_BUDGET_US,     0, 0, 0},
+    {"control_latency", CONTROL_LATENCY_BUDGET_US, 0, 0, 0},
+    {"task_wdt",        0,                         0, 0, 0},
+};
+#define TIMING_ALARM_PERIOD  0
+#define TIMING_ALARM_CONTROL 1
+#define TIMING_ALARM_WDT     2
+
+uint32_t timing_loop_start;     // micros() lần vào loop() trước, 0 khi chưa có
+uint32_t timing_command_us;     // micros() lúc nhận lệnh TOGGLE chưa được thực thi, 0 khi không có
+uint32_t timing_message_us;     // micros() lúc MQTTcallback nhận tin nhắn đang xử lý
+
+void timing_raise(uint8_t alarm, uint32_t value)
+{
+    TimingAlarm &a = timing_alarms[alarm];
+    if (value > a.worst)
+        a.worst = value;
+    a.count++;
+}
+
+void timing_begin() // gọi cuối setup()
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT)
+    {
+        LOG_E(LOG_MAIN, "restarted by watchdog (reason %d)", reason);
+        timing_raise(TIMING_ALARM_WDT, 0);
+    }
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_task_wdt_config_t config;
+    config.timeout_ms = LOOP_WDT_TIMEOUT_S * 1000;
+    config.idle_core_mask = 1 << 0; // như mặc định: idle của lõi 0
+    config.trigger_panic = true;
+    if (esp_task_wdt_reconfigure(&config) != ESP_OK)
+        esp_task_wdt_init(&config);
+#else
+    esp_task_wdt_init(LOOP_WDT_TIMEOUT_S, true); // đã khởi tạo sẵn: chỉ đổi thời gian
+#endif
+    enableLoopWDT(); // loopTask tự reset watchdog trước mỗi lần gọi loop()
+}
+
+void timing_loop() // gọi đầu loop()
+{
+    uint32_t now = micros();
+    if (timing_loop_start)
+    {
+        uint32_t period = now - timing_loop_start;
+        metric_loop_period.observe(period);
+        if (period > LOOP_PERIOD_BUDGET_US)
+        {
+            metric_budget_period.inc();
+            timing_raise(TIMING_ALARM_PERIOD, period);
+        }
+    }
+    timing_loop_start = now ? now : 1;
+}
+
+void timing_command() // lệnh TOGGLE vừa được áp dụng vào JsonData
+{
+    timing_command_us = timing_message_us ? timing_message_us : 1;
+}
+
+void timing_actuated() // OUT_checking() vừa ghi GPIO
+{
+    if (!timing_command_us)
+        return;
+    uint32_t latency = micros() - timing_command_us;
+    timing_command_us = 0;
+    metric_control_latency.observe(latency);
+    if (latency > CONTROL_LATENCY_BUDGET_US)
+    {
+        metric_budget_control.inc();
+        timing_raise(TIMING_ALARM_CONTROL, latency);
+    }
+}
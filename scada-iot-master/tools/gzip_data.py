@@ -0,0 +1,46 @@
+# Builds the filesystem image from a compressed copy of data/:
+# web pages (html, css, js, svg) get a <name>.gz next to them, gzip level 9
+# with mtime=0 so the same page always gives the same bytes (and the same
+# ETag, see fileFS_send_static). The plain page stays for clients that do
+# not accept gzip. Everything else is copied as is.
+#
+#   pio run -t buildfs / -t uploadfs
+import gzip
+import os
+import shutil
+
+Import("env")
+
+COMPRESSED = (".html", ".htm", ".css", ".js", ".svg")
+SKIPPED = ("desktop.ini",)
+
+source = env.subst("$PROJECT_DATA_DIR")
+staging = os.path.join(env.subst("$BUILD_DIR"), "data")
+
+
+def stage_data():
+    if os.path.isdir(staging):
+        shutil.rmtree(staging)
+    before = after = 0
+    for root, _, files in os.walk(source):
+        target_dir = os.path.join(staging, os.path.relpath(root, source))
+        os.makedirs(target_dir, exist_ok=True)
+        for name in files:
+            if name in SKIPPED:
+                continue
+            with open(os.path.join(root, name), "rb") as f:
+                content = f.read()
+            if name.lower().endswith(COMPRESSED):
+                compressed = gzip.compress(content, compresslevel=9, mtime=0)
+                before += len(content)
+                after += len(compressed)
+                with open(os.path.join(target_dir, name + ".gz"), "wb") as f:
+                    f.write(compressed)
+            with open(os.path.join(target_dir, name), "wb") as f:
+                f.write(content)
+    print("gzip_data: web pages %d bytes, gzip copies %d bytes" % (before, after))
+
+
+if set(COMMAND_LINE_TARGETS) & {"buildfs", "uploadfs", "uploadfsota"}:
+    stage_data()
+    env.Replace(PROJECT_DATA_DIR=staging)